@@ -0,0 +1,124 @@
+#include "Bench.h"
+#include "../sisskey/MappedFile.h"
+#include "../sisskey/Json.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <stdexcept>
+
+namespace sisskey
+{
+	void Bench::AddResult(std::string_view name, std::uint64_t iterations)
+	{
+		auto median = [](std::vector<double>& values)
+		{
+			std::sort(values.begin(), values.end());
+			const std::size_t middle{ values.size() / 2 };
+			return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) * 0.5;
+		};
+
+		std::vector<double> times;
+		for (const Sample& sample : m_Samples)
+			times.push_back(static_cast<double>(sample.nanoseconds) / static_cast<double>(iterations));
+		const double center{ median(times) };
+
+		// Median absolute deviation scaled to the standard deviation of a normal distribution
+		std::vector<double> deviations;
+		for (double time : times)
+			deviations.push_back(std::abs(time - center));
+		const double limit{ 3.0 * 1.4826 * median(deviations) };
+
+		Result result;
+		result.name = name;
+		result.iterations = iterations;
+		// Sorted by median
+		result.min = times.front();
+		std::vector<double> kept;
+		std::vector<double> cycles;
+		for (const Sample& sample : m_Samples)
+		{
+			const double time{ static_cast<double>(sample.nanoseconds) / static_cast<double>(iterations) };
+			if (limit > 0.0 && std::abs(time - center) > limit)
+			{
+				++result.rejected;
+				continue;
+			}
+			kept.push_back(time);
+			cycles.push_back(static_cast<double>(sample.cycles) / static_cast<double>(iterations));
+		}
+
+		result.samples = static_cast<int>(kept.size());
+		for (double time : kept)
+			result.mean += time;
+		result.mean /= static_cast<double>(kept.size());
+		for (double time : kept)
+			result.stddev += (time - result.mean) * (time - result.mean);
+		result.stddev = kept.size() > 1 ? std::sqrt(result.stddev / static_cast<double>(kept.size() - 1)) : 0.0;
+		result.median = median(kept);
+		result.cycles = median(cycles);
+
+		std::printf("%-40s %12.2f ns %12.1f cycles  +-%5.1f%%  %d/%d samples\n", result.name.c_str(), result.median, result.cycles,
+					result.mean > 0.0 ? 100.0 * result.stddev / result.mean : 0.0, result.samples, result.samples + result.rejected);
+		m_Results.push_back(std::move(result));
+	}
+
+	void Bench::WriteJson(const std::filesystem::path& path) const
+	{
+		std::ofstream file{ path };
+		if (!file)
+			throw std::runtime_error{ u8"Failed to open " + path.u8string() };
+
+		// Names are plain identifiers, nothing to escape
+		file.precision(17);
+		file << u8"{\n\t\"benchmarks\": [";
+		for (std::size_t i{}; i < m_Results.size(); ++i)
+		{
+			const Result& r = m_Results[i];
+			file << (i ? u8",\n" : u8"\n")
+				 << u8"\t\t{ \"name\": \"" << r.name
+				 << u8"\", \"iterations\": " << r.iterations
+				 << u8", \"median\": " << r.median
+				 << u8", \"mean\": " << r.mean
+				 << u8", \"min\": " << r.min
+				 << u8", \"stddev\": " << r.stddev
+				 << u8", \"cycles\": " << r.cycles
+				 << u8", \"samples\": " << r.samples
+				 << u8", \"rejected\": " << r.rejected << u8" }";
+		}
+		file << u8"\n\t]\n}\n";
+	}
+
+	int Bench::Compare(const std::filesystem::path& baseline, double threshold) const
+	{
+		MappedFile file{ baseline };
+		JsonDocument document;
+		document.Parse(file.Data(), file.Size());
+		const JsonValue benchmarks{ document.Root()[u8"benchmarks"] };
+		if (!benchmarks.IsArray())
+			throw std::runtime_error{ u8"Baseline has no benchmarks array" };
+
+		int regressions{ 0 };
+		std::printf("\n%-40s %12s %12s %8s\n", u8"compared to baseline", u8"baseline ns", u8"current ns", u8"change");
+		for (const Result& result : m_Results)
+		{
+			double base{ 0.0 };
+			for (JsonValue benchmark : benchmarks)
+				if (benchmark[u8"name"].AsString() == result.name)
+					base = benchmark[u8"median"].AsNumber();
+
+			if (base <= 0.0)
+			{
+				std::printf("%-40s %12s %12.2f %8s\n", result.name.c_str(), u8"-", result.median, u8"new");
+				continue;
+			}
+
+			const double change{ result.median / base - 1.0 };
+			const bool regressed{ change > threshold };
+			regressions += regressed;
+			std::printf("%-40s %12.2f %12.2f %+7.1f%%%s\n", result.name.c_str(), base, result.median, 100.0 * change, regressed ? u8"  REGRESSION" : u8"");
+		}
+
+		return regressions;
+	}
+}
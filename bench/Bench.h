@@ -0,0 +1,130 @@
+#pragma once
+#include "../sisskey/Timer.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+namespace sisskey
+{
+#ifdef _MSC_VER
+	inline const volatile void* g_BenchSink{ nullptr };
+#endif
+
+	// Keeps the compiler from optimizing away the computation of a value
+	template<typename T>
+	inline void DoNotOptimize(T& value) noexcept
+	{
+#ifdef _MSC_VER
+		g_BenchSink = &value;
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : "+m"(value) : : "memory");
+#endif
+	}
+
+	// Runs every benchmark function(iterations) a few times to warm up, then repeatedly with the number
+	// of iterations calibrated so a sample takes at least Options::sampleTime. Samples further than
+	// 3 scaled median absolute deviations from the median are rejected, times are reported per iteration.
+	class Bench
+	{
+	public:
+		struct Options
+		{
+			int warmup{ 3 };
+			int repetitions{ 15 };
+			// Seconds
+			double sampleTime{ 0.01 };
+			// Only benchmarks with names containing it are run
+			std::string filter;
+		};
+
+		struct Result
+		{
+			std::string name;
+			std::uint64_t iterations{ 0 };
+			// Nanoseconds per iteration of the kept samples
+			double median{ 0.0 };
+			double mean{ 0.0 };
+			double min{ 0.0 };
+			double stddev{ 0.0 };
+			// Time stamp counter ticks per iteration, median, 0 if unavailable
+			double cycles{ 0.0 };
+			int samples{ 0 };
+			int rejected{ 0 };
+		};
+
+	private:
+		struct Sample
+		{
+			std::int64_t nanoseconds;
+			std::int64_t cycles;
+		};
+
+		Options m_Options;
+		std::vector<Result> m_Results;
+		std::vector<Sample> m_Samples;
+
+		[[nodiscard]] static std::int64_t Cycles() noexcept
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			return static_cast<std::int64_t>(__rdtsc());
+#else
+			return 0;
+#endif
+		}
+
+		template<typename F>
+		static Sample Measure(F& function, std::uint64_t iterations)
+		{
+			const std::int64_t cycles{ Cycles() };
+			const std::int64_t start{ Clock::Now() };
+			function(iterations);
+			const std::int64_t end{ Clock::Now() };
+			return { end - start, Cycles() - cycles };
+		}
+
+		void AddResult(std::string_view name, std::uint64_t iterations);
+
+	public:
+		explicit Bench(Options options) : m_Options{ std::move(options) } {}
+
+		// function(std::uint64_t iterations) runs the measured code that many times
+		template<typename F>
+		void Run(std::string_view name, F&& function)
+		{
+			if (!m_Options.filter.empty() && name.find(m_Options.filter) == std::string_view::npos)
+				return;
+
+			// Grow until a sample is long enough for the clock resolution and scheduler noise
+			const std::int64_t sampleTime{ Clock::FromSeconds(m_Options.sampleTime) };
+			std::uint64_t iterations{ 1 };
+			for (std::int64_t time{ Measure(function, iterations).nanoseconds }; time < sampleTime && iterations < (1ull << 40);
+				 time = Measure(function, iterations).nanoseconds)
+			{
+				const double scale{ time > 0 ? 1.2 * static_cast<double>(sampleTime) / static_cast<double>(time) : 10.0 };
+				iterations = static_cast<std::uint64_t>(static_cast<double>(iterations) * std::min(std::max(scale, 2.0), 10.0));
+			}
+
+			for (int i{}; i < m_Options.warmup; ++i)
+				Measure(function, iterations);
+
+			m_Samples.clear();
+			for (int i{}; i < m_Options.repetitions; ++i)
+				m_Samples.push_back(Measure(function, iterations));
+
+			AddResult(name, iterations);
+		}
+
+		[[nodiscard]] const std::vector<Result>& GetResults() const noexcept { return m_Results; }
+
+		void WriteJson(const std::filesystem::path& path) const;
+		// Prints the comparison with a file written by WriteJson and returns the number of benchmarks
+		// with the median time more than threshold (relative) above the baseline
+		[[nodiscard]] int Compare(const std::filesystem::path& baseline, double threshold) const;
+	};
+}
@@ -0,0 +1,590 @@
+#include "Bench.h"
+#include "../sisskey/Timer.h"
+#include "../sisskey/WindowHeadless.h"
+#include "../sisskey/FrameAllocator.h"
+#include "../sisskey/JobSystem.h"
+#include "../sisskey/Math.h"
+#include "../sisskey/Culling.h"
+#include "../sisskey/RenderQueue.h"
+#include "../sisskey/GraphicsDeviceNull.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+
+using namespace sisskey;
+
+namespace
+{
+	void Usage()
+	{
+		std::printf(u8"sisskey_bench [options]\n"
+					u8"  --out <file>          write results as JSON (default sisskey_bench.json)\n"
+					u8"  --baseline <file>     compare with results of an earlier run\n"
+					u8"  --threshold <ratio>   median slowdown reported as a regression (default 0.1)\n"
+					u8"  --filter <text>       run benchmarks with names containing text\n"
+					u8"  --repetitions <n>     samples per benchmark (default 15)\n"
+					u8"  --warmup <n>          discarded samples per benchmark (default 3)\n"
+					u8"  --sample-time <s>     minimal duration of a sample (default 0.01)\n"
+					u8"  --threads <n>         job system threads, 0 - one per physical core\n"
+					u8"Exits with 1 if a benchmark regressed.\n");
+	}
+
+	void TimerBenchmarks(Bench& bench)
+	{
+		bench.Run(u8"clock/Now", [](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				std::int64_t now{ Clock::Now() };
+				DoNotOptimize(now);
+			}
+		});
+
+		bench.Run(u8"timer/Tick", [](std::uint64_t iterations)
+		{
+			Timer timer;
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				timer.Tick();
+				DoNotOptimize(timer);
+			}
+		});
+	}
+
+	void WindowBenchmarks(Bench& bench)
+	{
+		WindowHeadless window{ u8"sisskey_bench" };
+		bench.Run(u8"window/ProcessMessages/headless", [&window](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				Window::PMResult result{ window.ProcessMessages() };
+				DoNotOptimize(result);
+			}
+		});
+	}
+
+	void AllocatorBenchmarks(Bench& bench, JobSystem& jobs)
+	{
+		// Reset every 1024 allocations, so the arena stays in one block
+		constexpr std::uint64_t Batch{ 1024 };
+
+		LinearArena arena{ Batch * 128 };
+		bench.Run(u8"allocator/LinearArena/64", [&arena](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				void* p = arena.Allocate(64, 16);
+				DoNotOptimize(p);
+				if (i % Batch == Batch - 1)
+					arena.Reset();
+			}
+			arena.Reset();
+		});
+
+		FrameAllocator frames{ jobs.ThreadCount(), Batch * 128 };
+		bench.Run(u8"allocator/FrameAllocator/64", [&frames](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				void* p = frames.Allocate(64, 16);
+				DoNotOptimize(p);
+				if (i % Batch == Batch - 1)
+					frames.BeginFrame();
+			}
+			frames.BeginFrame();
+		});
+
+		bench.Run(u8"allocator/new/64", [](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				std::byte* p = new std::byte[64];
+				DoNotOptimize(p);
+				delete[] p;
+			}
+		});
+	}
+
+	void MathBenchmarks(Bench& bench)
+	{
+		constexpr std::size_t Count{ 1024 };
+
+		std::vector<Mat4> a(Count), b(Count), out(Count);
+		std::vector<Vec3> points(Count), transformed(Count);
+		std::vector<float> components[10];
+		for (std::size_t i{}; i < Count; ++i)
+		{
+			const float f{ static_cast<float>(i) };
+			a[i] = Compose({ f, 1.0f, 2.0f }, QuatFromAxisAngle({ 0.0f, 1.0f, 0.0f }, f), { 1.0f, 1.0f, 1.0f });
+			b[i] = Translation({ 1.0f, f, 3.0f });
+			points[i] = { f, -f, 0.5f * f };
+		}
+		// Identity rotations and unit scales
+		for (std::size_t c{}; c < 10; ++c)
+			components[c].assign(Count, c >= 6 ? 1.0f : 0.0f);
+		const TransformSoA transforms{ components[0].data(), components[1].data(), components[2].data(),
+									   components[3].data(), components[4].data(), components[5].data(), components[6].data(),
+									   components[7].data(), components[8].data(), components[9].data() };
+
+		bench.Run(u8"math/MultiplyMatrices/1024", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				MultiplyMatrices(a.data(), b.data(), out.data(), Count);
+				DoNotOptimize(out[0]);
+			}
+		});
+
+		bench.Run(u8"math/TransformPoints/1024", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				TransformPoints(a[1], points.data(), transformed.data(), Count);
+				DoNotOptimize(transformed[0]);
+			}
+		});
+
+		bench.Run(u8"math/ComposeTransforms/1024", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				ComposeTransforms(transforms, out.data(), Count);
+				DoNotOptimize(out[0]);
+			}
+		});
+	}
+
+	void CullingBenchmarks(Bench& bench, JobSystem& jobs)
+	{
+		constexpr std::size_t Count{ 100000 };
+
+		// Boxes scattered over a flat 1 km square, the camera in the middle sees about a sixth of them
+		std::mt19937 random{ 1 };
+		std::uniform_real_distribution<float> position{ -500.0f, 500.0f }, size{ 0.5f, 4.0f };
+		std::vector<AABB> boxes(Count);
+		BVH bvh;
+		std::vector<BVH::ProxyID> proxies(Count);
+		for (std::size_t i{}; i < Count; ++i)
+		{
+			const Vec3 center{ position(random), position(random) * 0.05f, position(random) };
+			const float extent{ size(random) };
+			boxes[i] = { center - Vec3{ extent, extent, extent }, center + Vec3{ extent, extent, extent } };
+			proxies[i] = bvh.Insert(boxes[i], static_cast<std::uint32_t>(i));
+		}
+		bvh.Update(jobs);
+
+		const Mat4 viewProjection{ Perspective(1.0f, 16.0f / 9.0f, 0.1f, 1000.0f) };
+		CullView view;
+		view.frustum = ExtractFrustum(viewProjection);
+
+		bench.Run(u8"culling/Cull/100k", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				bvh.Cull(jobs, view);
+				DoNotOptimize(view.visible);
+			}
+		});
+
+		// A wall in front of the camera hides most of the visible boxes
+		OcclusionBuffer occlusion;
+		bench.Run(u8"culling/CullOccluded/100k", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				occlusion.Begin(viewProjection);
+				occlusion.RasterizeBox({ { -100.0f, -50.0f, -31.0f }, { 100.0f, 50.0f, -30.0f } });
+				occlusion.End();
+				view.occlusion = &occlusion;
+				bvh.Cull(jobs, view);
+				view.occlusion = nullptr;
+				DoNotOptimize(view.visible);
+			}
+		});
+
+		// A tenth of the boxes moves out of their margins every update
+		bench.Run(u8"culling/Refit/10k", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				const float offset{ i % 2 ? -0.5f : 0.5f };
+				for (std::size_t j{ i % 10 }; j < Count; j += 10)
+				{
+					boxes[j].min.x += offset;
+					boxes[j].max.x += offset;
+					bvh.Move(proxies[j], boxes[j]);
+				}
+				bvh.Update(jobs);
+			}
+		});
+	}
+
+	// Logs the replayed commands, draws by their first vertex
+	class RecordingDevice final : public GraphicsDevice
+	{
+	public:
+		struct Call
+		{
+			char op;
+			std::uint32_t value;
+
+			bool operator==(const Call& other) const noexcept { return op == other.op && value == other.value; }
+		};
+
+		std::vector<Call> calls;
+		std::uint32_t capacity{ 0 };
+
+		void CmdUploadInstances(const Mat4* /*transforms*/, std::uint32_t /*count*/, std::uint32_t first, std::uint32_t capacity_) override
+		{
+			calls.push_back({ 'U', first });
+			capacity = capacity_;
+		}
+		void CmdSetPipeline(PipelineHandle pipeline) override { calls.push_back({ 'P', pipeline.value }); }
+		void CmdSetMaterial(MaterialID material) override { calls.push_back({ 'M', material }); }
+		void CmdSetVertexBuffer(BufferHandle buffer) override { calls.push_back({ 'V', buffer.value }); }
+		void CmdSetIndexBuffer(BufferHandle buffer) override { calls.push_back({ 'I', buffer.value }); }
+		void CmdDrawIndexed(std::uint32_t /*indexCount*/, std::uint32_t /*instanceCount*/, std::uint32_t firstIndex,
+							std::int32_t /*vertexOffset*/, std::uint32_t /*firstInstance*/) override
+		{
+			calls.push_back({ 'D', firstIndex });
+		}
+	};
+
+	// Verifies the replay order and the skipped binds on both sort paths before timing the queue
+	void CheckRenderQueue(JobSystem& jobs)
+	{
+		for (std::size_t count : { std::size_t{ 1000 }, std::size_t{ 20000 } })
+		{
+			// Few distinct keys, so most of them are equal and stability matters
+			std::mt19937 random{ static_cast<unsigned>(count) };
+			auto next = [&random](std::uint32_t n) { return static_cast<std::uint32_t>(random() % n); };
+			std::vector<std::uint64_t> keys(count);
+			std::vector<RenderCommand> commands(count);
+			for (std::size_t i{}; i < count; ++i)
+			{
+				RenderCommand& c = commands[i];
+				c.type = RenderCommand::Type::DrawIndexed;
+				c.pipeline = PipelineHandle{ 1 + next(4) };
+				c.material = 1 + next(8);
+				c.vertexBuffer = BufferHandle{ 1 + next(3) };
+				c.indexBuffer = BufferHandle{ 1 + next(3) };
+				c.first = static_cast<std::uint32_t>(i);
+				keys[i] = SortKey::Make(next(2), 0, c.pipeline.value, c.material, next(16));
+			}
+
+			std::vector<std::uint32_t> order(count);
+			for (std::size_t i{}; i < count; ++i)
+				order[i] = static_cast<std::uint32_t>(i);
+			std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) { return keys[a] < keys[b]; });
+
+			std::vector<RecordingDevice::Call> expected;
+			std::uint32_t bound[4]{ 0, 0, 0, 0 };
+			std::size_t redundant{ 0 };
+			for (std::uint32_t i : order)
+			{
+				const RenderCommand& c = commands[i];
+				const RecordingDevice::Call binds[4]{ { 'P', c.pipeline.value }, { 'M', c.material }, { 'V', c.vertexBuffer.value }, { 'I', c.indexBuffer.value } };
+				for (std::size_t b{}; b < 4; ++b)
+				{
+					if (bound[b] == binds[b].value)
+						++redundant;
+					else
+					{
+						bound[b] = binds[b].value;
+						expected.push_back(binds[b]);
+					}
+				}
+				expected.push_back({ 'D', i });
+			}
+
+			// One bucket keeps the recording order of equal keys
+			RenderQueue queue{ jobs.ThreadCount() };
+			RecordingDevice device;
+			for (std::size_t i{}; i < count; ++i)
+				queue.Record(keys[i], commands[i]);
+			queue.Sort(jobs);
+			queue.Submit(device);
+			if (device.calls != expected || queue.GetStatistics().redundantStates != redundant)
+				throw std::runtime_error{ u8"RenderQueue replayed " + std::to_string(count) + u8" commands out of order" };
+
+			// Recorded by all threads, equal keys may interleave
+			device.calls.clear();
+			jobs.ParallelFor(0, count, [&](std::size_t first, std::size_t last)
+			{
+				for (std::size_t i{ first }; i < last; ++i)
+					queue.Record(keys[i], commands[i]);
+			}, 256);
+			queue.Sort(jobs);
+			queue.Submit(device);
+			std::vector<std::uint32_t> drawn;
+			for (const RecordingDevice::Call& call : device.calls)
+				if (call.op == 'D')
+					drawn.push_back(call.value);
+			bool sorted{ drawn.size() == count };
+			for (std::size_t i{ 1 }; sorted && i < drawn.size(); ++i)
+				sorted = keys[drawn[i - 1]] <= keys[drawn[i]];
+			std::sort(drawn.begin(), drawn.end());
+			for (std::size_t i{}; sorted && i < drawn.size(); ++i)
+				sorted = drawn[i] == i;
+			if (!sorted)
+				throw std::runtime_error{ u8"RenderQueue lost or misordered " + std::to_string(count) + u8" commands recorded in parallel" };
+		}
+
+		// Instances of one mesh in two layers stay in their layers, mesh 2 is drawn between them
+		RenderQueue queue{ jobs.ThreadCount() };
+		RecordingDevice device;
+		RenderCommand mesh;
+		mesh.type = RenderCommand::Type::DrawIndexed;
+		mesh.pipeline = PipelineHandle{ 1 };
+		mesh.vertexBuffer = mesh.indexBuffer = BufferHandle{ 1 };
+		mesh.count = 3;
+		mesh.first = 1;
+		RenderCommand other{ mesh };
+		other.first = 2;
+		queue.Record(SortKey::Make(1, 0, 1, 0, 0), mesh, Identity());
+		queue.Record(SortKey::Make(0, 0, 1, 0, 0), mesh, Identity());
+		queue.Record(SortKey::Make(1, 0, 1, 0, 0), other, Identity());
+		queue.Sort(jobs);
+		queue.Submit(device);
+		std::vector<std::uint32_t> drawn;
+		for (const RecordingDevice::Call& call : device.calls)
+			if (call.op == 'D')
+				drawn.push_back(call.value);
+		if (drawn != std::vector<std::uint32_t>{ 1, 1, 2 })
+			throw std::runtime_error{ u8"RenderQueue merged instances across layers" };
+
+		// Submits of a frame share its region of the ring, a grown ring starts over in the region of the frame
+		RenderQueue ring{ jobs.ThreadCount(), 3, 4 };
+		const std::size_t submits[][2]{ { 3, 0 }, { 1, 1 }, { 2, 1 }, { 5, 1 } };
+		std::vector<std::uint32_t> uploads;
+		for (const auto& [instances, endFrame] : submits)
+		{
+			for (std::size_t i{}; i < instances; ++i)
+				ring.Record(0, mesh, Identity());
+			device.calls.clear();
+			ring.Sort(jobs);
+			ring.Submit(device);
+			uploads.push_back(device.calls.front().value);
+			if (endFrame)
+				ring.EndFrame();
+		}
+		if (uploads != std::vector<std::uint32_t>{ 0, 3, 4, 16 } || device.capacity != 24)
+			throw std::runtime_error{ u8"RenderQueue wrote the instances of a frame in flight" };
+	}
+
+	void RenderQueueBenchmarks(Bench& bench, JobSystem& jobs)
+	{
+		CheckRenderQueue(jobs);
+
+		constexpr std::size_t Count{ 100000 };
+
+		GraphicsDeviceNull device;
+		std::vector<PipelineHandle> pipelines(64);
+		for (PipelineHandle& pipeline : pipelines)
+			pipeline = device.CreatePipeline({});
+		std::vector<BufferHandle> buffers(1024);
+		for (BufferHandle& buffer : buffers)
+			buffer = device.CreateBuffer({ 1 << 16, BufferDesc::Usage::Index }, nullptr);
+
+		// 64 pipelines and 1024 materials at random depths, recorded in parallel like the draws of a culled scene
+		std::mt19937 random{ 1 };
+		std::uniform_int_distribution<std::uint32_t> pipeline{ 0, 63 }, material{ 0, 1023 }, depth{ 0, (1u << SortKey::DepthBits) - 1 };
+		std::vector<std::uint64_t> keys(Count);
+		std::vector<RenderCommand> commands(Count);
+		for (std::size_t i{}; i < Count; ++i)
+		{
+			commands[i].type = RenderCommand::Type::DrawIndexed;
+			commands[i].pipeline = pipelines[pipeline(random)];
+			commands[i].material = material(random);
+			commands[i].vertexBuffer = commands[i].indexBuffer = buffers[commands[i].material];
+			commands[i].count = 3 * 256;
+			keys[i] = SortKey::Make(0, 0, commands[i].pipeline.Index(), commands[i].material, depth(random));
+		}
+
+		RenderQueue queue{ jobs.ThreadCount() };
+		bench.Run(u8"renderqueue/RecordSortSubmit/100k", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				jobs.ParallelFor(0, Count, [&](std::size_t first, std::size_t last)
+				{
+					for (std::size_t j{ first }; j < last; ++j)
+						queue.Record(keys[j], commands[j]);
+				}, 1024);
+				queue.Sort(jobs);
+				queue.Submit(device);
+				queue.EndFrame();
+				RenderQueue::Statistics statistics{ queue.GetStatistics() };
+				DoNotOptimize(statistics);
+			}
+		});
+
+		// Props of 16 meshes with 8 materials, merged into 128 instanced draws
+		std::vector<Mat4> transforms(Count);
+		for (std::size_t i{}; i < Count; ++i)
+		{
+			commands[i].pipeline = pipelines[0];
+			commands[i].material = static_cast<std::uint32_t>(i % 8);
+			commands[i].vertexBuffer = commands[i].indexBuffer = buffers[i / 8 % 16];
+			keys[i] = SortKey::Make(0, 0, commands[i].pipeline.Index(), commands[i].material, depth(random));
+			transforms[i] = Translation({ static_cast<float>(i % 1000), 0.0f, static_cast<float>(i / 1000) });
+		}
+
+		bench.Run(u8"renderqueue/Instanced/100k", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				jobs.ParallelFor(0, Count, [&](std::size_t first, std::size_t last)
+				{
+					for (std::size_t j{ first }; j < last; ++j)
+						queue.Record(keys[j], commands[j], transforms[j]);
+				}, 1024);
+				queue.Sort(jobs);
+				queue.Submit(device);
+				queue.EndFrame();
+				RenderQueue::Statistics statistics{ queue.GetStatistics() };
+				DoNotOptimize(statistics);
+			}
+		});
+	}
+
+	// Destroying null or stale handles must not free a slot again
+	void CheckHandlePool()
+	{
+		HandlePool<BufferDesc, BufferHandle> pool{ GraphicsDevice::FramesInFlight };
+		pool.Destroy({});
+		const BufferHandle handle{ pool.Create(BufferDesc{ 1, BufferDesc::Usage::Vertex }) };
+		pool.Destroy(handle);
+#ifdef NDEBUG
+		pool.Destroy(handle);
+#endif
+		pool.Destroy({});
+		for (std::uint32_t i{}; i < GraphicsDevice::FramesInFlight; ++i)
+			pool.NextFrame();
+
+		const BufferHandle a{ pool.Create(BufferDesc{ 2, BufferDesc::Usage::Vertex }) };
+		const BufferHandle b{ pool.Create(BufferDesc{ 3, BufferDesc::Usage::Vertex }) };
+		if (a.Index() == b.Index() || pool.Size() != 2 || pool.IsValid(handle) || pool[a].size != 2 || pool[b].size != 3)
+			throw std::runtime_error{ u8"HandlePool reused a slot twice" };
+	}
+
+	void HandleBenchmarks(Bench& bench)
+	{
+		CheckHandlePool();
+
+		// Half of the handles are stale, as after a level unloads part of its resources
+		HandlePool<BufferDesc, BufferHandle> pool{ GraphicsDevice::FramesInFlight };
+		std::vector<BufferHandle> handles(4096);
+		for (std::size_t i{}; i < handles.size(); ++i)
+			handles[i] = pool.Create(BufferDesc{ i, BufferDesc::Usage::Vertex });
+		for (std::size_t i{}; i < handles.size(); i += 2)
+			pool.Destroy(handles[i]);
+
+		bench.Run(u8"handles/Get/4096", [&](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				std::size_t size{ 0 };
+				for (BufferHandle handle : handles)
+					if (const BufferDesc* desc{ pool.Get(handle) })
+						size += desc->size;
+				DoNotOptimize(size);
+			}
+		});
+	}
+
+	void JobBenchmarks(Bench& bench, JobSystem& jobs)
+	{
+		bench.Run(u8"jobs/RunWait", [&jobs](std::uint64_t iterations)
+		{
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				JobSystem::Job* job = jobs.CreateJob([]() {});
+				jobs.Run(job);
+				jobs.Wait(job);
+			}
+		});
+
+		bench.Run(u8"jobs/ParallelFor/4096", [&jobs](std::uint64_t iterations)
+		{
+			std::atomic<std::uint64_t> sum{ 0 };
+			for (std::uint64_t i{}; i < iterations; ++i)
+			{
+				jobs.ParallelFor(0, 4096, [&sum](std::size_t first, std::size_t last)
+				{
+					sum.fetch_add(last - first, std::memory_order_relaxed);
+				}, 64);
+			}
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Bench::Options options;
+	std::string out{ u8"sisskey_bench.json" };
+	std::string baseline;
+	double threshold{ 0.1 };
+	std::size_t threads{ 0 };
+
+	try
+	{
+		for (int i{ 1 }; i < argc; ++i)
+		{
+			const std::string arg{ argv[i] };
+			if (i + 1 >= argc)
+			{
+				Usage();
+				return 2;
+			}
+
+			const char* value{ argv[++i] };
+			if (arg == u8"--out") out = value;
+			else if (arg == u8"--baseline") baseline = value;
+			else if (arg == u8"--threshold") threshold = std::stod(value);
+			else if (arg == u8"--filter") options.filter = value;
+			else if (arg == u8"--repetitions") options.repetitions = std::max(1, std::stoi(value));
+			else if (arg == u8"--warmup") options.warmup = std::max(0, std::stoi(value));
+			else if (arg == u8"--sample-time") options.sampleTime = std::stod(value);
+			else if (arg == u8"--threads") threads = static_cast<std::size_t>(std::stoul(value));
+			else
+			{
+				Usage();
+				return 2;
+			}
+		}
+
+		Clock::EnableTSC();
+		JobSystem jobs{ threads };
+		Bench bench{ options };
+
+		TimerBenchmarks(bench);
+		WindowBenchmarks(bench);
+		AllocatorBenchmarks(bench, jobs);
+		MathBenchmarks(bench);
+		CullingBenchmarks(bench, jobs);
+		RenderQueueBenchmarks(bench, jobs);
+		HandleBenchmarks(bench);
+		JobBenchmarks(bench, jobs);
+
+		bench.WriteJson(out);
+		if (!baseline.empty())
+			return bench.Compare(baseline, threshold) ? 1 : 0;
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, u8"%s\n", e.what());
+		return 2;
+	}
+
+	return 0;
+}
@@ -0,0 +1,409 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace sisskey
+{
+	namespace
+	{
+		// Pixels of a block as floats, only the first channels are used
+		using Pixels = float[16][4];
+
+		// Mean and principal axis by power iteration on the covariance matrix
+		void PrincipalAxis(const Pixels& px, const bool* use, int channels, float mean[4], float axis[4]) noexcept
+		{
+			int count{ 0 };
+			std::fill_n(mean, 4, 0.0f);
+			for (int i{}; i < 16; ++i)
+			{
+				if (!use[i])
+					continue;
+				for (int c{}; c < channels; ++c)
+					mean[c] += px[i][c];
+				++count;
+			}
+			for (int c{}; c < channels; ++c)
+				mean[c] /= static_cast<float>(count);
+
+			float cov[4][4]{};
+			for (int i{}; i < 16; ++i)
+			{
+				if (!use[i])
+					continue;
+				for (int a{}; a < channels; ++a)
+					for (int b{}; b < channels; ++b)
+						cov[a][b] += (px[i][a] - mean[a]) * (px[i][b] - mean[b]);
+			}
+
+			// Start from the diagonal so a single dominant channel converges at once
+			std::fill_n(axis, 4, 0.0f);
+			for (int c{}; c < channels; ++c)
+				axis[c] = cov[c][c] + 1e-3f * static_cast<float>(c + 1);
+			for (int iteration{}; iteration < 8; ++iteration)
+			{
+				float next[4]{};
+				for (int a{}; a < channels; ++a)
+					for (int b{}; b < channels; ++b)
+						next[a] += cov[a][b] * axis[b];
+
+				float length{ 0.0f };
+				for (int c{}; c < channels; ++c)
+					length += next[c] * next[c];
+				if (length < 1e-12f)
+					break;
+				length = 1.0f / std::sqrt(length);
+				for (int c{}; c < channels; ++c)
+					axis[c] = next[c] * length;
+			}
+		}
+
+		// Extremes of the projection onto the principal axis
+		void AxisEndpoints(const Pixels& px, const bool* use, int channels, float e0[4], float e1[4]) noexcept
+		{
+			float mean[4], axis[4];
+			PrincipalAxis(px, use, channels, mean, axis);
+
+			float minT{ 0.0f }, maxT{ 0.0f };
+			for (int i{}; i < 16; ++i)
+			{
+				if (!use[i])
+					continue;
+				float t{ 0.0f };
+				for (int c{}; c < channels; ++c)
+					t += (px[i][c] - mean[c]) * axis[c];
+				minT = std::min(minT, t);
+				maxT = std::max(maxT, t);
+			}
+
+			for (int c{}; c < channels; ++c)
+			{
+				e0[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+				e1[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+			}
+		}
+
+		// Endpoints minimizing the squared error for fixed indices, weights[index] is the weight of e0
+		bool LeastSquares(const Pixels& px, const bool* use, const std::uint8_t* indices, const float* weights,
+						  int channels, float e0[4], float e1[4]) noexcept
+		{
+			float aa{ 0.0f }, ab{ 0.0f }, bb{ 0.0f };
+			float ax[4]{}, bx[4]{};
+			for (int i{}; i < 16; ++i)
+			{
+				if (!use[i])
+					continue;
+				const float a{ weights[indices[i]] };
+				const float b{ 1.0f - a };
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c{}; c < channels; ++c)
+				{
+					ax[c] += a * px[i][c];
+					bx[c] += b * px[i][c];
+				}
+			}
+
+			const float det{ aa * bb - ab * ab };
+			if (std::abs(det) < 1e-6f)
+				return false;
+			const float inv{ 1.0f / det };
+			for (int c{}; c < channels; ++c)
+			{
+				e0[c] = std::clamp((bb * ax[c] - ab * bx[c]) * inv, 0.0f, 255.0f);
+				e1[c] = std::clamp((aa * bx[c] - ab * ax[c]) * inv, 0.0f, 255.0f);
+			}
+			return true;
+		}
+
+		// Nearest palette entries, returns the total squared error
+		float SelectIndices(const Pixels& px, const bool* use, const float (*palette)[4], int count, int channels, std::uint8_t* indices) noexcept
+		{
+			float total{ 0.0f };
+			for (int i{}; i < 16; ++i)
+			{
+				if (!use[i])
+					continue;
+				float best{ 1e30f };
+				for (int p{}; p < count; ++p)
+				{
+					float error{ 0.0f };
+					for (int c{}; c < channels; ++c)
+					{
+						const float d{ px[i][c] - palette[p][c] };
+						error += d * d;
+					}
+					if (error < best)
+					{
+						best = error;
+						indices[i] = static_cast<std::uint8_t>(p);
+					}
+				}
+				total += best;
+			}
+			return total;
+		}
+
+		// BC1
+
+		[[nodiscard]] std::uint16_t To565(const float* c) noexcept
+		{
+			const auto r = static_cast<std::uint16_t>(std::lround(c[0] * 31.0f / 255.0f));
+			const auto g = static_cast<std::uint16_t>(std::lround(c[1] * 63.0f / 255.0f));
+			const auto b = static_cast<std::uint16_t>(std::lround(c[2] * 31.0f / 255.0f));
+			return static_cast<std::uint16_t>(r << 11 | g << 5 | b);
+		}
+
+		void From565(std::uint16_t v, float* c) noexcept
+		{
+			const int r{ v >> 11 & 31 }, g{ v >> 5 & 63 }, b{ v & 31 };
+			c[0] = static_cast<float>(r << 3 | r >> 2);
+			c[1] = static_cast<float>(g << 2 | g >> 4);
+			c[2] = static_cast<float>(b << 3 | b >> 2);
+			c[3] = 0.0f;
+		}
+
+		// Palette as decoded by the hardware, index 3 of the 3 color mode is transparent and never selected
+		void BC1Palette(std::uint16_t c0, std::uint16_t c1, bool fourColors, float palette[4][4]) noexcept
+		{
+			From565(c0, palette[0]);
+			From565(c1, palette[1]);
+			for (int c{}; c < 3; ++c)
+			{
+				if (fourColors)
+				{
+					palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+					palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+				}
+				else palette[2][c] = (palette[0][c] + palette[1][c]) * 0.5f;
+			}
+		}
+
+		void EncodeColor(const std::uint8_t* rgba, std::uint8_t* out, bool allowTransparent) noexcept
+		{
+			Pixels px;
+			bool use[16];
+			bool transparent{ false };
+			int opaque{ 0 };
+			for (int i{}; i < 16; ++i)
+			{
+				for (int c{}; c < 4; ++c)
+					px[i][c] = rgba[i * 4 + c];
+				use[i] = !allowTransparent || rgba[i * 4 + 3] >= 128;
+				transparent |= !use[i];
+				opaque += use[i];
+			}
+
+			std::uint16_t c0{ 0 }, c1{ 0 };
+			std::uint8_t indices[16]{};
+			if (opaque)
+			{
+				// 4 color mode index order: e0, e1, 2/3 e0 + 1/3 e1, 1/3 e0 + 2/3 e1
+				static constexpr float FourWeights[4]{ 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+				static constexpr float ThreeWeights[3]{ 1.0f, 0.0f, 0.5f };
+				const float* weights{ transparent ? ThreeWeights : FourWeights };
+				const int colors{ transparent ? 3 : 4 };
+
+				float e0[4], e1[4];
+				AxisEndpoints(px, use, 3, e0, e1);
+
+				float palette[4][4];
+				float bestError{ 1e30f };
+				for (int iteration{}; iteration < 3; ++iteration)
+				{
+					const std::uint16_t q0{ To565(e0) }, q1{ To565(e1) };
+					BC1Palette(q0, q1, !transparent, palette);
+					std::uint8_t candidate[16]{};
+					const float error{ SelectIndices(px, use, palette, colors, 3, candidate) };
+					if (error >= bestError)
+						break;
+					bestError = error;
+					c0 = q0;
+					c1 = q1;
+					std::copy_n(candidate, 16, indices);
+					if (!LeastSquares(px, use, indices, weights, 3, e0, e1))
+						break;
+				}
+
+				// The mode is selected by the endpoint order
+				if (transparent ? c0 > c1 : c0 < c1)
+				{
+					std::swap(c0, c1);
+					for (std::uint8_t& index : indices)
+					{
+						if (transparent)
+							index = index == 0 ? 1 : index == 1 ? 0 : index;
+						else index = index ^ 1;
+					}
+				}
+				else if (!transparent && c0 == c1)
+					std::fill_n(indices, 16, std::uint8_t{ 0 });
+			}
+			for (int i{}; i < 16; ++i)
+			{
+				if (!use[i])
+					indices[i] = 3;
+			}
+
+			std::uint32_t bits{ 0 };
+			for (int i{}; i < 16; ++i)
+				bits |= static_cast<std::uint32_t>(indices[i]) << (2 * i);
+			out[0] = static_cast<std::uint8_t>(c0);
+			out[1] = static_cast<std::uint8_t>(c0 >> 8);
+			out[2] = static_cast<std::uint8_t>(c1);
+			out[3] = static_cast<std::uint8_t>(c1 >> 8);
+			for (int b{}; b < 4; ++b)
+				out[4 + b] = static_cast<std::uint8_t>(bits >> (8 * b));
+		}
+
+		// BC4 with 8 interpolated values: a0 > a1, index order a0, a1, then 6/7 a0 + 1/7 a1 ... 1/7 a0 + 6/7 a1
+		void EncodeAlpha(const std::uint8_t* rgba, std::uint8_t* out) noexcept
+		{
+			int a0{ 0 }, a1{ 255 };
+			for (int i{}; i < 16; ++i)
+			{
+				a0 = std::max<int>(a0, rgba[i * 4 + 3]);
+				a1 = std::min<int>(a1, rgba[i * 4 + 3]);
+			}
+
+			std::uint64_t bits{ 0 };
+			if (a0 != a1)
+			{
+				int palette[8]{ a0, a1 };
+				for (int i{ 1 }; i < 7; ++i)
+					palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+
+				for (int i{}; i < 16; ++i)
+				{
+					const int a{ rgba[i * 4 + 3] };
+					int best{ 0 };
+					for (int p{ 1 }; p < 8; ++p)
+					{
+						if (std::abs(palette[p] - a) < std::abs(palette[best] - a))
+							best = p;
+					}
+					bits |= static_cast<std::uint64_t>(best) << (3 * i);
+				}
+			}
+
+			out[0] = static_cast<std::uint8_t>(a0);
+			out[1] = static_cast<std::uint8_t>(a1);
+			for (int b{}; b < 6; ++b)
+				out[2 + b] = static_cast<std::uint8_t>(bits >> (8 * b));
+		}
+
+		// BC7
+
+		constexpr int BC7Weights4[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		// Writes the fields of a block from the least significant bit up
+		class BitWriter
+		{
+		private:
+			std::uint8_t* m_Out;
+			int m_Position{ 0 };
+
+		public:
+			explicit BitWriter(std::uint8_t* out) noexcept : m_Out{ out } { std::memset(out, 0, 16); }
+
+			void Write(std::uint32_t value, int bits) noexcept
+			{
+				for (int i{}; i < bits; ++i, ++m_Position)
+					m_Out[m_Position >> 3] |= static_cast<std::uint8_t>(((value >> i) & 1) << (m_Position & 7));
+			}
+		};
+	}
+
+	void EncodeBC1(const std::uint8_t* rgba, std::uint8_t* out) noexcept
+	{
+		EncodeColor(rgba, out, true);
+	}
+
+	void EncodeBC3(const std::uint8_t* rgba, std::uint8_t* out) noexcept
+	{
+		EncodeAlpha(rgba, out);
+		EncodeColor(rgba, out + 8, false);
+	}
+
+	void EncodeBC7(const std::uint8_t* rgba, std::uint8_t* out) noexcept
+	{
+		Pixels px;
+		bool use[16];
+		for (int i{}; i < 16; ++i)
+		{
+			for (int c{}; c < 4; ++c)
+				px[i][c] = rgba[i * 4 + c];
+			use[i] = true;
+		}
+
+		// Weight of e0 for every index
+		float weights[16];
+		for (int i{}; i < 16; ++i)
+			weights[i] = static_cast<float>(64 - BC7Weights4[i]) / 64.0f;
+
+		float e0[4], e1[4];
+		AxisEndpoints(px, use, 4, e0, e1);
+
+		int best0[4]{}, best1[4]{}, bestP[2]{};
+		std::uint8_t indices[16]{};
+		float bestError{ 1e30f };
+		for (int iteration{}; iteration < 3; ++iteration)
+		{
+			bool improved{ false };
+			// Endpoints are 7 bits per channel plus a shared p-bit as the lowest bit
+			for (int p{}; p < 4; ++p)
+			{
+				const int p0{ p & 1 }, p1{ p >> 1 };
+				int q0[4], q1[4];
+				float palette[16][4];
+				for (int c{}; c < 4; ++c)
+				{
+					q0[c] = std::clamp(static_cast<int>(std::lround((e0[c] - p0) * 0.5f)), 0, 127);
+					q1[c] = std::clamp(static_cast<int>(std::lround((e1[c] - p1) * 0.5f)), 0, 127);
+					const int v0{ q0[c] << 1 | p0 }, v1{ q1[c] << 1 | p1 };
+					for (int i{}; i < 16; ++i)
+						palette[i][c] = static_cast<float>(((64 - BC7Weights4[i]) * v0 + BC7Weights4[i] * v1 + 32) >> 6);
+				}
+
+				std::uint8_t candidate[16]{};
+				const float error{ SelectIndices(px, use, palette, 16, 4, candidate) };
+				if (error < bestError)
+				{
+					bestError = error;
+					std::copy_n(q0, 4, best0);
+					std::copy_n(q1, 4, best1);
+					bestP[0] = p0;
+					bestP[1] = p1;
+					std::copy_n(candidate, 16, indices);
+					improved = true;
+				}
+			}
+			if (!improved || bestError == 0.0f || !LeastSquares(px, use, indices, weights, 4, e0, e1))
+				break;
+		}
+
+		// The most significant bit of the first index is implicitly 0
+		if (indices[0] & 8)
+		{
+			std::swap(best0, best1);
+			std::swap(bestP[0], bestP[1]);
+			for (std::uint8_t& index : indices)
+				index = static_cast<std::uint8_t>(15 - index);
+		}
+
+		BitWriter writer{ out };
+		writer.Write(1 << 6, 7);
+		for (int c{}; c < 4; ++c)
+		{
+			writer.Write(static_cast<std::uint32_t>(best0[c]), 7);
+			writer.Write(static_cast<std::uint32_t>(best1[c]), 7);
+		}
+		writer.Write(static_cast<std::uint32_t>(bestP[0]), 1);
+		writer.Write(static_cast<std::uint32_t>(bestP[1]), 1);
+		writer.Write(indices[0], 3);
+		for (int i{ 1 }; i < 16; ++i)
+			writer.Write(indices[i], 4);
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Encoders of 4x4 blocks of RGBA8 pixels (64 bytes, rows top to bottom)
+	// https://learn.microsoft.com/en-us/windows/win32/direct3d11/texture-block-compression-in-direct3d-11
+	// Endpoints are fit along the principal axis of the block colors and refined by least squares.
+
+	enum class BlockFormat { BC1, BC3, BC7 };
+
+	[[nodiscard]] constexpr std::size_t BlockSize(BlockFormat format) noexcept { return format == BlockFormat::BC1 ? 8 : 16; }
+
+	// Pixels with alpha below 128 use the transparent index of the 3 color mode
+	void EncodeBC1(const std::uint8_t* rgba, std::uint8_t* out) noexcept;
+	// BC1 color and BC4 alpha
+	void EncodeBC3(const std::uint8_t* rgba, std::uint8_t* out) noexcept;
+	// Mode 6 only: one subset, RGBA endpoints with 7 bits and a p-bit, 4-bit indices
+	void EncodeBC7(const std::uint8_t* rgba, std::uint8_t* out) noexcept;
+
+	inline void EncodeBlock(BlockFormat format, const std::uint8_t* rgba, std::uint8_t* out) noexcept
+	{
+		switch (format)
+		{
+		case BlockFormat::BC1: EncodeBC1(rgba, out); break;
+		case BlockFormat::BC3: EncodeBC3(rgba, out); break;
+		case BlockFormat::BC7: EncodeBC7(rgba, out); break;
+		}
+	}
+}
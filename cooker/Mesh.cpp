@@ -0,0 +1,563 @@
+#include "Mesh.h"
+
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace sisskey
+{
+	namespace
+	{
+		// Indices of a face corner into the position, texture coordinate and normal lists, -1 if missing
+		struct Corner
+		{
+			int position, uv, normal;
+
+			[[nodiscard]] bool operator==(const Corner& other) const noexcept
+			{
+				return position == other.position && uv == other.uv && normal == other.normal;
+			}
+		};
+
+		struct CornerHash
+		{
+			[[nodiscard]] std::size_t operator()(const Corner& c) const noexcept
+			{
+				return std::hash<std::uint64_t>{}(static_cast<std::uint64_t>(c.position) * 0x9E3779B97F4A7C15ull ^
+												   static_cast<std::uint64_t>(c.uv) * 0xC2B2AE3D27D4EB4Full ^ static_cast<std::uint32_t>(c.normal));
+			}
+		};
+
+		// OBJ indices are 1-based, negative ones count from the end of the list
+		[[nodiscard]] int ResolveIndex(long index, std::size_t count)
+		{
+			const long resolved{ index < 0 ? static_cast<long>(count) + index : index - 1 };
+			if (resolved < 0 || resolved >= static_cast<long>(count))
+				throw std::runtime_error{ u8"OBJ face index is out of range" };
+			return static_cast<int>(resolved);
+		}
+
+		// Forsyth's scoring, the last triangle gets a fixed score so its order doesn't matter
+		constexpr int CacheSize{ 32 };
+
+		[[nodiscard]] float VertexScore(int cachePosition, std::uint32_t remaining) noexcept
+		{
+			if (remaining == 0)
+				return -1.0f;
+
+			float score{ 0.0f };
+			if (cachePosition >= 0)
+			{
+				if (cachePosition < 3)
+					score = 0.75f;
+				else score = std::pow(1.0f - static_cast<float>(cachePosition - 3) / (CacheSize - 3), 1.5f);
+			}
+			// Vertices with few triangles left are finished first, so they leave the working set
+			return score + 2.0f / std::sqrt(static_cast<float>(remaining));
+		}
+
+		// Octahedral mapping of a unit vector to [-1, 1]^2
+		// https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+		void EncodeOctahedral(Vec3 n, std::int16_t* out) noexcept
+		{
+			const float sum{ std::abs(n.x) + std::abs(n.y) + std::abs(n.z) };
+			float x{ sum > 0.0f ? n.x / sum : 0.0f };
+			float y{ sum > 0.0f ? n.y / sum : 0.0f };
+			if (n.z < 0.0f)
+			{
+				const float wrappedX{ (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f) };
+				const float wrappedY{ (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f) };
+				x = wrappedX;
+				y = wrappedY;
+			}
+			out[0] = static_cast<std::int16_t>(std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+			out[1] = static_cast<std::int16_t>(std::lround(std::clamp(y, -1.0f, 1.0f) * 32767.0f));
+		}
+
+		// IEEE 754 binary16, rounded to nearest
+		[[nodiscard]] std::uint16_t FloatToHalf(float value) noexcept
+		{
+			std::uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			const std::uint32_t sign{ (bits >> 16) & 0x8000 };
+			const std::uint32_t absolute{ bits & 0x7FFFFFFF };
+
+			if (absolute >= 0x7F800000)
+				return static_cast<std::uint16_t>(sign | 0x7C00 | (absolute > 0x7F800000 ? 0x200 : 0)); // inf, nan
+			if (absolute >= 0x477FF000)
+				return static_cast<std::uint16_t>(sign | 0x7C00); // overflow
+			if (absolute < 0x38800000)
+			{
+				// Denormals, shifting the implicit bit in. Below 2^-25 everything rounds to zero,
+				// and the shifts would exceed 31 bits.
+				const std::uint32_t shift{ 113 - (absolute >> 23) };
+				if (shift > 11)
+					return static_cast<std::uint16_t>(sign);
+				const std::uint32_t mantissa{ (absolute & 0x7FFFFF) | 0x800000 };
+				return static_cast<std::uint16_t>(sign | ((mantissa + (1u << (shift + 12)) ) >> (shift + 13)));
+			}
+			return static_cast<std::uint16_t>(sign | ((absolute - 0x38000000 + 0xFFF + ((absolute >> 13) & 1)) >> 13));
+		}
+
+		void ComputeBounds(const Mesh& mesh, const std::uint32_t* vertices, std::size_t vertexCount,
+						   const std::uint8_t* triangles, std::size_t triangleCount, Meshlet& meshlet) noexcept
+		{
+			Vec3 min{ mesh.vertices[vertices[0]].position }, max{ min };
+			for (std::size_t i{ 1 }; i < vertexCount; ++i)
+			{
+				const Vec3 p{ mesh.vertices[vertices[i]].position };
+				min = { std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z) };
+				max = { std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z) };
+			}
+
+			const Vec3 center{ (min + max) * 0.5f };
+			float radius{ 0.0f };
+			for (std::size_t i{}; i < vertexCount; ++i)
+				radius = std::max(radius, Length(mesh.vertices[vertices[i]].position - center));
+
+			// Normal cone: the axis is the average direction, the spread is set by the most diverging triangle
+			std::vector<Vec3> normals;
+			normals.reserve(triangleCount);
+			Vec3 axis{ 0.0f, 0.0f, 0.0f };
+			for (std::size_t t{}; t < triangleCount; ++t)
+			{
+				const Vec3 a{ mesh.vertices[vertices[triangles[t * 3]]].position };
+				const Vec3 b{ mesh.vertices[vertices[triangles[t * 3 + 1]]].position };
+				const Vec3 c{ mesh.vertices[vertices[triangles[t * 3 + 2]]].position };
+				const Vec3 n{ Cross(b - a, c - a) };
+				const float length{ Length(n) };
+				if (length > 0.0f)
+				{
+					normals.push_back(n * (1.0f / length));
+					axis = axis + normals.back();
+				}
+			}
+
+			float cutoff{ 1.0f };
+			if (const float length{ Length(axis) }; length > 0.0f)
+			{
+				axis = axis * (1.0f / length);
+				float minDot{ 1.0f };
+				for (const Vec3& n : normals)
+					minDot = std::min(minDot, Dot(axis, n));
+				// Cones wider than a hemisphere never cull
+				if (minDot > 0.0f)
+					cutoff = std::sqrt(1.0f - minDot * minDot);
+			}
+
+			meshlet.center[0] = center.x;
+			meshlet.center[1] = center.y;
+			meshlet.center[2] = center.z;
+			meshlet.radius = radius;
+			meshlet.coneAxis[0] = axis.x;
+			meshlet.coneAxis[1] = axis.y;
+			meshlet.coneAxis[2] = axis.z;
+			meshlet.coneCutoff = cutoff;
+		}
+	}
+
+	Mesh LoadOBJ(const std::filesystem::path& path)
+	{
+		std::ifstream stream{ path, std::ios::binary };
+		if (!stream)
+			throw std::runtime_error{ u8"Failed to open " + path.u8string() };
+		const std::string file{ std::istreambuf_iterator<char>{ stream }, std::istreambuf_iterator<char>{} };
+
+		std::vector<Vec3> positions, normals;
+		std::vector<std::array<float, 2>> uvs;
+		std::unordered_map<Corner, std::uint32_t, CornerHash> corners;
+		std::vector<Corner> vertexCorners;
+		Mesh mesh;
+
+		std::vector<std::uint32_t> face;
+		for (std::size_t lineStart{ 0 }; lineStart < file.size();)
+		{
+			std::size_t lineEnd{ file.find('\n', lineStart) };
+			if (lineEnd == std::string::npos)
+				lineEnd = file.size();
+			// strtof and strtol stop at the newline, the file is a contiguous string
+			const char* p = file.c_str() + lineStart;
+			const char* const end = file.c_str() + lineEnd;
+			lineStart = lineEnd + 1;
+
+			while (p < end && (*p == ' ' || *p == '\t'))
+				++p;
+			if (end - p < 2)
+				continue;
+
+			char* next;
+			if (p[0] == 'v' && p[1] == ' ')
+			{
+				Vec3 v;
+				v.x = std::strtof(p + 2, &next);
+				v.y = std::strtof(next, &next);
+				v.z = std::strtof(next, &next);
+				positions.push_back(v);
+			}
+			else if (p[0] == 'v' && p[1] == 'n')
+			{
+				Vec3 n;
+				n.x = std::strtof(p + 2, &next);
+				n.y = std::strtof(next, &next);
+				n.z = std::strtof(next, &next);
+				normals.push_back(n);
+			}
+			else if (p[0] == 'v' && p[1] == 't')
+			{
+				const float u{ std::strtof(p + 2, &next) };
+				const float v{ std::strtof(next, &next) };
+				uvs.push_back({ u, v });
+			}
+			else if (p[0] == 'f' && p[1] == ' ')
+			{
+				face.clear();
+				p += 2;
+				for (;;)
+				{
+					while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+						++p;
+					if (p >= end)
+						break;
+
+					// v, v/vt, v//vn or v/vt/vn
+					Corner corner{ ResolveIndex(std::strtol(p, &next, 10), positions.size()), -1, -1 };
+					if (next == p)
+						throw std::runtime_error{ u8"Malformed OBJ face" };
+					p = next;
+					if (p < end && *p == '/')
+					{
+						++p;
+						if (p < end && *p != '/')
+						{
+							corner.uv = ResolveIndex(std::strtol(p, &next, 10), uvs.size());
+							p = next;
+						}
+						if (p < end && *p == '/')
+						{
+							++p;
+							corner.normal = ResolveIndex(std::strtol(p, &next, 10), normals.size());
+							p = next;
+						}
+					}
+
+					auto [it, inserted] = corners.try_emplace(corner, static_cast<std::uint32_t>(vertexCorners.size()));
+					if (inserted)
+						vertexCorners.push_back(corner);
+					face.push_back(it->second);
+				}
+
+				for (std::size_t i{ 2 }; i < face.size(); ++i)
+					mesh.indices.insert(mesh.indices.end(), { face[0], face[i - 1], face[i] });
+			}
+		}
+
+		if (mesh.indices.empty())
+			throw std::runtime_error{ u8"OBJ file has no faces" };
+
+		// Smooth normals over positions for corners without one
+		std::vector<Vec3> generated;
+		if (std::any_of(vertexCorners.begin(), vertexCorners.end(), [](const Corner& c) { return c.normal < 0; }))
+		{
+			generated.assign(positions.size(), { 0.0f, 0.0f, 0.0f });
+			for (std::size_t i{}; i < mesh.indices.size(); i += 3)
+			{
+				const int a{ vertexCorners[mesh.indices[i]].position };
+				const int b{ vertexCorners[mesh.indices[i + 1]].position };
+				const int c{ vertexCorners[mesh.indices[i + 2]].position };
+				// The length of the cross product weights the normal by the triangle area
+				const Vec3 n{ Cross(positions[b] - positions[a], positions[c] - positions[a]) };
+				for (int v : { a, b, c })
+					generated[v] = generated[v] + n;
+			}
+		}
+
+		mesh.vertices.reserve(vertexCorners.size());
+		for (const Corner& c : vertexCorners)
+		{
+			Vertex vertex{ positions[c.position], { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f } };
+			const Vec3 n{ c.normal >= 0 ? normals[c.normal] : generated[c.position] };
+			if (Length(n) > 0.0f)
+				vertex.normal = Normalize(n);
+			if (c.uv >= 0)
+			{
+				vertex.uv[0] = uvs[c.uv][0];
+				vertex.uv[1] = uvs[c.uv][1];
+			}
+			mesh.vertices.push_back(vertex);
+		}
+		return mesh;
+	}
+
+	CacheStatistics AnalyzeVertexCache(const std::vector<std::uint32_t>& indices, std::size_t vertexCount, std::size_t cacheSize)
+	{
+		// A vertex is cached while fewer than cacheSize misses happened after its own
+		std::vector<std::size_t> stamps(vertexCount, 0);
+		std::size_t time{ cacheSize + 1 };
+		std::size_t misses{ 0 };
+		for (std::uint32_t index : indices)
+		{
+			if (time - stamps[index] > cacheSize)
+			{
+				stamps[index] = time++;
+				++misses;
+			}
+		}
+		return { static_cast<float>(misses) / static_cast<float>(indices.size() / 3),
+				 static_cast<float>(misses) / static_cast<float>(std::max<std::size_t>(vertexCount, 1)) };
+	}
+
+	void OptimizeVertexCache(std::vector<std::uint32_t>& indices, std::size_t vertexCount)
+	{
+		const std::size_t triangleCount{ indices.size() / 3 };
+
+		// Triangles of every vertex, the first remaining[v] entries are the ones not emitted yet
+		std::vector<std::uint32_t> remaining(vertexCount, 0);
+		for (std::uint32_t index : indices)
+			++remaining[index];
+		std::vector<std::uint32_t> offsets(vertexCount + 1, 0);
+		for (std::size_t v{}; v < vertexCount; ++v)
+			offsets[v + 1] = offsets[v] + remaining[v];
+		std::vector<std::uint32_t> adjacency(indices.size());
+		{
+			std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (std::size_t t{}; t < triangleCount; ++t)
+				for (int k{}; k < 3; ++k)
+					adjacency[fill[indices[t * 3 + k]]++] = static_cast<std::uint32_t>(t);
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (std::size_t v{}; v < vertexCount; ++v)
+			vertexScore[v] = VertexScore(-1, remaining[v]);
+
+		std::vector<float> triangleScore(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		std::size_t best{ 0 };
+		for (std::size_t t{}; t < triangleCount; ++t)
+		{
+			triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+			if (triangleScore[t] > triangleScore[best])
+				best = t;
+		}
+
+		std::vector<std::uint32_t> result;
+		result.reserve(indices.size());
+		std::uint32_t cache[CacheSize + 3];
+		std::size_t cacheCount{ 0 };
+		std::size_t cursor{ 0 };
+
+		for (std::size_t emittedCount{}; emittedCount < triangleCount; ++emittedCount)
+		{
+			// Nothing in the cache has triangles left, continue with the next one in the input order
+			if (best == triangleCount)
+			{
+				while (emitted[cursor])
+					++cursor;
+				best = cursor;
+			}
+
+			const std::uint32_t* triangle = &indices[best * 3];
+			result.insert(result.end(), triangle, triangle + 3);
+			emitted[best] = true;
+
+			for (int k{}; k < 3; ++k)
+			{
+				const std::uint32_t v{ triangle[k] };
+				std::uint32_t* first = &adjacency[offsets[v]];
+				std::uint32_t* last = first + remaining[v];
+				std::iter_swap(std::find(first, last, static_cast<std::uint32_t>(best)), last - 1);
+				--remaining[v];
+			}
+
+			// Most recently used first, the triangle's vertices move to the front
+			std::uint32_t next[CacheSize + 3];
+			std::size_t nextCount{ 0 };
+			for (int k{}; k < 3; ++k)
+			{
+				if (std::find(next, next + nextCount, triangle[k]) == next + nextCount)
+					next[nextCount++] = triangle[k];
+			}
+			for (std::size_t i{}; i < cacheCount; ++i)
+			{
+				if (std::find(next, next + nextCount, cache[i]) == next + nextCount)
+					next[nextCount++] = cache[i];
+			}
+
+			for (std::size_t i{}; i < nextCount; ++i)
+			{
+				const std::uint32_t v{ next[i] };
+				cachePosition[v] = i < CacheSize ? static_cast<int>(i) : -1;
+				vertexScore[v] = VertexScore(cachePosition[v], remaining[v]);
+			}
+
+			// Only triangles of vertices whose score changed need a new score
+			best = triangleCount;
+			float bestScore{ -1.0f };
+			for (std::size_t i{}; i < nextCount; ++i)
+			{
+				const std::uint32_t v{ next[i] };
+				for (std::uint32_t j{ offsets[v] }; j < offsets[v] + remaining[v]; ++j)
+				{
+					const std::uint32_t t{ adjacency[j] };
+					triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+					if (triangleScore[t] > bestScore)
+					{
+						bestScore = triangleScore[t];
+						best = t;
+					}
+				}
+			}
+
+			cacheCount = std::min<std::size_t>(nextCount, CacheSize);
+			std::copy_n(next, cacheCount, cache);
+		}
+
+		indices = std::move(result);
+	}
+
+	void OptimizeVertexFetch(Mesh& mesh)
+	{
+		constexpr std::uint32_t Unused{ 0xFFFFFFFF };
+		std::vector<std::uint32_t> remap(mesh.vertices.size(), Unused);
+		std::vector<Vertex> vertices;
+		vertices.reserve(mesh.vertices.size());
+
+		for (std::uint32_t& index : mesh.indices)
+		{
+			if (remap[index] == Unused)
+			{
+				remap[index] = static_cast<std::uint32_t>(vertices.size());
+				vertices.push_back(mesh.vertices[index]);
+			}
+			index = remap[index];
+		}
+		mesh.vertices = std::move(vertices);
+	}
+
+	std::vector<MeshVertex> QuantizeVertices(const std::vector<Vertex>& vertices, MeshHeader& header)
+	{
+		Vec3 min{ vertices.front().position }, max{ min };
+		for (const Vertex& v : vertices)
+		{
+			min = { std::min(min.x, v.position.x), std::min(min.y, v.position.y), std::min(min.z, v.position.z) };
+			max = { std::max(max.x, v.position.x), std::max(max.y, v.position.y), std::max(max.z, v.position.z) };
+		}
+		const Vec3 extent{ max - min };
+		header.boundsMin[0] = min.x;
+		header.boundsMin[1] = min.y;
+		header.boundsMin[2] = min.z;
+		header.boundsExtent[0] = extent.x;
+		header.boundsExtent[1] = extent.y;
+		header.boundsExtent[2] = extent.z;
+
+		auto unorm16 = [](float value, float min, float extent)
+		{
+			return static_cast<std::uint16_t>(extent > 0.0f ? std::lround(std::clamp((value - min) / extent, 0.0f, 1.0f) * 65535.0f) : 0);
+		};
+
+		std::vector<MeshVertex> quantized(vertices.size());
+		for (std::size_t i{}; i < vertices.size(); ++i)
+		{
+			const Vertex& v = vertices[i];
+			MeshVertex& q = quantized[i];
+			q.position[0] = unorm16(v.position.x, min.x, extent.x);
+			q.position[1] = unorm16(v.position.y, min.y, extent.y);
+			q.position[2] = unorm16(v.position.z, min.z, extent.z);
+			q.position[3] = 0;
+			EncodeOctahedral(v.normal, q.normal);
+			q.uv[0] = FloatToHalf(v.uv[0]);
+			q.uv[1] = FloatToHalf(v.uv[1]);
+		}
+		return quantized;
+	}
+
+	Meshlets BuildMeshlets(const Mesh& mesh, std::size_t maxVertices, std::size_t maxTriangles)
+	{
+		Meshlets result;
+		// Index of a vertex in the current meshlet, 0xFF if it's not in it
+		std::vector<std::uint8_t> local(mesh.vertices.size(), 0xFF);
+		Meshlet current{};
+
+		auto finish = [&]()
+		{
+			if (current.triangleCount == 0)
+				return;
+			ComputeBounds(mesh, &result.vertices[current.vertexOffset], current.vertexCount,
+						  &result.triangles[current.triangleOffset * 3], current.triangleCount, current);
+			for (std::size_t i{}; i < current.vertexCount; ++i)
+				local[result.vertices[current.vertexOffset + i]] = 0xFF;
+			result.meshlets.push_back(current);
+			current = {};
+			current.vertexOffset = static_cast<std::uint32_t>(result.vertices.size());
+			current.triangleOffset = static_cast<std::uint32_t>(result.triangles.size() / 3);
+		};
+
+		for (std::size_t i{}; i < mesh.indices.size(); i += 3)
+		{
+			const std::uint32_t* triangle = &mesh.indices[i];
+			std::size_t added{ 0 };
+			for (int k{}; k < 3; ++k)
+				added += local[triangle[k]] == 0xFF && (k == 0 || triangle[k] != triangle[k - 1]) && (k < 2 || triangle[2] != triangle[0]);
+			if (current.vertexCount + added > maxVertices || current.triangleCount + 1 > maxTriangles)
+				finish();
+
+			for (int k{}; k < 3; ++k)
+			{
+				std::uint8_t& index = local[triangle[k]];
+				if (index == 0xFF)
+				{
+					index = static_cast<std::uint8_t>(current.vertexCount++);
+					result.vertices.push_back(triangle[k]);
+				}
+				result.triangles.push_back(index);
+			}
+			++current.triangleCount;
+		}
+		finish();
+		return result;
+	}
+
+	void WriteMesh(const std::filesystem::path& path, const Mesh& mesh, const Meshlets& meshlets)
+	{
+		MeshHeader header{};
+		header.magic = MeshHeader::Magic;
+		header.version = MeshHeader::CurrentVersion;
+		header.flags = mesh.vertices.size() > 0xFFFF ? MeshHeader::Indices32 : 0;
+		header.vertexCount = static_cast<std::uint32_t>(mesh.vertices.size());
+		header.indexCount = static_cast<std::uint32_t>(mesh.indices.size());
+		header.meshletCount = static_cast<std::uint32_t>(meshlets.meshlets.size());
+		header.meshletVertexCount = static_cast<std::uint32_t>(meshlets.vertices.size());
+		header.meshletTriangleCount = static_cast<std::uint32_t>(meshlets.triangles.size() / 3);
+		const std::vector<MeshVertex> vertices{ QuantizeVertices(mesh.vertices, header) };
+
+		std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+		if (!file)
+			throw std::runtime_error{ u8"Failed to open " + path.u8string() };
+
+		auto write = [&file](const void* data, std::size_t size) { file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size)); };
+		write(&header, sizeof(header));
+		write(vertices.data(), vertices.size() * sizeof(MeshVertex));
+		if (header.flags & MeshHeader::Indices32)
+			write(mesh.indices.data(), mesh.indices.size() * sizeof(std::uint32_t));
+		else
+		{
+			const std::vector<std::uint16_t> indices(mesh.indices.begin(), mesh.indices.end());
+			write(indices.data(), indices.size() * sizeof(std::uint16_t));
+			if (indices.size() & 1)
+				write(u8"\0\0", 2);
+		}
+		write(meshlets.meshlets.data(), meshlets.meshlets.size() * sizeof(Meshlet));
+		write(meshlets.vertices.data(), meshlets.vertices.size() * sizeof(std::uint32_t));
+		write(meshlets.triangles.data(), meshlets.triangles.size());
+
+		if (!file.flush())
+			throw std::runtime_error{ u8"Failed to write " + path.u8string() };
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../sisskey/Math.h"
+#include "../sisskey/MeshFormat.h"
+
+#include <filesystem>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	struct Vertex
+	{
+		Vec3 position;
+		Vec3 normal;
+		float uv[2];
+	};
+
+	struct Mesh
+	{
+		std::vector<Vertex> vertices;
+		std::vector<std::uint32_t> indices; // triangle list
+	};
+
+	// Wavefront OBJ, polygons are triangulated as fans and identical corners share a vertex.
+	// Missing normals are generated from the area weighted normals of adjacent faces.
+	[[nodiscard]] Mesh LoadOBJ(const std::filesystem::path& path);
+
+	// Average cache miss ratio (misses per triangle) and average transformed vertex ratio
+	// (misses per vertex) of a FIFO post-transform cache
+	struct CacheStatistics
+	{
+		float acmr;
+		float atvr;
+	};
+
+	[[nodiscard]] CacheStatistics AnalyzeVertexCache(const std::vector<std::uint32_t>& indices, std::size_t vertexCount, std::size_t cacheSize = 16);
+
+	// Triangle order for the post-transform cache, Forsyth's linear-speed vertex cache optimisation
+	// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+	void OptimizeVertexCache(std::vector<std::uint32_t>& indices, std::size_t vertexCount);
+
+	// Vertices in the order of first use, so the input assembler reads memory sequentially.
+	// Unreferenced vertices are removed.
+	void OptimizeVertexFetch(Mesh& mesh);
+
+	// boundsMin and boundsExtent of header are set for the positions
+	[[nodiscard]] std::vector<MeshVertex> QuantizeVertices(const std::vector<Vertex>& vertices, MeshHeader& header);
+
+	struct Meshlets
+	{
+		std::vector<Meshlet> meshlets;
+		std::vector<std::uint32_t> vertices;
+		std::vector<std::uint8_t> triangles;
+	};
+
+	// Consecutive triangles are grouped while they fit, so a cache optimized order gives compact clusters
+	[[nodiscard]] Meshlets BuildMeshlets(const Mesh& mesh, std::size_t maxVertices = 64, std::size_t maxTriangles = 124);
+
+	void WriteMesh(const std::filesystem::path& path, const Mesh& mesh, const Meshlets& meshlets);
+}
@@ -0,0 +1,404 @@
+#include "Texture.h"
+#include "../sisskey/JobSystem.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <cmath>
+#include <cctype>
+#include <cstring>
+
+namespace sisskey
+{
+	namespace
+	{
+		[[nodiscard]] float SrgbToLinear(float c) noexcept
+		{
+			return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+
+		[[nodiscard]] float LinearToSrgb(float c) noexcept
+		{
+			return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+		}
+
+		[[nodiscard]] std::uint8_t ToUnorm8(float c) noexcept
+		{
+			return static_cast<std::uint8_t>(std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f));
+		}
+
+		[[nodiscard]] Image FromRGBA8(const std::uint8_t* rgba, int width, int height, bool srgb)
+		{
+			float decode[256];
+			for (int i{}; i < 256; ++i)
+				decode[i] = srgb ? SrgbToLinear(static_cast<float>(i) / 255.0f) : static_cast<float>(i) / 255.0f;
+
+			Image image{ width, height, std::vector<Vec4>(static_cast<std::size_t>(width) * height) };
+			for (std::size_t i{}; i < image.pixels.size(); ++i)
+				image.pixels[i] = { decode[rgba[i * 4]], decode[rgba[i * 4 + 1]], decode[rgba[i * 4 + 2]], static_cast<float>(rgba[i * 4 + 3]) / 255.0f };
+			return image;
+		}
+
+		// http://www.paulbourke.net/dataformats/tga/
+		[[nodiscard]] Image LoadTGA(const std::vector<std::uint8_t>& file, bool srgb)
+		{
+			if (file.size() < 18)
+				throw std::runtime_error{ u8"TGA file is truncated" };
+			const std::uint8_t* header = file.data();
+			const int type{ header[2] };
+			const int width{ header[12] | header[13] << 8 };
+			const int height{ header[14] | header[15] << 8 };
+			const int bytesPerPixel{ header[16] / 8 };
+			const bool topDown{ (header[17] & 0x20) != 0 };
+			if (header[1] != 0 || (type != 2 && type != 10) || (bytesPerPixel != 3 && bytesPerPixel != 4) || width == 0 || height == 0)
+				throw std::runtime_error{ u8"Only truecolor TGA with 24 or 32 bits per pixel is supported" };
+
+			std::size_t position{ 18u + header[0] };
+			const std::size_t count{ static_cast<std::size_t>(width) * height };
+			std::vector<std::uint8_t> rgba(count * 4);
+			auto readPixel = [&](std::size_t index)
+			{
+				if (position + bytesPerPixel > file.size())
+					throw std::runtime_error{ u8"TGA file is truncated" };
+				rgba[index * 4] = file[position + 2];
+				rgba[index * 4 + 1] = file[position + 1];
+				rgba[index * 4 + 2] = file[position];
+				rgba[index * 4 + 3] = bytesPerPixel == 4 ? file[position + 3] : 255;
+				position += bytesPerPixel;
+			};
+
+			for (std::size_t i{}; i < count;)
+			{
+				if (type == 2)
+				{
+					readPixel(i++);
+					continue;
+				}
+
+				// RLE packets: a repeated pixel or a run of raw pixels
+				if (position >= file.size())
+					throw std::runtime_error{ u8"TGA file is truncated" };
+				const int packet{ file[position++] };
+				const std::size_t length{ std::min<std::size_t>((packet & 0x7F) + 1u, count - i) };
+				if (packet & 0x80)
+				{
+					readPixel(i);
+					for (std::size_t k{ 1 }; k < length; ++k)
+						std::memcpy(&rgba[(i + k) * 4], &rgba[i * 4], 4);
+					i += length;
+				}
+				else
+				{
+					for (std::size_t k{}; k < length; ++k)
+						readPixel(i++);
+				}
+			}
+
+			if (!topDown)
+			{
+				const std::size_t stride{ static_cast<std::size_t>(width) * 4 };
+				for (int y{}; y < height / 2; ++y)
+					std::swap_ranges(rgba.begin() + y * stride, rgba.begin() + (y + 1) * stride, rgba.begin() + (height - 1 - y) * stride);
+			}
+			return FromRGBA8(rgba.data(), width, height, srgb);
+		}
+
+		// http://netpbm.sourceforge.net/doc/ppm.html
+		[[nodiscard]] Image LoadPPM(const std::vector<std::uint8_t>& file, bool srgb)
+		{
+			std::size_t position{ 2 };
+			auto readNumber = [&]() -> int
+			{
+				// Whitespace and comments up to the end of the line
+				while (position < file.size() && (std::isspace(file[position]) || file[position] == '#'))
+				{
+					if (file[position] == '#')
+					{
+						while (position < file.size() && file[position] != '\n')
+							++position;
+					}
+					else ++position;
+				}
+				int value{ 0 };
+				if (position >= file.size() || !std::isdigit(file[position]))
+					throw std::runtime_error{ u8"Malformed PPM header" };
+				while (position < file.size() && std::isdigit(file[position]))
+					value = value * 10 + (file[position++] - '0');
+				return value;
+			};
+
+			const int width{ readNumber() };
+			const int height{ readNumber() };
+			const int maxValue{ readNumber() };
+			++position;
+			if (width <= 0 || height <= 0 || maxValue != 255)
+				throw std::runtime_error{ u8"Only 8-bit PPM is supported" };
+
+			const std::size_t count{ static_cast<std::size_t>(width) * height };
+			if (file.size() < position + count * 3)
+				throw std::runtime_error{ u8"PPM file is truncated" };
+			std::vector<std::uint8_t> rgba(count * 4);
+			for (std::size_t i{}; i < count; ++i)
+			{
+				std::memcpy(&rgba[i * 4], &file[position + i * 3], 3);
+				rgba[i * 4 + 3] = 255;
+			}
+			return FromRGBA8(rgba.data(), width, height, srgb);
+		}
+
+		// Taps of a 2:1 reduction: dst[i] = sum(weights[k] * src[2 * i + offset + k])
+		struct Kernel
+		{
+			int offset;
+			std::vector<float> weights;
+		};
+
+		[[nodiscard]] Kernel BoxKernel()
+		{
+			return { 0, { 0.5f, 0.5f } };
+		}
+
+		// Kaiser windowed sinc, 3 destination pixels to each side
+		// https://www.ignacio-castano.com/blog/2009/08/31/image-processing-kaiser-filter/
+		[[nodiscard]] Kernel KaiserKernel()
+		{
+			constexpr float Width{ 3.0f };
+			constexpr float Alpha{ 4.0f };
+			constexpr float Pi{ 3.14159265358979f };
+
+			// Zeroth order modified Bessel function of the first kind
+			auto bessel = [](float x)
+			{
+				float sum{ 1.0f }, term{ 1.0f };
+				for (int k{ 1 }; k < 20; ++k)
+				{
+					term *= (x * 0.5f / static_cast<float>(k)) * (x * 0.5f / static_cast<float>(k));
+					sum += term;
+				}
+				return sum;
+			};
+
+			// Destination pixel i is centered between source pixels 2i and 2i + 1
+			constexpr int Taps{ 2 * static_cast<int>(Width) * 2 };
+			Kernel kernel{ 1 - Taps / 2, std::vector<float>(Taps) };
+			float sum{ 0.0f };
+			for (int k{}; k < Taps; ++k)
+			{
+				const float x{ (static_cast<float>(kernel.offset + k) - 0.5f) * 0.5f };
+				const float t{ x / Width };
+				const float window{ bessel(Alpha * std::sqrt(std::max(0.0f, 1.0f - t * t))) / bessel(Alpha) };
+				const float sinc{ x == 0.0f ? 1.0f : std::sin(Pi * x) / (Pi * x) };
+				kernel.weights[k] = window * sinc;
+				sum += kernel.weights[k];
+			}
+			for (float& weight : kernel.weights)
+				weight /= sum;
+			return kernel;
+		}
+
+		// dst += src * weight
+		void MultiplyAdd(Vec4* dst, const Vec4* src, float weight, int count) noexcept
+		{
+#if defined(SISSKEY_SIMD_AVX2)
+			const __m256 w = _mm256_set1_ps(weight);
+			int i{ 0 };
+			for (; i + 2 <= count; i += 2)
+			{
+				const __m256 r = _mm256_fmadd_ps(_mm256_loadu_ps(&src[i].x), w, _mm256_loadu_ps(&dst[i].x));
+				_mm256_storeu_ps(&dst[i].x, r);
+			}
+			if (i < count)
+				_mm_store_ps(&dst[i].x, _mm_fmadd_ps(Load(src[i]), _mm256_castps256_ps128(w), Load(dst[i])));
+#elif defined(SISSKEY_SIMD_SSE41)
+			const __m128 w = _mm_set1_ps(weight);
+			for (int i{}; i < count; ++i)
+				_mm_store_ps(&dst[i].x, _mm_add_ps(Load(dst[i]), _mm_mul_ps(Load(src[i]), w)));
+#else
+			for (int i{}; i < count; ++i)
+				dst[i] = dst[i] + src[i] * weight;
+#endif
+		}
+
+		[[nodiscard]] Vec4 FilterHorizontal(const Vec4* row, int width, int x, const Kernel& kernel) noexcept
+		{
+			const int first{ 2 * x + kernel.offset };
+#if defined(SISSKEY_SIMD_SSE41)
+			__m128 sum = _mm_setzero_ps();
+			for (std::size_t k{}; k < kernel.weights.size(); ++k)
+			{
+				const int source{ std::clamp(first + static_cast<int>(k), 0, width - 1) };
+				sum = _mm_add_ps(sum, _mm_mul_ps(Load(row[source]), _mm_set1_ps(kernel.weights[k])));
+			}
+			return Store(sum);
+#else
+			Vec4 sum{};
+			for (std::size_t k{}; k < kernel.weights.size(); ++k)
+				sum = sum + row[std::clamp(first + static_cast<int>(k), 0, width - 1)] * kernel.weights[k];
+			return sum;
+#endif
+		}
+
+		// Separable: rows first, then columns of the half width image
+		[[nodiscard]] Image Downsample(const Image& source, const Kernel& kernel, JobSystem& jobs)
+		{
+			const int width{ std::max(1, source.width / 2) };
+			const int height{ std::max(1, source.height / 2) };
+			// A single row or column is copied as is
+			const Kernel identity{ 0, { 1.0f } };
+			const Kernel& vertical{ source.height > 1 ? kernel : identity };
+
+			std::vector<Vec4> rows(static_cast<std::size_t>(width) * source.height);
+			jobs.ParallelFor(0, static_cast<std::size_t>(source.height), [&](std::size_t first, std::size_t last)
+			{
+				for (std::size_t y{ first }; y < last; ++y)
+				{
+					const Vec4* row = &source.pixels[y * source.width];
+					for (int x{}; x < width; ++x)
+						rows[y * width + x] = source.width > 1 ? FilterHorizontal(row, source.width, x, kernel) : row[x];
+				}
+			}, 16);
+
+			Image image{ width, height, std::vector<Vec4>(static_cast<std::size_t>(width) * height) };
+			jobs.ParallelFor(0, static_cast<std::size_t>(height), [&](std::size_t first, std::size_t last)
+			{
+				for (std::size_t y{ first }; y < last; ++y)
+				{
+					Vec4* out = &image.pixels[y * width];
+					const int firstRow{ (source.height > 1 ? 2 * static_cast<int>(y) : static_cast<int>(y)) + vertical.offset };
+					for (std::size_t k{}; k < vertical.weights.size(); ++k)
+					{
+						const int row{ std::clamp(firstRow + static_cast<int>(k), 0, source.height - 1) };
+						MultiplyAdd(out, &rows[static_cast<std::size_t>(row) * width], vertical.weights[k], width);
+					}
+					// Negative lobes of the Kaiser filter ring around sharp edges
+					for (int x{}; x < width; ++x)
+						out[x] = { std::max(out[x].x, 0.0f), std::max(out[x].y, 0.0f), std::max(out[x].z, 0.0f), std::clamp(out[x].w, 0.0f, 1.0f) };
+				}
+			}, 8);
+			return image;
+		}
+	}
+
+	Image LoadImage(const std::filesystem::path& path, bool srgb)
+	{
+		std::ifstream stream{ path, std::ios::binary };
+		if (!stream)
+			throw std::runtime_error{ u8"Failed to open " + path.u8string() };
+		const std::vector<std::uint8_t> file{ std::istreambuf_iterator<char>{ stream }, std::istreambuf_iterator<char>{} };
+
+		if (file.size() >= 2 && file[0] == 'P' && file[1] == '6')
+			return LoadPPM(file, srgb);
+		return LoadTGA(file, srgb);
+	}
+
+	std::vector<Image> GenerateMips(Image source, MipFilter filter, JobSystem& jobs)
+	{
+		const Kernel kernel{ filter == MipFilter::Kaiser ? KaiserKernel() : BoxKernel() };
+
+		std::vector<Image> mips;
+		mips.push_back(std::move(source));
+		while (mips.back().width > 1 || mips.back().height > 1)
+			mips.push_back(Downsample(mips.back(), kernel, jobs));
+		return mips;
+	}
+
+	std::vector<std::uint8_t> ToRGBA8(const Image& image, bool srgb, JobSystem& jobs)
+	{
+		std::vector<std::uint8_t> rgba(image.pixels.size() * 4);
+		jobs.ParallelFor(0, image.pixels.size(), [&](std::size_t first, std::size_t last)
+		{
+			for (std::size_t i{ first }; i < last; ++i)
+			{
+				const Vec4& p = image.pixels[i];
+				rgba[i * 4] = ToUnorm8(srgb ? LinearToSrgb(p.x) : p.x);
+				rgba[i * 4 + 1] = ToUnorm8(srgb ? LinearToSrgb(p.y) : p.y);
+				rgba[i * 4 + 2] = ToUnorm8(srgb ? LinearToSrgb(p.z) : p.z);
+				rgba[i * 4 + 3] = ToUnorm8(p.w);
+			}
+		}, 4096);
+		return rgba;
+	}
+
+	std::vector<std::uint8_t> CompressImage(const std::vector<std::uint8_t>& rgba, int width, int height, BlockFormat format, JobSystem& jobs)
+	{
+		const int blocksX{ (width + 3) / 4 };
+		const int blocksY{ (height + 3) / 4 };
+		const std::size_t blockSize{ BlockSize(format) };
+		std::vector<std::uint8_t> blocks(static_cast<std::size_t>(blocksX) * blocksY * blockSize);
+
+		// A row of blocks per job keeps the source rows in cache
+		jobs.ParallelFor(0, static_cast<std::size_t>(blocksY), [&](std::size_t first, std::size_t last)
+		{
+			std::uint8_t block[64];
+			for (std::size_t by{ first }; by < last; ++by)
+			{
+				for (int bx{}; bx < blocksX; ++bx)
+				{
+					for (int y{}; y < 4; ++y)
+					{
+						const int sy{ std::min(static_cast<int>(by) * 4 + y, height - 1) };
+						for (int x{}; x < 4; ++x)
+						{
+							const int sx{ std::min(bx * 4 + x, width - 1) };
+							std::memcpy(&block[(y * 4 + x) * 4], &rgba[(static_cast<std::size_t>(sy) * width + sx) * 4], 4);
+						}
+					}
+					EncodeBlock(format, block, &blocks[(by * blocksX + bx) * blockSize]);
+				}
+			}
+		}, 1);
+		return blocks;
+	}
+
+	// https://learn.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+	void WriteDDS(const std::filesystem::path& path, BlockFormat format, bool srgb, int width, int height,
+				  const std::vector<std::vector<std::uint8_t>>& mips)
+	{
+		struct PixelFormat
+		{
+			std::uint32_t size, flags, fourCC, rgbBitCount, rMask, gMask, bMask, aMask;
+		};
+
+		struct Header
+		{
+			std::uint32_t magic, size, flags, height, width, pitchOrLinearSize, depth, mipMapCount, reserved1[11];
+			PixelFormat pixelFormat;
+			std::uint32_t caps, caps2, caps3, caps4, reserved2;
+			// DDS_HEADER_DXT10
+			std::uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+		};
+		static_assert(sizeof(Header) == 4 + 124 + 20, "DDS header layout");
+
+		constexpr std::uint32_t DX10{ 0x30315844 };
+		// DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC3_UNORM and DXGI_FORMAT_BC7_UNORM, the _SRGB variants follow them
+		constexpr std::uint32_t Formats[3]{ 71, 77, 98 };
+
+		Header header{};
+		header.magic = 0x20534444; // "DDS "
+		header.size = 124;
+		header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip map count, linear size
+		header.height = static_cast<std::uint32_t>(height);
+		header.width = static_cast<std::uint32_t>(width);
+		header.pitchOrLinearSize = static_cast<std::uint32_t>(mips.front().size());
+		header.mipMapCount = static_cast<std::uint32_t>(mips.size());
+		header.pixelFormat.size = 32;
+		header.pixelFormat.flags = 0x4; // fourCC
+		header.pixelFormat.fourCC = DX10;
+		header.caps = 0x1000 | (mips.size() > 1 ? 0x8 | 0x400000 : 0); // texture, complex, mip map
+		header.dxgiFormat = Formats[static_cast<int>(format)] + (srgb ? 1 : 0);
+		header.resourceDimension = 3; // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+		header.arraySize = 1;
+		header.miscFlags2 = format == BlockFormat::BC1 ? 0 : 1; // DDS_ALPHA_MODE_STRAIGHT
+
+		std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+		if (!file)
+			throw std::runtime_error{ u8"Failed to open " + path.u8string() };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (const auto& mip : mips)
+			file.write(reinterpret_cast<const char*>(mip.data()), static_cast<std::streamsize>(mip.size()));
+		if (!file.flush())
+			throw std::runtime_error{ u8"Failed to write " + path.u8string() };
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "BlockCompression.h"
+#include "../sisskey/Math.h"
+
+#include <filesystem>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	class JobSystem;
+
+	// RGBA with linear color, alpha is never gamma encoded
+	struct Image
+	{
+		int width{ 0 };
+		int height{ 0 };
+		std::vector<Vec4> pixels;
+	};
+
+	enum class MipFilter { Box, Kaiser };
+
+	// Uncompressed truecolor and RLE TGA (24 or 32 bit) or binary PPM (P6).
+	// srgb: color channels are decoded from sRGB, otherwise they are taken as is (normal maps, masks).
+	[[nodiscard]] Image LoadImage(const std::filesystem::path& path, bool srgb);
+
+	// Halves the size until 1x1, the first level is the source image.
+	// Filtering in linear space keeps the brightness of downsampled sRGB textures.
+	[[nodiscard]] std::vector<Image> GenerateMips(Image source, MipFilter filter, JobSystem& jobs);
+
+	// 8-bit RGBA, color channels are encoded to sRGB if srgb is set
+	[[nodiscard]] std::vector<std::uint8_t> ToRGBA8(const Image& image, bool srgb, JobSystem& jobs);
+
+	// Blocks row by row, partial blocks at the edges repeat the last row and column
+	[[nodiscard]] std::vector<std::uint8_t> CompressImage(const std::vector<std::uint8_t>& rgba, int width, int height, BlockFormat format, JobSystem& jobs);
+
+	// DDS with the DX10 header, mips follow each other from the largest one.
+	// The layout matches what D3D12 and Vulkan copy into a texture, rows of blocks with no padding.
+	void WriteDDS(const std::filesystem::path& path, BlockFormat format, bool srgb, int width, int height,
+				  const std::vector<std::vector<std::uint8_t>>& mips);
+}
@@ -0,0 +1,177 @@
+#include "Texture.h"
+#include "Mesh.h"
+#include "../sisskey/JobSystem.h"
+#include "../sisskey/Timer.h"
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <exception>
+
+using namespace sisskey;
+
+namespace
+{
+	void Usage()
+	{
+		std::printf(u8"sisskey_cooker <command> [options] <input> <output>\n"
+					u8"  texture               image (TGA, PPM) to a block compressed DDS with mips\n"
+					u8"    --format <f>        bc1, bc3 or bc7 (default bc7)\n"
+					u8"    --filter <f>        mip filter, box or kaiser (default kaiser)\n"
+					u8"    --linear            color is not sRGB, e.g. normal maps and masks\n"
+					u8"    --no-mips           only the top level\n"
+					u8"  mesh                  OBJ to a quantized, cache optimized mesh with meshlets\n"
+					u8"    --meshlet-vertices <n>   at most 255 (default 64)\n"
+					u8"    --meshlet-triangles <n>  (default 124)\n"
+					u8"  --threads <n>         job system threads, 0 - one per physical core\n");
+	}
+
+	struct TextureOptions
+	{
+		BlockFormat format{ BlockFormat::BC7 };
+		MipFilter filter{ MipFilter::Kaiser };
+		bool srgb{ true };
+		bool mips{ true };
+	};
+
+	void CookTexture(const std::string& input, const std::string& output, const TextureOptions& options, JobSystem& jobs)
+	{
+		const std::int64_t start{ Clock::Now() };
+
+		Image image{ LoadImage(input, options.srgb) };
+		const int width{ image.width };
+		const int height{ image.height };
+		std::vector<Image> levels;
+		if (options.mips)
+			levels = GenerateMips(std::move(image), options.filter, jobs);
+		else levels.push_back(std::move(image));
+
+		std::vector<std::vector<std::uint8_t>> mips;
+		std::size_t size{ 0 };
+		for (const Image& level : levels)
+		{
+			mips.push_back(CompressImage(ToRGBA8(level, options.srgb, jobs), level.width, level.height, options.format, jobs));
+			size += mips.back().size();
+		}
+		WriteDDS(output, options.format, options.srgb, width, height, mips);
+
+		std::printf(u8"%s: %dx%d, %zu mips, %zu bytes in %.3f s\n", output.c_str(), width, height, mips.size(), size,
+					Clock::ToSeconds(Clock::Now() - start));
+	}
+
+	struct MeshOptions
+	{
+		std::size_t meshletVertices{ 64 };
+		std::size_t meshletTriangles{ 124 };
+	};
+
+	void CookMesh(const std::string& input, const std::string& output, const MeshOptions& options)
+	{
+		const std::int64_t start{ Clock::Now() };
+
+		Mesh mesh{ LoadOBJ(input) };
+		const std::size_t inputVertices{ mesh.vertices.size() };
+		const CacheStatistics before{ AnalyzeVertexCache(mesh.indices, mesh.vertices.size()) };
+
+		OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+		OptimizeVertexFetch(mesh);
+		const CacheStatistics after{ AnalyzeVertexCache(mesh.indices, mesh.vertices.size()) };
+
+		const Meshlets meshlets{ BuildMeshlets(mesh, options.meshletVertices, options.meshletTriangles) };
+		WriteMesh(output, mesh, meshlets);
+
+		// Vertex and index memory per vertex, the source layout is Vertex with 32-bit indices
+		const std::size_t indexSize{ mesh.vertices.size() > 0xFFFF ? sizeof(std::uint32_t) : sizeof(std::uint16_t) };
+		const double sourceBytes{ static_cast<double>(inputVertices * sizeof(Vertex) + mesh.indices.size() * sizeof(std::uint32_t)) };
+		const double cookedBytes{ static_cast<double>(mesh.vertices.size() * sizeof(MeshVertex) + mesh.indices.size() * indexSize) };
+
+		std::printf(u8"%s: %zu vertices, %zu triangles, %zu meshlets in %.3f s\n"
+					u8"  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n"
+					u8"  vertex %zu -> %zu bytes, %.1f -> %.1f bytes per vertex with indices\n",
+					output.c_str(), mesh.vertices.size(), mesh.indices.size() / 3, meshlets.meshlets.size(),
+					Clock::ToSeconds(Clock::Now() - start), before.acmr, after.acmr, before.atvr, after.atvr,
+					sizeof(Vertex), sizeof(MeshVertex), sourceBytes / static_cast<double>(inputVertices),
+					cookedBytes / static_cast<double>(mesh.vertices.size()));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		Usage();
+		return 2;
+	}
+
+	const std::string command{ argv[1] };
+	TextureOptions texture;
+	MeshOptions mesh;
+	std::size_t threads{ 0 };
+	std::vector<std::string> positional;
+
+	try
+	{
+		for (int i{ 2 }; i < argc; ++i)
+		{
+			const std::string arg{ argv[i] };
+			const bool hasValue{ i + 1 < argc };
+			if (arg == u8"--format" && hasValue)
+			{
+				const std::string value{ argv[++i] };
+				if (value == u8"bc1") texture.format = BlockFormat::BC1;
+				else if (value == u8"bc3") texture.format = BlockFormat::BC3;
+				else if (value == u8"bc7") texture.format = BlockFormat::BC7;
+				else
+				{
+					Usage();
+					return 2;
+				}
+			}
+			else if (arg == u8"--filter" && hasValue)
+			{
+				const std::string value{ argv[++i] };
+				if (value == u8"box") texture.filter = MipFilter::Box;
+				else if (value == u8"kaiser") texture.filter = MipFilter::Kaiser;
+				else
+				{
+					Usage();
+					return 2;
+				}
+			}
+			else if (arg == u8"--linear") texture.srgb = false;
+			else if (arg == u8"--no-mips") texture.mips = false;
+			else if (arg == u8"--meshlet-vertices" && hasValue) mesh.meshletVertices = static_cast<std::size_t>(std::stoul(argv[++i]));
+			else if (arg == u8"--meshlet-triangles" && hasValue) mesh.meshletTriangles = static_cast<std::size_t>(std::stoul(argv[++i]));
+			else if (arg == u8"--threads" && hasValue) threads = static_cast<std::size_t>(std::stoul(argv[++i]));
+			else if (arg.rfind(u8"--", 0) != 0) positional.push_back(arg);
+			else
+			{
+				Usage();
+				return 2;
+			}
+		}
+
+		if ((command != u8"texture" && command != u8"mesh") || positional.size() != 2 ||
+			mesh.meshletVertices < 3 || mesh.meshletVertices > 255 || mesh.meshletTriangles == 0)
+		{
+			Usage();
+			return 2;
+		}
+
+		Clock::EnableTSC();
+		if (command == u8"mesh")
+			CookMesh(positional[0], positional[1], mesh);
+		else
+		{
+			JobSystem jobs{ threads };
+			CookTexture(positional[0], positional[1], texture, jobs);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, u8"%s\n", e.what());
+		return 2;
+	}
+
+	return 0;
+}
@@ -1,5 +1,4 @@
 #include "../sisskey/Engine.h"
-#include "../sisskey/Window.h"
 
 #include <string>
 #include <sstream>
@@ -71,8 +70,7 @@ int WINAPI WinMain(_In_ HINSTANCE, _In_opt_ HINSTANCE, _In_ LPSTR lpCmdLine, _In
 	engine.LoadSettings(std::filesystem::current_path() / u8"settings.json");
 	engine.Initialize();
 
-	auto w = sisskey::Window::Create();
-	while (w->ProcessMessages() != sisskey::Window::PMResult::Quit);
+	engine.Run([](float dt) {}, [](float alpha) {});
 	
 	return 0;
 }
\ No newline at end of file
@@ -1,5 +1,4 @@
 #include "../sisskey/Engine.h"
-#include "../sisskey/Window.h"
 
 #include <string>
 #include <sstream>
@@ -19,8 +18,7 @@ int main(int argc, char** argv)
 	engine.LoadSettings(std::filesystem::current_path() / u8"settings.json");
 	engine.Initialize();
 
-	auto w = sisskey::Window::Create();
-	while (w->ProcessMessages() != sisskey::Window::PMResult::Quit);
+	engine.Run([](float dt) {}, [](float alpha) {});
 
 	return 0;
 }
\ No newline at end of file
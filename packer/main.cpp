@@ -0,0 +1,172 @@
+#include "../sisskey/AssetArchive.h"
+#include "../sisskey/Compression.h"
+
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <exception>
+
+using namespace sisskey;
+
+namespace
+{
+	void Usage()
+	{
+		std::printf(u8"sisskey_packer [options] <directory> <archive>\n"
+					u8"  --compress            LZ4 compress assets that shrink by at least 1/8\n"
+					u8"  --align <n>           alignment of asset data, a power of two (default 64)\n"
+					u8"  --verbose             print every packed asset\n"
+					u8"Asset IDs are hashes of paths relative to <directory> with '/' separators.\n");
+	}
+
+	struct Asset
+	{
+		std::string path;
+		ArchiveEntry entry{};
+		std::vector<std::byte> data;
+	};
+
+	[[nodiscard]] std::vector<std::byte> ReadFile(const std::filesystem::path& path)
+	{
+		std::ifstream file{ path, std::ios::binary };
+		if (!file)
+			throw std::runtime_error{ u8"Failed to open " + path.u8string() };
+
+		std::vector<std::byte> data(static_cast<std::size_t>(std::filesystem::file_size(path)));
+		if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size())))
+			throw std::runtime_error{ u8"Failed to read " + path.u8string() };
+		return data;
+	}
+
+	void Pad(std::ofstream& file, std::uint64_t& offset, std::uint64_t alignment)
+	{
+		static constexpr char zeros[256]{};
+		for (std::uint64_t padding{ (alignment - offset % alignment) % alignment }; padding > 0;)
+		{
+			const std::uint64_t count{ std::min<std::uint64_t>(padding, sizeof(zeros)) };
+			file.write(zeros, static_cast<std::streamsize>(count));
+			padding -= count;
+			offset += count;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool compress{ false };
+	bool verbose{ false };
+	std::uint32_t alignment{ 64 };
+	std::vector<std::string> positional;
+
+	try
+	{
+		for (int i{ 1 }; i < argc; ++i)
+		{
+			const std::string arg{ argv[i] };
+			if (arg == u8"--compress") compress = true;
+			else if (arg == u8"--verbose") verbose = true;
+			else if (arg == u8"--align" && i + 1 < argc) alignment = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+			else if (arg.rfind(u8"--", 0) != 0) positional.push_back(arg);
+			else
+			{
+				Usage();
+				return 2;
+			}
+		}
+
+		if (positional.size() != 2 || alignment < alignof(ArchiveEntry) || (alignment & (alignment - 1)))
+		{
+			Usage();
+			return 2;
+		}
+
+		const std::filesystem::path root{ positional[0] };
+		const std::filesystem::path output{ positional[1] };
+
+		std::vector<Asset> assets;
+		for (const auto& file : std::filesystem::recursive_directory_iterator{ root })
+		{
+			if (!file.is_regular_file())
+				continue;
+			// Don't pack an earlier build of the archive itself
+			if (std::filesystem::exists(output) && std::filesystem::equivalent(file.path(), output))
+				continue;
+
+			Asset asset;
+			asset.path = std::filesystem::relative(file.path(), root).generic_u8string();
+			asset.entry.id = MakeAssetID(asset.path);
+			asset.data = ReadFile(file.path());
+			asset.entry.size = asset.data.size();
+
+			if (compress && !asset.data.empty())
+			{
+				std::vector<std::byte> compressed(LZ4CompressBound(asset.data.size()));
+				const std::size_t size{ LZ4Compress(asset.data, compressed) };
+				if (size <= asset.data.size() - asset.data.size() / 8)
+				{
+					compressed.resize(size);
+					asset.data = std::move(compressed);
+					asset.entry.flags |= ArchiveEntry::Compressed;
+				}
+			}
+			asset.entry.storedSize = asset.data.size();
+			assets.push_back(std::move(asset));
+		}
+
+		std::sort(assets.begin(), assets.end(), [](const Asset& a, const Asset& b) { return a.entry.id < b.entry.id; });
+		const auto collision = std::adjacent_find(assets.begin(), assets.end(), [](const Asset& a, const Asset& b) { return a.entry.id == b.entry.id; });
+		if (collision != assets.end())
+			throw std::runtime_error{ u8"Asset ID collision: " + collision->path + u8" and " + std::next(collision)->path };
+
+		// Blobs follow the entry table in the same order
+		const ArchiveHeader header{ ArchiveHeader::Magic, ArchiveHeader::CurrentVersion, static_cast<std::uint32_t>(assets.size()), alignment };
+		std::uint64_t offset{ sizeof(ArchiveHeader) + sizeof(ArchiveEntry) * assets.size() };
+		for (Asset& asset : assets)
+		{
+			offset = (offset + alignment - 1) & ~static_cast<std::uint64_t>(alignment - 1);
+			asset.entry.offset = offset;
+			offset += asset.entry.storedSize;
+		}
+
+		std::ofstream file{ output, std::ios::binary | std::ios::trunc };
+		if (!file)
+			throw std::runtime_error{ u8"Failed to open " + output.u8string() };
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		for (const Asset& asset : assets)
+			file.write(reinterpret_cast<const char*>(&asset.entry), sizeof(asset.entry));
+
+		std::uint64_t stored{ 0 }, original{ 0 };
+		offset = sizeof(ArchiveHeader) + sizeof(ArchiveEntry) * assets.size();
+		for (const Asset& asset : assets)
+		{
+			Pad(file, offset, alignment);
+			file.write(reinterpret_cast<const char*>(asset.data.data()), static_cast<std::streamsize>(asset.data.size()));
+			offset += asset.data.size();
+			stored += asset.entry.storedSize;
+			original += asset.entry.size;
+
+			if (verbose)
+				std::printf(u8"%016llx %12llu %12llu %s\n", static_cast<unsigned long long>(asset.entry.id),
+							static_cast<unsigned long long>(asset.entry.size), static_cast<unsigned long long>(asset.entry.storedSize), asset.path.c_str());
+		}
+		if (!file.flush())
+			throw std::runtime_error{ u8"Failed to write " + output.u8string() };
+
+		std::printf(u8"%zu assets, %llu bytes packed into %llu, archive %llu bytes\n", assets.size(),
+					static_cast<unsigned long long>(original), static_cast<unsigned long long>(stored), static_cast<unsigned long long>(offset));
+	}
+	catch (const std::exception& e)
+	{
+		std::fprintf(stderr, u8"%s\n", e.what());
+		return 2;
+	}
+
+	return 0;
+}
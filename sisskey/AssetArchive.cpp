@@ -0,0 +1,69 @@
+#include "AssetArchive.h"
+#include "Compression.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+namespace sisskey
+{
+	AssetArchive::AssetArchive(const std::filesystem::path& path) : m_File{ path, MappedFile::Mode::ReadOnly }
+	{
+		ArchiveHeader header;
+		if (m_File.Size() < sizeof(header))
+			throw std::runtime_error{ u8"Archive is too small" };
+		std::memcpy(&header, m_File.Data(), sizeof(header));
+
+		if (header.magic != ArchiveHeader::Magic)
+			throw std::runtime_error{ u8"Not an asset archive" };
+		if (header.version != ArchiveHeader::CurrentVersion)
+			throw std::runtime_error{ u8"Unsupported archive version" };
+		if (header.alignment < alignof(ArchiveEntry) || (header.alignment & (header.alignment - 1)))
+			throw std::runtime_error{ u8"Invalid archive alignment" };
+
+		const std::uint64_t fileSize{ m_File.Size() };
+		if (header.count > (fileSize - sizeof(header)) / sizeof(ArchiveEntry))
+			throw std::runtime_error{ u8"Archive entry table is truncated" };
+
+		// The mapping is page aligned, so the table right after the header is aligned too
+		m_Entries = { reinterpret_cast<const ArchiveEntry*>(m_File.Data() + sizeof(header)), header.count };
+
+		// Validated once here, lookups trust the table afterwards
+		for (std::size_t i{}; i < m_Entries.Size(); ++i)
+		{
+			const ArchiveEntry& entry{ m_Entries[i] };
+			if (i > 0 && m_Entries[i - 1].id >= entry.id)
+				throw std::runtime_error{ u8"Archive entries are not sorted" };
+			if (entry.offset % header.alignment || entry.offset > fileSize || entry.storedSize > fileSize - entry.offset)
+				throw std::runtime_error{ u8"Archive entry is out of bounds" };
+			if (!(entry.flags & ArchiveEntry::Compressed) && entry.storedSize != entry.size)
+				throw std::runtime_error{ u8"Archive entry size mismatch" };
+		}
+	}
+
+	const ArchiveEntry* AssetArchive::Find(AssetID id) const noexcept
+	{
+		const ArchiveEntry* it = std::lower_bound(m_Entries.begin(), m_Entries.end(), id,
+												  [](const ArchiveEntry& entry, AssetID id) { return entry.id < id; });
+		return it != m_Entries.end() && it->id == id ? it : nullptr;
+	}
+
+	Span<const std::byte> AssetArchive::View(AssetID id) const noexcept
+	{
+		const ArchiveEntry* entry = Find(id);
+		if (!entry || (entry->flags & ArchiveEntry::Compressed))
+			return {};
+		return Stored(*entry);
+	}
+
+	bool AssetArchive::Read(const ArchiveEntry& entry, Span<std::byte> out) const noexcept
+	{
+		if (out.Size() != entry.size)
+			return false;
+		if (entry.flags & ArchiveEntry::Compressed)
+			return LZ4Decompress(Stored(entry), out);
+		if (!out.Empty())
+			std::memcpy(out.Data(), Stored(entry).Data(), out.Size());
+		return true;
+	}
+}
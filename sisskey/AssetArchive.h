@@ -0,0 +1,78 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Span.h"
+#include "Hash.h"
+
+#include <filesystem>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Assets are identified by the hash of their path relative to the packed directory,
+	// with '/' as the separator, e.g. AssetID("textures/stone.dds")
+	using AssetID = std::uint64_t;
+
+	[[nodiscard]] constexpr AssetID MakeAssetID(std::string_view path) noexcept { return HashName(path); }
+
+	// Archive layout, little endian:
+	// ArchiveHeader, ArchiveEntry[count] sorted by id, blobs aligned to header.alignment
+	struct ArchiveHeader
+	{
+		static constexpr std::uint32_t Magic{ 0x41504b53 }; // "SKPA"
+		static constexpr std::uint32_t CurrentVersion{ 1 };
+
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t count;
+		std::uint32_t alignment;
+	};
+
+	struct ArchiveEntry
+	{
+		static constexpr std::uint32_t Compressed{ 1 << 0 }; // LZ4 block
+
+		AssetID id;
+		std::uint64_t offset; // from the beginning of the archive
+		std::uint64_t storedSize;
+		std::uint64_t size; // after decompression
+		std::uint32_t flags;
+		std::uint32_t reserved;
+	};
+
+	static_assert(sizeof(ArchiveHeader) == 16 && sizeof(ArchiveEntry) == 40, "Archive structures are written as is");
+
+	// Memory-mapped packed archive. Pages are loaded by the OS on first access,
+	// uncompressed assets are views into the mapping and live as long as the archive.
+	class AssetArchive
+	{
+	private:
+		MappedFile m_File;
+		Span<const ArchiveEntry> m_Entries;
+
+	public:
+		AssetArchive() = default;
+		// Throws if the file can't be mapped or is not a valid archive
+		explicit AssetArchive(const std::filesystem::path& path);
+
+		// Binary search in the entry table, nullptr if the asset is missing
+		[[nodiscard]] const ArchiveEntry* Find(AssetID id) const noexcept;
+		[[nodiscard]] bool Contains(AssetID id) const noexcept { return Find(id) != nullptr; }
+
+		// Stored bytes of the entry without copies, still compressed if the entry is
+		[[nodiscard]] Span<const std::byte> Stored(const ArchiveEntry& entry) const noexcept
+		{
+			return { reinterpret_cast<const std::byte*>(m_File.Data()) + entry.offset, static_cast<std::size_t>(entry.storedSize) };
+		}
+
+		// Contents of an uncompressed asset without copies, empty if the asset is missing or compressed
+		[[nodiscard]] Span<const std::byte> View(AssetID id) const noexcept;
+		// Copies or decompresses an asset into out of exactly entry.size bytes, false if the data is malformed
+		[[nodiscard]] bool Read(const ArchiveEntry& entry, Span<std::byte> out) const noexcept;
+
+		[[nodiscard]] Span<const ArchiveEntry> Entries() const noexcept { return m_Entries; }
+		[[nodiscard]] std::size_t Count() const noexcept { return m_Entries.Size(); }
+	};
+}
@@ -0,0 +1,547 @@
+#include "AsyncIO.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <cstring>
+#include <cassert>
+
+#ifdef _WIN64
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace sisskey
+{
+	namespace
+	{
+		// Larger reads are split, io_uring lengths are 32-bit
+		constexpr std::size_t MaxReadSize{ 1 << 30 };
+	}
+
+	AsyncFile::AsyncFile(const std::filesystem::path& path)
+	{
+#ifdef _WIN64
+		m_Handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (m_Handle == INVALID_HANDLE_VALUE)
+		{
+			m_Handle = nullptr;
+			throw std::runtime_error{ u8"Failed to open file" };
+		}
+#else
+		m_Handle = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (m_Handle == -1)
+			throw std::runtime_error{ u8"Failed to open file" };
+#endif
+	}
+
+	AsyncFile::~AsyncFile()
+	{
+		Close();
+	}
+
+	AsyncFile::AsyncFile(AsyncFile&& other) noexcept : m_Handle{ std::exchange(other.m_Handle, AsyncFile{}.m_Handle) }
+	{
+	}
+
+	AsyncFile& AsyncFile::operator=(AsyncFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+			m_Handle = std::exchange(other.m_Handle, AsyncFile{}.m_Handle);
+		}
+		return *this;
+	}
+
+	void AsyncFile::Close() noexcept
+	{
+#ifdef _WIN64
+		if (m_Handle)
+			CloseHandle(m_Handle);
+		m_Handle = nullptr;
+#else
+		if (m_Handle != -1)
+			close(m_Handle);
+		m_Handle = -1;
+#endif
+	}
+
+	std::uint64_t AsyncFile::Size() const
+	{
+#ifdef _WIN64
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_Handle, &size))
+			throw std::runtime_error{ u8"Failed to get file size" };
+		return static_cast<std::uint64_t>(size.QuadPart);
+#else
+		struct stat st;
+		if (fstat(m_Handle, &st) == -1)
+			throw std::runtime_error{ u8"Failed to get file size" };
+		return static_cast<std::uint64_t>(st.st_size);
+#endif
+	}
+
+	AsyncIO::AsyncIO(Backend backend, std::size_t queueDepth, std::size_t threads, std::function<void()> notify) :
+		m_Notify{ std::move(notify) },
+		m_QueueDepth{ std::max<std::size_t>(queueDepth, 1) }
+	{
+#ifdef __linux__
+		if (backend == Backend::Auto && SetupRing())
+		{
+			m_Threads.emplace_back(&AsyncIO::RingMain, this);
+			return;
+		}
+#else
+		(void)backend;
+#endif
+		// Every worker has a single read in flight
+		threads = std::clamp<std::size_t>(threads, 1, m_QueueDepth);
+		for (std::size_t i{}; i < threads; ++i)
+			m_Threads.emplace_back(&AsyncIO::WorkerMain, this);
+	}
+
+	AsyncIO::~AsyncIO()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_Running = false;
+			for (auto& queue : m_Queues)
+			{
+				for (RequestID id : queue)
+					m_Requests.erase(id);
+				queue.clear();
+			}
+		}
+		m_Condition.notify_all();
+#ifdef __linux__
+		if (UsesIoUring())
+			WakeRing();
+#endif
+
+		for (auto& thread : m_Threads)
+			thread.join();
+#ifdef __linux__
+		DestroyRing();
+#endif
+	}
+
+	bool AsyncIO::UsesIoUring() const noexcept
+	{
+#ifdef __linux__
+		return m_Ring.fd != -1;
+#else
+		return false;
+#endif
+	}
+
+	AsyncIO::RequestID AsyncIO::Submit(Request request)
+	{
+		assert(request.file && request.buffer && request.priority < Priority::Count);
+
+		RequestID id;
+		{
+			std::lock_guard lock{ m_Mutex };
+			id = m_NextID++;
+			const Priority priority{ request.priority };
+			m_Requests.emplace(id, Pending{ id, std::move(request) });
+			m_Queues[static_cast<std::size_t>(priority)].push_back(id);
+		}
+
+#ifdef __linux__
+		if (UsesIoUring())
+		{
+			WakeRing();
+			return id;
+		}
+#endif
+		m_Condition.notify_one();
+		return id;
+	}
+
+	bool AsyncIO::Cancel(RequestID id)
+	{
+		bool queued;
+		{
+			std::lock_guard lock{ m_Mutex };
+			auto it = m_Requests.find(id);
+			if (it == m_Requests.end())
+				return false;
+
+			Pending& pending = it->second;
+			queued = !pending.inFlight;
+			if (queued)
+			{
+				auto& queue = m_Queues[static_cast<std::size_t>(pending.request.priority)];
+				queue.erase(std::find(queue.begin(), queue.end(), id));
+				Complete(pending, Status::Cancelled, 0);
+			}
+			// Without io_uring the read can't be interrupted, its result is discarded
+			else if (!std::exchange(pending.cancelled, true) && UsesIoUring())
+				m_Cancels.push_back(id);
+		}
+
+		if (queued && m_Notify)
+			m_Notify();
+#ifdef __linux__
+		else if (!queued && UsesIoUring())
+			WakeRing();
+#endif
+		return true;
+	}
+
+	std::size_t AsyncIO::ProcessCompletions(JobSystem& jobs)
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_Processing.swap(m_Completions);
+		}
+
+		bool anyJobs{ false };
+		for (Completion& completion : m_Processing)
+		{
+			if (completion.delivery == Delivery::MainThread)
+				completion.callback(completion.result);
+			else anyJobs = true;
+		}
+
+		if (anyJobs)
+		{
+			jobs.ParallelFor(0, m_Processing.size(), [this](std::size_t first, std::size_t last)
+			{
+				for (std::size_t i{ first }; i < last; ++i)
+				{
+					if (m_Processing[i].delivery == Delivery::Job)
+						m_Processing[i].callback(m_Processing[i].result);
+				}
+			});
+		}
+
+		const std::size_t count{ m_Processing.size() };
+		m_Processing.clear();
+		return count;
+	}
+
+	AsyncIO::Pending* AsyncIO::Dequeue() noexcept
+	{
+		for (auto& queue : m_Queues)
+		{
+			if (!queue.empty())
+			{
+				Pending* pending = &m_Requests.at(queue.front());
+				queue.pop_front();
+				return pending;
+			}
+		}
+		return nullptr;
+	}
+
+	void AsyncIO::Complete(Pending& pending, Status status, int error)
+	{
+		if (pending.cancelled)
+			status = Status::Cancelled;
+		if (pending.request.callback)
+		{
+			m_Completions.push_back({ std::move(pending.request.callback),
+									  { pending.id, status, pending.request.buffer, pending.done, error },
+									  pending.request.delivery });
+		}
+		m_Requests.erase(pending.id);
+	}
+
+	void AsyncIO::WorkerMain() noexcept
+	{
+		SISSKEY_PROFILE_THREAD(u8"IO");
+
+		for (;;)
+		{
+			Pending* pending;
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_Condition.wait(lock, [this]()
+				{
+					return !m_Running || std::any_of(m_Queues.begin(), m_Queues.end(), [](const auto& queue) { return !queue.empty(); });
+				});
+				// Queued requests are dropped on shutdown
+				if (!m_Running)
+					break;
+
+				pending = Dequeue();
+				pending->inFlight = true;
+				++m_InFlight;
+			}
+
+			const Request& request = pending->request;
+			int error{ 0 };
+			while (pending->done < request.size)
+			{
+				const std::size_t size{ std::min(request.size - pending->done, MaxReadSize) };
+				const std::uint64_t offset{ request.offset + pending->done };
+				std::byte* buffer = static_cast<std::byte*>(request.buffer) + pending->done;
+#ifdef _WIN64
+				OVERLAPPED overlapped{};
+				overlapped.Offset = static_cast<DWORD>(offset);
+				overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+				DWORD read;
+				if (!ReadFile(request.file->NativeHandle(), buffer, static_cast<DWORD>(size), &read, &overlapped))
+				{
+					if (GetLastError() != ERROR_HANDLE_EOF)
+						error = static_cast<int>(GetLastError());
+					break;
+				}
+#else
+				const ssize_t read{ pread(request.file->NativeHandle(), buffer, size, static_cast<off_t>(offset)) };
+				if (read == -1)
+				{
+					if (errno == EINTR)
+						continue;
+					error = errno;
+					break;
+				}
+#endif
+				if (read == 0)
+					break;
+				pending->done += static_cast<std::size_t>(read);
+			}
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				--m_InFlight;
+				Complete(*pending, error ? Status::Error : Status::Ok, error);
+			}
+			if (m_Notify)
+				m_Notify();
+		}
+	}
+
+#ifdef __linux__
+	// Raw system calls, liburing isn't required
+	// https://kernel.dk/io_uring.pdf
+	bool AsyncIO::SetupRing() noexcept
+	{
+		io_uring_params params{};
+		// Reads in flight, the wake read and cancellations, rounded up to a power of two by the kernel
+		const int fd{ static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(m_QueueDepth + 32), &params)) };
+		if (fd < 0)
+			return false;
+		m_Ring.fd = fd;
+
+		// IORING_OP_READ needs 5.6, the same release added IORING_FEAT_RW_CUR_POS
+		if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_RW_CUR_POS))
+		{
+			DestroyRing();
+			return false;
+		}
+
+		m_Ring.ringSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+								   params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+		m_Ring.sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		void* ring{ mmap(nullptr, m_Ring.ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING) };
+		void* sqes{ mmap(nullptr, m_Ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES) };
+		m_Ring.ring = ring == MAP_FAILED ? nullptr : ring;
+		m_Ring.sqes = sqes == MAP_FAILED ? nullptr : sqes;
+		m_Ring.wakeFd = eventfd(0, EFD_CLOEXEC);
+		if (!m_Ring.ring || !m_Ring.sqes || m_Ring.wakeFd == -1)
+		{
+			DestroyRing();
+			return false;
+		}
+
+		char* base = static_cast<char*>(m_Ring.ring);
+		m_Ring.sqHead = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+		m_Ring.sqTail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+		m_Ring.sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+		m_Ring.sqMask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+		m_Ring.cqHead = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+		m_Ring.cqTail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+		m_Ring.cqMask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+		m_Ring.cqes = base + params.cq_off.cqes;
+		m_Ring.entries = params.sq_entries;
+		return true;
+	}
+
+	void AsyncIO::DestroyRing() noexcept
+	{
+		if (m_Ring.sqes)
+			munmap(m_Ring.sqes, m_Ring.sqesSize);
+		if (m_Ring.ring)
+			munmap(m_Ring.ring, m_Ring.ringSize);
+		if (m_Ring.wakeFd != -1)
+			close(m_Ring.wakeFd);
+		if (m_Ring.fd != -1)
+			close(m_Ring.fd);
+		m_Ring = Ring{};
+	}
+
+	void AsyncIO::WakeRing() noexcept
+	{
+		eventfd_write(m_Ring.wakeFd, 1);
+	}
+
+	void AsyncIO::RingMain() noexcept
+	{
+		SISSKEY_PROFILE_THREAD(u8"IO");
+
+		io_uring_sqe* const sqes = static_cast<io_uring_sqe*>(m_Ring.sqes);
+		const io_uring_cqe* const cqes = static_cast<const io_uring_cqe*>(m_Ring.cqes);
+		// Only this thread writes the submission tail
+		unsigned tail{ *m_Ring.sqTail };
+		unsigned unsubmitted{ 0 };
+
+		// nullptr while the submission ring is full
+		auto nextSqe = [&]() -> io_uring_sqe*
+		{
+			if (tail - __atomic_load_n(m_Ring.sqHead, __ATOMIC_ACQUIRE) >= m_Ring.entries)
+				return nullptr;
+			const unsigned index{ tail & m_Ring.sqMask };
+			io_uring_sqe* sqe = &sqes[index];
+			std::memset(sqe, 0, sizeof(*sqe));
+			m_Ring.sqArray[index] = index;
+			++tail;
+			++unsubmitted;
+			return sqe;
+		};
+
+		auto prepareRead = [&](Pending* pending) -> bool
+		{
+			io_uring_sqe* sqe = nextSqe();
+			if (!sqe)
+				return false;
+			const Request& request = pending->request;
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = request.file->NativeHandle();
+			sqe->off = request.offset + pending->done;
+			sqe->addr = reinterpret_cast<std::uintptr_t>(static_cast<std::byte*>(request.buffer) + pending->done);
+			sqe->len = static_cast<unsigned>(std::min(request.size - pending->done, MaxReadSize));
+			sqe->user_data = reinterpret_cast<std::uintptr_t>(pending);
+			return true;
+		};
+
+		bool wakeArmed{ false };
+		std::vector<Pending*> resubmit;
+		std::vector<std::pair<Pending*, int>> finished;
+
+		for (;;)
+		{
+			if (!wakeArmed)
+			{
+				if (io_uring_sqe* sqe = nextSqe())
+				{
+					sqe->opcode = IORING_OP_READ;
+					sqe->fd = m_Ring.wakeFd;
+					sqe->addr = reinterpret_cast<std::uintptr_t>(&m_Ring.wakeValue);
+					sqe->len = sizeof(m_Ring.wakeValue);
+					sqe->user_data = WakeTag;
+					wakeArmed = true;
+				}
+			}
+
+			// Short reads continue where they stopped
+			resubmit.erase(std::remove_if(resubmit.begin(), resubmit.end(), prepareRead), resubmit.end());
+
+			{
+				std::lock_guard lock{ m_Mutex };
+				if (!m_Running && m_InFlight == 0)
+					break;
+
+				// Addresses of requests that completed in the meantime are no longer in the map
+				std::size_t cancelled{ 0 };
+				for (; cancelled < m_Cancels.size(); ++cancelled)
+				{
+					auto it = m_Requests.find(m_Cancels[cancelled]);
+					if (it == m_Requests.end())
+						continue;
+					io_uring_sqe* sqe = nextSqe();
+					if (!sqe)
+						break;
+					sqe->opcode = IORING_OP_ASYNC_CANCEL;
+					sqe->fd = -1;
+					sqe->addr = reinterpret_cast<std::uintptr_t>(&it->second);
+					sqe->user_data = CancelTag;
+				}
+				m_Cancels.erase(m_Cancels.begin(), m_Cancels.begin() + cancelled);
+
+				// The batch of requests queued since the last submission, most important first
+				while (m_Running && m_InFlight < m_QueueDepth)
+				{
+					Pending* pending = Dequeue();
+					if (!pending)
+						break;
+					if (!prepareRead(pending))
+					{
+						m_Queues[static_cast<std::size_t>(pending->request.priority)].push_front(pending->id);
+						break;
+					}
+					pending->inFlight = true;
+					++m_InFlight;
+				}
+			}
+
+			// The wake read is always pending, so this doesn't block past the next Submit
+			__atomic_store_n(m_Ring.sqTail, tail, __ATOMIC_RELEASE);
+			const long submitted{ syscall(__NR_io_uring_enter, m_Ring.fd, unsubmitted, 1u, IORING_ENTER_GETEVENTS, nullptr, 0) };
+			if (submitted > 0)
+				unsubmitted -= static_cast<unsigned>(submitted);
+			else if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+				std::this_thread::yield();
+
+			unsigned head{ *m_Ring.cqHead };
+			const unsigned cqTail{ __atomic_load_n(m_Ring.cqTail, __ATOMIC_ACQUIRE) };
+			for (; head != cqTail; ++head)
+			{
+				const io_uring_cqe& cqe = cqes[head & m_Ring.cqMask];
+				if (cqe.user_data == WakeTag)
+					wakeArmed = false;
+				else if (cqe.user_data != CancelTag)
+					finished.emplace_back(reinterpret_cast<Pending*>(static_cast<std::uintptr_t>(cqe.user_data)), cqe.res);
+			}
+			__atomic_store_n(m_Ring.cqHead, head, __ATOMIC_RELEASE);
+
+			if (finished.empty())
+				continue;
+
+			std::size_t completed{ 0 };
+			{
+				std::lock_guard lock{ m_Mutex };
+				for (auto [pending, res] : finished)
+				{
+					if (res > 0)
+					{
+						pending->done += static_cast<std::size_t>(res);
+						if (pending->done < pending->request.size && !pending->cancelled)
+						{
+							resubmit.push_back(pending);
+							continue;
+						}
+					}
+					// A cancel that targeted a completed request may hit a new one at the same address
+					else if (res < 0 && !pending->cancelled && (res == -EINTR || res == -EAGAIN || res == -ECANCELED))
+					{
+						resubmit.push_back(pending);
+						continue;
+					}
+
+					--m_InFlight;
+					Complete(*pending, res < 0 ? Status::Error : Status::Ok, res < 0 ? -res : 0);
+					++completed;
+				}
+			}
+			finished.clear();
+			if (completed && m_Notify)
+				m_Notify();
+		}
+	}
+#endif
+}
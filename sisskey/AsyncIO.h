@@ -0,0 +1,175 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <unordered_map>
+#include <array>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	class JobSystem;
+
+	// File opened for asynchronous reads, must outlive the requests that read it
+	class AsyncFile
+	{
+	private:
+#ifdef _WIN64
+		void* m_Handle{ nullptr };
+#else
+		int m_Handle{ -1 };
+#endif
+
+		void Close() noexcept;
+
+	public:
+		AsyncFile() = default;
+		explicit AsyncFile(const std::filesystem::path& path);
+		~AsyncFile();
+		AsyncFile(AsyncFile&& other) noexcept;
+		AsyncFile& operator=(AsyncFile&& other) noexcept;
+		AsyncFile(const AsyncFile&) = delete;
+		AsyncFile& operator=(const AsyncFile&) = delete;
+
+		[[nodiscard]] std::uint64_t Size() const;
+#ifdef _WIN64
+		[[nodiscard]] void* NativeHandle() const noexcept { return m_Handle; }
+#else
+		[[nodiscard]] int NativeHandle() const noexcept { return m_Handle; }
+#endif
+	};
+
+	// Asynchronous file reads for streaming, e.g. assets at ArchiveEntry offsets of a packed archive.
+	// On Linux requests are batched into io_uring submissions by a single I/O thread,
+	// elsewhere or when io_uring isn't available a few threads read with pread.
+	// At most queueDepth reads are in flight, the rest wait in per-priority queues,
+	// so a burst of prefetches doesn't delay reads of visible assets.
+	// Completion callbacks are called by ProcessCompletions, never by the I/O threads.
+	class AsyncIO
+	{
+	public:
+		using RequestID = std::uint64_t;
+
+		enum class Priority { Visible, Nearby, Prefetch, Count };
+		enum class Delivery { MainThread, Job };
+		enum class Backend { Auto, ThreadPool };
+		enum class Status { Ok, Error, Cancelled };
+
+		struct Result
+		{
+			RequestID id;
+			Status status;
+			void* buffer;
+			std::size_t bytesRead; // less than requested at the end of the file
+			int error; // errno or GetLastError
+		};
+
+		using Callback = std::function<void(const Result&)>;
+
+		struct Request
+		{
+			const AsyncFile* file;
+			std::uint64_t offset;
+			void* buffer; // must stay valid until the callback is called
+			std::size_t size;
+			Priority priority{ Priority::Visible };
+			Delivery delivery{ Delivery::MainThread };
+			Callback callback;
+		};
+
+	private:
+		static constexpr RequestID WakeTag{ 0 };
+		static constexpr RequestID CancelTag{ ~RequestID{ 0 } };
+
+		struct Pending
+		{
+			RequestID id;
+			Request request;
+			std::size_t done{ 0 };
+			bool inFlight{ false };
+			bool cancelled{ false };
+		};
+
+		struct Completion
+		{
+			Callback callback;
+			Result result;
+			Delivery delivery;
+		};
+
+		std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		bool m_Running{ true };
+		RequestID m_NextID{ 1 };
+		// Nodes have stable addresses, I/O threads keep pointers to in flight requests
+		std::unordered_map<RequestID, Pending> m_Requests;
+		std::array<std::deque<RequestID>, static_cast<std::size_t>(Priority::Count)> m_Queues;
+		std::vector<RequestID> m_Cancels; // in flight requests for IORING_OP_ASYNC_CANCEL
+		std::vector<Completion> m_Completions;
+		std::vector<Completion> m_Processing;
+		std::function<void()> m_Notify;
+
+		std::size_t m_QueueDepth;
+		std::size_t m_InFlight{ 0 };
+		std::vector<std::thread> m_Threads;
+
+#ifdef __linux__
+		// Rings shared with the kernel, mapped at setup
+		struct Ring
+		{
+			int fd{ -1 };
+			int wakeFd{ -1 }; // eventfd with a read always pending, written by Submit and Cancel
+			void* ring{ nullptr };
+			void* sqes{ nullptr };
+			std::size_t ringSize{ 0 };
+			std::size_t sqesSize{ 0 };
+			unsigned* sqHead{ nullptr };
+			unsigned* sqTail{ nullptr };
+			unsigned* sqArray{ nullptr };
+			unsigned* cqHead{ nullptr };
+			unsigned* cqTail{ nullptr };
+			void* cqes{ nullptr };
+			unsigned sqMask{ 0 };
+			unsigned cqMask{ 0 };
+			unsigned entries{ 0 };
+			std::uint64_t wakeValue{ 0 };
+		} m_Ring;
+
+		[[nodiscard]] bool SetupRing() noexcept;
+		void DestroyRing() noexcept;
+		void WakeRing() noexcept;
+		void RingMain() noexcept;
+#endif
+		void WorkerMain() noexcept;
+
+		// m_Mutex must be locked
+		[[nodiscard]] Pending* Dequeue() noexcept; // next queued request in priority order
+		void Complete(Pending& pending, Status status, int error); // also erases the request
+
+	public:
+		// queueDepth: reads in flight at once, threads: readers of the thread pool backend
+		// notify: called by I/O threads when completions are ready, e.g. to wake the main loop
+		AsyncIO(Backend backend = Backend::Auto, std::size_t queueDepth = 64, std::size_t threads = 2, std::function<void()> notify = {});
+		// Waits for reads in flight, callbacks of requests that didn't complete are never called
+		~AsyncIO();
+		AsyncIO(const AsyncIO&) = delete;
+		AsyncIO& operator=(const AsyncIO&) = delete;
+
+		// Any thread
+		[[nodiscard]] RequestID Submit(Request request);
+		// Queued requests are removed, reads in flight are cancelled if the kernel can,
+		// the callback is still called with Status::Cancelled. False if the request already completed.
+		bool Cancel(RequestID id);
+
+		// Main thread, once per frame. Job delivered callbacks run in parallel and are finished on return.
+		std::size_t ProcessCompletions(JobSystem& jobs);
+
+		[[nodiscard]] bool UsesIoUring() const noexcept;
+	};
+}
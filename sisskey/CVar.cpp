@@ -0,0 +1,218 @@
+#include "CVar.h"
+
+#include <array>
+#include <mutex>
+#include <charconv>
+#include <stdexcept>
+#include <cmath>
+
+namespace sisskey
+{
+	namespace
+	{
+		struct Slot
+		{
+			// 0 - empty, entries are never removed, unregistered variables leave a null pointer
+			std::atomic<std::uint64_t> hash{ 0 };
+			std::atomic<CVarBase*> cvar{ nullptr };
+		};
+
+		struct State
+		{
+			std::array<Slot, CVars::Capacity> slots;
+			std::mutex mutex; // guards registration and the queue
+			std::vector<CVarBase*> queue;
+			std::vector<CVarBase*> processing;
+		};
+
+		State& GetState()
+		{
+			static State state;
+			return state;
+		}
+
+		[[nodiscard]] std::uint64_t SlotHash(std::uint64_t hash) noexcept
+		{
+			return hash ? hash : 1;
+		}
+
+		[[nodiscard]] bool ParseBool(std::string_view s, bool& value) noexcept
+		{
+			if (s == u8"1" || s == u8"true" || s == u8"on")
+				value = true;
+			else if (s == u8"0" || s == u8"false" || s == u8"off")
+				value = false;
+			else
+				return false;
+			return true;
+		}
+	}
+
+	CVarBase::CVarBase(const char* name, std::uint64_t hash, const char* description, CVarType type) :
+		m_Name{ name }, m_Description{ description }, m_Hash{ hash }, m_Type{ type }
+	{
+		CVars::Register(*this);
+	}
+
+	CVarBase::~CVarBase()
+	{
+		CVars::Unregister(*this);
+	}
+
+	void CVarBase::Changed()
+	{
+		if (!m_Queued.exchange(true, std::memory_order_acq_rel))
+			CVars::Queue(*this);
+	}
+
+	template<typename T>
+	bool CVar<T>::Set(double value)
+	{
+		if (std::isnan(value))
+			return false;
+		if constexpr (std::is_same_v<T, bool>)
+			Set(value != 0.0);
+		else if constexpr (std::is_same_v<T, int>)
+			Set(static_cast<int>(std::clamp(std::round(value), static_cast<double>(m_Min), static_cast<double>(m_Max))));
+		else
+			Set(static_cast<float>(value));
+		return true;
+	}
+
+	template<typename T>
+	bool CVar<T>::SetFromString(std::string_view value)
+	{
+		T parsed{};
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			if (!ParseBool(value, parsed))
+				return false;
+		}
+		else
+		{
+			const auto result = std::from_chars(value.data(), value.data() + value.size(), parsed);
+			if (result.ec != std::errc{} || result.ptr != value.data() + value.size())
+				return false;
+		}
+		Set(parsed);
+		return true;
+	}
+
+	template<typename T>
+	std::string CVar<T>::ToString() const
+	{
+		if constexpr (std::is_same_v<T, bool>)
+			return Get() ? u8"true" : u8"false";
+		else
+			return std::to_string(Get());
+	}
+
+	template class CVar<bool>;
+	template class CVar<int>;
+	template class CVar<float>;
+
+	void CVars::Register(CVarBase& cvar)
+	{
+		State& state = GetState();
+		std::lock_guard<std::mutex> lock{ state.mutex };
+
+		const std::uint64_t hash{ SlotHash(cvar.m_Hash) };
+		for (std::size_t i{ hash & (Capacity - 1) }, probes{}; probes < Capacity; i = (i + 1) & (Capacity - 1), ++probes)
+		{
+			Slot& slot = state.slots[i];
+			const std::uint64_t current{ slot.hash.load(std::memory_order_relaxed) };
+			if (current == hash)
+			{
+				// Re-registered after the previous instance was destroyed
+				if (slot.cvar.load(std::memory_order_relaxed))
+					throw std::runtime_error{ std::string{ u8"Duplicate console variable " } + cvar.m_Name };
+				slot.cvar.store(&cvar, std::memory_order_release);
+				return;
+			}
+			if (current == 0)
+			{
+				slot.cvar.store(&cvar, std::memory_order_relaxed);
+				slot.hash.store(hash, std::memory_order_release);
+				return;
+			}
+		}
+		throw std::length_error{ u8"Too many console variables" };
+	}
+
+	void CVars::Unregister(CVarBase& cvar) noexcept
+	{
+		State& state = GetState();
+		std::lock_guard<std::mutex> lock{ state.mutex };
+
+		for (Slot& slot : state.slots)
+		{
+			CVarBase* expected{ &cvar };
+			if (slot.cvar.compare_exchange_strong(expected, nullptr))
+				break;
+		}
+		state.queue.erase(std::remove(state.queue.begin(), state.queue.end(), &cvar), state.queue.end());
+	}
+
+	void CVars::Queue(CVarBase& cvar)
+	{
+		State& state = GetState();
+		std::lock_guard<std::mutex> lock{ state.mutex };
+		state.queue.push_back(&cvar);
+	}
+
+	CVarBase* CVars::Find(std::uint64_t hash) noexcept
+	{
+		State& state = GetState();
+		hash = SlotHash(hash);
+		for (std::size_t i{ hash & (Capacity - 1) }, probes{}; probes < Capacity; i = (i + 1) & (Capacity - 1), ++probes)
+		{
+			const Slot& slot = state.slots[i];
+			const std::uint64_t current{ slot.hash.load(std::memory_order_acquire) };
+			if (current == hash)
+				return slot.cvar.load(std::memory_order_acquire);
+			if (current == 0)
+				break;
+		}
+		return nullptr;
+	}
+
+	CVarBase* CVars::Find(std::string_view name) noexcept
+	{
+		CVarBase* cvar{ Find(HashName(name)) };
+		return cvar && cvar->GetName() == name ? cvar : nullptr;
+	}
+
+	bool CVars::Set(std::string_view name, std::string_view value)
+	{
+		CVarBase* cvar{ Find(name) };
+		return cvar && cvar->SetFromString(value);
+	}
+
+	void CVars::ProcessChanges()
+	{
+		State& state = GetState();
+		{
+			std::lock_guard<std::mutex> lock{ state.mutex };
+			if (state.queue.empty())
+				return;
+			state.processing.swap(state.queue);
+		}
+
+		for (CVarBase* cvar : state.processing)
+		{
+			// Changes made by the callbacks are queued for the next call
+			cvar->m_Queued.store(false, std::memory_order_release);
+			for (auto& callback : cvar->m_Callbacks)
+				callback();
+		}
+		state.processing.clear();
+	}
+
+	void CVars::ForEach(const std::function<void(CVarBase&)>& function)
+	{
+		State& state = GetState();
+		for (Slot& slot : state.slots)
+			if (CVarBase* cvar = slot.cvar.load(std::memory_order_acquire))
+				function(*cvar);
+	}
+}
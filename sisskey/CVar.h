@@ -0,0 +1,148 @@
+#pragma once
+
+#include "Hash.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+
+namespace sisskey
+{
+	enum class CVarType : std::uint8_t
+	{
+		Bool,
+		Int,
+		Float
+	};
+
+	// Name of a console variable and its hash, computed at compile time by SISSKEY_CVAR
+	struct CVarName
+	{
+		const char* name;
+		std::uint64_t hash;
+	};
+
+	// Console variable, declare them with static storage duration:
+	//   static CVar<int> cv_FrameCap{ SISSKEY_CVAR(u8"engine.frameCap"), 0, u8"Frames per second limit, 0 - uncapped", 0, 1000 };
+	// Values are atomics, Get() from any thread is a plain load.
+	// Set() may be called from any thread, change callbacks run on the main thread in CVars::ProcessChanges.
+	class CVarBase
+	{
+		friend class CVars;
+	private:
+		const char* m_Name;
+		const char* m_Description;
+		std::uint64_t m_Hash;
+		CVarType m_Type;
+		std::atomic<bool> m_Queued{ false };
+		std::vector<std::function<void()>> m_Callbacks;
+
+	protected:
+		CVarBase(const char* name, std::uint64_t hash, const char* description, CVarType type);
+		~CVarBase();
+
+		void Changed();
+
+	public:
+		CVarBase(const CVarBase&) = delete;
+		CVarBase& operator=(const CVarBase&) = delete;
+
+		[[nodiscard]] std::string_view GetName() const noexcept { return m_Name; }
+		[[nodiscard]] std::string_view GetDescription() const noexcept { return m_Description; }
+		[[nodiscard]] std::uint64_t GetHash() const noexcept { return m_Hash; }
+		[[nodiscard]] CVarType GetType() const noexcept { return m_Type; }
+
+		// Main thread only
+		void OnChange(std::function<void()> callback) { m_Callbacks.push_back(std::move(callback)); }
+
+		// Return false if the value can't be converted
+		virtual bool Set(double value) = 0;
+		virtual bool SetFromString(std::string_view value) = 0;
+		[[nodiscard]] virtual std::string ToString() const = 0;
+	};
+
+	template<typename T>
+	class CVar final : public CVarBase
+	{
+		static_assert(std::is_same_v<T, bool> || std::is_same_v<T, int> || std::is_same_v<T, float>, "CVar type must be bool, int or float");
+	private:
+		std::atomic<T> m_Value;
+		T m_Min;
+		T m_Max;
+
+		static constexpr CVarType Type() noexcept
+		{
+			if constexpr (std::is_same_v<T, bool>)
+				return CVarType::Bool;
+			else if constexpr (std::is_same_v<T, int>)
+				return CVarType::Int;
+			else
+				return CVarType::Float;
+		}
+
+	public:
+		CVar(CVarName name, T value, const char* description = u8"",
+			 T min = std::numeric_limits<T>::lowest(), T max = std::numeric_limits<T>::max()) :
+			CVarBase{ name.name, name.hash, description, Type() }, m_Value{ value }, m_Min{ min }, m_Max{ max } {}
+
+		[[nodiscard]] T Get() const noexcept { return m_Value.load(std::memory_order_relaxed); }
+		[[nodiscard]] operator T() const noexcept { return Get(); }
+
+		// Clamped to the range
+		void Set(T value)
+		{
+			if constexpr (!std::is_same_v<T, bool>)
+				value = std::clamp(value, m_Min, m_Max);
+			if (m_Value.exchange(value, std::memory_order_relaxed) != value)
+				Changed();
+		}
+
+		CVar& operator=(T value)
+		{
+			Set(value);
+			return *this;
+		}
+
+		bool Set(double value) override;
+		bool SetFromString(std::string_view value) override;
+		[[nodiscard]] std::string ToString() const override;
+	};
+
+	extern template class CVar<bool>;
+	extern template class CVar<int>;
+	extern template class CVar<float>;
+
+	// Registry of all console variables, an open addressing hash table keyed by name hashes.
+	// Lookups are lock-free, registration happens during static initialization.
+	class CVars
+	{
+		friend CVarBase;
+	private:
+		static void Register(CVarBase& cvar);
+		static void Unregister(CVarBase& cvar) noexcept;
+		static void Queue(CVarBase& cvar);
+
+	public:
+		static constexpr std::size_t Capacity{ 4096 };
+
+		[[nodiscard]] static CVarBase* Find(std::uint64_t hash) noexcept;
+		[[nodiscard]] static CVarBase* Find(std::string_view name) noexcept;
+
+		// Returns false if there is no such variable or the value is invalid
+		static bool Set(std::string_view name, std::string_view value);
+
+		// Runs change callbacks of variables modified since the last call, main thread only
+		static void ProcessChanges();
+
+		static void ForEach(const std::function<void(CVarBase&)>& function);
+	};
+}
+
+// Console variable name from a string literal, hashed at compile time
+#define SISSKEY_CVAR(name) (::sisskey::CVarName{ name, SISSKEY_HASH(name) })
@@ -0,0 +1,59 @@
+#include "CommandBuffer.h"
+
+namespace sisskey
+{
+	void CommandBuffer::Playback(World& world)
+	{
+		const std::byte* p = m_Data.data();
+		const std::byte* const end = p + m_Data.size();
+
+		auto read = [&p](auto& value)
+		{
+			std::memcpy(&value, p, sizeof(value));
+			p += sizeof(value);
+		};
+
+		while (p < end)
+		{
+			Header header;
+			read(header);
+
+			switch (header.type)
+			{
+			case Type::Create:
+			{
+				std::array<ComponentID, MaxComponentTypes> ids;
+				std::array<const void*, MaxComponentTypes> data;
+				for (std::uint32_t i{}; i < header.count; ++i)
+				{
+					std::uint32_t size;
+					read(ids[i]);
+					read(size);
+					data[i] = p;
+					p += size;
+				}
+				world.CreateRaw(header.count, ids.data(), data.data());
+			} break;
+			case Type::Destroy:
+			{
+				world.Destroy(header.entity);
+			} break;
+			case Type::Add:
+			{
+				std::uint32_t size;
+				read(size);
+				if (world.IsAlive(header.entity))
+					world.AddRaw(header.entity, header.count, p);
+				p += size;
+			} break;
+			case Type::Remove:
+			{
+				if (world.IsAlive(header.entity))
+					world.RemoveRaw(header.entity, header.count);
+			} break;
+			}
+		}
+
+		m_Data.clear();
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "World.h"
+
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace sisskey
+{
+	// Records structural changes of a World to apply them later on one thread,
+	// e.g. from inside a (parallel) query. Use one buffer per thread.
+	class CommandBuffer
+	{
+	private:
+		enum class Type : std::uint32_t
+		{
+			Create,
+			Destroy,
+			Add,
+			Remove
+		};
+
+		// Create: count = number of components, each followed by its id, size and data
+		// Add: count = component id, followed by size and data
+		// Remove: count = component id
+		struct Header
+		{
+			Type type;
+			std::uint32_t count;
+			Entity entity;
+		};
+
+		std::vector<std::byte> m_Data;
+
+		void Write(const void* data, std::size_t size)
+		{
+			const std::size_t offset{ m_Data.size() };
+			m_Data.resize(offset + size);
+			std::memcpy(m_Data.data() + offset, data, size);
+		}
+
+		template<typename T>
+		void WriteComponent(const T& component)
+		{
+			const ComponentID id{ ComponentRegistry::ID<T>() };
+			const std::uint32_t size{ sizeof(T) };
+			Write(&id, sizeof(id));
+			Write(&size, sizeof(size));
+			Write(&component, sizeof(T));
+		}
+
+	public:
+		template<typename... Ts>
+		void Create(const Ts&... components)
+		{
+			const Header header{ Type::Create, sizeof...(Ts), {} };
+			Write(&header, sizeof(header));
+			(WriteComponent(components), ...);
+		}
+
+		void Destroy(Entity entity)
+		{
+			const Header header{ Type::Destroy, 0, entity };
+			Write(&header, sizeof(header));
+		}
+
+		template<typename T>
+		void Add(Entity entity, const T& component = {})
+		{
+			const Header header{ Type::Add, ComponentRegistry::ID<T>(), entity };
+			const std::uint32_t size{ sizeof(T) };
+			Write(&header, sizeof(header));
+			Write(&size, sizeof(size));
+			Write(&component, sizeof(T));
+		}
+
+		template<typename T>
+		void Remove(Entity entity)
+		{
+			const Header header{ Type::Remove, ComponentRegistry::ID<T>(), entity };
+			Write(&header, sizeof(header));
+		}
+
+		// Applies commands in the recorded order and clears the buffer.
+		// Commands targeting already destroyed entities are skipped.
+		void Playback(World& world);
+
+		[[nodiscard]] bool Empty() const noexcept { return m_Data.empty(); }
+		void Clear() noexcept { m_Data.clear(); }
+	};
+}
@@ -0,0 +1,195 @@
+#include "Compression.h"
+
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+namespace sisskey
+{
+	namespace
+	{
+		constexpr std::size_t MinMatch{ 4 };
+		// The last 5 bytes are always literals and the last match starts at least 12 bytes before the end
+		constexpr std::size_t LastLiterals{ 5 };
+		constexpr std::size_t MatchFindLimit{ 12 };
+		constexpr std::size_t MaxOffset{ 65535 };
+		constexpr int HashLog{ 12 };
+
+		[[nodiscard]] std::uint32_t Read32(const std::byte* p) noexcept
+		{
+			std::uint32_t value;
+			std::memcpy(&value, p, sizeof(value));
+			return value;
+		}
+
+		[[nodiscard]] std::uint32_t Hash(std::uint32_t sequence) noexcept
+		{
+			return (sequence * 2654435761u) >> (32 - HashLog);
+		}
+
+		std::byte* WriteLength(std::byte* op, std::size_t length) noexcept
+		{
+			for (; length >= 255; length -= 255)
+				*op++ = std::byte{ 255 };
+			*op++ = static_cast<std::byte>(length);
+			return op;
+		}
+
+		std::byte* WriteSequence(std::byte* op, const std::byte* literals, std::size_t literalCount, std::size_t offset, std::size_t matchLength) noexcept
+		{
+			std::byte* token = op++;
+			const std::size_t matchCode{ matchLength - MinMatch };
+			*token = static_cast<std::byte>(((literalCount < 15 ? literalCount : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+			if (literalCount >= 15)
+				op = WriteLength(op, literalCount - 15);
+			std::memcpy(op, literals, literalCount);
+			op += literalCount;
+
+			*op++ = static_cast<std::byte>(offset & 0xFF);
+			*op++ = static_cast<std::byte>(offset >> 8);
+			if (matchCode >= 15)
+				op = WriteLength(op, matchCode - 15);
+			return op;
+		}
+
+		[[nodiscard]] bool ReadLength(const std::byte*& ip, const std::byte* end, std::size_t& length) noexcept
+		{
+			std::byte value;
+			do
+			{
+				if (ip == end)
+					return false;
+				value = *ip++;
+				length += static_cast<std::size_t>(value);
+			} while (value == std::byte{ 255 });
+			return true;
+		}
+	}
+
+	std::size_t LZ4Compress(Span<const std::byte> in, Span<std::byte> out) noexcept
+	{
+		assert(out.Size() >= LZ4CompressBound(in.Size()));
+
+		const std::byte* const base = in.Data();
+		const std::size_t size{ in.Size() };
+		std::byte* op = out.Data();
+		std::size_t anchor{ 0 };
+
+		if (size > MatchFindLimit)
+		{
+			// Positions of the latest occurrences of 4 byte sequences, stale entries are rejected by the comparison
+			std::uint32_t table[1 << HashLog]{};
+			const std::size_t matchLimit{ size - LastLiterals };
+			const std::size_t findLimit{ size - MatchFindLimit };
+
+			std::size_t ip{ 1 };
+			table[Hash(Read32(base))] = 0;
+			while (ip < findLimit)
+			{
+				const std::uint32_t sequence{ Read32(base + ip) };
+				const std::uint32_t h{ Hash(sequence) };
+				std::size_t match{ table[h] };
+				table[h] = static_cast<std::uint32_t>(ip);
+
+				if (match >= ip || ip - match > MaxOffset || Read32(base + match) != sequence)
+				{
+					// Skip faster through incompressible data
+					ip += 1 + ((ip - anchor) >> 6);
+					continue;
+				}
+
+				while (ip > anchor && match > 0 && base[ip - 1] == base[match - 1])
+				{
+					--ip;
+					--match;
+				}
+
+				std::size_t length{ MinMatch };
+				while (ip + length < matchLimit && base[ip + length] == base[match + length])
+					++length;
+
+				op = WriteSequence(op, base + anchor, ip - anchor, ip - match, length);
+				ip += length;
+				anchor = ip;
+
+				if (ip < findLimit)
+					table[Hash(Read32(base + ip - 2))] = static_cast<std::uint32_t>(ip - 2);
+			}
+		}
+
+		// Last literals without a match
+		const std::size_t literalCount{ size - anchor };
+		*op++ = static_cast<std::byte>((literalCount < 15 ? literalCount : 15) << 4);
+		if (literalCount >= 15)
+			op = WriteLength(op, literalCount - 15);
+		if (literalCount)
+			std::memcpy(op, base + anchor, literalCount);
+		op += literalCount;
+
+		return static_cast<std::size_t>(op - out.Data());
+	}
+
+	bool LZ4Decompress(Span<const std::byte> in, Span<std::byte> out) noexcept
+	{
+		const std::byte* ip = in.Data();
+		const std::byte* const inEnd = ip + in.Size();
+		std::byte* op = out.Data();
+		std::byte* const outEnd = op + out.Size();
+
+		while (ip < inEnd)
+		{
+			const std::size_t token{ static_cast<std::size_t>(*ip++) };
+
+			// Short literal runs are copied 16 bytes at once while both buffers have room for it
+			std::size_t literalCount{ token >> 4 };
+			if (literalCount < 15 && inEnd - ip >= 16 && outEnd - op >= 16)
+				std::memcpy(op, ip, 16);
+			else
+			{
+				if (literalCount == 15 && !ReadLength(ip, inEnd, literalCount))
+					return false;
+				if (literalCount > static_cast<std::size_t>(inEnd - ip) || literalCount > static_cast<std::size_t>(outEnd - op))
+					return false;
+				if (literalCount)
+					std::memcpy(op, ip, literalCount);
+			}
+			ip += literalCount;
+			op += literalCount;
+
+			// The last sequence has no match
+			if (ip == inEnd)
+				break;
+
+			if (inEnd - ip < 2)
+				return false;
+			const std::size_t offset{ static_cast<std::size_t>(ip[0]) | static_cast<std::size_t>(ip[1]) << 8 };
+			ip += 2;
+			if (offset == 0 || offset > static_cast<std::size_t>(op - out.Data()))
+				return false;
+
+			std::size_t length{ token & 15 };
+			if (length == 15 && !ReadLength(ip, inEnd, length))
+				return false;
+			length += MinMatch;
+			if (length > static_cast<std::size_t>(outEnd - op))
+				return false;
+
+			// Overlapping matches repeat the last offset bytes, 8 byte steps are safe from an offset of 8.
+			// They may write up to 7 bytes past the match, which are overwritten later.
+			const std::byte* match = op - offset;
+			if (offset >= 8 && static_cast<std::size_t>(outEnd - op) >= length + 8)
+			{
+				for (std::size_t i{}; i < length; i += 8)
+					std::memcpy(op + i, match + i, 8);
+			}
+			else
+			{
+				for (std::size_t i{}; i < length; ++i)
+					op[i] = match[i];
+			}
+			op += length;
+		}
+
+		return op == outEnd;
+	}
+}
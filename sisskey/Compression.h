@@ -0,0 +1,18 @@
+#pragma once
+#include "Span.h"
+
+#include <cstddef>
+
+namespace sisskey
+{
+	// LZ4 block format, compatible with LZ4_decompress_safe
+	// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+	// The compressor is the greedy single pass one with a small hash table,
+	// decompression validates the input and never writes out of bounds.
+
+	[[nodiscard]] constexpr std::size_t LZ4CompressBound(std::size_t size) noexcept { return size + size / 255 + 16; }
+	// out must hold LZ4CompressBound(in.Size()) bytes, returns the compressed size
+	[[nodiscard]] std::size_t LZ4Compress(Span<const std::byte> in, Span<std::byte> out) noexcept;
+	// out must have exactly the original size, returns false if the input is malformed
+	[[nodiscard]] bool LZ4Decompress(Span<const std::byte> in, Span<std::byte> out) noexcept;
+}
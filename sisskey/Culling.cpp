@@ -0,0 +1,723 @@
+#include "Culling.h"
+#include "Profiler.h"
+
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+namespace sisskey
+{
+	namespace
+	{
+		constexpr float Huge{ std::numeric_limits<float>::max() };
+		// Never intersects anything and leaves other boxes unchanged in Union
+		constexpr AABB EmptyBox{ { Huge, Huge, Huge }, { -Huge, -Huge, -Huge } };
+
+		// Subtrees with more proxies are built by separate jobs
+		constexpr std::size_t ParallelBuildSize{ 4096 };
+		constexpr std::size_t RebuildChanges{ 64 };
+		constexpr double RebuildAreaRatio{ 2.0 };
+
+		[[nodiscard]] float HalfArea(const AABB& box) noexcept
+		{
+			const float x{ std::max(box.max.x - box.min.x, 0.0f) };
+			const float y{ std::max(box.max.y - box.min.y, 0.0f) };
+			const float z{ std::max(box.max.z - box.min.z, 0.0f) };
+			return x * y + y * z + z * x;
+		}
+
+		[[nodiscard]] Vec4 Row(const Mat4& m, int i) noexcept
+		{
+			return { (&m.columns[0].x)[i], (&m.columns[1].x)[i], (&m.columns[2].x)[i], (&m.columns[3].x)[i] };
+		}
+
+		[[nodiscard]] Vec4 NormalizePlane(const Vec4& plane) noexcept
+		{
+			return plane * (1.0f / std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z));
+		}
+
+		struct ChildMasks
+		{
+			std::uint32_t intersecting; // not outside of any plane
+			std::uint32_t inside; // inside of all planes
+		};
+
+		// bounds: minX[8], minY[8], minZ[8], maxX[8], maxY[8], maxZ[8] of a node.
+		// A box is outside if its corner farthest along the normal is behind a plane,
+		// inside if the nearest corner is in front of all of them.
+		[[nodiscard]] ChildMasks TestChildren(const float* bounds, const Frustum& frustum) noexcept
+		{
+#if defined(SISSKEY_SIMD_AVX2)
+			const __m256 minX = _mm256_load_ps(bounds), minY = _mm256_load_ps(bounds + 8), minZ = _mm256_load_ps(bounds + 16);
+			const __m256 maxX = _mm256_load_ps(bounds + 24), maxY = _mm256_load_ps(bounds + 32), maxZ = _mm256_load_ps(bounds + 40);
+			const __m256 zero = _mm256_setzero_ps();
+			// Empty slots have min > max
+			__m256 outside = _mm256_cmp_ps(minX, maxX, _CMP_GT_OQ);
+			__m256 crossing = _mm256_setzero_ps();
+			for (const Vec4& plane : frustum.planes)
+			{
+				const __m256 nx = _mm256_set1_ps(plane.x), ny = _mm256_set1_ps(plane.y), nz = _mm256_set1_ps(plane.z);
+				const __m256 ax = _mm256_mul_ps(nx, minX), bx = _mm256_mul_ps(nx, maxX);
+				const __m256 ay = _mm256_mul_ps(ny, minY), by = _mm256_mul_ps(ny, maxY);
+				const __m256 az = _mm256_mul_ps(nz, minZ), bz = _mm256_mul_ps(nz, maxZ);
+				const __m256 d = _mm256_set1_ps(plane.w);
+				const __m256 farthest = _mm256_add_ps(_mm256_add_ps(_mm256_max_ps(ax, bx), _mm256_max_ps(ay, by)), _mm256_add_ps(_mm256_max_ps(az, bz), d));
+				const __m256 nearest = _mm256_add_ps(_mm256_add_ps(_mm256_min_ps(ax, bx), _mm256_min_ps(ay, by)), _mm256_add_ps(_mm256_min_ps(az, bz), d));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(farthest, zero, _CMP_LT_OQ));
+				crossing = _mm256_or_ps(crossing, _mm256_cmp_ps(nearest, zero, _CMP_LT_OQ));
+			}
+			const std::uint32_t out{ static_cast<std::uint32_t>(_mm256_movemask_ps(outside)) };
+			const std::uint32_t cross{ static_cast<std::uint32_t>(_mm256_movemask_ps(crossing)) };
+			return { ~out & 0xFF, ~(out | cross) & 0xFF };
+#elif defined(SISSKEY_SIMD_SSE41)
+			ChildMasks masks{ 0, 0 };
+			for (int half{}; half < 2; ++half)
+			{
+				const float* b = bounds + half * 4;
+				const __m128 minX = _mm_load_ps(b), minY = _mm_load_ps(b + 8), minZ = _mm_load_ps(b + 16);
+				const __m128 maxX = _mm_load_ps(b + 24), maxY = _mm_load_ps(b + 32), maxZ = _mm_load_ps(b + 40);
+				const __m128 zero = _mm_setzero_ps();
+				__m128 outside = _mm_cmpgt_ps(minX, maxX);
+				__m128 crossing = _mm_setzero_ps();
+				for (const Vec4& plane : frustum.planes)
+				{
+					const __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+					const __m128 ax = _mm_mul_ps(nx, minX), bx = _mm_mul_ps(nx, maxX);
+					const __m128 ay = _mm_mul_ps(ny, minY), by = _mm_mul_ps(ny, maxY);
+					const __m128 az = _mm_mul_ps(nz, minZ), bz = _mm_mul_ps(nz, maxZ);
+					const __m128 d = _mm_set1_ps(plane.w);
+					const __m128 farthest = _mm_add_ps(_mm_add_ps(_mm_max_ps(ax, bx), _mm_max_ps(ay, by)), _mm_add_ps(_mm_max_ps(az, bz), d));
+					const __m128 nearest = _mm_add_ps(_mm_add_ps(_mm_min_ps(ax, bx), _mm_min_ps(ay, by)), _mm_add_ps(_mm_min_ps(az, bz), d));
+					outside = _mm_or_ps(outside, _mm_cmplt_ps(farthest, zero));
+					crossing = _mm_or_ps(crossing, _mm_cmplt_ps(nearest, zero));
+				}
+				const std::uint32_t out{ static_cast<std::uint32_t>(_mm_movemask_ps(outside)) };
+				const std::uint32_t cross{ static_cast<std::uint32_t>(_mm_movemask_ps(crossing)) };
+				masks.intersecting |= (~out & 0xF) << (half * 4);
+				masks.inside |= (~(out | cross) & 0xF) << (half * 4);
+			}
+			return masks;
+#else
+			ChildMasks masks{ 0, 0 };
+			for (int i{}; i < 8; ++i)
+			{
+				const float minX{ bounds[i] }, minY{ bounds[8 + i] }, minZ{ bounds[16 + i] };
+				const float maxX{ bounds[24 + i] }, maxY{ bounds[32 + i] }, maxZ{ bounds[40 + i] };
+				bool outside{ minX > maxX }, crossing{ false };
+				for (const Vec4& plane : frustum.planes)
+				{
+					const float farthest{ std::max(plane.x * minX, plane.x * maxX) + std::max(plane.y * minY, plane.y * maxY) +
+										  std::max(plane.z * minZ, plane.z * maxZ) + plane.w };
+					const float nearest{ std::min(plane.x * minX, plane.x * maxX) + std::min(plane.y * minY, plane.y * maxY) +
+										 std::min(plane.z * minZ, plane.z * maxZ) + plane.w };
+					outside |= farthest < 0.0f;
+					crossing |= nearest < 0.0f;
+				}
+				masks.intersecting |= static_cast<std::uint32_t>(!outside) << i;
+				masks.inside |= static_cast<std::uint32_t>(!outside && !crossing) << i;
+			}
+			return masks;
+#endif
+		}
+
+		// Children of a node inside the frustum only need the empty slots masked out
+		[[nodiscard]] std::uint32_t OccupiedChildren(const float* bounds) noexcept
+		{
+			std::uint32_t mask{ 0 };
+			for (int i{}; i < 8; ++i)
+				mask |= static_cast<std::uint32_t>(bounds[i] <= bounds[24 + i]) << i;
+			return mask;
+		}
+	}
+
+	Frustum ExtractFrustum(const Mat4& viewProjection) noexcept
+	{
+		// Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"
+		const Vec4 x{ Row(viewProjection, 0) }, y{ Row(viewProjection, 1) }, z{ Row(viewProjection, 2) }, w{ Row(viewProjection, 3) };
+		return { { NormalizePlane(w + x), NormalizePlane(w - x), NormalizePlane(w + y), NormalizePlane(w - y),
+				   NormalizePlane(z), NormalizePlane(w - z) } };
+	}
+
+	// OcclusionBuffer
+
+	OcclusionBuffer::OcclusionBuffer(int width, int height)
+		: m_ViewProjection{ Identity() }, m_Width{ width }, m_Height{ height },
+		  m_TilesX{ (width + TileSize - 1) / TileSize }, m_TilesY{ (height + TileSize - 1) / TileSize },
+		  m_Depth(static_cast<std::size_t>(width) * height, 1.0f), m_TileMax(static_cast<std::size_t>(m_TilesX) * m_TilesY, 1.0f)
+	{
+	}
+
+	void OcclusionBuffer::Begin(const Mat4& viewProjection)
+	{
+		m_ViewProjection = viewProjection;
+		std::fill(m_Depth.begin(), m_Depth.end(), 1.0f);
+	}
+
+	void OcclusionBuffer::RasterizeTriangles(const Vec3* vertices, const std::uint32_t* indices, std::size_t indexCount, const Mat4& world) noexcept
+	{
+		SISSKEY_ZONE(u8"RasterizeOccluders");
+		const Mat4 m{ m_ViewProjection * world };
+		for (std::size_t i{}; i + 3 <= indexCount; i += 3)
+		{
+			Vec4 clip[3];
+			for (int k{}; k < 3; ++k)
+			{
+				const Vec3 p{ vertices[indices[i + k]] };
+				clip[k] = m * Vec4{ p.x, p.y, p.z, 1.0f };
+			}
+			RasterizeTriangle(clip[0], clip[1], clip[2], false);
+		}
+	}
+
+	void OcclusionBuffer::RasterizeBox(const AABB& box) noexcept
+	{
+		// Corner i has the maximum x if bit 2 is set, y for bit 1 and z for bit 0.
+		// Faces are counterclockwise seen from the outside, so the back faces are skipped.
+		static constexpr std::uint8_t Indices[36]{ 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+												   2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+		SISSKEY_ZONE(u8"RasterizeOccluders");
+		Vec4 corners[8];
+		for (int i{}; i < 8; ++i)
+			corners[i] = m_ViewProjection * Vec4{ i & 4 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 1 ? box.max.z : box.min.z, 1.0f };
+		for (std::size_t i{}; i < 36; i += 3)
+			RasterizeTriangle(corners[Indices[i]], corners[Indices[i + 1]], corners[Indices[i + 2]], true);
+	}
+
+	void OcclusionBuffer::RasterizeTriangle(const Vec4& a, const Vec4& b, const Vec4& c, bool cullBackFaces) noexcept
+	{
+		// Clip against the near plane, the other planes are handled by the screen bounds
+		const Vec4 in[3]{ a, b, c };
+		Vec4 polygon[4];
+		int count{ 0 };
+		for (int i{}; i < 3; ++i)
+		{
+			const Vec4& p = in[i];
+			const Vec4& q = in[(i + 1) % 3];
+			if (p.z >= 0.0f)
+				polygon[count++] = p;
+			if ((p.z >= 0.0f) != (q.z >= 0.0f))
+				polygon[count++] = p + (q - p) * (p.z / (p.z - q.z));
+		}
+		if (count < 3)
+			return;
+
+		float x[4], y[4], z[4];
+		for (int i{}; i < count; ++i)
+		{
+			if (polygon[i].w <= 0.0f)
+				return;
+			const float invW{ 1.0f / polygon[i].w };
+			x[i] = (polygon[i].x * invW * 0.5f + 0.5f) * static_cast<float>(m_Width);
+			y[i] = (polygon[i].y * invW * 0.5f + 0.5f) * static_cast<float>(m_Height);
+			z[i] = polygon[i].z * invW;
+		}
+
+		for (int t{ 1 }; t + 1 < count; ++t)
+		{
+			int i0{ 0 }, i1{ t }, i2{ t + 1 };
+			float area{ (x[i1] - x[i0]) * (y[i2] - y[i0]) - (x[i2] - x[i0]) * (y[i1] - y[i0]) };
+			if (area == 0.0f)
+				continue;
+			// Clockwise on the screen
+			if (area < 0.0f)
+			{
+				if (cullBackFaces)
+					continue;
+				std::swap(i1, i2);
+				area = -area;
+			}
+
+			const float left{ std::min({ x[i0], x[i1], x[i2] }) }, right{ std::max({ x[i0], x[i1], x[i2] }) };
+			const float bottom{ std::min({ y[i0], y[i1], y[i2] }) }, top{ std::max({ y[i0], y[i1], y[i2] }) };
+			const int x0{ static_cast<int>(std::clamp(std::floor(left), 0.0f, static_cast<float>(m_Width))) };
+			const int x1{ static_cast<int>(std::clamp(std::ceil(right), 0.0f, static_cast<float>(m_Width))) };
+			const int y0{ static_cast<int>(std::clamp(std::floor(bottom), 0.0f, static_cast<float>(m_Height))) };
+			const int y1{ static_cast<int>(std::clamp(std::ceil(top), 0.0f, static_cast<float>(m_Height))) };
+
+			const float invArea{ 1.0f / area };
+			for (int py{ y0 }; py < y1; ++py)
+			{
+				const float sy{ static_cast<float>(py) + 0.5f };
+				float* row = &m_Depth[static_cast<std::size_t>(py) * m_Width];
+				for (int px{ x0 }; px < x1; ++px)
+				{
+					// Pixel centers inside all edges
+					const float sx{ static_cast<float>(px) + 0.5f };
+					const float w0{ (x[i2] - x[i1]) * (sy - y[i1]) - (y[i2] - y[i1]) * (sx - x[i1]) };
+					const float w1{ (x[i0] - x[i2]) * (sy - y[i2]) - (y[i0] - y[i2]) * (sx - x[i2]) };
+					const float w2{ (x[i1] - x[i0]) * (sy - y[i0]) - (y[i1] - y[i0]) * (sx - x[i0]) };
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						continue;
+					const float depth{ (w0 * z[i0] + w1 * z[i1] + w2 * z[i2]) * invArea };
+					row[px] = std::min(row[px], depth);
+				}
+			}
+		}
+	}
+
+	void OcclusionBuffer::End()
+	{
+		for (int ty{}; ty < m_TilesY; ++ty)
+		{
+			for (int tx{}; tx < m_TilesX; ++tx)
+			{
+				float farthest{ 0.0f };
+				for (int py{ ty * TileSize }; py < std::min((ty + 1) * TileSize, m_Height); ++py)
+					for (int px{ tx * TileSize }; px < std::min((tx + 1) * TileSize, m_Width); ++px)
+						farthest = std::max(farthest, m_Depth[static_cast<std::size_t>(py) * m_Width + px]);
+				m_TileMax[static_cast<std::size_t>(ty) * m_TilesX + tx] = farthest;
+			}
+		}
+	}
+
+	bool OcclusionBuffer::IsVisible(const AABB& box) const noexcept
+	{
+		float left{ Huge }, right{ -Huge }, bottom{ Huge }, top{ -Huge }, nearest{ Huge };
+		for (int i{}; i < 8; ++i)
+		{
+			const Vec4 clip{ m_ViewProjection * Vec4{ i & 4 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 1 ? box.max.z : box.min.z, 1.0f } };
+			// Boxes crossing the near plane are too close to be hidden
+			if (clip.z < 0.0f || clip.w <= 0.0f)
+				return true;
+			const float invW{ 1.0f / clip.w };
+			const float x{ (clip.x * invW * 0.5f + 0.5f) * static_cast<float>(m_Width) };
+			const float y{ (clip.y * invW * 0.5f + 0.5f) * static_cast<float>(m_Height) };
+			left = std::min(left, x);
+			right = std::max(right, x);
+			bottom = std::min(bottom, y);
+			top = std::max(top, y);
+			nearest = std::min(nearest, clip.z * invW);
+		}
+
+		// Off screen, that is decided by the frustum
+		if (right < 0.0f || left > static_cast<float>(m_Width) || top < 0.0f || bottom > static_cast<float>(m_Height))
+			return true;
+
+		// All pixels the projected box overlaps
+		const int x0{ static_cast<int>(std::max(std::floor(left), 0.0f)) };
+		const int x1{ static_cast<int>(std::min(std::floor(right), static_cast<float>(m_Width - 1))) };
+		const int y0{ static_cast<int>(std::max(std::floor(bottom), 0.0f)) };
+		const int y1{ static_cast<int>(std::min(std::floor(top), static_cast<float>(m_Height - 1))) };
+
+		for (int ty{ y0 / TileSize }; ty <= y1 / TileSize; ++ty)
+		{
+			for (int tx{ x0 / TileSize }; tx <= x1 / TileSize; ++tx)
+			{
+				if (m_TileMax[static_cast<std::size_t>(ty) * m_TilesX + tx] < nearest)
+					continue;
+				for (int py{ std::max(y0, ty * TileSize) }; py <= std::min(y1, ty * TileSize + TileSize - 1); ++py)
+				{
+					const float* row = &m_Depth[static_cast<std::size_t>(py) * m_Width];
+					for (int px{ std::max(x0, tx * TileSize) }; px <= std::min(x1, tx * TileSize + TileSize - 1); ++px)
+						if (row[px] >= nearest)
+							return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	// BVH
+
+	std::uint32_t BVH::AllocateNode(std::uint32_t parent, std::uint32_t parentSlot, std::uint32_t depth)
+	{
+		const std::uint32_t index{ static_cast<std::uint32_t>(m_Nodes.size()) };
+		Node& node = m_Nodes.emplace_back();
+		for (std::size_t i{}; i < Width; ++i)
+			SetSlot(node, i, Empty, EmptyBox);
+		node.parent = parent;
+		node.parentSlot = parentSlot;
+		node.depth = depth;
+		node.dirty = false;
+		return index;
+	}
+
+	void BVH::MarkDirty(std::uint32_t node)
+	{
+		Node& n = m_Nodes[node];
+		if (n.dirty)
+			return;
+		n.dirty = true;
+		if (m_Dirty.size() <= n.depth)
+			m_Dirty.resize(n.depth + 1);
+		m_Dirty[n.depth].push_back(node);
+	}
+
+	void BVH::SetSlot(Node& node, std::size_t slot, std::uint32_t child, const AABB& bounds) noexcept
+	{
+		node.children[slot] = child;
+		node.minX[slot] = bounds.min.x;
+		node.minY[slot] = bounds.min.y;
+		node.minZ[slot] = bounds.min.z;
+		node.maxX[slot] = bounds.max.x;
+		node.maxY[slot] = bounds.max.y;
+		node.maxZ[slot] = bounds.max.z;
+	}
+
+	AABB BVH::NodeBounds(const Node& node) const noexcept
+	{
+		AABB bounds{ EmptyBox };
+		for (std::size_t i{}; i < Width; ++i)
+			bounds = Union(bounds, { { node.minX[i], node.minY[i], node.minZ[i] }, { node.maxX[i], node.maxY[i], node.maxZ[i] } });
+		return bounds;
+	}
+
+	void BVH::NoteChange() noexcept
+	{
+		if (++m_Changes > std::max(RebuildChanges, m_ProxyCount / 8))
+			m_Rebuild = true;
+	}
+
+	BVH::ProxyID BVH::Insert(const AABB& bounds, std::uint32_t userData)
+	{
+		ProxyID id;
+		if (!m_FreeProxies.empty())
+		{
+			id = m_FreeProxies.back();
+			m_FreeProxies.pop_back();
+		}
+		else
+		{
+			id = static_cast<ProxyID>(m_Proxies.size());
+			m_Proxies.emplace_back();
+		}
+
+		const Vec3 margin{ m_Margin, m_Margin, m_Margin };
+		m_Proxies[id] = { { bounds.min - margin, bounds.max + margin }, userData, Empty, 0, true };
+		++m_ProxyCount;
+		NoteChange();
+		// A pending rebuild places it
+		if (!m_Rebuild)
+			Place(id);
+		return id;
+	}
+
+	void BVH::Remove(ProxyID proxy)
+	{
+		assert(proxy < m_Proxies.size() && m_Proxies[proxy].alive);
+		Proxy& p = m_Proxies[proxy];
+		if (p.node != Empty)
+		{
+			SetSlot(m_Nodes[p.node], p.slot, Empty, EmptyBox);
+			MarkDirty(p.node);
+		}
+		p.alive = false;
+		p.node = Empty;
+		m_FreeProxies.push_back(proxy);
+		--m_ProxyCount;
+		NoteChange();
+	}
+
+	void BVH::Move(ProxyID proxy, const AABB& bounds)
+	{
+		assert(proxy < m_Proxies.size() && m_Proxies[proxy].alive);
+		Proxy& p = m_Proxies[proxy];
+		if (Contains(p.bounds, bounds))
+			return;
+
+		const Vec3 margin{ m_Margin, m_Margin, m_Margin };
+		p.bounds = { bounds.min - margin, bounds.max + margin };
+		if (p.node != Empty)
+		{
+			SetSlot(m_Nodes[p.node], p.slot, proxy | ProxyBit, p.bounds);
+			MarkDirty(p.node);
+		}
+	}
+
+	void BVH::Place(ProxyID proxy)
+	{
+		Proxy& p = m_Proxies[proxy];
+		if (m_Nodes.empty())
+			static_cast<void>(AllocateNode(Empty, 0, 0));
+
+		std::uint32_t index{ 0 };
+		for (;;)
+		{
+			Node& node = m_Nodes[index];
+
+			// A free slot, otherwise the child growing the least
+			std::size_t best{ 0 };
+			float bestCost{ Huge };
+			for (std::size_t i{}; i < Width; ++i)
+			{
+				if (node.children[i] == Empty)
+				{
+					best = i;
+					break;
+				}
+				const AABB child{ { node.minX[i], node.minY[i], node.minZ[i] }, { node.maxX[i], node.maxY[i], node.maxZ[i] } };
+				const float cost{ HalfArea(Union(child, p.bounds)) - HalfArea(child) };
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					best = i;
+				}
+			}
+
+			const std::uint32_t child{ node.children[best] };
+			if (child == Empty)
+			{
+				SetSlot(node, best, proxy | ProxyBit, p.bounds);
+				p.node = index;
+				p.slot = static_cast<std::uint32_t>(best);
+				MarkDirty(index);
+				return;
+			}
+			if (!(child & ProxyBit))
+			{
+				index = child;
+				continue;
+			}
+
+			// The proxy in the slot is replaced by a node with both proxies
+			const std::uint32_t split{ AllocateNode(index, static_cast<std::uint32_t>(best), node.depth + 1) };
+			Node& n = m_Nodes[split];
+			Proxy& other = m_Proxies[child & ~ProxyBit];
+			SetSlot(n, 0, child, other.bounds);
+			other.node = split;
+			other.slot = 0;
+			SetSlot(n, 1, proxy | ProxyBit, p.bounds);
+			p.node = split;
+			p.slot = 1;
+			m_Nodes[index].children[best] = split;
+			MarkDirty(split);
+			return;
+		}
+	}
+
+	void BVH::Refit()
+	{
+		// Children are deeper than their parents, so every node is refit once after all its dirty descendants
+		for (std::size_t depth{ m_Dirty.size() }; depth-- > 0;)
+		{
+			for (std::uint32_t index : m_Dirty[depth])
+			{
+				Node& node = m_Nodes[index];
+				node.dirty = false;
+				if (node.parent == Empty)
+					continue;
+
+				const AABB bounds{ NodeBounds(node) };
+				Node& parent = m_Nodes[node.parent];
+				const std::uint32_t slot{ node.parentSlot };
+				const AABB old{ { parent.minX[slot], parent.minY[slot], parent.minZ[slot] }, { parent.maxX[slot], parent.maxY[slot], parent.maxZ[slot] } };
+				if (Contains(old, bounds) && Contains(bounds, old))
+					continue;
+
+				m_Area += HalfArea(bounds) - HalfArea(old);
+				SetSlot(parent, slot, index, bounds);
+				MarkDirty(node.parent);
+			}
+			m_Dirty[depth].clear();
+		}
+	}
+
+	void BVH::Update(JobSystem& jobs)
+	{
+		SISSKEY_ZONE(u8"BVH::Update");
+		if (!m_Rebuild)
+			Refit();
+		if (m_Rebuild || m_Area > RebuildAreaRatio * m_BuildArea)
+			Rebuild(jobs);
+	}
+
+	void BVH::Rebuild(JobSystem& jobs)
+	{
+		SISSKEY_ZONE(u8"BVH::Rebuild");
+		m_BuildItems.clear();
+		for (std::uint32_t i{}; i < m_Proxies.size(); ++i)
+		{
+			if (m_Proxies[i].alive)
+				m_BuildItems.push_back({ (m_Proxies[i].bounds.min + m_Proxies[i].bounds.max) * 0.5f, i });
+		}
+
+		m_Nodes.clear();
+		for (auto& dirty : m_Dirty)
+			dirty.clear();
+		m_Changes = 0;
+		m_Rebuild = false;
+		m_Area = 0.0;
+		m_BuildArea = 0.0;
+		if (m_BuildItems.empty())
+			return;
+
+		// Every node but the root has at least two children, so there are fewer nodes than proxies
+		m_Nodes.resize(m_BuildItems.size());
+		m_Nodes[0].parent = Empty;
+		m_Nodes[0].parentSlot = 0;
+		m_Nodes[0].depth = 0;
+		m_Nodes[0].dirty = false;
+		std::atomic<std::uint32_t> nextNode{ 1 };
+		static_cast<void>(Build(jobs, 0, m_BuildItems.data(), m_BuildItems.data() + m_BuildItems.size(), nextNode));
+		m_Nodes.resize(nextNode.load(std::memory_order_relaxed));
+
+		for (std::size_t i{ 1 }; i < m_Nodes.size(); ++i)
+			m_Area += HalfArea(NodeBounds(m_Nodes[i]));
+		m_BuildArea = m_Area;
+	}
+
+	AABB BVH::Build(JobSystem& jobs, std::uint32_t index, BuildItem* first, BuildItem* last, std::atomic<std::uint32_t>& nextNode)
+	{
+		// The node array is preallocated, so the reference stays valid while other jobs allocate
+		Node& node = m_Nodes[index];
+		for (std::size_t i{}; i < Width; ++i)
+			SetSlot(node, i, Empty, EmptyBox);
+
+		const std::size_t count{ static_cast<std::size_t>(last - first) };
+		if (count <= Width)
+		{
+			for (std::size_t i{}; i < count; ++i)
+			{
+				Proxy& proxy = m_Proxies[first[i].proxy];
+				SetSlot(node, i, first[i].proxy | ProxyBit, proxy.bounds);
+				proxy.node = index;
+				proxy.slot = static_cast<std::uint32_t>(i);
+			}
+			return NodeBounds(node);
+		}
+
+		// Three levels of median splits along the widest axis of the centroids give 8 groups.
+		// Splits are rounded to multiples of the width, so the leaves are full and some groups can be empty.
+		BuildItem* groups[Width + 1];
+		groups[0] = first;
+		groups[Width] = last;
+		for (std::size_t step{ Width / 2 }; step > 0; step /= 2)
+		{
+			for (std::size_t i{}; i < Width; i += step * 2)
+			{
+				BuildItem* begin = groups[i];
+				BuildItem* end = groups[i + step * 2];
+				const std::size_t size{ static_cast<std::size_t>(end - begin) };
+				if (size <= Width)
+				{
+					groups[i + step] = end;
+					continue;
+				}
+
+				AABB centroids{ EmptyBox };
+				for (BuildItem* item = begin; item != end; ++item)
+					centroids = Union(centroids, { item->centroid, item->centroid });
+				const Vec3 extent{ centroids.max - centroids.min };
+				const int axis{ extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2 };
+
+				BuildItem* middle = begin + (size / 2 + Width - 1) / Width * Width;
+				std::nth_element(begin, middle, end, [axis](const BuildItem& a, const BuildItem& b)
+				{
+					return (&a.centroid.x)[axis] < (&b.centroid.x)[axis];
+				});
+				groups[i + step] = middle;
+			}
+		}
+
+		auto buildGroup = [this, &jobs, &node, &groups, &nextNode, index](std::size_t i)
+		{
+			const std::ptrdiff_t size{ groups[i + 1] - groups[i] };
+			if (size == 0)
+				return;
+			if (size == 1)
+			{
+				Proxy& proxy = m_Proxies[groups[i]->proxy];
+				SetSlot(node, i, groups[i]->proxy | ProxyBit, proxy.bounds);
+				proxy.node = index;
+				proxy.slot = static_cast<std::uint32_t>(i);
+				return;
+			}
+
+			const std::uint32_t child{ nextNode.fetch_add(1, std::memory_order_relaxed) };
+			Node& n = m_Nodes[child];
+			n.parent = index;
+			n.parentSlot = static_cast<std::uint32_t>(i);
+			n.depth = node.depth + 1;
+			n.dirty = false;
+			SetSlot(node, i, child, Build(jobs, child, groups[i], groups[i + 1], nextNode));
+		};
+
+		if (count >= ParallelBuildSize)
+		{
+			jobs.ParallelFor(0, Width, [&buildGroup](std::size_t begin, std::size_t end)
+			{
+				for (std::size_t i{ begin }; i < end; ++i)
+					buildGroup(i);
+			}, 1);
+		}
+		else
+		{
+			for (std::size_t i{}; i < Width; ++i)
+				buildGroup(i);
+		}
+		return NodeBounds(node);
+	}
+
+	void BVH::Visit(const CullView& view, const CullView::Task& task, std::vector<std::uint32_t>& visible, std::vector<CullView::Task>& next) const
+	{
+		const Node& node = m_Nodes[task.node];
+		std::uint32_t intersecting, inside;
+		if (task.inside)
+			intersecting = inside = OccupiedChildren(node.minX);
+		else
+		{
+			const ChildMasks masks{ TestChildren(node.minX, view.frustum) };
+			intersecting = masks.intersecting;
+			inside = masks.inside;
+		}
+
+		for (std::size_t i{}; i < Width; ++i)
+		{
+			if (!(intersecting >> i & 1))
+				continue;
+			if (view.occlusion && !view.occlusion->IsVisible({ { node.minX[i], node.minY[i], node.minZ[i] }, { node.maxX[i], node.maxY[i], node.maxZ[i] } }))
+				continue;
+
+			const std::uint32_t child{ node.children[i] };
+			if (child & ProxyBit)
+				visible.push_back(m_Proxies[child & ~ProxyBit].userData);
+			else next.push_back({ child, (inside >> i & 1) != 0 });
+		}
+	}
+
+	void BVH::Cull(JobSystem& jobs, CullView& view) const
+	{
+		SISSKEY_ZONE(u8"BVH::Cull");
+		view.visible.clear();
+		view.tasks.clear();
+		if (m_Nodes.empty())
+			return;
+
+		// Top levels breadth-first until there are enough subtrees for all threads,
+		// proxies found on the way are visible directly
+		view.tasks.push_back({ 0, false });
+		const std::size_t taskCount{ jobs.ThreadCount() * 4 };
+		while (!view.tasks.empty() && view.tasks.size() < taskCount)
+		{
+			view.expand.clear();
+			for (const CullView::Task& task : view.tasks)
+				Visit(view, task, view.visible, view.expand);
+			std::swap(view.tasks, view.expand);
+		}
+
+		if (view.results.size() < view.tasks.size())
+		{
+			view.results.resize(view.tasks.size());
+			view.stacks.resize(view.tasks.size());
+		}
+		jobs.ParallelFor(0, view.tasks.size(), [this, &view](std::size_t first, std::size_t last)
+		{
+			for (std::size_t i{ first }; i < last; ++i)
+			{
+				std::vector<std::uint32_t>& visible = view.results[i];
+				std::vector<CullView::Task>& stack = view.stacks[i];
+				visible.clear();
+				stack.assign(1, view.tasks[i]);
+				while (!stack.empty())
+				{
+					const CullView::Task task{ stack.back() };
+					stack.pop_back();
+					Visit(view, task, visible, stack);
+				}
+			}
+		}, 1);
+
+		for (std::size_t i{}; i < view.tasks.size(); ++i)
+			view.visible.insert(view.visible.end(), view.results[i].begin(), view.results[i].end());
+	}
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "Math.h"
+#include "JobSystem.h"
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	struct AABB
+	{
+		Vec3 min, max;
+	};
+
+	[[nodiscard]] inline AABB Union(const AABB& a, const AABB& b) noexcept
+	{
+		return { { std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z) },
+				 { std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z) } };
+	}
+
+	[[nodiscard]] inline bool Contains(const AABB& outer, const AABB& inner) noexcept
+	{
+		return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+			   outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+	}
+
+	// Planes are (normal, d) with normals pointing inside, a point p is inside if dot(normal, p) + d >= 0
+	struct Frustum
+	{
+		Vec4 planes[6]; // left, right, bottom, top, near, far
+	};
+
+	// Clip space of Vulkan and Direct3D 12: -w <= x, y <= w and 0 <= z <= w
+	[[nodiscard]] Frustum ExtractFrustum(const Mat4& viewProjection) noexcept;
+
+	// Low resolution depth buffer of large occluders, rasterized on the CPU.
+	// Every pixel keeps the nearest occluder depth, a box is hidden if its nearest depth is
+	// behind the occluders in all pixels its projection touches.
+	// Occluders must be solid and should not extend beyond the geometry they stand for.
+	class OcclusionBuffer
+	{
+	public:
+		static constexpr int TileSize{ 8 };
+
+	private:
+		Mat4 m_ViewProjection;
+		int m_Width;
+		int m_Height;
+		int m_TilesX;
+		int m_TilesY;
+		std::vector<float> m_Depth;
+		// Farthest depth of every tile, rejects most of the occluded boxes without reading pixels
+		std::vector<float> m_TileMax;
+
+		void RasterizeTriangle(const Vec4& a, const Vec4& b, const Vec4& c, bool cullBackFaces) noexcept;
+
+	public:
+		explicit OcclusionBuffer(int width = 256, int height = 128);
+
+		// Clears the buffer, occluders are rasterized and boxes tested with viewProjection
+		void Begin(const Mat4& viewProjection);
+		// Triangle list, vertices are transformed by world first. Both windings are rasterized.
+		void RasterizeTriangles(const Vec3* vertices, const std::uint32_t* indices, std::size_t indexCount, const Mat4& world) noexcept;
+		void RasterizeBox(const AABB& box) noexcept;
+		// Must be called after the occluders are rasterized and before the tests
+		void End();
+
+		// False if the box is certainly hidden, thread safe
+		[[nodiscard]] bool IsVisible(const AABB& box) const noexcept;
+
+		[[nodiscard]] int Width() const noexcept { return m_Width; }
+		[[nodiscard]] int Height() const noexcept { return m_Height; }
+		// Row-major, 1 is the far plane
+		[[nodiscard]] const float* Depth() const noexcept { return m_Depth.data(); }
+	};
+
+	// Input and output of BVH::Cull, one per view (camera, shadow cascade and so on).
+	// It keeps its buffers between frames, so culling doesn't allocate after a few frames.
+	struct CullView
+	{
+		Frustum frustum;
+		// Optional, must be finished with End before culling
+		const OcclusionBuffer* occlusion{ nullptr };
+		// User data of the visible proxies
+		std::vector<std::uint32_t> visible;
+
+		// Subtrees distributed between jobs and their results
+		struct Task
+		{
+			std::uint32_t node;
+			bool inside;
+		};
+		std::vector<Task> tasks;
+		std::vector<Task> expand;
+		std::vector<std::vector<std::uint32_t>> results;
+		// Traversal stack of every subtree
+		std::vector<std::vector<Task>> stacks;
+	};
+
+	// Dynamic bounding volume hierarchy with 8 children per node.
+	// A node stores the bounds of its children as structure of arrays, so a frustum plane is tested against
+	// all of them with one AVX2 (or two SSE) operation per component. A child is either a node or a proxy.
+	// Proxies have bounds enlarged by a margin, so small movements don't change the tree. Moved and removed proxies
+	// refit the bounds along their paths and inserts go down the path of the least area increase.
+	// The tree is rebuilt top-down in parallel after many inserts and removals, or when refitting
+	// doubled its surface area.
+	class BVH
+	{
+	public:
+		using ProxyID = std::uint32_t;
+		static constexpr std::size_t Width{ 8 };
+		static constexpr ProxyID InvalidProxy{ 0xFFFFFFFF };
+
+	private:
+		static constexpr std::uint32_t Empty{ 0xFFFFFFFF };
+		static constexpr std::uint32_t ProxyBit{ 0x80000000 };
+
+		struct alignas(32) Node
+		{
+			float minX[Width], minY[Width], minZ[Width];
+			float maxX[Width], maxY[Width], maxZ[Width];
+			// Node index, proxy index with ProxyBit or Empty
+			std::uint32_t children[Width];
+			std::uint32_t parent;
+			std::uint32_t parentSlot;
+			std::uint32_t depth;
+			bool dirty;
+
+			// Left uninitialized, the build preallocates nodes for the worst case and fills the ones it uses
+			Node() noexcept {}
+		};
+
+		struct Proxy
+		{
+			AABB bounds; // enlarged by the margin
+			std::uint32_t userData;
+			std::uint32_t node; // Empty if not in the tree
+			std::uint32_t slot;
+			bool alive;
+		};
+
+		struct BuildItem
+		{
+			Vec3 centroid;
+			std::uint32_t proxy;
+		};
+
+		float m_Margin;
+		std::vector<Node> m_Nodes;
+		std::vector<Proxy> m_Proxies;
+		std::vector<ProxyID> m_FreeProxies;
+		std::size_t m_ProxyCount{ 0 };
+		// Inserts and removals since the last build
+		std::size_t m_Changes{ 0 };
+		bool m_Rebuild{ false };
+		// Sum of the surface areas of all nodes but the root, the expected traversal cost grows with it
+		double m_Area{ 0.0 };
+		double m_BuildArea{ 0.0 };
+		// Dirty nodes by depth, refit bottom-up
+		std::vector<std::vector<std::uint32_t>> m_Dirty;
+		std::vector<BuildItem> m_BuildItems;
+
+		[[nodiscard]] std::uint32_t AllocateNode(std::uint32_t parent, std::uint32_t parentSlot, std::uint32_t depth);
+		void MarkDirty(std::uint32_t node);
+		void SetSlot(Node& node, std::size_t slot, std::uint32_t child, const AABB& bounds) noexcept;
+		[[nodiscard]] AABB NodeBounds(const Node& node) const noexcept;
+		void Place(ProxyID proxy);
+		void NoteChange() noexcept;
+		void Refit();
+		void Rebuild(JobSystem& jobs);
+		AABB Build(JobSystem& jobs, std::uint32_t node, BuildItem* first, BuildItem* last, std::atomic<std::uint32_t>& nextNode);
+		// Visible proxies of the node are appended to visible, visible child nodes to next
+		void Visit(const CullView& view, const CullView::Task& task, std::vector<std::uint32_t>& visible, std::vector<CullView::Task>& next) const;
+
+	public:
+		explicit BVH(float margin = 0.1f) : m_Margin{ margin } {}
+
+		ProxyID Insert(const AABB& bounds, std::uint32_t userData);
+		void Remove(ProxyID proxy);
+		void Move(ProxyID proxy, const AABB& bounds);
+		// Applies the changes by refitting or rebuilding, must be called before culling
+		void Update(JobSystem& jobs);
+
+		// Fills view.visible with the user data of the proxies intersecting the frustum that aren't occluded
+		void Cull(JobSystem& jobs, CullView& view) const;
+
+		[[nodiscard]] std::size_t ProxyCount() const noexcept { return m_ProxyCount; }
+		[[nodiscard]] std::size_t NodeCount() const noexcept { return m_Nodes.size(); }
+	};
+}
@@ -1,16 +1,348 @@
 #include "Engine.h"
 
+#include <algorithm>
+#include <thread>
+#include <limits>
+#include <exception>
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN64
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
 namespace sisskey
 {
+	namespace
+	{
+		CVar<float> cv_FixedTimeStep{ SISSKEY_CVAR(u8"engine.fixedTimeStep"), 1.0f / 60.0f, u8"Simulation time step in seconds", 1e-4f, 1.0f };
+		CVar<float> cv_MaxFrameTime{ SISSKEY_CVAR(u8"engine.maxFrameTime"), 0.25f, u8"Longest frame time simulated at once, avoids the \"spiral of death\" after long stalls", 1e-3f, 10.0f };
+		// No device waits for vsync, uncapped frames keep a core busy
+		CVar<int> cv_FrameCap{ SISSKEY_CVAR(u8"engine.frameCap"), 240, u8"Frames per second limit, 0 - uncapped, the main thread never sleeps", 0, 10000 };
+		CVar<int> cv_BackgroundFrameRate{ SISSKEY_CVAR(u8"engine.backgroundFrameRate"), 0, u8"Frames per second while the window is unfocused or minimized, 0 - no frames until it's active again", 0, 1000 };
+		CVar<float> cv_SimulatedFrameTime{ SISSKEY_CVAR(u8"engine.simulatedFrameTime"), 0.0f, u8"Frame time fed to the simulation in seconds, for repeatable runs, 0 - measured", 0.0f, 10.0f };
+		CVar<int> cv_MaxFrames{ SISSKEY_CVAR(u8"engine.maxFrames"), 0, u8"Quit after this many frames, 0 - run until the window is closed", 0, std::numeric_limits<int>::max() };
+		CVar<int> cv_GraphicsAPI{ SISSKEY_CVAR(u8"graphics.api"), 0, u8"Graphics device created by the engine: 0 - Vulkan, 1 - DX12, 2 - software, 3 - null", 0, 3 };
+		CVar<int> cv_Threads{ SISSKEY_CVAR(u8"jobs.threads"), 0, u8"Job system threads including the main one, 0 - one per physical core", 0, 256 };
+		CVar<int> cv_IOBackend{ SISSKEY_CVAR(u8"io.backend"), 0, u8"Asynchronous reads: 0 - io_uring if available, 1 - thread pool. Applied at startup", 0, 1 };
+		CVar<int> cv_IOQueueDepth{ SISSKEY_CVAR(u8"io.queueDepth"), 64, u8"Asynchronous reads in flight at once. Applied at startup", 1, 4096 };
+		CVar<int> cv_IOThreads{ SISSKEY_CVAR(u8"io.threads"), 2, u8"Reader threads of the thread pool backend. Applied at startup", 1, 64 };
+	}
+
+	// "+name value" and "--name=value" set console variables.
+	// They are removed from args and take precedence over the settings file.
 	void Engine::ParseCmdLine(std::vector<std::string>& args)
 	{
+		std::vector<std::string> rest;
+		for (std::size_t i{}; i < args.size(); ++i)
+		{
+			const std::string& arg = args[i];
+			if (arg.size() > 1 && arg[0] == '+' && i + 1 < args.size() && CVars::Find(std::string_view{ arg }.substr(1)))
+			{
+				m_CmdLineVars.emplace_back(arg.substr(1), args[i + 1]);
+				++i;
+				continue;
+			}
+
+			if (const std::size_t eq{ arg.find('=') }; arg.rfind(u8"--", 0) == 0 && eq != std::string::npos && CVars::Find(std::string_view{ arg }.substr(2, eq - 2)))
+			{
+				m_CmdLineVars.emplace_back(arg.substr(2, eq - 2), arg.substr(eq + 1));
+				continue;
+			}
+
+			rest.push_back(arg);
+		}
+		args = std::move(rest);
+
+		ApplyCmdLine();
+	}
+
+	void Engine::ApplyCmdLine()
+	{
+		for (const auto& [name, value] : m_CmdLineVars)
+			CVars::Set(name, value);
 	}
 
 	void Engine::LoadSettings(std::filesystem::path settings)
 	{
+		// Keys without a game binding set console variables of the same name
+		m_Settings.SetUnboundHandler([](std::string_view key, JsonValue value)
+		{
+			if (CVarBase* cvar = CVars::Find(key))
+			{
+				if (value.IsBool())
+					cvar->Set(value.AsBool() ? 1.0 : 0.0);
+				else if (value.IsNumber())
+					cvar->Set(value.AsNumber());
+				else if (value.IsString())
+					cvar->SetFromString(value.AsString());
+			}
+		});
+
+		// A malformed file keeps the defaults, it's watched and applied once it's fixed
+		try
+		{
+			m_Settings.Load(settings);
+		}
+		catch (const std::exception& e)
+		{
+			std::fprintf(stderr, u8"%s: %s\n", settings.u8string().c_str(), e.what());
+		}
+		ApplyCmdLine();
 	}
 
 	void Engine::Initialize()
 	{
+		// Before any other thread reads the clock
+		Clock::EnableTSC();
+		SISSKEY_PROFILE_THREAD(u8"Main");
+		CreateJobSystem();
+		m_Window = Window::Create();
+		m_GraphicsDevice = GraphicsDevice::Create(static_cast<GraphicsDevice::API>(cv_GraphicsAPI.Get()), m_Window.get());
+		// Completions end the wait for messages in the background
+		m_AsyncIO = std::make_unique<AsyncIO>(static_cast<AsyncIO::Backend>(cv_IOBackend.Get()), static_cast<std::size_t>(cv_IOQueueDepth.Get()),
+											  static_cast<std::size_t>(cv_IOThreads.Get()), [window = m_Window.get()]() { window->Wake(); });
+	}
+
+	void Engine::CreateJobSystem()
+	{
+		// Destroy the old threads first
+		m_RenderQueue.reset();
+		m_FrameAllocator.reset();
+		m_JobSystem.reset();
+
+		m_JobThreads = cv_Threads.Get();
+		m_JobSystem = std::make_unique<JobSystem>(static_cast<std::size_t>(m_JobThreads));
+		m_FrameAllocator = std::make_unique<FrameAllocator>(m_JobSystem->ThreadCount(), 1 << 20);
+		m_RenderQueue = std::make_unique<RenderQueue>(m_JobSystem->ThreadCount());
+	}
+
+	void Engine::SetFixedTimeStep(float dt)
+	{
+		assert(dt > 0.0f);
+		cv_FixedTimeStep.Set(dt);
+	}
+
+	void Engine::SetMaxFrameTime(float time)
+	{
+		assert(time > 0.0f);
+		cv_MaxFrameTime.Set(time);
+	}
+
+	void Engine::SetFrameCap(int fps)
+	{
+		cv_FrameCap.Set(fps);
+	}
+
+	void Engine::Wake() noexcept
+	{
+		if (m_Window)
+			m_Window->Wake();
+	}
+
+	// Sleep in 1 ms steps while the remaining time is larger than the
+	// expected duration of such a sleep, then spin for the rest.
+	// The estimate adapts to the actual scheduler granularity,
+	// so the spin part stays short without oversleeping the deadline.
+	void Engine::WaitUntil(std::int64_t deadline) noexcept
+	{
+		for (auto now = Clock::Now(); now < deadline; now = Clock::Now())
+		{
+			const double remaining = Clock::ToSeconds(deadline - now);
+			if (remaining <= m_Sleep.estimate)
+				break;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			const double observed = Clock::ToSeconds(Clock::Now() - now);
+			++m_Sleep.count;
+			const double delta = observed - m_Sleep.mean;
+			m_Sleep.mean += delta / static_cast<double>(m_Sleep.count);
+			m_Sleep.m2 += delta * (observed - m_Sleep.mean);
+			m_Sleep.estimate = m_Sleep.mean + std::sqrt(m_Sleep.m2 / static_cast<double>(m_Sleep.count - 1));
+
+			// Keep adapting if the scheduler behaviour changes over time
+			if (m_Sleep.count > 1000)
+				m_Sleep = SleepEstimate{ m_Sleep.estimate, m_Sleep.mean, 0.0, 1 };
+		}
+
+		while (Clock::Now() < deadline)
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			_mm_pause();
+#else
+			std::this_thread::yield();
+#endif
+		}
+	}
+
+	void Engine::Run(const UpdateCallback& update, const RenderCallback& render)
+	{
+		assert(m_Window && "Engine::Initialize must be called before Engine::Run");
+
+#ifdef _WIN64
+		// Default scheduler granularity on Windows is 15.6 ms
+		timeBeginPeriod(1);
+#endif
+
+		// Simulation time is accumulated in integer clock ticks, so it doesn't drift
+		std::int64_t accumulator{ 0 };
+		std::int64_t deadline{ Clock::Now() };
+		std::int64_t frameStart{ deadline };
+		std::int64_t backgroundDeadline{ deadline };
+		bool paused{ false };
+		std::int64_t frames{ 0 };
+		m_Timer.Reset();
+
+		for (;;)
+		{
+			// In the background the thread sleeps until a message, Wake or the next throttled frame
+			Window::PMResult pmr{ Window::PMResult::Nothing };
+			bool messagesProcessed{ false };
+			if (paused)
+			{
+				while (paused)
+				{
+					const int rate{ cv_BackgroundFrameRate.Get() };
+					const std::int64_t now{ Clock::Now() };
+					if (rate > 0 && now >= backgroundDeadline)
+					{
+						backgroundDeadline = std::max(backgroundDeadline + Clock::Frequency / rate, now);
+						break;
+					}
+
+					m_Window->WaitMessages(rate > 0 ? backgroundDeadline - now : -1);
+
+					if (m_Settings.Poll())
+						ApplyCmdLine();
+					CVars::ProcessChanges();
+					m_AsyncIO->ProcessCompletions(*m_JobSystem);
+
+					// Input events of this call are kept for the frame
+					pmr = m_Window->ProcessMessages();
+					messagesProcessed = true;
+					if (pmr == Window::PMResult::Quit)
+						break;
+					if (pmr == Window::PMResult::Resume)
+						paused = false;
+				}
+				if (pmr == Window::PMResult::Quit)
+					break;
+
+				// Idle time isn't a part of any frame
+				frameStart = deadline = Clock::Now();
+			}
+
+			{
+				SISSKEY_ZONE(u8"Frame");
+				{
+					SISSKEY_ZONE(u8"Settings");
+					if (m_Settings.Poll())
+						ApplyCmdLine();
+					CVars::ProcessChanges();
+				}
+
+				// No jobs are in flight between frames
+				if (cv_Threads.Get() != m_JobThreads)
+					CreateJobSystem();
+				m_FrameAllocator->BeginFrame();
+
+				{
+					SISSKEY_ZONE(u8"IO");
+					m_AsyncIO->ProcessCompletions(*m_JobSystem);
+				}
+
+				const float dt{ cv_FixedTimeStep.Get() };
+				const std::int64_t step{ Clock::FromSeconds(dt) };
+				const std::int64_t maxFrameTime{ Clock::FromSeconds(cv_MaxFrameTime.Get()) };
+
+				if (!messagesProcessed)
+				{
+					SISSKEY_ZONE(u8"ProcessMessages");
+					pmr = m_Window->ProcessMessages();
+				}
+				if (pmr == Window::PMResult::Quit)
+					break;
+				else if (pmr == Window::PMResult::Pause)
+				{
+					m_Timer.Stop();
+					paused = true;
+					backgroundDeadline = Clock::Now();
+				}
+				else if (pmr == Window::PMResult::Resume)
+				{
+					m_Timer.Start();
+					paused = false;
+				}
+
+				// Nothing to do until the next background frame
+				if (paused && cv_BackgroundFrameRate.Get() == 0)
+					continue;
+
+				m_Timer.Tick();
+				if (const float simulated{ cv_SimulatedFrameTime.Get() }; simulated > 0.0f)
+					accumulator += Clock::FromSeconds(simulated);
+				else accumulator += std::min(m_Timer.DeltaTicks(), maxFrameTime);
+				while (accumulator >= step)
+				{
+					SISSKEY_ZONE(u8"Update");
+					if (update)
+						update(dt);
+					accumulator -= step;
+				}
+
+				if (!m_FrameGraph.Empty())
+				{
+					SISSKEY_ZONE(u8"FrameGraph");
+					m_FrameGraph.Execute(*m_JobSystem);
+				}
+
+				if (render)
+				{
+					SISSKEY_ZONE(u8"Render");
+					render(static_cast<float>(static_cast<double>(accumulator) / static_cast<double>(step)));
+					m_RenderQueue->Sort(*m_JobSystem);
+					m_RenderQueue->Submit(*m_GraphicsDevice);
+				}
+				m_GraphicsDevice->EndFrame(*m_JobSystem);
+				m_RenderQueue->EndFrame();
+
+				if (const int frameCap{ cv_FrameCap.Get() }; frameCap > 0)
+				{
+					SISSKEY_ZONE(u8"Wait");
+					const std::int64_t period{ Clock::Frequency / frameCap };
+					deadline += period;
+
+					// Don't try to catch up after a long frame, start over instead
+					const std::int64_t now{ Clock::Now() };
+					if (deadline + period < now)
+						deadline = now;
+
+					WaitUntil(deadline);
+				}
+			}
+			SISSKEY_PROFILE_FRAME();
+
+			const std::int64_t frameEnd{ Clock::Now() };
+			m_FrameStats.AddFrame(frameEnd - frameStart);
+			frameStart = frameEnd;
+
+			++frames;
+			if (const int maxFrames{ cv_MaxFrames.Get() }; maxFrames > 0 && frames >= maxFrames)
+				break;
+		}
+
+#ifdef _WIN64
+		timeEndPeriod(1);
+#endif
 	}
-}
\ No newline at end of file
+}
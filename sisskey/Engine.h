@@ -2,12 +2,65 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+#include "Timer.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "Window.h"
+#include "GraphicsDevice.h"
+#include "JobSystem.h"
+#include "TaskGraph.h"
+#include "FrameAllocator.h"
+#include "RenderQueue.h"
+#include "AsyncIO.h"
+#include "World.h"
+#include "Settings.h"
+#include "CVar.h"
 
 namespace sisskey
 {
 	class Engine
 	{
+	public:
+		// Called zero or more times per frame with a fixed delta time
+		using UpdateCallback = std::function<void(float dt)>;
+		// Called once per frame with the interpolation factor [0, 1)
+		// between the two latest simulation states
+		using RenderCallback = std::function<void(float alpha)>;
+
 	private:
+		std::unique_ptr<JobSystem> m_JobSystem;
+		std::unique_ptr<FrameAllocator> m_FrameAllocator;
+		std::unique_ptr<RenderQueue> m_RenderQueue;
+		std::unique_ptr<Window> m_Window;
+		std::unique_ptr<GraphicsDevice> m_GraphicsDevice;
+		std::unique_ptr<AsyncIO> m_AsyncIO;
+		Timer m_Timer;
+		FrameStats m_FrameStats;
+		TaskGraph m_FrameGraph;
+		World m_World;
+		Settings m_Settings;
+
+		int m_JobThreads{ 0 };
+		std::vector<std::pair<std::string, std::string>> m_CmdLineVars;
+
+		// Running estimate of how long a 1 ms sleep really takes (Welford's algorithm)
+		// https://blat-blatnik.github.io/computerBear/making-accurate-sleep-function/
+		struct SleepEstimate
+		{
+			double estimate{ 5e-3 };
+			double mean{ 5e-3 };
+			double m2{ 0.0 };
+			std::int64_t count{ 1 };
+		} m_Sleep;
+
+		// Deadline in Clock ticks
+		void WaitUntil(std::int64_t deadline) noexcept;
+		void CreateJobSystem();
+		void ApplyCmdLine();
 
 	public:
 		Engine() = default;
@@ -18,8 +71,40 @@ namespace sisskey
 		Engine& operator=(const Engine&) = delete;
 
 		void ParseCmdLine(std::vector<std::string>& args);
+		// Binds engine settings and loads the file, it's reloaded between frames when modified.
+		// A malformed file is reported on stderr and the defaults are kept. The engine must not be moved afterwards.
 		void LoadSettings(std::filesystem::path settings);
 
 		void Initialize();
+		void Run(const UpdateCallback& update, const RenderCallback& render);
+
+		// Set the engine.fixedTimeStep, engine.maxFrameTime and engine.frameCap console variables
+		void SetFixedTimeStep(float dt);
+		void SetMaxFrameTime(float time);
+		// 240 by default, 0 - uncapped, frames are rendered back to back
+		void SetFrameCap(int fps);
+
+		// Ends the wait for window messages while the engine idles in the background, can be called from any thread,
+		// e.g. by jobs that have results for the main thread. See engine.backgroundFrameRate.
+		void Wake() noexcept;
+
+		[[nodiscard]] Window& GetWindow() noexcept { return *m_Window; }
+		// Created for the window, see graphics.api
+		[[nodiscard]] GraphicsDevice& GetGraphicsDevice() noexcept { return *m_GraphicsDevice; }
+		// The job system, the frame allocator and the render queue are recreated between frames when jobs.threads changes
+		[[nodiscard]] JobSystem& GetJobSystem() noexcept { return *m_JobSystem; }
+		// Completion callbacks run at the beginning of a frame, see io.backend
+		[[nodiscard]] AsyncIO& GetAsyncIO() noexcept { return *m_AsyncIO; }
+		// Transient memory, valid until the end of the next frame
+		[[nodiscard]] FrameAllocator& GetFrameAllocator() noexcept { return *m_FrameAllocator; }
+		// Commands recorded by the render callback are sorted and submitted right after it
+		[[nodiscard]] RenderQueue& GetRenderQueue() noexcept { return *m_RenderQueue; }
+		// Systems executed in parallel once per frame, after simulation updates and before rendering
+		[[nodiscard]] TaskGraph& GetFrameGraph() noexcept { return m_FrameGraph; }
+		[[nodiscard]] World& GetWorld() noexcept { return m_World; }
+		// Bind game settings before LoadSettings
+		[[nodiscard]] Settings& GetSettings() noexcept { return m_Settings; }
+		// Durations of the latest frames, including frame cap waits
+		[[nodiscard]] const FrameStats& GetFrameStats() const noexcept { return m_FrameStats; }
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,96 @@
+#include "FileWatcher.h"
+
+#include <stdexcept>
+#include <cstring>
+
+#ifdef _WIN64
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace sisskey
+{
+	FileWatcher::FileWatcher(std::filesystem::path path) : m_Path{ std::filesystem::absolute(path) }
+	{
+		// Watch the directory, the file itself may be replaced or not exist yet
+		const std::filesystem::path directory{ m_Path.parent_path() };
+
+#ifdef _WIN64
+		m_Handle = FindFirstChangeNotificationW(directory.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+		if (m_Handle == INVALID_HANDLE_VALUE)
+		{
+			m_Handle = nullptr;
+			throw std::runtime_error{ u8"Failed to watch directory" };
+		}
+
+		std::error_code ec;
+		m_LastWrite = std::filesystem::last_write_time(m_Path, ec);
+#elif defined(__linux__)
+		m_Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_Fd == -1)
+			throw std::runtime_error{ u8"Failed to initialize inotify" };
+
+		if (inotify_add_watch(m_Fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1)
+		{
+			close(m_Fd);
+			throw std::runtime_error{ u8"Failed to watch directory" };
+		}
+#endif
+	}
+
+	FileWatcher::~FileWatcher()
+	{
+#ifdef _WIN64
+		if (m_Handle)
+			FindCloseChangeNotification(m_Handle);
+#elif defined(__linux__)
+		if (m_Fd != -1)
+			close(m_Fd);
+#endif
+	}
+
+	bool FileWatcher::Changed()
+	{
+		bool changed{ false };
+
+#ifdef _WIN64
+		// The notification only tells that something in the directory has changed
+		while (WaitForSingleObject(m_Handle, 0) == WAIT_OBJECT_0)
+		{
+			FindNextChangeNotification(m_Handle);
+
+			std::error_code ec;
+			const auto lastWrite = std::filesystem::last_write_time(m_Path, ec);
+			if (!ec && lastWrite != m_LastWrite)
+			{
+				m_LastWrite = lastWrite;
+				changed = true;
+			}
+		}
+#elif defined(__linux__)
+		const std::string name{ m_Path.filename().string() };
+
+		alignas(inotify_event) char buffer[4096];
+		for (;;)
+		{
+			const ssize_t length{ read(m_Fd, buffer, sizeof(buffer)) };
+			if (length <= 0)
+				break;
+
+			for (ssize_t offset{ 0 }; offset < length;)
+			{
+				const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				if (event->len && std::strcmp(event->name, name.c_str()) == 0)
+					changed = true;
+				offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+			}
+		}
+#endif
+
+		return changed;
+	}
+}
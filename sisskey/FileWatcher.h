@@ -0,0 +1,31 @@
+#pragma once
+
+#include <filesystem>
+
+namespace sisskey
+{
+	// Detects modifications of a single file without blocking,
+	// including editors that save by writing a new file and renaming it over the old one.
+	class FileWatcher
+	{
+	private:
+		std::filesystem::path m_Path;
+#ifdef _WIN64
+		void* m_Handle{ nullptr };
+		std::filesystem::file_time_type m_LastWrite;
+#elif defined(__linux__)
+		int m_Fd{ -1 };
+#endif
+
+	public:
+		// Throws std::runtime_error if the directory of the file can't be watched
+		explicit FileWatcher(std::filesystem::path path);
+		~FileWatcher();
+		FileWatcher(const FileWatcher&) = delete;
+		FileWatcher& operator=(const FileWatcher&) = delete;
+
+		// True if the file was written since the previous call
+		[[nodiscard]] bool Changed();
+		[[nodiscard]] const std::filesystem::path& GetPath() const noexcept { return m_Path; }
+	};
+}
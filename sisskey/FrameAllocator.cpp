@@ -0,0 +1,86 @@
+#include "FrameAllocator.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace sisskey
+{
+	LinearArena::LinearArena(std::size_t capacity)
+	{
+		AddBlock(capacity);
+	}
+
+	void LinearArena::AddBlock(std::size_t size)
+	{
+		// Grow geometrically so a frame that overflows doesn't allocate too often
+		if (!m_Blocks.empty())
+			size = std::max(size, m_Blocks.back().size * 2);
+
+		m_Blocks.push_back({ std::make_unique<std::byte[]>(size), size });
+		m_Current = m_Blocks.back().memory.get();
+		m_End = m_Current + size;
+	}
+
+	void LinearArena::Reset()
+	{
+		m_HighWaterMark = std::max(m_HighWaterMark, m_Used);
+
+		// Merge the overflow blocks so the next frame of the same size fits into one
+		if (m_Blocks.size() > 1)
+		{
+			const std::size_t capacity{ Capacity() };
+			m_Blocks.clear();
+			AddBlock(capacity);
+		}
+
+		m_Current = m_Blocks.front().memory.get();
+		m_End = m_Current + m_Blocks.front().size;
+		m_Used = 0;
+	}
+
+	std::size_t LinearArena::Capacity() const noexcept
+	{
+		std::size_t capacity{ 0 };
+		for (const auto& block : m_Blocks)
+			capacity += block.size;
+		return capacity;
+	}
+
+	FrameAllocator::FrameAllocator(std::size_t threads, std::size_t bytesPerThread, std::size_t frames)
+	{
+		assert(threads > 0 && frames > 0);
+
+		m_Arenas.resize(frames);
+		for (auto& arenas : m_Arenas)
+		{
+			arenas.reserve(threads);
+			for (std::size_t i{}; i < threads; ++i)
+				arenas.emplace_back(bytesPerThread);
+		}
+		m_Statistics.capacity = threads * bytesPerThread * frames;
+	}
+
+	LinearArena& FrameAllocator::CurrentArena() noexcept
+	{
+		assert(JobSystem::ThreadIndex() < m_Arenas[m_Frame].size());
+		return m_Arenas[m_Frame][JobSystem::ThreadIndex()];
+	}
+
+	void FrameAllocator::BeginFrame()
+	{
+		m_Statistics.used = 0;
+		for (const auto& arena : m_Arenas[m_Frame])
+			m_Statistics.used += arena.Used();
+		m_Statistics.highWaterMark = std::max(m_Statistics.highWaterMark, m_Statistics.used);
+
+		m_Frame = (m_Frame + 1) % m_Arenas.size();
+		for (auto& arena : m_Arenas[m_Frame])
+			arena.Reset();
+
+		m_Statistics.capacity = 0;
+		for (const auto& arenas : m_Arenas)
+			for (const auto& arena : arenas)
+				m_Statistics.capacity += arena.Capacity();
+	}
+}
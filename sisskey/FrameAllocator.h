@@ -0,0 +1,145 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Bump allocator, memory is released all at once with Reset.
+	// When the block is exhausted, additional blocks are allocated and
+	// on the next Reset they are merged into a single larger block.
+	class alignas(64) LinearArena
+	{
+	private:
+		struct Block
+		{
+			std::unique_ptr<std::byte[]> memory;
+			std::size_t size;
+		};
+
+		std::vector<Block> m_Blocks;
+		std::byte* m_Current{ nullptr };
+		std::byte* m_End{ nullptr };
+		std::size_t m_Used{ 0 };
+		std::size_t m_HighWaterMark{ 0 };
+
+		void AddBlock(std::size_t size);
+
+	public:
+		explicit LinearArena(std::size_t capacity);
+		LinearArena(LinearArena&&) = default;
+		LinearArena& operator=(LinearArena&&) = default;
+		LinearArena(const LinearArena&) = delete;
+		LinearArena& operator=(const LinearArena&) = delete;
+
+		[[nodiscard]] void* Allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+		{
+			std::uintptr_t p{ (reinterpret_cast<std::uintptr_t>(m_Current) + alignment - 1) & ~(alignment - 1) };
+			if (p + size > reinterpret_cast<std::uintptr_t>(m_End))
+			{
+				AddBlock(size + alignment);
+				p = (reinterpret_cast<std::uintptr_t>(m_Current) + alignment - 1) & ~(alignment - 1);
+			}
+
+			m_Used += p + size - reinterpret_cast<std::uintptr_t>(m_Current);
+			m_Current = reinterpret_cast<std::byte*>(p + size);
+			return reinterpret_cast<void*>(p);
+		}
+
+		void Reset();
+
+		// Bytes allocated since the last Reset, including alignment padding
+		[[nodiscard]] std::size_t Used() const noexcept { return m_Used; }
+		[[nodiscard]] std::size_t HighWaterMark() const noexcept { return m_HighWaterMark; }
+		[[nodiscard]] std::size_t Capacity() const noexcept;
+	};
+
+	// Per-thread linear arenas that are reset at frame boundaries.
+	// Memory allocated during a frame stays valid for (frames - 1) more frames,
+	// so with double buffering render data of frame N lives while N + 1 is simulated.
+	// Threads are identified by JobSystem::ThreadIndex.
+	class FrameAllocator
+	{
+	public:
+		struct Statistics
+		{
+			std::size_t used{ 0 }; // bytes allocated during the last completed frame
+			std::size_t highWaterMark{ 0 }; // maximum of used over all frames
+			std::size_t capacity{ 0 }; // bytes reserved by all arenas
+		};
+
+	private:
+		std::vector<std::vector<LinearArena>> m_Arenas; // [frame][thread]
+		std::size_t m_Frame{ 0 };
+		Statistics m_Statistics;
+
+		[[nodiscard]] LinearArena& CurrentArena() noexcept;
+
+	public:
+		FrameAllocator(std::size_t threads, std::size_t bytesPerThread, std::size_t frames = 2);
+		FrameAllocator(FrameAllocator&&) = default;
+		FrameAllocator& operator=(FrameAllocator&&) = default;
+		FrameAllocator(const FrameAllocator&) = delete;
+		FrameAllocator& operator=(const FrameAllocator&) = delete;
+
+		// Finishes the current frame and recycles the oldest one, main thread only
+		void BeginFrame();
+
+		[[nodiscard]] void* Allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t))
+		{
+			return CurrentArena().Allocate(size, alignment);
+		}
+
+		template<typename T>
+		[[nodiscard]] T* Allocate(std::size_t count)
+		{
+			return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+		}
+
+		// Destructors are never called, so only trivially destructible types are allowed
+		template<typename T, typename... Args>
+		[[nodiscard]] T* New(Args&&... args)
+		{
+			static_assert(std::is_trivially_destructible_v<T>, "Frame allocated objects are never destroyed");
+			return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		}
+
+		[[nodiscard]] const Statistics& GetStatistics() const noexcept { return m_Statistics; }
+		[[nodiscard]] std::size_t FramesInFlight() const noexcept { return m_Arenas.size(); }
+	};
+
+	// Adaptor for standard containers, deallocation is a no-op
+	template<typename T>
+	class FrameStdAllocator
+	{
+		template<typename U>
+		friend class FrameStdAllocator;
+	private:
+		FrameAllocator* m_Allocator;
+
+	public:
+		using value_type = T;
+
+		explicit FrameStdAllocator(FrameAllocator& allocator) noexcept : m_Allocator{ &allocator } {}
+		template<typename U>
+		FrameStdAllocator(const FrameStdAllocator<U>& other) noexcept : m_Allocator{ other.m_Allocator } {}
+
+		[[nodiscard]] T* allocate(std::size_t n) { return m_Allocator->Allocate<T>(n); }
+		void deallocate(T*, std::size_t) noexcept {}
+
+		template<typename U>
+		[[nodiscard]] bool operator==(const FrameStdAllocator<U>& other) const noexcept { return m_Allocator == other.m_Allocator; }
+		template<typename U>
+		[[nodiscard]] bool operator!=(const FrameStdAllocator<U>& other) const noexcept { return m_Allocator != other.m_Allocator; }
+	};
+
+	template<typename T>
+	using FrameVector = std::vector<T, FrameStdAllocator<T>>;
+	using FrameString = std::basic_string<char, std::char_traits<char>, FrameStdAllocator<char>>;
+}
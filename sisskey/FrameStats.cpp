@@ -0,0 +1,127 @@
+#include "FrameStats.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace sisskey
+{
+	FrameStats::FrameStats(std::size_t window) : m_Frames(window), m_Hitch(window)
+	{
+		assert(window > 0);
+	}
+
+	std::size_t FrameStats::Bucket(std::int64_t ticks) noexcept
+	{
+		return std::min(static_cast<std::size_t>(std::max<std::int64_t>(ticks, 0) / BucketWidth), BucketCount - 1);
+	}
+
+	void FrameStats::AddFrame(std::int64_t ticks) noexcept
+	{
+		// Same as Percentile(0.5)
+		const std::int64_t median{ static_cast<std::int64_t>(m_MedianBucket + 1) * BucketWidth };
+		const bool hitch{ m_Count > 0 && ticks >= m_HitchMinimum && static_cast<double>(ticks) > m_HitchFactor * static_cast<double>(median) };
+
+		if (m_Count == m_Frames.size())
+		{
+			// Evict the oldest frame
+			const std::size_t evicted{ Bucket(m_Frames[m_Next]) };
+			--m_Histogram[evicted];
+			m_BelowMedian -= evicted < m_MedianBucket;
+			m_Sum -= m_Frames[m_Next];
+			m_WindowHitches -= m_Hitch[m_Next];
+		}
+		else
+			++m_Count;
+
+		m_Frames[m_Next] = ticks;
+		m_Hitch[m_Next] = hitch;
+		const std::size_t bucket{ Bucket(ticks) };
+		++m_Histogram[bucket];
+		m_BelowMedian += bucket < m_MedianBucket;
+		m_Sum += ticks;
+		m_WindowHitches += hitch;
+		m_TotalHitches += hitch;
+
+		m_Next = (m_Next + 1) % m_Frames.size();
+		UpdateMedian();
+	}
+
+	void FrameStats::UpdateMedian() noexcept
+	{
+		// Rank as in Percentile, the median is the first bucket where the frames reach it
+		const auto rank = std::max<std::size_t>(static_cast<std::size_t>(0.5 * static_cast<double>(m_Count) + 0.5), 1);
+		while (m_BelowMedian + m_Histogram[m_MedianBucket] < rank)
+			m_BelowMedian += m_Histogram[m_MedianBucket++];
+		while (m_MedianBucket > 0 && m_BelowMedian >= rank)
+			m_BelowMedian -= m_Histogram[--m_MedianBucket];
+	}
+
+	void FrameStats::Reset() noexcept
+	{
+		m_Next = 0;
+		m_Count = 0;
+		m_Sum = 0;
+		m_Histogram.fill(0);
+		m_MedianBucket = 0;
+		m_BelowMedian = 0;
+		m_WindowHitches = 0;
+		m_TotalHitches = 0;
+	}
+
+	void FrameStats::SetHitchThreshold(double factor, std::int64_t minimum) noexcept
+	{
+		m_HitchFactor = factor;
+		m_HitchMinimum = minimum;
+	}
+
+	std::int64_t FrameStats::Latest() const noexcept
+	{
+		return m_Count ? m_Frames[(m_Next + m_Frames.size() - 1) % m_Frames.size()] : 0;
+	}
+
+	std::int64_t FrameStats::Min() const noexcept
+	{
+		if (!m_Count)
+			return 0;
+		return *std::min_element(m_Frames.begin(), m_Frames.begin() + m_Count);
+	}
+
+	std::int64_t FrameStats::Max() const noexcept
+	{
+		if (!m_Count)
+			return 0;
+		return *std::max_element(m_Frames.begin(), m_Frames.begin() + m_Count);
+	}
+
+	std::int64_t FrameStats::Percentile(double p) const noexcept
+	{
+		if (!m_Count)
+			return 0;
+
+		// Rank of the percentile, 1-based
+		const auto rank = std::max<std::size_t>(static_cast<std::size_t>(p * static_cast<double>(m_Count) + 0.5), 1);
+		std::size_t seen{ 0 };
+		for (std::size_t i{}; i < BucketCount; ++i)
+		{
+			seen += m_Histogram[i];
+			if (seen >= rank)
+				return static_cast<std::int64_t>(i + 1) * BucketWidth;
+		}
+		return static_cast<std::int64_t>(BucketCount) * BucketWidth;
+	}
+
+	FrameStats::Summary FrameStats::GetSummary() const noexcept
+	{
+		Summary summary;
+		summary.min = Clock::ToSeconds(Min());
+		summary.avg = Clock::ToSeconds(Average());
+		summary.max = Clock::ToSeconds(Max());
+		summary.p50 = Clock::ToSeconds(Percentile(0.5));
+		summary.p95 = Clock::ToSeconds(Percentile(0.95));
+		summary.p99 = Clock::ToSeconds(Percentile(0.99));
+		summary.hitches = m_WindowHitches;
+		summary.frames = m_Count;
+		return summary;
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Frame time statistics over a rolling window of the latest frames.
+	// Percentiles come from a fixed-bucket histogram updated incrementally and nothing allocates after construction.
+	// The median used for hitch detection is kept up to date as frames are added, it moves by a bucket or two
+	// per frame unless frame times jump, so adding a frame doesn't scan the histogram.
+	class FrameStats
+	{
+	public:
+		// 0.1 ms buckets up to 100 ms, longer frames go into the last one
+		static constexpr std::int64_t BucketWidth{ 100'000 };
+		static constexpr std::size_t BucketCount{ 1000 };
+
+		struct Summary
+		{
+			double min{ 0.0 };
+			double avg{ 0.0 };
+			double max{ 0.0 };
+			double p50{ 0.0 };
+			double p95{ 0.0 };
+			double p99{ 0.0 };
+			std::uint32_t hitches{ 0 };
+			std::size_t frames{ 0 };
+		};
+
+	private:
+		std::vector<std::int64_t> m_Frames;
+		std::vector<std::uint8_t> m_Hitch;
+		std::size_t m_Next{ 0 };
+		std::size_t m_Count{ 0 };
+		std::int64_t m_Sum{ 0 };
+		std::array<std::uint32_t, BucketCount> m_Histogram{};
+		// Bucket of the median and the number of frames in the buckets below it
+		std::size_t m_MedianBucket{ 0 };
+		std::size_t m_BelowMedian{ 0 };
+
+		std::uint32_t m_WindowHitches{ 0 };
+		std::uint64_t m_TotalHitches{ 0 };
+		double m_HitchFactor{ 2.0 };
+		std::int64_t m_HitchMinimum{ 0 };
+
+		[[nodiscard]] static std::size_t Bucket(std::int64_t ticks) noexcept;
+		void UpdateMedian() noexcept;
+
+	public:
+		explicit FrameStats(std::size_t window = 300);
+
+		// Frame time in Clock ticks
+		void AddFrame(std::int64_t ticks) noexcept;
+		void Reset() noexcept;
+
+		// A frame is a hitch if it is longer than factor * the median of the window and at least minimum ticks
+		void SetHitchThreshold(double factor, std::int64_t minimum = 0) noexcept;
+
+		[[nodiscard]] std::size_t FrameCount() const noexcept { return m_Count; }
+		[[nodiscard]] std::int64_t Latest() const noexcept;
+		[[nodiscard]] std::int64_t Min() const noexcept;
+		[[nodiscard]] std::int64_t Max() const noexcept;
+		[[nodiscard]] std::int64_t Average() const noexcept { return m_Count ? m_Sum / static_cast<std::int64_t>(m_Count) : 0; }
+		// Upper bound of the bucket containing the percentile, p in [0, 1]
+		[[nodiscard]] std::int64_t Percentile(double p) const noexcept;
+		[[nodiscard]] std::uint32_t WindowHitches() const noexcept { return m_WindowHitches; }
+		[[nodiscard]] std::uint64_t TotalHitches() const noexcept { return m_TotalHitches; }
+
+		// Times in seconds
+		[[nodiscard]] Summary GetSummary() const noexcept;
+	};
+}
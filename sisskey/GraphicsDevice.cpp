@@ -5,11 +5,17 @@
 #endif
 
 #include "GraphicsDeviceVulkan.h"
+#include "GraphicsDeviceSoftware.h"
+#include "GraphicsDeviceNull.h"
 
 namespace sisskey
 {
-	[[nodiscard]] std::unique_ptr<GraphicsDevice> GraphicsDevice::Create(API api)
+	[[nodiscard]] std::unique_ptr<GraphicsDevice> GraphicsDevice::Create(API api, Window* window, std::pair<int, int> size)
 	{
+		if (api == API::Software)
+			return std::make_unique<GraphicsDeviceSoftware>(window, size);
+		if (api == API::Null)
+			return std::make_unique<GraphicsDeviceNull>();
 #ifdef _WIN64
 		if (api == API::DX12)
 			return std::make_unique<GraphicsDeviceDX12>();
@@ -1,16 +1,76 @@
 #pragma once
+#include "HandlePool.h"
 
 #include <memory>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
 
 namespace sisskey
 {
+	class Window;
+	class JobSystem;
+	struct Mat4;
+
+	using BufferHandle = Handle<struct BufferTag>;
+	using TextureHandle = Handle<struct TextureTag>;
+	using PipelineHandle = Handle<struct PipelineTag>;
+	// Resources bound together, e.g. a descriptor set, 0 is none
+	using MaterialID = std::uint32_t;
+
+	struct BufferDesc
+	{
+		enum class Usage
+		{
+			Vertex,
+			Index,
+			Constant,
+			Instance
+		};
+
+		std::size_t size{ 0 };
+		Usage usage{ Usage::Vertex };
+	};
+
+	struct TextureDesc
+	{
+		enum class Format
+		{
+			RGBA8,
+			Depth32F
+		};
+
+		int width{ 0 };
+		int height{ 0 };
+		Format format{ Format::RGBA8 };
+	};
+
+	struct PipelineDesc
+	{
+		// SPIR-V or DXIL module, a pixel shader function of the software device
+		const void* shader{ nullptr };
+		std::size_t shaderSize{ 0 };
+		// Vertex attributes after the position, in floats
+		std::uint32_t attributeCount{ 0 };
+		// Reads the instance transforms of the RenderQueue at instance rate
+		bool instanced{ false };
+		bool cullBackFaces{ true };
+		bool depthTest{ true };
+		bool depthWrite{ true };
+	};
+
 	class GraphicsDevice
 	{
 	public:
+		// Frames the GPU may work on while the CPU records the next one
+		static constexpr std::uint32_t FramesInFlight{ 3 };
+
 		enum class API
 		{
 			Vulkan,
-			DX12
+			DX12,
+			Software,
+			Null
 		};
 	protected:
 		GraphicsDevice() = default;
@@ -19,8 +79,39 @@ namespace sisskey
 		GraphicsDevice(const GraphicsDevice&) = delete;
 		GraphicsDevice& operator=(const GraphicsDevice&) = delete;
 
-		[[nodiscard]] static std::unique_ptr<GraphicsDevice> Create(API api = API::Vulkan);
+		// window: presentation target, nullptr - offscreen
+		[[nodiscard]] static std::unique_ptr<GraphicsDevice> Create(API api = API::Vulkan, Window* window = nullptr, std::pair<int, int> size = { 1280, 720 });
 
+		// Resources are referenced by generational handles, a destroyed handle never resolves again.
+		// The objects are released FramesInFlight frames after they are destroyed, when the GPU is done with them.
+		// Backends without the objects return null handles. Main thread only.
+		[[nodiscard]] virtual BufferHandle CreateBuffer(const BufferDesc& /*desc*/, const void* /*data*/) { return {}; }
+		virtual void DestroyBuffer(BufferHandle /*buffer*/) {}
+		[[nodiscard]] virtual TextureHandle CreateTexture(const TextureDesc& /*desc*/, const void* /*pixels*/) { return {}; }
+		virtual void DestroyTexture(TextureHandle /*texture*/) {}
+		[[nodiscard]] virtual PipelineHandle CreatePipeline(const PipelineDesc& /*desc*/) { return {}; }
+		virtual void DestroyPipeline(PipelineHandle /*pipeline*/) {}
+		// Called once per frame after the last submission. Backends that render on the CPU render and present the frame
+		// with the jobs, then the resources destroyed FramesInFlight frames ago are released.
+		virtual void EndFrame(JobSystem& /*jobs*/) {}
 
+		// Command replay, called by RenderQueue::Submit on the main thread.
+		// Bound state stays until it's set again and Set calls never repeat the bound object.
+		// Backends without the objects ignore the commands.
+		virtual void CmdBegin() {}
+		// Per-instance transforms of the frame, read by instanced draws at instance rate starting from firstInstance.
+		// They are copied to [first, first + count) of a ring buffer that holds capacity transforms,
+		// the ring is recreated when capacity changes. The old ring is released FramesInFlight frames later like a destroyed
+		// resource, frames in flight keep reading it. RenderQueue never writes the regions of frames in flight.
+		virtual void CmdUploadInstances(const Mat4* /*transforms*/, std::uint32_t /*count*/, std::uint32_t /*first*/, std::uint32_t /*capacity*/) {}
+		virtual void CmdSetPipeline(PipelineHandle /*pipeline*/) {}
+		virtual void CmdSetMaterial(MaterialID /*material*/) {}
+		virtual void CmdSetVertexBuffer(BufferHandle /*buffer*/) {}
+		virtual void CmdSetIndexBuffer(BufferHandle /*buffer*/) {}
+		virtual void CmdDraw(std::uint32_t /*vertexCount*/, std::uint32_t /*instanceCount*/, std::uint32_t /*firstVertex*/, std::uint32_t /*firstInstance*/) {}
+		virtual void CmdDrawIndexed(std::uint32_t /*indexCount*/, std::uint32_t /*instanceCount*/, std::uint32_t /*firstIndex*/,
+									std::int32_t /*vertexOffset*/, std::uint32_t /*firstInstance*/) {}
+		virtual void CmdDispatch(std::uint32_t /*x*/, std::uint32_t /*y*/, std::uint32_t /*z*/) {}
+		virtual void CmdEnd() {}
 	};
 }
\ No newline at end of file
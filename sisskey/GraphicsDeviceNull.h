@@ -0,0 +1,31 @@
+#pragma once
+#include "GraphicsDevice.h"
+
+namespace sisskey
+{
+	// Does nothing, for dedicated servers and benchmarks of everything but rendering.
+	// Resources keep only their descriptions, so handles behave as with the other backends.
+	class GraphicsDeviceNull final : public GraphicsDevice
+	{
+	private:
+		HandlePool<BufferDesc, BufferHandle> m_Buffers{ FramesInFlight };
+		HandlePool<TextureDesc, TextureHandle> m_Textures{ FramesInFlight };
+		HandlePool<PipelineDesc, PipelineHandle> m_Pipelines{ FramesInFlight };
+
+	public:
+		GraphicsDeviceNull() = default;
+
+		[[nodiscard]] BufferHandle CreateBuffer(const BufferDesc& desc, const void* /*data*/) override { return m_Buffers.Create(desc); }
+		void DestroyBuffer(BufferHandle buffer) override { m_Buffers.Destroy(buffer); }
+		[[nodiscard]] TextureHandle CreateTexture(const TextureDesc& desc, const void* /*pixels*/) override { return m_Textures.Create(desc); }
+		void DestroyTexture(TextureHandle texture) override { m_Textures.Destroy(texture); }
+		[[nodiscard]] PipelineHandle CreatePipeline(const PipelineDesc& desc) override { return m_Pipelines.Create(desc); }
+		void DestroyPipeline(PipelineHandle pipeline) override { m_Pipelines.Destroy(pipeline); }
+		void EndFrame(JobSystem& /*jobs*/) override
+		{
+			m_Buffers.NextFrame();
+			m_Textures.NextFrame();
+			m_Pipelines.NextFrame();
+		}
+	};
+}
@@ -0,0 +1,544 @@
+#include "GraphicsDeviceSoftware.h"
+#include "Window.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+namespace sisskey
+{
+	GraphicsDeviceSoftware::GraphicsDeviceSoftware(Window* window, std::pair<int, int> size)
+	{
+		m_pWindow = window;
+		Resize(size);
+	}
+
+	void GraphicsDeviceSoftware::Resize(std::pair<int, int> size)
+	{
+		auto [width, height] = size;
+		if (width <= 0 || height <= 0)
+			throw std::runtime_error{ u8"Invalid framebuffer size" };
+
+		m_Width = width;
+		m_Height = height;
+		m_Stride = (width + 7) & ~7;
+		m_TilesX = (m_Stride + TileSize - 1) / TileSize;
+		m_TilesY = (height + TileSize - 1) / TileSize;
+		m_Depth.assign(static_cast<std::size_t>(m_Stride) * height, 1.0f);
+		if (!m_pWindow)
+		{
+			m_Color.assign(static_cast<std::size_t>(m_Stride) * height, 0);
+			m_pColor = m_Color.data();
+		}
+	}
+
+	[[nodiscard]] BufferHandle GraphicsDeviceSoftware::CreateBuffer(const BufferDesc& desc, const void* data)
+	{
+		const BufferHandle buffer{ m_Buffers.Create(desc.size) };
+		if (data)
+			std::memcpy(m_Buffers[buffer].data(), data, desc.size);
+		return buffer;
+	}
+
+	[[nodiscard]] TextureHandle GraphicsDeviceSoftware::CreateTexture(const TextureDesc& desc, const void* pixels)
+	{
+		if (desc.width <= 0 || desc.height <= 0)
+			throw std::runtime_error{ u8"Invalid texture size" };
+
+		const std::size_t count{ static_cast<std::size_t>(desc.width) * desc.height };
+		const TextureHandle texture{ m_Textures.Create(Texture{ desc, std::vector<std::uint32_t>(count) }) };
+		if (pixels)
+			std::memcpy(m_Textures[texture].pixels.data(), pixels, count * sizeof(std::uint32_t));
+		return texture;
+	}
+
+	[[nodiscard]] PipelineHandle GraphicsDeviceSoftware::CreatePipeline(const PipelineDesc& desc)
+	{
+		assert(desc.shader && "Pipeline needs a pixel shader");
+		return m_Pipelines.Create(desc);
+	}
+
+	void GraphicsDeviceSoftware::EndFrame(JobSystem& jobs)
+	{
+		if (!m_Draws.empty() || m_Clear)
+		{
+			Execute(jobs);
+			Present();
+		}
+		m_Buffers.NextFrame();
+		m_Textures.NextFrame();
+		m_Pipelines.NextFrame();
+	}
+
+	void GraphicsDeviceSoftware::CmdBegin()
+	{
+		m_InstanceCount = 0;
+	}
+
+	void GraphicsDeviceSoftware::CmdUploadInstances(const Mat4* transforms, std::uint32_t count, std::uint32_t first, std::uint32_t capacity)
+	{
+		assert(first + count <= capacity);
+		// Replay copies the transforms into the draw calls, no frame reads the old ring after a resize
+		if (m_Instances.size() != capacity)
+			m_Instances.resize(capacity);
+		std::copy_n(transforms, count, m_Instances.begin() + first);
+		m_FirstInstance = first;
+		m_InstanceCount = count;
+	}
+
+	void GraphicsDeviceSoftware::CmdDraw(std::uint32_t vertexCount, std::uint32_t instanceCount, std::uint32_t firstVertex, std::uint32_t firstInstance)
+	{
+		DrawCall draw;
+		draw.vertexCount = vertexCount;
+		Replay(draw, firstVertex, instanceCount, firstInstance);
+	}
+
+	void GraphicsDeviceSoftware::CmdDrawIndexed(std::uint32_t indexCount, std::uint32_t instanceCount, std::uint32_t firstIndex,
+												std::int32_t vertexOffset, std::uint32_t firstInstance)
+	{
+		const std::vector<std::byte>& indices = m_Buffers[m_IndexBuffer];
+		assert((firstIndex + indexCount) * sizeof(std::uint32_t) <= indices.size());
+		DrawCall draw;
+		draw.indices = reinterpret_cast<const std::uint32_t*>(indices.data()) + firstIndex;
+		draw.indexCount = indexCount;
+		assert(vertexOffset >= 0);
+
+		// Meshes share buffers, only the vertices the slice references are transformed for every instance
+		const auto [low, high] = std::minmax_element(draw.indices, draw.indices + indexCount);
+		draw.firstVertex = indexCount ? *low : 0;
+		draw.vertexCount = indexCount ? *high + 1 : 0;
+		Replay(draw, static_cast<std::uint32_t>(vertexOffset), instanceCount, firstInstance);
+	}
+
+	void GraphicsDeviceSoftware::Replay(DrawCall draw, std::uint32_t firstVertex, std::uint32_t instanceCount, std::uint32_t firstInstance)
+	{
+		const PipelineDesc& pipeline = m_Pipelines[m_Pipeline];
+		const std::vector<std::byte>& vertices = m_Buffers[m_VertexBuffer];
+
+		// Planar layout, the positions and then the attributes of all vertices
+		const std::size_t first{ firstVertex };
+		const std::size_t count{ vertices.size() / (sizeof(Vec3) + pipeline.attributeCount * sizeof(float)) };
+		assert(first + draw.vertexCount <= count);
+		const Vec3* positions = reinterpret_cast<const Vec3*>(vertices.data());
+		const float* attributes = reinterpret_cast<const float*>(vertices.data() + count * sizeof(Vec3));
+
+		draw.positions = positions + first;
+		draw.attributes = attributes + first * pipeline.attributeCount;
+		draw.attributeCount = pipeline.attributeCount;
+		draw.shader = reinterpret_cast<PixelShader>(pipeline.shader);
+		draw.cullBackFaces = pipeline.cullBackFaces;
+		draw.depthTest = pipeline.depthTest;
+		draw.depthWrite = pipeline.depthWrite;
+
+		for (std::uint32_t i{}; i < instanceCount; ++i)
+		{
+			const std::uint32_t instance{ firstInstance + i };
+			assert(!pipeline.instanced || instance - m_FirstInstance < m_InstanceCount);
+			draw.transform = pipeline.instanced ? m_ViewProjection * m_Instances[instance] : m_ViewProjection;
+			Draw(draw);
+		}
+	}
+
+	void GraphicsDeviceSoftware::Clear(std::uint32_t color, float depth) noexcept
+	{
+		m_Clear = true;
+		m_ClearColor = color;
+		m_ClearDepth = depth;
+	}
+
+	void GraphicsDeviceSoftware::Draw(const DrawCall& draw)
+	{
+		assert(draw.shader && draw.positions && "Draw call needs positions and a shader");
+		assert(draw.attributeCount <= MaxAttributes && (draw.attributes || !draw.attributeCount));
+		assert(draw.firstVertex <= draw.vertexCount && (draw.indices || !draw.firstVertex));
+		m_Draws.push_back(draw);
+	}
+
+	void GraphicsDeviceSoftware::Execute(JobSystem& jobs)
+	{
+		const std::int64_t start{ Clock::Now() };
+		m_Statistics = {};
+
+		if (m_pWindow)
+		{
+			const Window::Framebuffer framebuffer{ m_pWindow->AcquireFramebuffer({ m_Width, m_Height }) };
+			assert(framebuffer.stride == m_Stride);
+			m_pColor = framebuffer.pixels;
+		}
+
+		m_VertexOffsets.assign(1, 0);
+		m_TriangleOffsets.assign(1, 0);
+		for (const DrawCall& draw : m_Draws)
+		{
+			m_VertexOffsets.push_back(m_VertexOffsets.back() + draw.vertexCount - draw.firstVertex);
+			m_TriangleOffsets.push_back(m_TriangleOffsets.back() + (draw.indices ? draw.indexCount : draw.vertexCount) / 3);
+		}
+		m_Statistics.triangles = m_TriangleOffsets.back();
+
+		const std::size_t chunks{ (m_TriangleOffsets.back() + ChunkSize - 1) / ChunkSize };
+		if (m_Chunks.size() < chunks)
+			m_Chunks.resize(chunks);
+		m_ChunkCount = chunks;
+
+		{
+			SISSKEY_ZONE(u8"Geometry");
+			m_ClipPositions.resize(m_VertexOffsets.back());
+			jobs.ParallelFor(0, m_ClipPositions.size(), [this](std::size_t first, std::size_t last)
+			{
+				TransformVertices(first, last);
+			}, 4096);
+
+			jobs.ParallelFor(0, chunks, [this](std::size_t first, std::size_t last)
+			{
+				for (std::size_t chunk{ first }; chunk < last; ++chunk)
+					ProcessChunk(chunk);
+			}, 1);
+		}
+
+		const std::int64_t geometryEnd{ Clock::Now() };
+		m_Statistics.geometryTicks = geometryEnd - start;
+		for (std::size_t chunk{}; chunk < chunks; ++chunk)
+			m_Statistics.rasterizedTriangles += m_Chunks[chunk].triangles.size();
+
+		if (chunks || m_Clear)
+		{
+			SISSKEY_ZONE(u8"Raster");
+			std::atomic<std::uint64_t> pixels{ 0 };
+			jobs.ParallelFor(0, static_cast<std::size_t>(m_TilesX) * m_TilesY, [this, &pixels](std::size_t first, std::size_t last)
+			{
+				std::uint64_t count{ 0 };
+				for (std::size_t tile{ first }; tile < last; ++tile)
+					count += RasterizeTile(static_cast<int>(tile));
+				pixels.fetch_add(count, std::memory_order_relaxed);
+			}, 1);
+			m_Statistics.shadedPixels = pixels.load(std::memory_order_relaxed);
+		}
+
+		m_Statistics.rasterTicks = Clock::Now() - geometryEnd;
+		m_Clear = false;
+		m_Draws.clear();
+	}
+
+	void GraphicsDeviceSoftware::TransformVertices(std::size_t first, std::size_t last) noexcept
+	{
+		std::size_t draw = static_cast<std::size_t>(std::upper_bound(m_VertexOffsets.begin(), m_VertexOffsets.end(), first) - m_VertexOffsets.begin()) - 1;
+		for (std::size_t i{ first }; i < last; ++i)
+		{
+			while (i >= m_VertexOffsets[draw + 1])
+				++draw;
+			const Vec3 p{ m_Draws[draw].positions[m_Draws[draw].firstVertex + i - m_VertexOffsets[draw]] };
+			m_ClipPositions[i] = m_Draws[draw].transform * Vec4{ p.x, p.y, p.z, 1.0f };
+		}
+	}
+
+	void GraphicsDeviceSoftware::ProcessChunk(std::size_t index) noexcept
+	{
+		Chunk& chunk = m_Chunks[index];
+		chunk.triangles.clear();
+
+		const std::size_t first{ index * ChunkSize };
+		const std::size_t last{ std::min(first + ChunkSize, m_TriangleOffsets.back()) };
+		std::size_t d = static_cast<std::size_t>(std::upper_bound(m_TriangleOffsets.begin(), m_TriangleOffsets.end(), first) - m_TriangleOffsets.begin()) - 1;
+
+		ClipVertex v[3];
+		for (std::size_t t{ first }; t < last; ++t)
+		{
+			while (t >= m_TriangleOffsets[d + 1])
+				++d;
+			const DrawCall& draw = m_Draws[d];
+			const std::size_t local{ (t - m_TriangleOffsets[d]) * 3 };
+
+			for (std::size_t k{}; k < 3; ++k)
+			{
+				const std::uint32_t vertex{ draw.indices ? draw.indices[local + k] : static_cast<std::uint32_t>(local + k) };
+				assert(vertex >= draw.firstVertex && vertex < draw.vertexCount);
+				v[k].position = m_ClipPositions[m_VertexOffsets[d] + vertex - draw.firstVertex];
+				std::copy_n(draw.attributes + static_cast<std::size_t>(vertex) * draw.attributeCount, draw.attributeCount, v[k].attributes);
+			}
+
+			// Entirely outside one of the clip planes
+			const Vec4& a = v[0].position;
+			const Vec4& b = v[1].position;
+			const Vec4& c = v[2].position;
+			if ((a.x > a.w && b.x > b.w && c.x > c.w) || (a.x < -a.w && b.x < -b.w && c.x < -c.w) ||
+				(a.y > a.w && b.y > b.w && c.y > c.w) || (a.y < -a.w && b.y < -b.w && c.y < -c.w) ||
+				(a.z > a.w && b.z > b.w && c.z > c.w) || (a.z < 0.0f && b.z < 0.0f && c.z < 0.0f))
+				continue;
+
+			if (a.z >= 0.0f && b.z >= 0.0f && c.z >= 0.0f)
+			{
+				SetupTriangle(v[0], v[1], v[2], static_cast<std::uint32_t>(d), chunk);
+				continue;
+			}
+
+			// Sutherland-Hodgman against the near plane, z >= 0, a triangle becomes at most a quad
+			ClipVertex polygon[4];
+			std::size_t count{ 0 };
+			for (std::size_t k{}; k < 3; ++k)
+			{
+				const ClipVertex& from = v[k];
+				const ClipVertex& to = v[(k + 1) % 3];
+				if (from.position.z >= 0.0f)
+					polygon[count++] = from;
+				if ((from.position.z >= 0.0f) != (to.position.z >= 0.0f))
+				{
+					const float s{ from.position.z / (from.position.z - to.position.z) };
+					ClipVertex& r = polygon[count++];
+					r.position = from.position + (to.position - from.position) * s;
+					for (std::uint32_t i{}; i < draw.attributeCount; ++i)
+						r.attributes[i] = from.attributes[i] + (to.attributes[i] - from.attributes[i]) * s;
+				}
+			}
+			for (std::size_t k{ 1 }; k + 1 < count; ++k)
+				SetupTriangle(polygon[0], polygon[k], polygon[k + 1], static_cast<std::uint32_t>(d), chunk);
+		}
+
+		// Counting sort of the triangles by the tiles they overlap
+		const std::size_t tiles{ static_cast<std::size_t>(m_TilesX) * m_TilesY };
+		chunk.binOffsets.assign(tiles + 1, 0);
+		for (const Triangle& triangle : chunk.triangles)
+			for (int y{ triangle.minY / TileSize }; y <= triangle.maxY / TileSize; ++y)
+				for (int x{ triangle.minX / TileSize }; x <= triangle.maxX / TileSize; ++x)
+					++chunk.binOffsets[static_cast<std::size_t>(y) * m_TilesX + x + 1];
+
+		for (std::size_t tile{}; tile < tiles; ++tile)
+			chunk.binOffsets[tile + 1] += chunk.binOffsets[tile];
+		chunk.bins.resize(chunk.binOffsets[tiles]);
+
+		// Offsets are used as cursors and shifted back afterwards
+		for (std::uint32_t i{}; i < chunk.triangles.size(); ++i)
+		{
+			const Triangle& triangle = chunk.triangles[i];
+			for (int y{ triangle.minY / TileSize }; y <= triangle.maxY / TileSize; ++y)
+				for (int x{ triangle.minX / TileSize }; x <= triangle.maxX / TileSize; ++x)
+					chunk.bins[chunk.binOffsets[static_cast<std::size_t>(y) * m_TilesX + x]++] = i;
+		}
+		for (std::size_t tile{ tiles }; tile > 0; --tile)
+			chunk.binOffsets[tile] = chunk.binOffsets[tile - 1];
+		chunk.binOffsets[0] = 0;
+	}
+
+	void GraphicsDeviceSoftware::SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, std::uint32_t draw, Chunk& chunk) noexcept
+	{
+		const DrawCall& call = m_Draws[draw];
+		const ClipVertex* v[3]{ &v0, &v1, &v2 };
+		if (!(v0.position.w > 0.0f && v1.position.w > 0.0f && v2.position.w > 0.0f))
+			return;
+
+		// Screen space, y down, pixel centers at .5
+		float x[3], y[3], z[3], invW[3];
+		for (std::size_t i{}; i < 3; ++i)
+		{
+			invW[i] = 1.0f / v[i]->position.w;
+			x[i] = (v[i]->position.x * invW[i] * 0.5f + 0.5f) * static_cast<float>(m_Width);
+			y[i] = (0.5f - v[i]->position.y * invW[i] * 0.5f) * static_cast<float>(m_Height);
+			z[i] = v[i]->position.z * invW[i];
+		}
+
+		// Counter-clockwise in clip space is clockwise with y down, the area is negative
+		float area{ (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]) };
+		if (!(area != 0.0f) || (call.cullBackFaces && area > 0.0f))
+			return;
+
+		// Make the edge functions positive inside
+		if (area < 0.0f)
+		{
+			std::swap(v[1], v[2]);
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(z[1], z[2]);
+			std::swap(invW[1], invW[2]);
+			area = -area;
+		}
+
+		const float minX{ std::clamp(std::floor(std::min({ x[0], x[1], x[2] })), 0.0f, static_cast<float>(m_Width - 1)) };
+		const float maxX{ std::clamp(std::floor(std::max({ x[0], x[1], x[2] })), 0.0f, static_cast<float>(m_Width - 1)) };
+		const float minY{ std::clamp(std::floor(std::min({ y[0], y[1], y[2] })), 0.0f, static_cast<float>(m_Height - 1)) };
+		const float maxY{ std::clamp(std::floor(std::max({ y[0], y[1], y[2] })), 0.0f, static_cast<float>(m_Height - 1)) };
+		if (std::max({ x[0], x[1], x[2] }) < 0.0f || std::max({ y[0], y[1], y[2] }) < 0.0f ||
+			std::min({ x[0], x[1], x[2] }) > static_cast<float>(m_Width) || std::min({ y[0], y[1], y[2] }) > static_cast<float>(m_Height))
+			return;
+
+		Triangle& t = chunk.triangles.emplace_back();
+		t.minX = static_cast<std::int32_t>(minX);
+		t.maxX = static_cast<std::int32_t>(maxX);
+		t.minY = static_cast<std::int32_t>(minY);
+		t.maxY = static_cast<std::int32_t>(maxY);
+		t.draw = draw;
+		t.topLeft = 0;
+
+		// Edge i is opposite to vertex i. Shared edges get exactly negated coefficients,
+		// so a pixel on them belongs to exactly one triangle with the top-left rule.
+		for (std::size_t i{}; i < 3; ++i)
+		{
+			const std::size_t a{ (i + 1) % 3 };
+			const std::size_t b{ (i + 2) % 3 };
+			Plane& edge = t.edges[i];
+			edge.x = y[a] - y[b];
+			edge.y = x[b] - x[a];
+			edge.c = x[a] * y[b] - y[a] * x[b];
+			if (edge.x > 0.0f || (edge.x == 0.0f && edge.y > 0.0f))
+				t.topLeft |= 1u << i;
+		}
+
+		// Planes of values interpolated linearly in screen space
+		const float dx1{ x[1] - x[0] }, dy1{ y[1] - y[0] };
+		const float dx2{ x[2] - x[0] }, dy2{ y[2] - y[0] };
+		const float invArea{ 1.0f / area };
+		const auto plane = [&](float f0, float f1, float f2) noexcept
+		{
+			const float df1{ f1 - f0 };
+			const float df2{ f2 - f0 };
+			Plane p;
+			p.x = (df1 * dy2 - df2 * dy1) * invArea;
+			p.y = (dx1 * df2 - dx2 * df1) * invArea;
+			p.c = f0 - p.x * x[0] - p.y * y[0];
+			return p;
+		};
+
+		t.z = plane(z[0], z[1], z[2]);
+		t.invW = plane(invW[0], invW[1], invW[2]);
+		for (std::uint32_t i{}; i < call.attributeCount; ++i)
+			t.attributes[i] = plane(v[0]->attributes[i] * invW[0], v[1]->attributes[i] * invW[1], v[2]->attributes[i] * invW[2]);
+	}
+
+	std::uint64_t GraphicsDeviceSoftware::RasterizeTile(int tile) noexcept
+	{
+		const int tileX{ tile % m_TilesX * TileSize };
+		const int tileY{ tile / m_TilesX * TileSize };
+
+		if (m_Clear)
+		{
+			const int width{ std::min(TileSize, m_Stride - tileX) };
+			const int bottom{ std::min(tileY + TileSize, m_Height) };
+			for (int y{ tileY }; y < bottom; ++y)
+			{
+				const std::size_t row{ static_cast<std::size_t>(y) * m_Stride + tileX };
+				std::fill_n(m_pColor + row, width, m_ClearColor);
+				std::fill_n(m_Depth.data() + row, width, m_ClearDepth);
+			}
+		}
+
+		std::uint64_t pixels{ 0 };
+		for (std::size_t c{}; c < m_ChunkCount; ++c)
+		{
+			const Chunk& chunk = m_Chunks[c];
+			for (std::uint32_t i{ chunk.binOffsets[tile] }; i < chunk.binOffsets[tile + 1]; ++i)
+				pixels += RasterizeTriangle(chunk.triangles[chunk.bins[i]], tileX, tileY);
+		}
+		return pixels;
+	}
+
+	std::uint64_t GraphicsDeviceSoftware::RasterizeTriangle(const Triangle& t, int tileX, int tileY) noexcept
+	{
+		const DrawCall& draw = m_Draws[t.draw];
+		const int xBegin{ std::max(t.minX, tileX) & ~7 };
+		const int xEnd{ std::min(t.maxX, tileX + TileSize - 1) };
+		const int yBegin{ std::max(t.minY, tileY) };
+		const int yEnd{ std::min(t.maxY, tileY + TileSize - 1) };
+
+		std::uint64_t pixels{ 0 };
+		float attributes[MaxAttributes];
+
+#if defined(SISSKEY_SIMD_AVX2)
+		const __m256 lanes{ _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f) };
+		const __m256 zero{ _mm256_setzero_ps() };
+		const __m256 one{ _mm256_set1_ps(1.0f) };
+		const __m256 width{ _mm256_set1_ps(static_cast<float>(m_Width)) };
+		const __m256 all{ _mm256_castsi256_ps(_mm256_set1_epi32(-1)) };
+		const __m256 depthTest{ draw.depthTest ? zero : all };
+		const __m256 zx{ _mm256_set1_ps(t.z.x) };
+		__m256 ex[3], topLeft[3];
+		for (std::size_t i{}; i < 3; ++i)
+		{
+			ex[i] = _mm256_set1_ps(t.edges[i].x);
+			topLeft[i] = (t.topLeft >> i) & 1 ? all : zero;
+		}
+#endif
+
+		for (int y{ yBegin }; y <= yEnd; ++y)
+		{
+			const float py{ static_cast<float>(y) + 0.5f };
+			std::uint32_t* color = m_pColor + static_cast<std::size_t>(y) * m_Stride;
+			float* depth = m_Depth.data() + static_cast<std::size_t>(y) * m_Stride;
+
+			const float rowEdge[3]{ t.edges[0].y * py + t.edges[0].c, t.edges[1].y * py + t.edges[1].c, t.edges[2].y * py + t.edges[2].c };
+			const float rowZ{ t.z.y * py + t.z.c };
+			const float rowInvW{ t.invW.y * py + t.invW.c };
+
+			for (int x{ xBegin }; x <= xEnd; x += 8)
+			{
+				unsigned mask{ 0 };
+#if defined(SISSKEY_SIMD_AVX2)
+				const __m256 px{ _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes) };
+				__m256 inside{ _mm256_cmp_ps(px, width, _CMP_LT_OQ) };
+				for (std::size_t i{}; i < 3; ++i)
+				{
+					const __m256 e{ _mm256_add_ps(_mm256_mul_ps(ex[i], px), _mm256_set1_ps(rowEdge[i])) };
+					inside = _mm256_and_ps(inside, _mm256_or_ps(_mm256_cmp_ps(e, zero, _CMP_GT_OQ), _mm256_and_ps(_mm256_cmp_ps(e, zero, _CMP_EQ_OQ), topLeft[i])));
+				}
+				if (!_mm256_movemask_ps(inside))
+					continue;
+
+				const __m256 z{ _mm256_add_ps(_mm256_mul_ps(zx, px), _mm256_set1_ps(rowZ)) };
+				const __m256 stored{ _mm256_loadu_ps(depth + x) };
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(z, one, _CMP_LE_OQ));
+				inside = _mm256_and_ps(inside, _mm256_or_ps(_mm256_cmp_ps(z, stored, _CMP_LT_OQ), depthTest));
+				mask = static_cast<unsigned>(_mm256_movemask_ps(inside));
+				if (!mask)
+					continue;
+				if (draw.depthWrite)
+					_mm256_storeu_ps(depth + x, _mm256_blendv_ps(stored, z, inside));
+#else
+				for (int lane{}; lane < 8 && x + lane < m_Width; ++lane)
+				{
+					const float px{ static_cast<float>(x + lane) + 0.5f };
+					bool inside{ true };
+					for (std::size_t i{}; i < 3; ++i)
+					{
+						const float e{ t.edges[i].x * px + rowEdge[i] };
+						inside = inside && (e > 0.0f || (e == 0.0f && ((t.topLeft >> i) & 1)));
+					}
+					const float z{ t.z.x * px + rowZ };
+					if (inside && z <= 1.0f && (!draw.depthTest || z < depth[x + lane]))
+					{
+						mask |= 1u << lane;
+						if (draw.depthWrite)
+							depth[x + lane] = z;
+					}
+				}
+#endif
+
+				for (; mask; mask &= mask - 1)
+				{
+#if defined(_MSC_VER) && !defined(__clang__)
+					unsigned long lane;
+					_BitScanForward(&lane, mask);
+#else
+					const int lane{ __builtin_ctz(mask) };
+#endif
+					const float px{ static_cast<float>(x + static_cast<int>(lane)) + 0.5f };
+					const float w{ 1.0f / (t.invW.x * px + rowInvW) };
+					for (std::uint32_t i{}; i < draw.attributeCount; ++i)
+						attributes[i] = (t.attributes[i].x * px + t.attributes[i].y * py + t.attributes[i].c) * w;
+					color[x + static_cast<int>(lane)] = draw.shader(attributes, draw.constants);
+					++pixels;
+				}
+			}
+		}
+
+		return pixels;
+	}
+
+	void GraphicsDeviceSoftware::Present()
+	{
+		if (m_pWindow)
+			m_pWindow->PresentFramebuffer();
+	}
+}
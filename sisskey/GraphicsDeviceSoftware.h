@@ -0,0 +1,200 @@
+#pragma once
+#include "GraphicsDevice.h"
+#include "Math.h"
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	class JobSystem;
+
+	// CPU rasterizer, a fallback for machines without a GPU and a reference for the other backends.
+	// Triangles are transformed, clipped against the near plane and set up in parallel chunks,
+	// each chunk bins its triangles into screen tiles and the tiles are rasterized in parallel,
+	// 8 pixels per step with AVX2. Submission order is kept within every tile.
+	// Clip space z is in [0, w] and y points up, front faces are counter-clockwise.
+	class GraphicsDeviceSoftware final : public GraphicsDevice
+	{
+	public:
+		static constexpr int TileSize{ 64 };
+		static constexpr std::uint32_t MaxAttributes{ 8 };
+		static constexpr std::size_t ChunkSize{ 1024 };
+
+		// Returns the color of a covered pixel as 0xAARRGGBB,
+		// attributes are interpolated with perspective correction
+		using PixelShader = std::uint32_t(*)(const float* attributes, const void* constants) noexcept;
+
+		// Referenced data must stay valid until Execute returns
+		struct DrawCall
+		{
+			Mat4 transform; // object to clip space
+			const Vec3* positions{ nullptr };
+			// attributeCount floats per vertex
+			const float* attributes{ nullptr };
+			std::uint32_t attributeCount{ 0 };
+			std::uint32_t vertexCount{ 0 };
+			// Smallest index of indexed draws, the vertices below it aren't transformed
+			std::uint32_t firstVertex{ 0 };
+			// Three per triangle, nullptr - consecutive vertices
+			const std::uint32_t* indices{ nullptr };
+			std::uint32_t indexCount{ 0 };
+			PixelShader shader{ nullptr };
+			const void* constants{ nullptr };
+			bool cullBackFaces{ true };
+			bool depthTest{ true };
+			bool depthWrite{ true };
+		};
+
+		// Counters of the last Execute, divide by the times for Mtris/s and Mpix/s
+		struct Statistics
+		{
+			std::uint64_t triangles{ 0 };
+			// After clipping and culling
+			std::uint64_t rasterizedTriangles{ 0 };
+			std::uint64_t shadedPixels{ 0 };
+			std::int64_t geometryTicks{ 0 };
+			std::int64_t rasterTicks{ 0 };
+		};
+
+	private:
+		struct Plane
+		{
+			float x, y, c;
+		};
+
+		struct Triangle
+		{
+			Plane edges[3];
+			Plane z;
+			Plane invW;
+			Plane attributes[MaxAttributes];
+			std::int32_t minX, minY, maxX, maxY;
+			std::uint32_t draw;
+			// Bit per edge
+			std::uint32_t topLeft;
+		};
+
+		struct ClipVertex
+		{
+			Vec4 position;
+			float attributes[MaxAttributes];
+		};
+
+		struct Texture
+		{
+			TextureDesc desc;
+			std::vector<std::uint32_t> pixels;
+		};
+
+		// Triangles of ChunkSize consecutive input triangles sorted by tile
+		struct Chunk
+		{
+			std::vector<Triangle> triangles;
+			std::vector<std::uint32_t> binOffsets;
+			std::vector<std::uint32_t> bins;
+		};
+
+		// Renders into its framebuffers if set
+		Window* m_pWindow{ nullptr };
+
+		int m_Width{ 0 };
+		int m_Height{ 0 };
+		// Multiple of 8, so 8 pixel steps never cross rows
+		int m_Stride{ 0 };
+		int m_TilesX{ 0 };
+		int m_TilesY{ 0 };
+		// m_Color or the framebuffer of the window
+		std::uint32_t* m_pColor{ nullptr };
+		std::vector<std::uint32_t> m_Color;
+		std::vector<float> m_Depth;
+
+		bool m_Clear{ false };
+		std::uint32_t m_ClearColor{ 0 };
+		float m_ClearDepth{ 1.0f };
+
+		HandlePool<std::vector<std::byte>, BufferHandle> m_Buffers{ FramesInFlight };
+		HandlePool<Texture, TextureHandle> m_Textures{ FramesInFlight };
+		HandlePool<PipelineDesc, PipelineHandle> m_Pipelines{ FramesInFlight };
+
+		// Command replay, the instance ring and the range uploaded this frame
+		Mat4 m_ViewProjection{ Identity() };
+		std::vector<Mat4> m_Instances;
+		std::uint32_t m_FirstInstance{ 0 };
+		std::uint32_t m_InstanceCount{ 0 };
+		PipelineHandle m_Pipeline;
+		BufferHandle m_VertexBuffer;
+		BufferHandle m_IndexBuffer;
+
+		std::vector<DrawCall> m_Draws;
+		std::vector<std::size_t> m_VertexOffsets;
+		std::vector<std::size_t> m_TriangleOffsets;
+		std::vector<Vec4> m_ClipPositions;
+		std::vector<Chunk> m_Chunks;
+		std::size_t m_ChunkCount{ 0 };
+		Statistics m_Statistics;
+
+		void TransformVertices(std::size_t first, std::size_t last) noexcept;
+		void ProcessChunk(std::size_t chunk) noexcept;
+		void SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, std::uint32_t draw, Chunk& chunk) noexcept;
+		[[nodiscard]] std::uint64_t RasterizeTile(int tile) noexcept;
+		[[nodiscard]] std::uint64_t RasterizeTriangle(const Triangle& triangle, int tileX, int tileY) noexcept;
+		// Submits a draw call per instance with the bound pipeline and buffers, firstVertex is the vertex offset of indexed draws.
+		// The draw has its vertex range, only the transform differs between the instances.
+		void Replay(DrawCall draw, std::uint32_t firstVertex, std::uint32_t instanceCount, std::uint32_t firstInstance);
+
+	public:
+		// window: nullptr - render offscreen only
+		GraphicsDeviceSoftware(Window* window, std::pair<int, int> size);
+
+		void Resize(std::pair<int, int> size);
+
+		// Resources live in system memory, textures have a 32-bit value per pixel in either format
+		[[nodiscard]] BufferHandle CreateBuffer(const BufferDesc& desc, const void* data) override;
+		void DestroyBuffer(BufferHandle buffer) override { m_Buffers.Destroy(buffer); }
+		[[nodiscard]] TextureHandle CreateTexture(const TextureDesc& desc, const void* pixels) override;
+		void DestroyTexture(TextureHandle texture) override { m_Textures.Destroy(texture); }
+		[[nodiscard]] PipelineHandle CreatePipeline(const PipelineDesc& desc) override;
+		void DestroyPipeline(PipelineHandle pipeline) override { m_Pipelines.Destroy(pipeline); }
+		// Executes and presents the frame unless its draws were already executed, e.g. by a caller using the device directly
+		void EndFrame(JobSystem& jobs) override;
+
+		// RenderQueue commands become a draw call per instance. Vertex buffers hold the positions of all vertices
+		// followed by PipelineDesc::attributeCount floats per vertex, index buffers hold 32-bit indices.
+		// Pipelines created as instanced transform each instance from object to world space with the uploaded
+		// transforms, the others draw in world space. Materials are ignored.
+		void CmdBegin() override;
+		void CmdUploadInstances(const Mat4* transforms, std::uint32_t count, std::uint32_t first, std::uint32_t capacity) override;
+		void CmdSetPipeline(PipelineHandle pipeline) override { m_Pipeline = pipeline; }
+		void CmdSetVertexBuffer(BufferHandle buffer) override { m_VertexBuffer = buffer; }
+		void CmdSetIndexBuffer(BufferHandle buffer) override { m_IndexBuffer = buffer; }
+		void CmdDraw(std::uint32_t vertexCount, std::uint32_t instanceCount, std::uint32_t firstVertex, std::uint32_t firstInstance) override;
+		void CmdDrawIndexed(std::uint32_t indexCount, std::uint32_t instanceCount, std::uint32_t firstIndex,
+							std::int32_t vertexOffset, std::uint32_t firstInstance) override;
+		// World to clip space of the replayed draws
+		void SetViewProjection(const Mat4& viewProjection) noexcept { m_ViewProjection = viewProjection; }
+
+		// Clears the buffers before the draws of the frame are rasterized.
+		// Color is undefined in frames rendered to a window without a clear.
+		void Clear(std::uint32_t color, float depth = 1.0f) noexcept;
+		void Draw(const DrawCall& draw);
+		// Renders and removes the submitted draws, main thread only
+		void Execute(JobSystem& jobs);
+		// Shows the color buffer in the window, see Window::PresentFramebuffer
+		void Present();
+
+		[[nodiscard]] int GetWidth() const noexcept { return m_Width; }
+		[[nodiscard]] int GetHeight() const noexcept { return m_Height; }
+		[[nodiscard]] int GetStride() const noexcept { return m_Stride; }
+		// Row-major, GetStride() pixels per row
+		[[nodiscard]] const std::uint32_t* GetColorBuffer() const noexcept { return m_pColor; }
+		[[nodiscard]] const float* GetDepthBuffer() const noexcept { return m_Depth.data(); }
+		[[nodiscard]] const Statistics& GetStatistics() const noexcept { return m_Statistics; }
+		// Contents of live resources for draw calls, the pipeline shader is a PixelShader
+		[[nodiscard]] const void* GetBufferData(BufferHandle buffer) const noexcept { return m_Buffers[buffer].data(); }
+		[[nodiscard]] const std::uint32_t* GetTexturePixels(TextureHandle texture) const noexcept { return m_Textures[texture].pixels.data(); }
+		[[nodiscard]] const PipelineDesc& GetPipeline(PipelineHandle pipeline) const noexcept { return m_Pipelines[pipeline]; }
+	};
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+namespace sisskey
+{
+	// 32-bit reference to an object of a HandlePool, the slot index and its generation.
+	// The tag makes handles of different resources distinct types. The default handle is null.
+	template<typename Tag>
+	struct Handle
+	{
+		static constexpr std::uint32_t IndexBits{ 20 };
+		static constexpr std::uint32_t IndexMask{ (1u << IndexBits) - 1 };
+
+		std::uint32_t value{ 0 };
+
+		[[nodiscard]] constexpr std::uint32_t Index() const noexcept { return value & IndexMask; }
+		[[nodiscard]] constexpr std::uint32_t Generation() const noexcept { return value >> IndexBits; }
+		[[nodiscard]] constexpr explicit operator bool() const noexcept { return value != 0; }
+		[[nodiscard]] friend constexpr bool operator==(Handle a, Handle b) noexcept { return a.value == b.value; }
+		[[nodiscard]] friend constexpr bool operator!=(Handle a, Handle b) noexcept { return a.value != b.value; }
+	};
+
+	// Objects in one array addressed by generational handles, freed slots are kept in a free list.
+	// Destroy invalidates the handles of an object at once, but the object is released and its slot reused
+	// only after the given number of NextFrame calls, when the GPU no longer reads it.
+	// Generations are 12 bits, a stale handle resolves again after its slot is reused 4095 times.
+	template<typename T, typename H>
+	class HandlePool
+	{
+		static constexpr std::uint32_t MaxGeneration{ (1u << (32 - H::IndexBits)) - 1 };
+
+		std::vector<T> m_Objects;
+		// Never 0, so the null handle doesn't resolve. Incremented by Destroy.
+		std::vector<std::uint32_t> m_Generations;
+		std::vector<std::uint32_t> m_Free;
+		// Slots destroyed in each of the last frames
+		std::vector<std::vector<std::uint32_t>> m_Retiring;
+		std::size_t m_Frame{ 0 };
+		std::size_t m_Size{ 0 };
+
+	public:
+		explicit HandlePool(std::size_t frames) : m_Retiring(frames)
+		{
+			assert(frames > 0);
+		}
+
+		template<typename... Args>
+		[[nodiscard]] H Create(Args&&... args)
+		{
+			std::uint32_t index;
+			if (!m_Free.empty())
+			{
+				index = m_Free.back();
+				m_Free.pop_back();
+				m_Objects[index] = T(std::forward<Args>(args)...);
+			}
+			else
+			{
+				index = static_cast<std::uint32_t>(m_Objects.size());
+				assert(index <= H::IndexMask && "Too many objects");
+				m_Objects.emplace_back(std::forward<Args>(args)...);
+				m_Generations.push_back(1);
+			}
+			++m_Size;
+			return { (m_Generations[index] << H::IndexBits) | index };
+		}
+
+		// Null and stale handles are ignored, stale ones are checked in debug builds
+		void Destroy(H handle)
+		{
+			assert((!handle || IsValid(handle)) && "Destroyed twice or stale handle");
+			if (!IsValid(handle))
+				return;
+			const std::uint32_t index{ handle.Index() };
+			m_Generations[index] = m_Generations[index] == MaxGeneration ? 1 : m_Generations[index] + 1;
+			m_Retiring[m_Frame].push_back(index);
+			--m_Size;
+		}
+
+		// Releases the objects destroyed the given number of frames ago
+		void NextFrame()
+		{
+			m_Frame = (m_Frame + 1) % m_Retiring.size();
+			for (std::uint32_t index : m_Retiring[m_Frame])
+			{
+				m_Objects[index] = T{};
+				m_Free.push_back(index);
+			}
+			m_Retiring[m_Frame].clear();
+		}
+
+		[[nodiscard]] bool IsValid(H handle) const noexcept
+		{
+			const std::uint32_t index{ handle.Index() };
+			return index < m_Generations.size() && m_Generations[index] == handle.Generation();
+		}
+
+		// nullptr if the handle is null or destroyed
+		[[nodiscard]] T* Get(H handle) noexcept { return IsValid(handle) ? &m_Objects[handle.Index()] : nullptr; }
+		[[nodiscard]] const T* Get(H handle) const noexcept { return IsValid(handle) ? &m_Objects[handle.Index()] : nullptr; }
+
+		// Valid handles only, checked in debug builds. Resolves with one indexed load.
+		[[nodiscard]] T& operator[](H handle) noexcept
+		{
+			assert(IsValid(handle));
+			return m_Objects[handle.Index()];
+		}
+		[[nodiscard]] const T& operator[](H handle) const noexcept
+		{
+			assert(IsValid(handle));
+			return m_Objects[handle.Index()];
+		}
+
+		// Live objects, without the destroyed ones that aren't released yet
+		[[nodiscard]] std::size_t Size() const noexcept { return m_Size; }
+	};
+}
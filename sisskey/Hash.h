@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string_view>
+#include <type_traits>
+#include <cstdint>
+
+namespace sisskey
+{
+	// 64-bit FNV-1a, usable at compile time
+	// http://www.isthe.com/chongo/tech/comp/fnv/
+	[[nodiscard]] constexpr std::uint64_t HashName(std::string_view name) noexcept
+	{
+		std::uint64_t hash{ 0xcbf29ce484222325 };
+		for (char c : name)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 0x100000001b3;
+		}
+		return hash;
+	}
+}
+
+// Forces compile-time evaluation of the hash of a string literal
+#define SISSKEY_HASH(name) (std::integral_constant<std::uint64_t, ::sisskey::HashName(name)>::value)
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sisskey
+{
+	enum class InputEventType : std::uint8_t
+	{
+		KeyDown,
+		KeyUp,
+		ButtonDown,
+		ButtonUp,
+		// Cursor position in window coordinates
+		MouseMove,
+		// Steps in x (horizontal) and y (vertical, positive - away from the user)
+		MouseWheel
+	};
+
+	enum MouseButton : std::uint32_t
+	{
+		MouseButtonLeft,
+		MouseButtonMiddle,
+		MouseButtonRight,
+		MouseButtonX1,
+		MouseButtonX2
+	};
+
+	// Keys use platform key codes (X11 keycodes, Windows virtual keys)
+	struct InputEvent
+	{
+		// Clock ticks when the event was received from the system
+		std::int64_t time;
+		InputEventType type;
+		// Key code or MouseButton
+		std::uint32_t code;
+		// Cursor position, wheel steps
+		std::int32_t x;
+		std::int32_t y;
+	};
+
+	// Unaccelerated mouse motion in device units, fractional where the device reports it
+	struct RawMouseMotion
+	{
+		std::int64_t time;
+		float x;
+		float y;
+	};
+}
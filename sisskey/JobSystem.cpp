@@ -0,0 +1,269 @@
+#include "JobSystem.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN64
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <set>
+#include <string>
+#endif
+
+namespace sisskey
+{
+	namespace
+	{
+		thread_local std::size_t t_ThreadIndex{ 0 };
+
+		void CpuRelax() noexcept
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			_mm_pause();
+#else
+			std::this_thread::yield();
+#endif
+		}
+
+		// https://en.wikipedia.org/wiki/Xorshift
+		std::uint32_t XorShift(std::uint32_t& state) noexcept
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+	}
+
+	void JobSystem::WorkStealingQueue::Push(Job* job) noexcept
+	{
+		const std::int64_t b{ m_Bottom.load(std::memory_order_relaxed) };
+		assert(b - m_Top.load(std::memory_order_acquire) < static_cast<std::int64_t>(MaxJobsPerThread) && "Job queue overflow");
+		m_Jobs[b & Mask].store(job, std::memory_order_relaxed);
+		m_Bottom.store(b + 1, std::memory_order_release);
+	}
+
+	JobSystem::Job* JobSystem::WorkStealingQueue::Pop() noexcept
+	{
+		const std::int64_t b{ m_Bottom.load(std::memory_order_relaxed) - 1 };
+		m_Bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::int64_t t{ m_Top.load(std::memory_order_relaxed) };
+
+		if (t > b)
+		{
+			// Queue is empty
+			m_Bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* job = m_Jobs[b & Mask].load(std::memory_order_relaxed);
+		if (t == b)
+		{
+			// The last job, race against stealers
+			if (!m_Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				job = nullptr;
+			m_Bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	JobSystem::Job* JobSystem::WorkStealingQueue::Steal() noexcept
+	{
+		std::int64_t t{ m_Top.load(std::memory_order_acquire) };
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const std::int64_t b{ m_Bottom.load(std::memory_order_acquire) };
+
+		if (t >= b)
+			return nullptr;
+
+		Job* job = m_Jobs[t & Mask].load(std::memory_order_relaxed);
+		if (!m_Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return job;
+	}
+
+	JobSystem::JobSystem(std::size_t threads)
+	{
+		if (threads == 0)
+			threads = PhysicalCoreCount();
+
+		m_ThreadData.reserve(threads);
+		for (std::size_t i{}; i < threads; ++i)
+		{
+			m_ThreadData.push_back(std::make_unique<ThreadData>());
+			m_ThreadData.back()->random = static_cast<std::uint32_t>(i * 2654435761u + 1);
+		}
+
+		t_ThreadIndex = 0;
+		m_Workers.reserve(threads - 1);
+		for (std::size_t i{ 1 }; i < threads; ++i)
+			m_Workers.emplace_back(&JobSystem::WorkerMain, this, i);
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_Running.store(false);
+		}
+		m_Wake.notify_all();
+
+		for (auto& worker : m_Workers)
+			worker.join();
+	}
+
+	std::size_t JobSystem::PhysicalCoreCount() noexcept
+	{
+		std::size_t cores{ 0 };
+#ifdef _WIN64
+		DWORD length{ 0 };
+		GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+		std::vector<std::uint8_t> buffer(length);
+		auto info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+		if (GetLogicalProcessorInformationEx(RelationProcessorCore, info, &length))
+		{
+			for (DWORD offset{}; offset < length; ++cores)
+				offset += reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset)->Size;
+		}
+#elif defined(__linux__)
+		// Count unique (package, core) pairs of the online cpus
+		std::set<std::pair<int, int>> unique;
+		for (unsigned cpu{}; cpu < std::thread::hardware_concurrency(); ++cpu)
+		{
+			const std::string topology{ "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/" };
+			std::ifstream package{ topology + "physical_package_id" };
+			std::ifstream core{ topology + "core_id" };
+			std::pair<int, int> id{};
+			if (!(package >> id.first) || !(core >> id.second))
+				break;
+			unique.insert(id);
+		}
+		cores = unique.size();
+#endif
+		if (cores == 0)
+			cores = std::thread::hardware_concurrency();
+		return std::max<std::size_t>(cores, 1);
+	}
+
+	std::size_t JobSystem::ThreadIndex() noexcept
+	{
+		return t_ThreadIndex;
+	}
+
+	JobSystem::Job* JobSystem::AllocateJob() noexcept
+	{
+		ThreadData& data = *m_ThreadData[t_ThreadIndex];
+		Job* job = &data.pool[data.allocated++ & (MaxJobsPerThread - 1)];
+		assert(IsFinished(job) && "Too many jobs in flight");
+		return job;
+	}
+
+	void JobSystem::AddContinuation(Job* ancestor, Job* continuation) noexcept
+	{
+		const std::int32_t index{ ancestor->continuationCount.fetch_add(1, std::memory_order_relaxed) };
+		assert(index < static_cast<std::int32_t>(MaxContinuations) && "Too many continuations");
+		ancestor->continuations[index] = continuation;
+	}
+
+	void JobSystem::Run(Job* job) noexcept
+	{
+		m_ThreadData[t_ThreadIndex]->queue.Push(job);
+		m_Queued.fetch_add(1);
+
+		if (m_Sleeping.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_Wake.notify_one();
+		}
+	}
+
+	void JobSystem::Wait(const Job* job) noexcept
+	{
+		while (!IsFinished(job))
+		{
+			if (Job* next = GetJob())
+				Execute(next);
+			else
+				CpuRelax();
+		}
+	}
+
+	JobSystem::Job* JobSystem::GetJob() noexcept
+	{
+		ThreadData& data = *m_ThreadData[t_ThreadIndex];
+
+		Job* job = data.queue.Pop();
+		if (!job)
+		{
+			// Try to steal starting from a random victim
+			const std::size_t count{ m_ThreadData.size() };
+			const std::size_t start{ XorShift(data.random) % count };
+			for (std::size_t i{}; i < count && !job; ++i)
+			{
+				const std::size_t victim{ (start + i) % count };
+				if (victim != t_ThreadIndex)
+					job = m_ThreadData[victim]->queue.Steal();
+			}
+		}
+
+		if (job)
+			m_Queued.fetch_sub(1, std::memory_order_relaxed);
+		return job;
+	}
+
+	void JobSystem::Execute(Job* job) noexcept
+	{
+		job->function(*job);
+		Finish(job);
+	}
+
+	void JobSystem::Finish(Job* job) noexcept
+	{
+		if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+
+		const std::int32_t continuations{ job->continuationCount.load(std::memory_order_relaxed) };
+		for (std::int32_t i{}; i < continuations; ++i)
+			Run(job->continuations[i]);
+
+		if (job->parent)
+			Finish(job->parent);
+	}
+
+	void JobSystem::WorkerMain(std::size_t index) noexcept
+	{
+		t_ThreadIndex = index;
+		SISSKEY_PROFILE_THREAD(u8"Worker " + std::to_string(index));
+
+		constexpr int SpinCount{ 256 };
+		int spins{ 0 };
+		while (m_Running.load(std::memory_order_relaxed))
+		{
+			if (Job* job = GetJob())
+			{
+				Execute(job);
+				spins = 0;
+			}
+			else if (++spins < SpinCount)
+				CpuRelax();
+			else
+			{
+				// Nothing to do for a while, go to sleep until new jobs are queued
+				std::unique_lock<std::mutex> lock{ m_Mutex };
+				m_Sleeping.fetch_add(1);
+				m_Wake.wait(lock, [this]() { return m_Queued.load() > 0 || !m_Running.load(); });
+				m_Sleeping.fetch_sub(1);
+				spins = 0;
+			}
+		}
+	}
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Job system with per-thread work-stealing deques
+	// https://blog.molecular-matters.com/2015/08/24/job-system-2-0-lock-free-work-stealing-part-1-basics/
+	// The thread that created the JobSystem (main thread) has index 0 and
+	// executes jobs while it waits, worker threads have indices [1, ThreadCount()).
+	// Only these threads are allowed to create and run jobs.
+	class JobSystem
+	{
+	public:
+		static constexpr std::size_t MaxContinuations{ 4 };
+		static constexpr std::size_t PayloadSize{ 64 };
+		static constexpr std::size_t MaxJobsPerThread{ 4096 };
+
+		struct alignas(64) Job
+		{
+			void (*function)(Job&) { nullptr };
+			Job* parent{ nullptr };
+			std::atomic<std::int32_t> unfinished{ 0 };
+			std::atomic<std::int32_t> continuationCount{ 0 };
+			std::array<Job*, MaxContinuations> continuations{};
+			alignas(16) unsigned char payload[PayloadSize];
+		};
+
+	private:
+		// Chase-Lev deque with a fixed capacity, memory orderings as in
+		// "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al., 2013)
+		class WorkStealingQueue
+		{
+		private:
+			static constexpr std::int64_t Mask{ MaxJobsPerThread - 1 };
+
+			alignas(64) std::atomic<std::int64_t> m_Top{ 0 };
+			alignas(64) std::atomic<std::int64_t> m_Bottom{ 0 };
+			alignas(64) std::array<std::atomic<Job*>, MaxJobsPerThread> m_Jobs{};
+
+		public:
+			// Owner thread only
+			void Push(Job* job) noexcept;
+			[[nodiscard]] Job* Pop() noexcept;
+			// Any thread
+			[[nodiscard]] Job* Steal() noexcept;
+		};
+
+		struct alignas(64) ThreadData
+		{
+			WorkStealingQueue queue;
+			std::array<Job, MaxJobsPerThread> pool;
+			std::size_t allocated{ 0 };
+			std::uint32_t random{ 0 };
+		};
+
+		std::vector<std::unique_ptr<ThreadData>> m_ThreadData;
+		std::vector<std::thread> m_Workers;
+
+		std::atomic<bool> m_Running{ true };
+		std::atomic<std::int64_t> m_Queued{ 0 };
+		std::atomic<std::int32_t> m_Sleeping{ 0 };
+		std::mutex m_Mutex;
+		std::condition_variable m_Wake;
+
+		[[nodiscard]] Job* AllocateJob() noexcept;
+		[[nodiscard]] Job* GetJob() noexcept;
+		void Execute(Job* job) noexcept;
+		void Finish(Job* job) noexcept;
+		void WorkerMain(std::size_t index) noexcept;
+
+		template<typename F>
+		static void Invoke(Job& job)
+		{
+			F* f = std::launder(reinterpret_cast<F*>(job.payload));
+			(*f)();
+			f->~F();
+		}
+
+		template<typename F>
+		[[nodiscard]] Job* CreateJobImpl(Job* parent, F&& function) noexcept
+		{
+			using Fn = std::decay_t<F>;
+			static_assert(sizeof(Fn) <= PayloadSize, "Job function is too large, capture by reference instead");
+			static_assert(alignof(Fn) <= 16, "Job function alignment is too strict");
+
+			Job* job = AllocateJob();
+			job->function = &Invoke<Fn>;
+			job->parent = parent;
+			job->unfinished.store(1, std::memory_order_relaxed);
+			job->continuationCount.store(0, std::memory_order_relaxed);
+			if (parent)
+				parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+			new (job->payload) Fn(std::forward<F>(function));
+			return job;
+		}
+
+		template<typename F>
+		void ParallelForSplit(Job* root, const F* function, std::size_t first, std::size_t last, std::size_t grain) noexcept
+		{
+			// Hand off the upper halves, keep splitting the lower one
+			while (last - first > grain)
+			{
+				const std::size_t middle{ first + (last - first) / 2 };
+				Run(CreateChildJob(root, [this, root, function, middle, last, grain]()
+				{
+					ParallelForSplit(root, function, middle, last, grain);
+				}));
+				last = middle;
+			}
+			(*function)(first, last);
+		}
+
+	public:
+		// threads: total number of threads including the main one, 0 - one per physical core
+		explicit JobSystem(std::size_t threads = 0);
+		~JobSystem();
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		[[nodiscard]] static std::size_t PhysicalCoreCount() noexcept;
+		[[nodiscard]] static std::size_t ThreadIndex() noexcept;
+		[[nodiscard]] std::size_t ThreadCount() const noexcept { return m_ThreadData.size(); }
+
+		template<typename F>
+		[[nodiscard]] Job* CreateJob(F&& function) noexcept { return CreateJobImpl(nullptr, std::forward<F>(function)); }
+
+		// Parent doesn't finish until all its children are finished
+		template<typename F>
+		[[nodiscard]] Job* CreateChildJob(Job* parent, F&& function) noexcept { return CreateJobImpl(parent, std::forward<F>(function)); }
+
+		// Continuation is run when ancestor finishes, must be added before ancestor is run
+		void AddContinuation(Job* ancestor, Job* continuation) noexcept;
+
+		void Run(Job* job) noexcept;
+		// Executes other jobs until the job is finished
+		void Wait(const Job* job) noexcept;
+		[[nodiscard]] static bool IsFinished(const Job* job) noexcept { return job->unfinished.load(std::memory_order_acquire) == 0; }
+
+		// Calls function(first, last) for subranges of [begin, end) in parallel and waits for completion
+		// grain: maximal subrange size, 0 - split into a few ranges per thread
+		template<typename F>
+		void ParallelFor(std::size_t begin, std::size_t end, const F& function, std::size_t grain = 0) noexcept
+		{
+			if (begin >= end)
+				return;
+
+			const std::size_t count{ end - begin };
+			if (grain == 0)
+				grain = count / (ThreadCount() * 4);
+			if (grain == 0)
+				grain = 1;
+
+			Job* root = CreateJob([]() {});
+			Run(CreateChildJob(root, [this, root, &function, begin, end, grain]()
+			{
+				ParallelForSplit(root, &function, begin, end, grain);
+			}));
+			Run(root);
+			Wait(root);
+		}
+	};
+}
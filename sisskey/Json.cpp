@@ -0,0 +1,417 @@
+#include "Json.h"
+
+#include <charconv>
+#include <stdexcept>
+#include <string>
+
+namespace sisskey
+{
+	namespace
+	{
+		[[nodiscard]] int HexDigit(char c) noexcept
+		{
+			if (c >= '0' && c <= '9')
+				return c - '0';
+			if (c >= 'a' && c <= 'f')
+				return c - 'a' + 10;
+			if (c >= 'A' && c <= 'F')
+				return c - 'A' + 10;
+			return -1;
+		}
+
+		char* EncodeUTF8(char* out, std::uint32_t cp) noexcept
+		{
+			if (cp < 0x80)
+				*out++ = static_cast<char>(cp);
+			else if (cp < 0x800)
+			{
+				*out++ = static_cast<char>(0xC0 | (cp >> 6));
+				*out++ = static_cast<char>(0x80 | (cp & 0x3F));
+			}
+			else if (cp < 0x10000)
+			{
+				*out++ = static_cast<char>(0xE0 | (cp >> 12));
+				*out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+				*out++ = static_cast<char>(0x80 | (cp & 0x3F));
+			}
+			else
+			{
+				*out++ = static_cast<char>(0xF0 | (cp >> 18));
+				*out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+				*out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+				*out++ = static_cast<char>(0x80 | (cp & 0x3F));
+			}
+			return out;
+		}
+	}
+
+	class JsonParser
+	{
+	private:
+		using Node = JsonDocument::Node;
+
+		std::vector<Node>& m_Nodes;
+		char* const m_Begin;
+		char* const m_End;
+		char* m_Pos;
+
+		[[noreturn]] void Error(const char* message) const
+		{
+			std::size_t line{ 1 }, column{ 1 };
+			for (const char* p{ m_Begin }; p < m_Pos && p < m_End; ++p)
+			{
+				if (*p == '\n')
+				{
+					++line;
+					column = 1;
+				}
+				else
+					++column;
+			}
+			throw std::runtime_error{ std::string{ message } + u8" at line " + std::to_string(line) + u8", column " + std::to_string(column) };
+		}
+
+		void SkipWhitespace() noexcept
+		{
+			while (m_Pos < m_End && (*m_Pos == ' ' || *m_Pos == '\n' || *m_Pos == '\r' || *m_Pos == '\t'))
+				++m_Pos;
+		}
+
+		[[nodiscard]] char Peek()
+		{
+			SkipWhitespace();
+			if (m_Pos == m_End)
+				Error(u8"Unexpected end of input");
+			return *m_Pos;
+		}
+
+		void Expect(const char* literal, std::size_t length)
+		{
+			if (static_cast<std::size_t>(m_End - m_Pos) < length || std::string_view{ m_Pos, length } != std::string_view{ literal, length })
+				Error(u8"Invalid literal");
+			m_Pos += length;
+		}
+
+		// m_Pos is at the opening quote
+		std::string_view ParseString()
+		{
+			char* const start{ ++m_Pos };
+			char* p{ start };
+
+			// Fast path until the first escape sequence
+			while (p < m_End && *p != '"' && *p != '\\')
+			{
+				if (static_cast<unsigned char>(*p) < 0x20)
+				{
+					m_Pos = p;
+					Error(u8"Control character in string");
+				}
+				++p;
+			}
+
+			char* out{ p };
+			while (p < m_End && *p != '"')
+			{
+				if (static_cast<unsigned char>(*p) < 0x20)
+				{
+					m_Pos = p;
+					Error(u8"Control character in string");
+				}
+				if (*p != '\\')
+				{
+					*out++ = *p++;
+					continue;
+				}
+
+				if (++p == m_End)
+					break;
+				switch (*p++)
+				{
+				case '"': *out++ = '"'; break;
+				case '\\': *out++ = '\\'; break;
+				case '/': *out++ = '/'; break;
+				case 'b': *out++ = '\b'; break;
+				case 'f': *out++ = '\f'; break;
+				case 'n': *out++ = '\n'; break;
+				case 'r': *out++ = '\r'; break;
+				case 't': *out++ = '\t'; break;
+				case 'u':
+				{
+					auto hex4 = [this, &p]()
+					{
+						std::uint32_t value{ 0 };
+						for (int i{}; i < 4; ++i)
+						{
+							const int digit{ p < m_End ? HexDigit(*p) : -1 };
+							if (digit < 0)
+							{
+								m_Pos = p;
+								Error(u8"Invalid unicode escape");
+							}
+							value = value << 4 | static_cast<std::uint32_t>(digit);
+							++p;
+						}
+						return value;
+					};
+
+					std::uint32_t cp{ hex4() };
+					// Surrogate pair
+					if (cp >= 0xD800 && cp <= 0xDBFF && m_End - p >= 6 && p[0] == '\\' && p[1] == 'u')
+					{
+						p += 2;
+						const std::uint32_t low{ hex4() };
+						if (low < 0xDC00 || low > 0xDFFF)
+						{
+							m_Pos = p;
+							Error(u8"Invalid surrogate pair");
+						}
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+					}
+					// The encoding is never longer than the escape sequence
+					out = EncodeUTF8(out, cp);
+				} break;
+				default:
+					m_Pos = p - 1;
+					Error(u8"Invalid escape sequence");
+				}
+			}
+
+			if (p == m_End)
+			{
+				m_Pos = p;
+				Error(u8"Unterminated string");
+			}
+			m_Pos = p + 1;
+			return { start, static_cast<std::size_t>(out - start) };
+		}
+
+		double ParseNumber()
+		{
+			// std::from_chars accepts a few things JSON doesn't, validate the grammar first
+			char* p{ m_Pos };
+			if (p < m_End && *p == '-')
+				++p;
+			if (p == m_End || *p < '0' || *p > '9')
+				Error(u8"Invalid number");
+			if (*p == '0')
+				++p;
+			else
+				while (p < m_End && *p >= '0' && *p <= '9')
+					++p;
+			if (p < m_End && *p == '.')
+			{
+				if (++p == m_End || *p < '0' || *p > '9')
+					Error(u8"Invalid number");
+				while (p < m_End && *p >= '0' && *p <= '9')
+					++p;
+			}
+			if (p < m_End && (*p == 'e' || *p == 'E'))
+			{
+				if (++p < m_End && (*p == '+' || *p == '-'))
+					++p;
+				if (p == m_End || *p < '0' || *p > '9')
+					Error(u8"Invalid number");
+				while (p < m_End && *p >= '0' && *p <= '9')
+					++p;
+			}
+
+			double value{ 0.0 };
+			const auto result = std::from_chars(m_Pos, p, value);
+			if (result.ec == std::errc::result_out_of_range)
+				Error(u8"Number out of range");
+			if (result.ec != std::errc{})
+				Error(u8"Invalid number");
+			m_Pos = p;
+			return value;
+		}
+
+		std::uint32_t ParseValue(std::size_t depth)
+		{
+			if (depth > JsonDocument::MaxDepth)
+				Error(u8"Nesting too deep");
+
+			const char c{ Peek() };
+			const auto index = static_cast<std::uint32_t>(m_Nodes.size());
+			m_Nodes.emplace_back();
+
+			switch (c)
+			{
+			case '{':
+			case '[':
+			{
+				const bool object{ c == '{' };
+				const char close{ object ? '}' : ']' };
+				m_Nodes[index].type = object ? JsonType::Object : JsonType::Array;
+				++m_Pos;
+
+				if (Peek() == close)
+				{
+					++m_Pos;
+					break;
+				}
+
+				std::uint32_t last{ JsonDocument::None };
+				std::uint32_t count{ 0 };
+				for (;;)
+				{
+					std::string_view key;
+					if (object)
+					{
+						if (Peek() != '"')
+							Error(u8"Expected member name");
+						key = ParseString();
+						if (Peek() != ':')
+							Error(u8"Expected ':'");
+						++m_Pos;
+					}
+
+					const std::uint32_t child{ ParseValue(depth + 1) };
+					m_Nodes[child].key = key;
+					if (last == JsonDocument::None)
+						m_Nodes[index].first = child;
+					else
+						m_Nodes[last].next = child;
+					last = child;
+					++count;
+
+					const char separator{ Peek() };
+					++m_Pos;
+					if (separator == close)
+						break;
+					if (separator != ',')
+					{
+						--m_Pos;
+						Error(object ? u8"Expected ',' or '}'" : u8"Expected ',' or ']'");
+					}
+				}
+				m_Nodes[index].count = count;
+			} break;
+			case '"':
+				m_Nodes[index].type = JsonType::String;
+				m_Nodes[index].string = ParseString();
+				break;
+			case 't':
+				Expect(u8"true", 4);
+				m_Nodes[index].type = JsonType::Bool;
+				m_Nodes[index].boolean = true;
+				break;
+			case 'f':
+				Expect(u8"false", 5);
+				m_Nodes[index].type = JsonType::Bool;
+				break;
+			case 'n':
+				Expect(u8"null", 4);
+				break;
+			default:
+				if (c != '-' && (c < '0' || c > '9'))
+					Error(u8"Unexpected character");
+				m_Nodes[index].type = JsonType::Number;
+				m_Nodes[index].number = ParseNumber();
+				break;
+			}
+
+			return index;
+		}
+
+	public:
+		JsonParser(std::vector<Node>& nodes, char* data, std::size_t size) noexcept :
+			m_Nodes{ nodes }, m_Begin{ data }, m_End{ data + size }, m_Pos{ data } {}
+
+		void Parse()
+		{
+			// UTF-8 byte order mark
+			if (m_End - m_Pos >= 3 && std::string_view{ m_Pos, 3 } == u8"\xEF\xBB\xBF")
+				m_Pos += 3;
+
+			ParseValue(0);
+			SkipWhitespace();
+			if (m_Pos != m_End)
+				Error(u8"Unexpected data after the root value");
+		}
+	};
+
+	void JsonDocument::Parse(char* data, std::size_t size)
+	{
+		m_Nodes.clear();
+		// Rough upper bound of the value count for typical documents, avoids most reallocations
+		m_Nodes.reserve(size / 8 + 1);
+
+		try
+		{
+			JsonParser{ m_Nodes, data, size }.Parse();
+		}
+		catch (...)
+		{
+			m_Nodes.clear();
+			throw;
+		}
+	}
+
+	JsonValue::Iterator& JsonValue::Iterator::operator++() noexcept
+	{
+		m_Index = m_Document->m_Nodes[m_Index].next;
+		return *this;
+	}
+
+	JsonType JsonValue::Type() const noexcept
+	{
+		return m_Document->m_Nodes[m_Index].type;
+	}
+
+	bool JsonValue::AsBool(bool fallback) const noexcept
+	{
+		return IsBool() ? m_Document->m_Nodes[m_Index].boolean : fallback;
+	}
+
+	double JsonValue::AsNumber(double fallback) const noexcept
+	{
+		return IsNumber() ? m_Document->m_Nodes[m_Index].number : fallback;
+	}
+
+	std::string_view JsonValue::AsString(std::string_view fallback) const noexcept
+	{
+		return IsString() ? m_Document->m_Nodes[m_Index].string : fallback;
+	}
+
+	std::string_view JsonValue::Key() const noexcept
+	{
+		return Valid() ? m_Document->m_Nodes[m_Index].key : std::string_view{};
+	}
+
+	std::size_t JsonValue::Size() const noexcept
+	{
+		return Valid() ? m_Document->m_Nodes[m_Index].count : 0;
+	}
+
+	JsonValue JsonValue::operator[](std::string_view key) const noexcept
+	{
+		if (!IsObject())
+			return {};
+		for (JsonValue member : *this)
+			if (member.Key() == key)
+				return member;
+		return {};
+	}
+
+	JsonValue JsonValue::operator[](std::size_t index) const noexcept
+	{
+		if (!IsArray() || index >= Size())
+			return {};
+		auto it = begin();
+		while (index--)
+			++it;
+		return *it;
+	}
+
+	JsonValue::Iterator JsonValue::begin() const noexcept
+	{
+		if (!IsArray() && !IsObject())
+			return end();
+		return { m_Document, m_Document->m_Nodes[m_Index].first };
+	}
+
+	JsonValue::Iterator JsonValue::end() const noexcept
+	{
+		return { m_Document, JsonDocument::None };
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	enum class JsonType : std::uint8_t
+	{
+		Null,
+		Bool,
+		Number,
+		String,
+		Array,
+		Object
+	};
+
+	class JsonDocument;
+	class JsonParser;
+
+	// Lightweight reference to a value of a JsonDocument.
+	// A default constructed value is invalid, it's returned for missing members and elements.
+	class JsonValue
+	{
+	private:
+		const JsonDocument* m_Document{ nullptr };
+		std::uint32_t m_Index{ 0 };
+
+	public:
+		class Iterator
+		{
+		private:
+			const JsonDocument* m_Document;
+			std::uint32_t m_Index;
+
+		public:
+			Iterator(const JsonDocument* document, std::uint32_t index) noexcept : m_Document{ document }, m_Index{ index } {}
+			[[nodiscard]] JsonValue operator*() const noexcept { return { m_Document, m_Index }; }
+			Iterator& operator++() noexcept;
+			[[nodiscard]] bool operator!=(const Iterator& other) const noexcept { return m_Index != other.m_Index; }
+		};
+
+		JsonValue() = default;
+		JsonValue(const JsonDocument* document, std::uint32_t index) noexcept : m_Document{ document }, m_Index{ index } {}
+
+		[[nodiscard]] bool Valid() const noexcept { return m_Document != nullptr; }
+		explicit operator bool() const noexcept { return Valid(); }
+
+		[[nodiscard]] JsonType Type() const noexcept;
+		[[nodiscard]] bool IsNull() const noexcept { return Valid() && Type() == JsonType::Null; }
+		[[nodiscard]] bool IsBool() const noexcept { return Valid() && Type() == JsonType::Bool; }
+		[[nodiscard]] bool IsNumber() const noexcept { return Valid() && Type() == JsonType::Number; }
+		[[nodiscard]] bool IsString() const noexcept { return Valid() && Type() == JsonType::String; }
+		[[nodiscard]] bool IsArray() const noexcept { return Valid() && Type() == JsonType::Array; }
+		[[nodiscard]] bool IsObject() const noexcept { return Valid() && Type() == JsonType::Object; }
+
+		// Return the fallback if the value is missing or has a different type
+		[[nodiscard]] bool AsBool(bool fallback = false) const noexcept;
+		[[nodiscard]] double AsNumber(double fallback = 0.0) const noexcept;
+		[[nodiscard]] std::string_view AsString(std::string_view fallback = {}) const noexcept;
+
+		// Name of an object member
+		[[nodiscard]] std::string_view Key() const noexcept;
+
+		// Number of array elements or object members
+		[[nodiscard]] std::size_t Size() const noexcept;
+		// Linear search, iterate instead when visiting all members
+		[[nodiscard]] JsonValue operator[](std::string_view key) const noexcept;
+		[[nodiscard]] JsonValue operator[](std::size_t index) const noexcept;
+
+		// Elements of an array or members of an object
+		[[nodiscard]] Iterator begin() const noexcept;
+		[[nodiscard]] Iterator end() const noexcept;
+	};
+
+	// JSON (RFC 8259) parsed in situ: strings are views into the source buffer,
+	// escape sequences are decoded in place, so the buffer must be writable and outlive the document.
+	// All values are stored in one array, which is reused when parsing again.
+	class JsonDocument
+	{
+		friend JsonValue;
+		friend JsonValue::Iterator;
+		friend JsonParser;
+	public:
+		static constexpr std::uint32_t None{ 0xFFFFFFFF };
+		static constexpr std::size_t MaxDepth{ 256 };
+
+	private:
+		struct Node
+		{
+			JsonType type{ JsonType::Null };
+			bool boolean{ false };
+			std::uint32_t next{ None }; // next sibling
+			std::uint32_t first{ None }; // first child
+			std::uint32_t count{ 0 };
+			double number{ 0.0 };
+			std::string_view key;
+			std::string_view string;
+		};
+
+		std::vector<Node> m_Nodes;
+
+	public:
+		// Throws std::runtime_error with the line and column of the first error
+		void Parse(char* data, std::size_t size);
+		void Clear() noexcept { m_Nodes.clear(); }
+
+		[[nodiscard]] JsonValue Root() const noexcept { return m_Nodes.empty() ? JsonValue{} : JsonValue{ this, 0 }; }
+		[[nodiscard]] std::size_t ValueCount() const noexcept { return m_Nodes.size(); }
+	};
+}
@@ -0,0 +1,125 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN64
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace sisskey
+{
+	MappedFile::MappedFile(const std::filesystem::path& path, Mode mode)
+	{
+#ifdef _WIN64
+		m_File = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_File == INVALID_HANDLE_VALUE)
+		{
+			m_File = nullptr;
+			throw std::runtime_error{ u8"Failed to open file" };
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_File, &size))
+		{
+			Close();
+			throw std::runtime_error{ u8"Failed to get file size" };
+		}
+		if (size.QuadPart == 0)
+			return;
+
+		const bool copy{ mode == Mode::CopyOnWrite };
+		m_Mapping = CreateFileMappingW(m_File, nullptr, copy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+		if (m_Mapping)
+			m_Data = static_cast<char*>(MapViewOfFile(m_Mapping, copy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0));
+		if (!m_Data)
+		{
+			Close();
+			throw std::runtime_error{ u8"Failed to map file" };
+		}
+		m_Size = static_cast<std::size_t>(size.QuadPart);
+#elif defined(__linux__)
+		const int fd{ open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+		if (fd == -1)
+			throw std::runtime_error{ u8"Failed to open file" };
+
+		struct stat st;
+		if (fstat(fd, &st) == -1)
+		{
+			close(fd);
+			throw std::runtime_error{ u8"Failed to get file size" };
+		}
+		if (st.st_size == 0)
+		{
+			close(fd);
+			return;
+		}
+
+		// The mapping keeps its own reference to the file
+		void* data{ mode == Mode::CopyOnWrite ?
+			mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0) :
+			mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0) };
+		close(fd);
+		if (data == MAP_FAILED)
+			throw std::runtime_error{ u8"Failed to map file" };
+
+		m_Data = static_cast<char*>(data);
+		m_Size = static_cast<std::size_t>(st.st_size);
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept :
+		m_Data{ std::exchange(other.m_Data, nullptr) },
+		m_Size{ std::exchange(other.m_Size, 0) }
+#ifdef _WIN64
+		, m_File{ std::exchange(other.m_File, nullptr) },
+		m_Mapping{ std::exchange(other.m_Mapping, nullptr) }
+#endif
+	{
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+			m_Data = std::exchange(other.m_Data, nullptr);
+			m_Size = std::exchange(other.m_Size, 0);
+#ifdef _WIN64
+			m_File = std::exchange(other.m_File, nullptr);
+			m_Mapping = std::exchange(other.m_Mapping, nullptr);
+#endif
+		}
+		return *this;
+	}
+
+	void MappedFile::Close() noexcept
+	{
+#ifdef _WIN64
+		if (m_Data)
+			UnmapViewOfFile(m_Data);
+		if (m_Mapping)
+			CloseHandle(m_Mapping);
+		if (m_File)
+			CloseHandle(m_File);
+		m_File = m_Mapping = nullptr;
+#elif defined(__linux__)
+		if (m_Data)
+			munmap(m_Data, m_Size);
+#endif
+		m_Data = nullptr;
+		m_Size = 0;
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+#include <cstddef>
+
+namespace sisskey
+{
+	// Read-only file mapped into memory.
+	// CopyOnWrite maps a private view that is read in whole up front:
+	// the contents can be modified in place (e.g. by an in situ parser),
+	// changes are never written back to the file.
+	// ReadOnly maps pages shared with the page cache and faults them in on demand,
+	// for large files of which only parts are accessed. Writes to it crash.
+	class MappedFile
+	{
+	public:
+		enum class Mode { CopyOnWrite, ReadOnly };
+
+	private:
+		char* m_Data{ nullptr };
+		std::size_t m_Size{ 0 };
+#ifdef _WIN64
+		void* m_File{ nullptr };
+		void* m_Mapping{ nullptr };
+#endif
+
+		void Close() noexcept;
+
+	public:
+		MappedFile() = default;
+		explicit MappedFile(const std::filesystem::path& path, Mode mode = Mode::CopyOnWrite);
+		~MappedFile();
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		[[nodiscard]] char* Data() noexcept { return m_Data; }
+		[[nodiscard]] const char* Data() const noexcept { return m_Data; }
+		[[nodiscard]] std::size_t Size() const noexcept { return m_Size; }
+		[[nodiscard]] bool Empty() const noexcept { return m_Size == 0; }
+	};
+}
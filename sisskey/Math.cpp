@@ -0,0 +1,283 @@
+#include "Math.h"
+
+namespace sisskey
+{
+	namespace
+	{
+#if defined(SISSKEY_SIMD_AVX2)
+		inline __m256 Madd(__m256 a, __m256 b, __m256 c) noexcept
+		{
+#if defined(__FMA__) || defined(_MSC_VER)
+			return _mm256_fmadd_ps(a, b, c);
+#else
+			return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+		}
+
+		inline void Transpose8(__m256 r[8]) noexcept
+		{
+			const __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+			const __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+			const __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+			const __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+			const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)), s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)), s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0)), s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+			const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0)), s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+			r[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+			r[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+			r[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+			r[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+			r[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+			r[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+			r[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+			r[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+		}
+#endif
+
+#if defined(SISSKEY_SIMD_SSE41)
+		inline void StoreVec3(Vec3* out, __m128 v) noexcept
+		{
+			_mm_storel_pi(reinterpret_cast<__m64*>(out), v);
+			_mm_store_ss(&out->z, _mm_movehl_ps(v, v));
+		}
+#endif
+
+		// Elements of T * R * S in column-major order for one lane
+		template<typename V, typename Ops>
+		inline void ComposeElements(const V t[3], const V q[4], const V s[3], V e[16], Ops ops) noexcept
+		{
+			const V one{ ops.set(1.0f) }, two{ ops.set(2.0f) }, zero{ ops.set(0.0f) };
+			const V xx{ ops.mul(q[0], q[0]) }, yy{ ops.mul(q[1], q[1]) }, zz{ ops.mul(q[2], q[2]) };
+			const V xy{ ops.mul(q[0], q[1]) }, xz{ ops.mul(q[0], q[2]) }, yz{ ops.mul(q[1], q[2]) };
+			const V wx{ ops.mul(q[3], q[0]) }, wy{ ops.mul(q[3], q[1]) }, wz{ ops.mul(q[3], q[2]) };
+
+			e[0] = ops.mul(ops.sub(one, ops.mul(two, ops.add(yy, zz))), s[0]);
+			e[1] = ops.mul(ops.mul(two, ops.add(xy, wz)), s[0]);
+			e[2] = ops.mul(ops.mul(two, ops.sub(xz, wy)), s[0]);
+			e[3] = zero;
+			e[4] = ops.mul(ops.mul(two, ops.sub(xy, wz)), s[1]);
+			e[5] = ops.mul(ops.sub(one, ops.mul(two, ops.add(xx, zz))), s[1]);
+			e[6] = ops.mul(ops.mul(two, ops.add(yz, wx)), s[1]);
+			e[7] = zero;
+			e[8] = ops.mul(ops.mul(two, ops.add(xz, wy)), s[2]);
+			e[9] = ops.mul(ops.mul(two, ops.sub(yz, wx)), s[2]);
+			e[10] = ops.mul(ops.sub(one, ops.mul(two, ops.add(xx, yy))), s[2]);
+			e[11] = zero;
+			e[12] = t[0];
+			e[13] = t[1];
+			e[14] = t[2];
+			e[15] = one;
+		}
+
+#if defined(SISSKEY_SIMD_AVX2)
+		struct Ops256
+		{
+			__m256 set(float f) const noexcept { return _mm256_set1_ps(f); }
+			__m256 add(__m256 a, __m256 b) const noexcept { return _mm256_add_ps(a, b); }
+			__m256 sub(__m256 a, __m256 b) const noexcept { return _mm256_sub_ps(a, b); }
+			__m256 mul(__m256 a, __m256 b) const noexcept { return _mm256_mul_ps(a, b); }
+		};
+#endif
+#if defined(SISSKEY_SIMD_SSE41)
+		struct Ops128
+		{
+			__m128 set(float f) const noexcept { return _mm_set1_ps(f); }
+			__m128 add(__m128 a, __m128 b) const noexcept { return _mm_add_ps(a, b); }
+			__m128 sub(__m128 a, __m128 b) const noexcept { return _mm_sub_ps(a, b); }
+			__m128 mul(__m128 a, __m128 b) const noexcept { return _mm_mul_ps(a, b); }
+		};
+#endif
+	}
+
+	Mat4 Transpose(const Mat4& m) noexcept
+	{
+#if defined(SISSKEY_SIMD_SSE41)
+		__m128 c0 = Load(m.columns[0]), c1 = Load(m.columns[1]), c2 = Load(m.columns[2]), c3 = Load(m.columns[3]);
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		return { { Store(c0), Store(c1), Store(c2), Store(c3) } };
+#else
+		const Vec4* c = m.columns;
+		return { { { c[0].x, c[1].x, c[2].x, c[3].x }, { c[0].y, c[1].y, c[2].y, c[3].y },
+				   { c[0].z, c[1].z, c[2].z, c[3].z }, { c[0].w, c[1].w, c[2].w, c[3].w } } };
+#endif
+	}
+
+	void TransformPoints(const Mat4& m, const Vec3* in, Vec3* out, std::size_t count) noexcept
+	{
+		std::size_t i{ 0 };
+#if defined(SISSKEY_SIMD_AVX2)
+		// Two points per iteration, one per 128-bit lane
+		const __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.columns[0]));
+		const __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.columns[1]));
+		const __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.columns[2]));
+		const __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m.columns[3]));
+		for (; i + 2 <= count; i += 2)
+		{
+			const __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(in[i].x)), _mm_set1_ps(in[i + 1].x), 1);
+			const __m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(in[i].y)), _mm_set1_ps(in[i + 1].y), 1);
+			const __m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(in[i].z)), _mm_set1_ps(in[i + 1].z), 1);
+			const __m256 r = Madd(c0, x, Madd(c1, y, Madd(c2, z, c3)));
+			StoreVec3(out + i, _mm256_castps256_ps128(r));
+			StoreVec3(out + i + 1, _mm256_extractf128_ps(r, 1));
+		}
+#endif
+#if defined(SISSKEY_SIMD_SSE41)
+		for (; i < count; ++i)
+			StoreVec3(out + i, LinearCombine(m, _mm_setr_ps(in[i].x, in[i].y, in[i].z, 1.0f)));
+#else
+		for (; i < count; ++i)
+			out[i] = TransformPoint(m, in[i]);
+#endif
+	}
+
+	void TransformPoints(const Mat4& m, const float* x, const float* y, const float* z,
+						 float* outX, float* outY, float* outZ, std::size_t count) noexcept
+	{
+		const Vec4* c = m.columns;
+		std::size_t i{ 0 };
+#if defined(SISSKEY_SIMD_AVX2)
+		const __m256 m00 = _mm256_set1_ps(c[0].x), m01 = _mm256_set1_ps(c[1].x), m02 = _mm256_set1_ps(c[2].x), m03 = _mm256_set1_ps(c[3].x);
+		const __m256 m10 = _mm256_set1_ps(c[0].y), m11 = _mm256_set1_ps(c[1].y), m12 = _mm256_set1_ps(c[2].y), m13 = _mm256_set1_ps(c[3].y);
+		const __m256 m20 = _mm256_set1_ps(c[0].z), m21 = _mm256_set1_ps(c[1].z), m22 = _mm256_set1_ps(c[2].z), m23 = _mm256_set1_ps(c[3].z);
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+			_mm256_storeu_ps(outX + i, Madd(m00, px, Madd(m01, py, Madd(m02, pz, m03))));
+			_mm256_storeu_ps(outY + i, Madd(m10, px, Madd(m11, py, Madd(m12, pz, m13))));
+			_mm256_storeu_ps(outZ + i, Madd(m20, px, Madd(m21, py, Madd(m22, pz, m23))));
+		}
+#elif defined(SISSKEY_SIMD_SSE41)
+		const __m128 m00 = _mm_set1_ps(c[0].x), m01 = _mm_set1_ps(c[1].x), m02 = _mm_set1_ps(c[2].x), m03 = _mm_set1_ps(c[3].x);
+		const __m128 m10 = _mm_set1_ps(c[0].y), m11 = _mm_set1_ps(c[1].y), m12 = _mm_set1_ps(c[2].y), m13 = _mm_set1_ps(c[3].y);
+		const __m128 m20 = _mm_set1_ps(c[0].z), m21 = _mm_set1_ps(c[1].z), m22 = _mm_set1_ps(c[2].z), m23 = _mm_set1_ps(c[3].z);
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+			_mm_storeu_ps(outX + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, px), _mm_mul_ps(m01, py)), _mm_add_ps(_mm_mul_ps(m02, pz), m03)));
+			_mm_storeu_ps(outY + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, px), _mm_mul_ps(m11, py)), _mm_add_ps(_mm_mul_ps(m12, pz), m13)));
+			_mm_storeu_ps(outZ + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m20, px), _mm_mul_ps(m21, py)), _mm_add_ps(_mm_mul_ps(m22, pz), m23)));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			outX[i] = c[0].x * x[i] + c[1].x * y[i] + c[2].x * z[i] + c[3].x;
+			outY[i] = c[0].y * x[i] + c[1].y * y[i] + c[2].y * z[i] + c[3].y;
+			outZ[i] = c[0].z * x[i] + c[1].z * y[i] + c[2].z * z[i] + c[3].z;
+		}
+	}
+
+	void MultiplyMatrices(const Mat4* a, const Mat4* b, Mat4* out, std::size_t count) noexcept
+	{
+#if defined(SISSKEY_SIMD_AVX2)
+		// Two result columns per register
+		for (std::size_t i{}; i < count; ++i)
+		{
+			const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i].columns[0]));
+			const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i].columns[1]));
+			const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i].columns[2]));
+			const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i].columns[3]));
+			for (int c{}; c < 4; c += 2)
+			{
+				const __m256 bc = _mm256_loadu_ps(&b[i].columns[c].x);
+				__m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(0, 0, 0, 0)));
+				r = Madd(a1, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(1, 1, 1, 1)), r);
+				r = Madd(a2, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(2, 2, 2, 2)), r);
+				r = Madd(a3, _mm256_shuffle_ps(bc, bc, _MM_SHUFFLE(3, 3, 3, 3)), r);
+				_mm256_storeu_ps(&out[i].columns[c].x, r);
+			}
+		}
+#else
+		for (std::size_t i{}; i < count; ++i)
+			out[i] = a[i] * b[i];
+#endif
+	}
+
+	void ComposeTransforms(const TransformSoA& tr, Mat4* out, std::size_t count) noexcept
+	{
+		std::size_t i{ 0 };
+#if defined(SISSKEY_SIMD_AVX2)
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 t[3]{ _mm256_loadu_ps(tr.tx + i), _mm256_loadu_ps(tr.ty + i), _mm256_loadu_ps(tr.tz + i) };
+			const __m256 q[4]{ _mm256_loadu_ps(tr.qx + i), _mm256_loadu_ps(tr.qy + i), _mm256_loadu_ps(tr.qz + i), _mm256_loadu_ps(tr.qw + i) };
+			const __m256 s[3]{ _mm256_loadu_ps(tr.sx + i), _mm256_loadu_ps(tr.sy + i), _mm256_loadu_ps(tr.sz + i) };
+			__m256 e[16];
+			ComposeElements(t, q, s, e, Ops256{});
+
+			// Element-major to matrix-major, 8 floats (two columns) per store
+			Transpose8(e);
+			Transpose8(e + 8);
+			for (std::size_t j{}; j < 8; ++j)
+			{
+				_mm256_storeu_ps(&out[i + j].columns[0].x, e[j]);
+				_mm256_storeu_ps(&out[i + j].columns[2].x, e[8 + j]);
+			}
+		}
+#endif
+#if defined(SISSKEY_SIMD_SSE41)
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 t[3]{ _mm_loadu_ps(tr.tx + i), _mm_loadu_ps(tr.ty + i), _mm_loadu_ps(tr.tz + i) };
+			const __m128 q[4]{ _mm_loadu_ps(tr.qx + i), _mm_loadu_ps(tr.qy + i), _mm_loadu_ps(tr.qz + i), _mm_loadu_ps(tr.qw + i) };
+			const __m128 s[3]{ _mm_loadu_ps(tr.sx + i), _mm_loadu_ps(tr.sy + i), _mm_loadu_ps(tr.sz + i) };
+			__m128 e[16];
+			ComposeElements(t, q, s, e, Ops128{});
+
+			for (std::size_t c{}; c < 4; ++c)
+			{
+				_MM_TRANSPOSE4_PS(e[c * 4], e[c * 4 + 1], e[c * 4 + 2], e[c * 4 + 3]);
+				for (std::size_t j{}; j < 4; ++j)
+					_mm_store_ps(&out[i + j].columns[c].x, e[c * 4 + j]);
+			}
+		}
+#endif
+		for (; i < count; ++i)
+			out[i] = Compose({ tr.tx[i], tr.ty[i], tr.tz[i] }, { tr.qx[i], tr.qy[i], tr.qz[i], tr.qw[i] }, { tr.sx[i], tr.sy[i], tr.sz[i] });
+	}
+
+	void UpdateHierarchy(const Mat4* local, const std::uint32_t* parent, Mat4* world, std::size_t count) noexcept
+	{
+		for (std::size_t i{}; i < count; ++i)
+			world[i] = parent[i] == NoParent ? local[i] : world[parent[i]] * local[i];
+	}
+
+	namespace reference
+	{
+		void TransformPoints(const Mat4& m, const Vec3* in, Vec3* out, std::size_t count) noexcept
+		{
+			const Vec4* c = m.columns;
+			for (std::size_t i{}; i < count; ++i)
+			{
+				const Vec3 p{ in[i] };
+				out[i] = { c[0].x * p.x + c[1].x * p.y + c[2].x * p.z + c[3].x,
+						   c[0].y * p.x + c[1].y * p.y + c[2].y * p.z + c[3].y,
+						   c[0].z * p.x + c[1].z * p.y + c[2].z * p.z + c[3].z };
+			}
+		}
+
+		void MultiplyMatrices(const Mat4* a, const Mat4* b, Mat4* out, std::size_t count) noexcept
+		{
+			for (std::size_t i{}; i < count; ++i)
+			{
+				const float* pa = &a[i].columns[0].x;
+				const float* pb = &b[i].columns[0].x;
+				float* po = &out[i].columns[0].x;
+				for (int col{}; col < 4; ++col)
+					for (int row{}; row < 4; ++row)
+					{
+						float sum{ 0.0f };
+						for (int k{}; k < 4; ++k)
+							sum += pa[k * 4 + row] * pb[col * 4 + k];
+						po[col * 4 + row] = sum;
+					}
+			}
+		}
+
+		void ComposeTransforms(const TransformSoA& tr, Mat4* out, std::size_t count) noexcept
+		{
+			for (std::size_t i{}; i < count; ++i)
+				out[i] = Compose({ tr.tx[i], tr.ty[i], tr.tz[i] }, { tr.qx[i], tr.qy[i], tr.qz[i], tr.qw[i] }, { tr.sx[i], tr.sy[i], tr.sz[i] });
+		}
+	}
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Instruction set is selected at compile time:
+// SISSKEY_SIMD_SCALAR forces the portable implementation,
+// otherwise AVX2 or SSE4.1 is used when the compiler targets it.
+// MSVC has no SSE4.1 target macro, define SISSKEY_SIMD_SSE41 explicitly there.
+#if !defined(SISSKEY_SIMD_SCALAR)
+	#if defined(__AVX2__)
+		#define SISSKEY_SIMD_AVX2
+		#ifndef SISSKEY_SIMD_SSE41
+			#define SISSKEY_SIMD_SSE41
+		#endif
+	#elif defined(__SSE4_1__) && !defined(SISSKEY_SIMD_SSE41)
+		#define SISSKEY_SIMD_SSE41
+	#elif !defined(SISSKEY_SIMD_SSE41)
+		#define SISSKEY_SIMD_SCALAR
+	#endif
+#endif
+
+#if defined(SISSKEY_SIMD_AVX2)
+#include <immintrin.h>
+#elif defined(SISSKEY_SIMD_SSE41)
+#include <smmintrin.h>
+#endif
+
+namespace sisskey
+{
+	struct Vec3
+	{
+		float x, y, z;
+	};
+
+	struct alignas(16) Vec4
+	{
+		float x, y, z, w;
+	};
+
+	// Unit quaternion, w is the scalar part
+	struct alignas(16) Quat
+	{
+		float x, y, z, w;
+	};
+
+	// Column-major, transforms column vectors: v' = M * v
+	struct alignas(16) Mat4
+	{
+		Vec4 columns[4];
+	};
+
+	// Structure of arrays input of ComposeTransforms
+	struct TransformSoA
+	{
+		const float* tx; const float* ty; const float* tz;
+		const float* qx; const float* qy; const float* qz; const float* qw;
+		const float* sx; const float* sy; const float* sz;
+	};
+
+	// Vec3
+
+	[[nodiscard]] inline Vec3 operator+(Vec3 a, Vec3 b) noexcept { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+	[[nodiscard]] inline Vec3 operator-(Vec3 a, Vec3 b) noexcept { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	[[nodiscard]] inline Vec3 operator-(Vec3 a) noexcept { return { -a.x, -a.y, -a.z }; }
+	[[nodiscard]] inline Vec3 operator*(Vec3 a, float s) noexcept { return { a.x * s, a.y * s, a.z * s }; }
+	[[nodiscard]] inline Vec3 operator*(Vec3 a, Vec3 b) noexcept { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+	[[nodiscard]] inline float Dot(Vec3 a, Vec3 b) noexcept { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	[[nodiscard]] inline Vec3 Cross(Vec3 a, Vec3 b) noexcept { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+	[[nodiscard]] inline float Length(Vec3 a) noexcept { return std::sqrt(Dot(a, a)); }
+	[[nodiscard]] inline Vec3 Normalize(Vec3 a) noexcept { return a * (1.0f / Length(a)); }
+
+	// Vec4
+
+#if defined(SISSKEY_SIMD_SSE41)
+	[[nodiscard]] inline __m128 Load(const Vec4& v) noexcept { return _mm_load_ps(&v.x); }
+	[[nodiscard]] inline Vec4 Store(__m128 v) noexcept { Vec4 r; _mm_store_ps(&r.x, v); return r; }
+
+	[[nodiscard]] inline Vec4 operator+(const Vec4& a, const Vec4& b) noexcept { return Store(_mm_add_ps(Load(a), Load(b))); }
+	[[nodiscard]] inline Vec4 operator-(const Vec4& a, const Vec4& b) noexcept { return Store(_mm_sub_ps(Load(a), Load(b))); }
+	[[nodiscard]] inline Vec4 operator*(const Vec4& a, float s) noexcept { return Store(_mm_mul_ps(Load(a), _mm_set1_ps(s))); }
+	[[nodiscard]] inline Vec4 operator*(const Vec4& a, const Vec4& b) noexcept { return Store(_mm_mul_ps(Load(a), Load(b))); }
+	[[nodiscard]] inline float Dot(const Vec4& a, const Vec4& b) noexcept { return _mm_cvtss_f32(_mm_dp_ps(Load(a), Load(b), 0xF1)); }
+#else
+	[[nodiscard]] inline Vec4 operator+(const Vec4& a, const Vec4& b) noexcept { return { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; }
+	[[nodiscard]] inline Vec4 operator-(const Vec4& a, const Vec4& b) noexcept { return { a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w }; }
+	[[nodiscard]] inline Vec4 operator*(const Vec4& a, float s) noexcept { return { a.x * s, a.y * s, a.z * s, a.w * s }; }
+	[[nodiscard]] inline Vec4 operator*(const Vec4& a, const Vec4& b) noexcept { return { a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w }; }
+	[[nodiscard]] inline float Dot(const Vec4& a, const Vec4& b) noexcept { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+#endif
+
+	// Quat
+
+	[[nodiscard]] inline Quat Conjugate(const Quat& q) noexcept { return { -q.x, -q.y, -q.z, q.w }; }
+
+	[[nodiscard]] inline Quat Normalize(const Quat& q) noexcept
+	{
+		const float s{ 1.0f / std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w) };
+		return { q.x * s, q.y * s, q.z * s, q.w * s };
+	}
+
+	[[nodiscard]] inline Quat QuatFromAxisAngle(Vec3 axis, float angle) noexcept
+	{
+		const Vec3 a{ Normalize(axis) * std::sin(angle * 0.5f) };
+		return { a.x, a.y, a.z, std::cos(angle * 0.5f) };
+	}
+
+	// Applies b first, then a
+	[[nodiscard]] inline Quat operator*(const Quat& a, const Quat& b) noexcept
+	{
+		return { a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+				 a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+				 a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+				 a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z };
+	}
+
+	// v' = v + 2w(q x v) + 2q x (q x v)
+	[[nodiscard]] inline Vec3 Rotate(const Quat& q, Vec3 v) noexcept
+	{
+		const Vec3 u{ q.x, q.y, q.z };
+		const Vec3 t{ Cross(u, v) * 2.0f };
+		return v + t * q.w + Cross(u, t);
+	}
+
+	// Mat4
+
+	[[nodiscard]] inline Mat4 Identity() noexcept
+	{
+		return { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+	}
+
+	[[nodiscard]] inline Mat4 Translation(Vec3 t) noexcept
+	{
+		Mat4 m{ Identity() };
+		m.columns[3] = { t.x, t.y, t.z, 1.0f };
+		return m;
+	}
+
+	[[nodiscard]] inline Mat4 Scaling(Vec3 s) noexcept
+	{
+		return { { { s.x, 0.0f, 0.0f, 0.0f }, { 0.0f, s.y, 0.0f, 0.0f }, { 0.0f, 0.0f, s.z, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+	}
+
+	// T * R * S
+	[[nodiscard]] inline Mat4 Compose(Vec3 t, const Quat& q, Vec3 s) noexcept
+	{
+		const float xx{ q.x * q.x }, yy{ q.y * q.y }, zz{ q.z * q.z };
+		const float xy{ q.x * q.y }, xz{ q.x * q.z }, yz{ q.y * q.z };
+		const float wx{ q.w * q.x }, wy{ q.w * q.y }, wz{ q.w * q.z };
+
+		return { { { (1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy + wz) * s.x, 2.0f * (xz - wy) * s.x, 0.0f },
+				   { 2.0f * (xy - wz) * s.y, (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz + wx) * s.y, 0.0f },
+				   { 2.0f * (xz + wy) * s.z, 2.0f * (yz - wx) * s.z, (1.0f - 2.0f * (xx + yy)) * s.z, 0.0f },
+				   { t.x, t.y, t.z, 1.0f } } };
+	}
+
+	[[nodiscard]] inline Mat4 Rotation(const Quat& q) noexcept { return Compose({ 0.0f, 0.0f, 0.0f }, q, { 1.0f, 1.0f, 1.0f }); }
+
+	// Right-handed view space looking down -z, depth in [0, 1] as in Vulkan and Direct3D 12
+	[[nodiscard]] inline Mat4 Perspective(float fovY, float aspect, float zNear, float zFar) noexcept
+	{
+		const float f{ 1.0f / std::tan(fovY * 0.5f) };
+		const float range{ zFar / (zNear - zFar) };
+		return { { { f / aspect, 0.0f, 0.0f, 0.0f }, { 0.0f, f, 0.0f, 0.0f }, { 0.0f, 0.0f, range, -1.0f }, { 0.0f, 0.0f, zNear * range, 0.0f } } };
+	}
+
+	[[nodiscard]] Mat4 Transpose(const Mat4& m) noexcept;
+
+#if defined(SISSKEY_SIMD_SSE41)
+	[[nodiscard]] inline __m128 LinearCombine(const Mat4& m, __m128 v) noexcept
+	{
+		__m128 r = _mm_mul_ps(Load(m.columns[0]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm_add_ps(r, _mm_mul_ps(Load(m.columns[1]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm_add_ps(r, _mm_mul_ps(Load(m.columns[2]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+		r = _mm_add_ps(r, _mm_mul_ps(Load(m.columns[3]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+		return r;
+	}
+
+	[[nodiscard]] inline Vec4 operator*(const Mat4& m, const Vec4& v) noexcept { return Store(LinearCombine(m, Load(v))); }
+
+	[[nodiscard]] inline Mat4 operator*(const Mat4& a, const Mat4& b) noexcept
+	{
+		Mat4 r;
+		for (int i{}; i < 4; ++i)
+			_mm_store_ps(&r.columns[i].x, LinearCombine(a, Load(b.columns[i])));
+		return r;
+	}
+#else
+	[[nodiscard]] inline Vec4 operator*(const Mat4& m, const Vec4& v) noexcept
+	{
+		return m.columns[0] * v.x + m.columns[1] * v.y + m.columns[2] * v.z + m.columns[3] * v.w;
+	}
+
+	[[nodiscard]] inline Mat4 operator*(const Mat4& a, const Mat4& b) noexcept
+	{
+		Mat4 r;
+		for (int i{}; i < 4; ++i)
+			r.columns[i] = a * b.columns[i];
+		return r;
+	}
+#endif
+
+	[[nodiscard]] inline Vec3 TransformPoint(const Mat4& m, Vec3 p) noexcept
+	{
+		const Vec4 r{ m * Vec4{ p.x, p.y, p.z, 1.0f } };
+		return { r.x, r.y, r.z };
+	}
+
+	// Batch kernels, in and out arrays must not overlap
+
+	void TransformPoints(const Mat4& m, const Vec3* in, Vec3* out, std::size_t count) noexcept;
+	void TransformPoints(const Mat4& m, const float* x, const float* y, const float* z,
+						 float* outX, float* outY, float* outZ, std::size_t count) noexcept;
+	// out[i] = a[i] * b[i]
+	void MultiplyMatrices(const Mat4* a, const Mat4* b, Mat4* out, std::size_t count) noexcept;
+	// out[i] = T[i] * R[i] * S[i]
+	void ComposeTransforms(const TransformSoA& transforms, Mat4* out, std::size_t count) noexcept;
+	// Parents must precede their children, parent[i] == NoParent for roots
+	constexpr std::uint32_t NoParent{ 0xFFFFFFFF };
+	void UpdateHierarchy(const Mat4* local, const std::uint32_t* parent, Mat4* world, std::size_t count) noexcept;
+
+	// Straightforward scalar versions of the batch kernels, used to validate and benchmark the optimized ones
+	namespace reference
+	{
+		void TransformPoints(const Mat4& m, const Vec3* in, Vec3* out, std::size_t count) noexcept;
+		void MultiplyMatrices(const Mat4* a, const Mat4* b, Mat4* out, std::size_t count) noexcept;
+		void ComposeTransforms(const TransformSoA& transforms, Mat4* out, std::size_t count) noexcept;
+	}
+}
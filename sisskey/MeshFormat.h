@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+namespace sisskey
+{
+	// Cooked mesh layout, little endian, written by sisskey_cooker mesh:
+	// MeshHeader, MeshVertex[vertexCount], indices (16 or 32 bit, padded to 4 bytes),
+	// Meshlet[meshletCount], meshlet vertices (32-bit indices of vertices),
+	// meshlet triangles (3 bytes per triangle, indices into the meshlet vertices)
+	struct MeshHeader
+	{
+		static constexpr std::uint32_t Magic{ 0x534d4b53 }; // "SKMS"
+		static constexpr std::uint32_t CurrentVersion{ 1 };
+		static constexpr std::uint32_t Indices32{ 1 << 0 };
+
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint32_t flags;
+		std::uint32_t vertexCount;
+		std::uint32_t indexCount;
+		std::uint32_t meshletCount;
+		std::uint32_t meshletVertexCount;
+		std::uint32_t meshletTriangleCount;
+		// position = boundsMin + position / 65535 * boundsExtent
+		float boundsMin[3];
+		float boundsExtent[3];
+	};
+
+	// 16 bytes, formats R16G16B16A16_UNORM, R16G16_SNORM and R16G16_SFLOAT
+	struct MeshVertex
+	{
+		std::uint16_t position[4]; // w is unused
+		std::int16_t normal[2]; // octahedral encoding
+		std::uint16_t uv[2]; // half floats
+	};
+
+	// Cluster of up to 64 vertices and 124 triangles.
+	// The cluster is back facing and can be culled if
+	// dot(normalize(center - cameraPosition), coneAxis) >= coneCutoff + radius / length(center - cameraPosition),
+	// a cutoff of 1 disables the test.
+	struct Meshlet
+	{
+		std::uint32_t vertexOffset;
+		std::uint32_t triangleOffset; // in triangles
+		std::uint32_t vertexCount;
+		std::uint32_t triangleCount;
+		float center[3];
+		float radius;
+		float coneAxis[3];
+		float coneCutoff;
+	};
+
+	static_assert(sizeof(MeshHeader) == 56 && sizeof(MeshVertex) == 16 && sizeof(Meshlet) == 48, "Mesh structures are written as is");
+}
@@ -0,0 +1,346 @@
+#include "Profiler.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <unordered_map>
+#include <fstream>
+#include <cstdio>
+
+namespace sisskey
+{
+	namespace
+	{
+		struct Event
+		{
+			const char* name; // nullptr closes the innermost open zone
+			std::int64_t time;
+		};
+
+		// Single producer (the owning thread), single consumer (EndFrame on the main thread)
+		struct ThreadBuffer
+		{
+			static constexpr std::uint64_t Capacity{ 1 << 16 };
+
+			alignas(64) std::atomic<std::uint64_t> head{ 0 };
+			// Producer only
+			std::uint64_t cachedTail{ 0 };
+			std::uint64_t openZones{ 0 };
+			std::atomic<std::uint64_t> dropped{ 0 };
+
+			alignas(64) std::atomic<std::uint64_t> tail{ 0 };
+			std::unique_ptr<Event[]> events{ std::make_unique<Event[]>(Capacity) };
+
+			// Consumer only
+			struct Open
+			{
+				std::uint32_t name;
+				std::uint32_t node;
+				std::int64_t start;
+			};
+			std::vector<Open> stack;
+			std::uint32_t index{ 0 };
+			std::string name; // guarded by State::mutex
+
+			[[nodiscard]] std::uint64_t Free(std::uint64_t h) noexcept
+			{
+				if (Capacity - (h - cachedTail) < openZones + 2)
+					cachedTail = tail.load(std::memory_order_acquire);
+				return Capacity - (h - cachedTail);
+			}
+
+			void Push(const char* n, std::int64_t time) noexcept
+			{
+				const std::uint64_t h{ head.load(std::memory_order_relaxed) };
+				events[h & (Capacity - 1)] = { n, time };
+				head.store(h + 1, std::memory_order_release);
+			}
+		};
+
+		struct Zone
+		{
+			std::uint32_t name;
+			std::uint32_t thread;
+			std::uint32_t depth;
+			std::int64_t start;
+			std::int64_t end;
+		};
+
+		struct Frame
+		{
+			std::int64_t start{ 0 };
+			std::int64_t end{ 0 };
+			std::vector<Zone> zones;
+		};
+
+		struct State
+		{
+			std::mutex mutex; // guards buffers and thread names
+			std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+			// Main thread only
+			std::unordered_map<const char*, std::uint32_t> nameIds;
+			std::unordered_map<std::string, std::uint32_t> threadNameIds;
+			std::vector<std::string> names;
+			std::vector<Profiler::Node> nodes;
+			std::deque<Frame> history;
+			std::uint64_t frameIndex{ 0 };
+			std::int64_t frameStart{ Profiler::Now() };
+
+			double slowFrameTime{ 0.0 };
+			std::filesystem::path slowFrameDirectory;
+			std::uint64_t nextSlowFrame{ 0 };
+		};
+
+		State& GetState()
+		{
+			static State state;
+			return state;
+		}
+
+		thread_local ThreadBuffer* t_Buffer{ nullptr };
+
+		ThreadBuffer& GetBuffer()
+		{
+			if (!t_Buffer)
+			{
+				State& state = GetState();
+				std::lock_guard<std::mutex> lock{ state.mutex };
+				auto& buffer = state.buffers.emplace_back(std::make_unique<ThreadBuffer>());
+				buffer->index = static_cast<std::uint32_t>(state.buffers.size() - 1);
+				t_Buffer = buffer.get();
+			}
+			return *t_Buffer;
+		}
+
+		std::uint32_t Intern(State& state, const char* name)
+		{
+			auto [it, inserted] = state.nameIds.try_emplace(name, static_cast<std::uint32_t>(state.names.size()));
+			if (inserted)
+				state.names.emplace_back(name);
+			return it->second;
+		}
+
+		std::uint32_t AddNode(State& state, std::uint32_t name, std::uint32_t thread, std::uint32_t parent)
+		{
+			const auto index = static_cast<std::uint32_t>(state.nodes.size());
+			Profiler::Node node{ name, thread, parent, Profiler::None, Profiler::None, 0, 0, 0 };
+			if (parent != Profiler::None)
+			{
+				Profiler::Node& p = state.nodes[parent];
+				node.depth = p.depth + 1;
+				node.nextSibling = p.firstChild;
+				p.firstChild = index;
+			}
+			state.nodes.push_back(node);
+			return index;
+		}
+
+		std::uint32_t GetChild(State& state, std::uint32_t parent, std::uint32_t name)
+		{
+			for (std::uint32_t i{ state.nodes[parent].firstChild }; i != Profiler::None; i = state.nodes[i].nextSibling)
+				if (state.nodes[i].name == name)
+					return i;
+			return AddNode(state, name, state.nodes[parent].thread, parent);
+		}
+
+		void Drain(State& state, ThreadBuffer& buffer, Frame& frame)
+		{
+			const std::uint64_t head{ buffer.head.load(std::memory_order_acquire) };
+			std::uint64_t tail{ buffer.tail.load(std::memory_order_relaxed) };
+			if (head == tail && buffer.stack.empty())
+				return;
+
+			std::string threadName{ buffer.name.empty() ? u8"Thread " + std::to_string(buffer.index) : buffer.name };
+			auto [it, inserted] = state.threadNameIds.try_emplace(threadName, static_cast<std::uint32_t>(state.names.size()));
+			if (inserted)
+				state.names.push_back(std::move(threadName));
+			const std::uint32_t root{ AddNode(state, it->second, buffer.index, Profiler::None) };
+
+			// Zones still open from the previous frame
+			std::uint32_t parent{ root };
+			for (auto& open : buffer.stack)
+				parent = open.node = GetChild(state, parent, open.name);
+
+			for (; tail != head; ++tail)
+			{
+				const Event& event = buffer.events[tail & (ThreadBuffer::Capacity - 1)];
+				if (event.name)
+				{
+					const std::uint32_t name{ Intern(state, event.name) };
+					const std::uint32_t node{ GetChild(state, buffer.stack.empty() ? root : buffer.stack.back().node, name) };
+					buffer.stack.push_back({ name, node, event.time });
+				}
+				else if (!buffer.stack.empty())
+				{
+					const auto open = buffer.stack.back();
+					buffer.stack.pop_back();
+					Profiler::Node& node = state.nodes[open.node];
+					++node.calls;
+					node.ticks += event.time - open.start;
+					frame.zones.push_back({ open.name, buffer.index, static_cast<std::uint32_t>(buffer.stack.size()), open.start, event.time });
+				}
+			}
+
+			buffer.tail.store(tail, std::memory_order_release);
+		}
+
+		void WriteEscaped(std::ostream& out, const std::string& s)
+		{
+			for (char c : s)
+			{
+				if (c == '"' || c == '\\')
+					out << '\\' << c;
+				else if (static_cast<unsigned char>(c) < 0x20)
+					out << ' ';
+				else
+					out << c;
+			}
+		}
+	}
+
+	bool Profiler::BeginZone(const char* name) noexcept
+	{
+		ThreadBuffer& buffer = GetBuffer();
+		// Keep room for the ends of all open zones, so a recorded begin is never left unmatched
+		if (buffer.Free(buffer.head.load(std::memory_order_relaxed)) < buffer.openZones + 2)
+		{
+			buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		++buffer.openZones;
+		buffer.Push(name, Now());
+		return true;
+	}
+
+	void Profiler::EndZone() noexcept
+	{
+		const std::int64_t time{ Now() };
+		ThreadBuffer& buffer = *t_Buffer;
+		--buffer.openZones;
+		buffer.Push(nullptr, time);
+	}
+
+	void Profiler::SetThreadName(std::string name)
+	{
+		ThreadBuffer& buffer = GetBuffer();
+		std::lock_guard<std::mutex> lock{ GetState().mutex };
+		buffer.name = std::move(name);
+	}
+
+	void Profiler::EndFrame()
+	{
+		State& state = GetState();
+		const std::int64_t now{ Now() };
+
+		Frame frame;
+		if (state.history.size() == HistoryFrames)
+		{
+			frame = std::move(state.history.front());
+			state.history.pop_front();
+			frame.zones.clear();
+		}
+		frame.start = state.frameStart;
+		frame.end = now;
+
+		state.nodes.clear();
+		{
+			std::lock_guard<std::mutex> lock{ state.mutex };
+			for (auto& buffer : state.buffers)
+				Drain(state, *buffer, frame);
+		}
+
+		state.history.push_back(std::move(frame));
+		state.frameStart = now;
+		++state.frameIndex;
+
+		if (state.slowFrameTime > 0.0 && state.frameIndex >= state.nextSlowFrame && Clock::ToSeconds(now - state.history.back().start) > state.slowFrameTime)
+		{
+			WriteChromeTrace(state.slowFrameDirectory / (u8"slow_frame_" + std::to_string(state.frameIndex) + u8".json"));
+			// Don't write overlapping traces
+			state.nextSlowFrame = state.frameIndex + HistoryFrames;
+		}
+	}
+
+	bool Profiler::WriteChromeTrace(const std::filesystem::path& path)
+	{
+		State& state = GetState();
+		if (state.history.empty())
+			return false;
+
+		std::ofstream out{ path };
+		if (!out)
+			return false;
+
+		const std::int64_t base{ state.history.front().start };
+		const double toMicroseconds{ 1e6 / static_cast<double>(Clock::Frequency) };
+		char number[32];
+		auto writeTime = [&](std::int64_t ticks)
+		{
+			std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(ticks) * toMicroseconds);
+			out << number;
+		};
+
+		out << u8"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		{
+			std::lock_guard<std::mutex> lock{ state.mutex };
+			for (const auto& buffer : state.buffers)
+			{
+				out << u8"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->index << u8",\"args\":{\"name\":\"";
+				WriteEscaped(out, buffer->name.empty() ? u8"Thread " + std::to_string(buffer->index) : buffer->name);
+				out << u8"\"}},\n";
+			}
+		}
+
+		for (const Frame& frame : state.history)
+			for (const Zone& zone : frame.zones)
+			{
+				out << u8"{\"name\":\"";
+				WriteEscaped(out, state.names[zone.name]);
+				out << u8"\",\"ph\":\"X\",\"pid\":0,\"tid\":" << zone.thread << u8",\"ts\":";
+				writeTime(zone.start - base);
+				out << u8",\"dur\":";
+				writeTime(zone.end - zone.start);
+				out << u8"},\n";
+			}
+
+		// Frame boundaries as global instant events
+		for (const Frame& frame : state.history)
+		{
+			out << u8"{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":";
+			writeTime(frame.end - base);
+			out << (&frame == &state.history.back() ? u8"}" : u8"},\n");
+		}
+		out << u8"]}\n";
+
+		return static_cast<bool>(out);
+	}
+
+	void Profiler::SetSlowFrameTrigger(double seconds, std::filesystem::path directory)
+	{
+		State& state = GetState();
+		state.slowFrameTime = seconds;
+		state.slowFrameDirectory = std::move(directory);
+	}
+
+	const std::vector<Profiler::Node>& Profiler::FrameZones() noexcept
+	{
+		return GetState().nodes;
+	}
+
+	const std::string& Profiler::GetName(std::uint32_t name) noexcept
+	{
+		return GetState().names[name];
+	}
+
+	std::uint64_t Profiler::DroppedZones() noexcept
+	{
+		State& state = GetState();
+		std::lock_guard<std::mutex> lock{ state.mutex };
+		std::uint64_t dropped{ 0 };
+		for (const auto& buffer : state.buffers)
+			dropped += buffer->dropped.load(std::memory_order_relaxed);
+		return dropped;
+	}
+}
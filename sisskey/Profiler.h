@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Timer.h"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Hierarchical CPU profiler.
+	// Zones are recorded into lock-free per-thread rings and collected on the main thread
+	// once per frame by EndFrame, which aggregates them into a per-frame hierarchy and keeps
+	// a short history that can be exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+	// Zone names must stay valid until the end of the frame they are recorded in, string literals are best.
+	// Everything compiles out with SISSKEY_NO_PROFILER.
+	class Profiler
+	{
+	public:
+		static constexpr std::uint32_t None{ 0xFFFFFFFF };
+		// Frames kept for the trace export
+		static constexpr std::size_t HistoryFrames{ 120 };
+
+		// Zone of the last frame aggregated by its call path, one root per thread that recorded anything.
+		// Zones still open at the end of a frame are accounted in the frame they are closed in.
+		struct Node
+		{
+			std::uint32_t name;
+			std::uint32_t thread;
+			std::uint32_t parent;
+			std::uint32_t firstChild;
+			std::uint32_t nextSibling;
+			std::uint32_t depth;
+			std::uint32_t calls;
+			std::int64_t ticks;
+		};
+
+		[[nodiscard]] static std::int64_t Now() noexcept { return Clock::Now(); }
+
+		// Returns false if the ring is full and the zone was dropped, EndZone must not be called then
+		[[nodiscard]] static bool BeginZone(const char* name) noexcept;
+		static void EndZone() noexcept;
+		static void SetThreadName(std::string name);
+
+		// Main thread only
+		static void EndFrame();
+		static bool WriteChromeTrace(const std::filesystem::path& path);
+		// Writes the history to directory/slow_frame_<index>.json when a frame takes longer than seconds, 0 disables
+		static void SetSlowFrameTrigger(double seconds, std::filesystem::path directory);
+
+		[[nodiscard]] static const std::vector<Node>& FrameZones() noexcept;
+		[[nodiscard]] static const std::string& GetName(std::uint32_t name) noexcept;
+		[[nodiscard]] static std::uint64_t DroppedZones() noexcept;
+	};
+
+	class ProfileZone
+	{
+	private:
+		bool m_Recorded;
+
+	public:
+		explicit ProfileZone(const char* name) noexcept : m_Recorded{ Profiler::BeginZone(name) } {}
+		~ProfileZone()
+		{
+			if (m_Recorded)
+				Profiler::EndZone();
+		}
+		ProfileZone(const ProfileZone&) = delete;
+		ProfileZone& operator=(const ProfileZone&) = delete;
+	};
+}
+
+#define SISSKEY_CONCAT_IMPL(a, b) a##b
+#define SISSKEY_CONCAT(a, b) SISSKEY_CONCAT_IMPL(a, b)
+
+#ifndef SISSKEY_NO_PROFILER
+#define SISSKEY_ZONE(name) ::sisskey::ProfileZone SISSKEY_CONCAT(sisskeyZone, __LINE__){ name }
+#define SISSKEY_PROFILE_THREAD(name) ::sisskey::Profiler::SetThreadName(name)
+#define SISSKEY_PROFILE_FRAME() ::sisskey::Profiler::EndFrame()
+#else
+#define SISSKEY_ZONE(name) ((void)0)
+#define SISSKEY_PROFILE_THREAD(name) ((void)0)
+#define SISSKEY_PROFILE_FRAME() ((void)0)
+#endif
@@ -0,0 +1,316 @@
+#include "RenderQueue.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+
+namespace sisskey
+{
+	namespace
+	{
+		// Fewer commands are sorted with std::stable_sort, the radix passes don't pay off
+		constexpr std::size_t RadixSortSize{ 2048 };
+		constexpr std::size_t MinBlockSize{ 4096 };
+		constexpr std::size_t RadixPasses{ 8 };
+		constexpr std::uint32_t NoGroup{ 0xFFFFFFFF };
+
+		// Commands that draw the same geometry
+		[[nodiscard]] bool SameMesh(const RenderCommand& a, const RenderCommand& b) noexcept
+		{
+			return a.vertexBuffer == b.vertexBuffer && a.indexBuffer == b.indexBuffer && a.count == b.count &&
+				   a.first == b.first && a.vertexOffset == b.vertexOffset;
+		}
+
+		[[nodiscard]] std::uint32_t HashMesh(const RenderCommand& c) noexcept
+		{
+			std::uint64_t h{ (static_cast<std::uint64_t>(c.vertexBuffer.value) << 32) | c.indexBuffer.value };
+			h ^= ((static_cast<std::uint64_t>(c.count) << 32) | c.first) * 0x9E3779B97F4A7C15ull;
+			h ^= static_cast<std::uint32_t>(c.vertexOffset);
+			h *= 0xFF51AFD7ED558CCDull;
+			return static_cast<std::uint32_t>(h >> 32);
+		}
+	}
+
+	RenderQueue::RenderQueue(std::size_t threads, std::uint32_t frames, std::uint32_t instancesPerFrame)
+		: m_Buckets(threads), m_Frames{ frames }, m_RegionSize{ instancesPerFrame }
+	{
+		assert(threads > 0 && frames > 0 && instancesPerFrame > 0);
+	}
+
+	void RenderQueue::EndFrame() noexcept
+	{
+		++m_Frame;
+		m_Used = 0;
+	}
+
+	std::size_t RenderQueue::Size() const noexcept
+	{
+		std::size_t size{ 0 };
+		for (const Bucket& bucket : m_Buckets)
+			size += bucket.entries.size();
+		return size;
+	}
+
+	void RenderQueue::Sort(JobSystem& jobs)
+	{
+		SISSKEY_ZONE(u8"RenderQueue::Sort");
+		const std::size_t count{ Size() };
+		const bool radix{ count >= RadixSortSize };
+		m_Items.resize(count);
+
+		// Buckets are concatenated in thread order, the digit counts come for free
+		jobs.ParallelFor(0, m_Buckets.size(), [this, radix](std::size_t first, std::size_t last)
+		{
+			for (std::size_t b{ first }; b < last; ++b)
+			{
+				std::size_t offset{ 0 };
+				for (std::size_t i{}; i < b; ++i)
+					offset += m_Buckets[i].entries.size();
+
+				Bucket& bucket = m_Buckets[b];
+				Item* items = m_Items.data() + offset;
+				for (std::size_t i{}; i < bucket.entries.size(); ++i)
+					items[i] = { bucket.entries[i].key, static_cast<std::uint32_t>(b), static_cast<std::uint32_t>(i) };
+
+				if (!radix)
+					continue;
+				std::memset(bucket.histogram, 0, sizeof(bucket.histogram));
+				for (const Entry& entry : bucket.entries)
+					for (std::size_t d{}; d < RadixPasses; ++d)
+						++bucket.histogram[d][(entry.key >> (d * 8)) & 0xFF];
+			}
+		}, 1);
+
+		if (radix)
+			RadixSort(jobs);
+		else std::stable_sort(m_Items.begin(), m_Items.end(), [](const Item& a, const Item& b) { return a.key < b.key; });
+		m_Sorted = true;
+	}
+
+	void RenderQueue::RadixSort(JobSystem& jobs)
+	{
+		const std::size_t count{ m_Items.size() };
+		m_Scratch.resize(count);
+
+		const std::size_t blocks{ std::clamp<std::size_t>(count / MinBlockSize, 1, jobs.ThreadCount() * 4) };
+		const std::size_t blockSize{ (count + blocks - 1) / blocks };
+		m_BlockOffsets.resize(blocks * 256);
+
+		Item* source = m_Items.data();
+		Item* target = m_Scratch.data();
+		for (std::size_t d{}; d < RadixPasses; ++d)
+		{
+			// Keys usually share the upper bytes (layer, pass, pipeline), such passes wouldn't move anything
+			const std::uint32_t digit{ static_cast<std::uint32_t>((source[0].key >> (d * 8)) & 0xFF) };
+			std::size_t same{ 0 };
+			for (const Bucket& bucket : m_Buckets)
+				same += bucket.entries.empty() ? 0 : bucket.histogram[d][digit];
+			if (same == count)
+				continue;
+
+			const std::uint32_t shift{ static_cast<std::uint32_t>(d * 8) };
+			jobs.ParallelFor(0, blocks, [this, source, count, blockSize, shift](std::size_t first, std::size_t last)
+			{
+				for (std::size_t k{ first }; k < last; ++k)
+				{
+					std::uint32_t* histogram = &m_BlockOffsets[k * 256];
+					std::fill_n(histogram, 256, 0u);
+					for (std::size_t i{ k * blockSize }; i < std::min(count, (k + 1) * blockSize); ++i)
+						++histogram[(source[i].key >> shift) & 0xFF];
+				}
+			}, 1);
+
+			// Digit-major, block-minor offsets keep the sort stable
+			std::uint32_t sum{ 0 };
+			for (std::size_t bin{}; bin < 256; ++bin)
+			{
+				for (std::size_t k{}; k < blocks; ++k)
+				{
+					const std::uint32_t c{ m_BlockOffsets[k * 256 + bin] };
+					m_BlockOffsets[k * 256 + bin] = sum;
+					sum += c;
+				}
+			}
+
+			jobs.ParallelFor(0, blocks, [this, source, target, count, blockSize, shift](std::size_t first, std::size_t last)
+			{
+				for (std::size_t k{ first }; k < last; ++k)
+				{
+					std::uint32_t offsets[256];
+					std::copy_n(&m_BlockOffsets[k * 256], 256, offsets);
+					for (std::size_t i{ k * blockSize }; i < std::min(count, (k + 1) * blockSize); ++i)
+						target[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+				}
+			}, 1);
+			std::swap(source, target);
+		}
+
+		if (source != m_Items.data())
+			m_Items.swap(m_Scratch);
+	}
+
+	std::uint32_t RenderQueue::MergeInstances()
+	{
+		SISSKEY_ZONE(u8"RenderQueue::MergeInstances");
+		std::size_t instances{ 0 };
+		for (const Bucket& bucket : m_Buckets)
+			instances += bucket.transforms.size();
+		// Earlier submits of the frame keep their part of the region. The device recreates the ring buffer
+		// for a new capacity and keeps the old one for the frames in flight, so the new ring starts empty.
+		if (m_Used + instances > m_RegionSize)
+		{
+			do
+				m_RegionSize *= 2;
+			while (m_RegionSize < instances);
+			m_Used = 0;
+		}
+		const std::uint32_t region{ static_cast<std::uint32_t>(m_Frame % m_Frames) * m_RegionSize + m_Used };
+		m_Used += static_cast<std::uint32_t>(instances);
+
+		m_Instances.resize(instances);
+		m_Batches.clear();
+		std::uint32_t next{ 0 };
+		for (std::size_t i{}; i < m_Items.size();)
+		{
+			// Commands with the same state in one layer and pass, adjacent because both are in the key
+			const RenderCommand& c = GetEntry(m_Items[i]).command;
+			const std::uint32_t layerPass{ SortKey::LayerPass(m_Items[i].key) };
+			std::size_t end{ i + 1 };
+			for (; end < m_Items.size(); ++end)
+			{
+				const RenderCommand& other = GetEntry(m_Items[end]).command;
+				if (other.type != c.type || other.pipeline != c.pipeline || other.material != c.material ||
+					SortKey::LayerPass(m_Items[end].key) != layerPass)
+					break;
+			}
+
+			// Instanced draws are grouped by mesh, a group is drawn in place of its first instance
+			std::size_t tableSize{ 16 };
+			while (tableSize < (end - i) * 2)
+				tableSize *= 2;
+			if (end - i > 1)
+				m_GroupTable.assign(tableSize, NoGroup);
+			m_Groups.clear();
+			m_GroupOf.resize(end - i);
+			for (std::size_t k{ i }; k < end; ++k)
+			{
+				const Entry& entry = GetEntry(m_Items[k]);
+				if (entry.transform == NoTransform)
+				{
+					m_Batches.push_back({ static_cast<std::uint32_t>(k), entry.command.instanceCount, entry.command.firstInstance });
+					continue;
+				}
+
+				std::uint32_t group{ NoGroup };
+				if (end - i > 1)
+				{
+					std::size_t slot{ HashMesh(entry.command) & (tableSize - 1) };
+					for (; (group = m_GroupTable[slot]) != NoGroup; slot = (slot + 1) & (tableSize - 1))
+					{
+						if (SameMesh(entry.command, GetEntry(m_Items[m_Batches[m_Groups[group].batch].item]).command))
+							break;
+					}
+					if (group == NoGroup)
+						m_GroupTable[slot] = static_cast<std::uint32_t>(m_Groups.size());
+				}
+				if (group == NoGroup)
+				{
+					group = static_cast<std::uint32_t>(m_Groups.size());
+					m_Groups.push_back({ static_cast<std::uint32_t>(m_Batches.size()), 0 });
+					m_Batches.push_back({ static_cast<std::uint32_t>(k), 0, 0 });
+				}
+				m_GroupOf[k - i] = group;
+				++m_Batches[m_Groups[group].batch].instanceCount;
+			}
+
+			for (const Group& group : m_Groups)
+			{
+				Batch& batch = m_Batches[group.batch];
+				batch.firstInstance = region + next;
+				next += batch.instanceCount;
+			}
+			for (std::size_t k{ i }; k < end; ++k)
+			{
+				const Item& item = m_Items[k];
+				const Entry& entry = GetEntry(item);
+				if (entry.transform == NoTransform)
+					continue;
+				Group& group = m_Groups[m_GroupOf[k - i]];
+				m_Instances[m_Batches[group.batch].firstInstance - region + group.written++] = m_Buckets[item.bucket].transforms[entry.transform];
+			}
+			i = end;
+		}
+		return region;
+	}
+
+	void RenderQueue::Submit(GraphicsDevice& device)
+	{
+		SISSKEY_ZONE(u8"RenderQueue::Submit");
+		assert(m_Sorted || Size() == 0);
+
+		m_Statistics = {};
+		m_Statistics.commands = m_Items.size();
+		const std::uint32_t region{ MergeInstances() };
+		m_Statistics.instances = m_Instances.size();
+
+		constexpr std::uint32_t Unbound{ 0xFFFFFFFF };
+		std::uint32_t pipeline{ Unbound }, material{ Unbound }, vertexBuffer{ Unbound }, indexBuffer{ Unbound };
+		auto bind = [this](std::uint32_t& bound, std::uint32_t object)
+		{
+			if (bound == object)
+			{
+				++m_Statistics.redundantStates;
+				return false;
+			}
+			bound = object;
+			++m_Statistics.stateChanges;
+			return true;
+		};
+
+		std::size_t dispatches{ 0 };
+		device.CmdBegin();
+		if (!m_Instances.empty())
+			device.CmdUploadInstances(m_Instances.data(), static_cast<std::uint32_t>(m_Instances.size()), region, m_Frames * m_RegionSize);
+		for (const Batch& batch : m_Batches)
+		{
+			const RenderCommand& c = GetEntry(m_Items[batch.item]).command;
+			if (bind(pipeline, c.pipeline.value))
+				device.CmdSetPipeline(c.pipeline);
+			if (bind(material, c.material))
+				device.CmdSetMaterial(c.material);
+
+			switch (c.type)
+			{
+			case RenderCommand::Type::Draw:
+				if (bind(vertexBuffer, c.vertexBuffer.value))
+					device.CmdSetVertexBuffer(c.vertexBuffer);
+				device.CmdDraw(c.count, batch.instanceCount, c.first, batch.firstInstance);
+				++m_Statistics.drawCalls;
+				break;
+			case RenderCommand::Type::DrawIndexed:
+				if (bind(vertexBuffer, c.vertexBuffer.value))
+					device.CmdSetVertexBuffer(c.vertexBuffer);
+				if (bind(indexBuffer, c.indexBuffer.value))
+					device.CmdSetIndexBuffer(c.indexBuffer);
+				device.CmdDrawIndexed(c.count, batch.instanceCount, c.first, c.vertexOffset, batch.firstInstance);
+				++m_Statistics.drawCalls;
+				break;
+			case RenderCommand::Type::Dispatch:
+				device.CmdDispatch(c.groups[0], c.groups[1], c.groups[2]);
+				++dispatches;
+				break;
+			}
+		}
+		device.CmdEnd();
+		m_Statistics.draws = m_Items.size() - dispatches;
+
+		for (Bucket& bucket : m_Buckets)
+		{
+			bucket.entries.clear();
+			bucket.transforms.clear();
+		}
+		m_Items.clear();
+		m_Sorted = false;
+	}
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "GraphicsDevice.h"
+#include "JobSystem.h"
+#include "Math.h"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+namespace sisskey
+{
+	// 64-bit keys ordering the commands of a RenderQueue, smaller keys are submitted first.
+	// Layer (4 bits) and pass (6 bits) are the most significant, then either state or depth.
+	struct SortKey
+	{
+		static constexpr std::uint32_t LayerBits{ 4 };
+		static constexpr std::uint32_t PassBits{ 6 };
+		static constexpr std::uint32_t PipelineBits{ 14 };
+		static constexpr std::uint32_t MaterialBits{ 16 };
+		static constexpr std::uint32_t DepthBits{ 24 };
+
+		// Opaque geometry: grouped by pipeline and material to minimize state changes,
+		// front to back within a material. Fields are truncated to their bit counts.
+		[[nodiscard]] static constexpr std::uint64_t Make(std::uint32_t layer, std::uint32_t pass, std::uint32_t pipeline,
+														 std::uint32_t material, std::uint32_t depth) noexcept
+		{
+			return Field(layer, LayerBits, 60) | Field(pass, PassBits, 54) | Field(pipeline, PipelineBits, 40) |
+				   Field(material, MaterialBits, 24) | Field(depth, DepthBits, 0);
+		}
+
+		// Blended geometry: depth first, pass InvertDepth(depth) for back to front
+		[[nodiscard]] static constexpr std::uint64_t MakeDepthFirst(std::uint32_t layer, std::uint32_t pass, std::uint32_t depth,
+																   std::uint32_t pipeline, std::uint32_t material) noexcept
+		{
+			return Field(layer, LayerBits, 60) | Field(pass, PassBits, 54) | Field(depth, DepthBits, 30) |
+				   Field(pipeline, PipelineBits, 16) | Field(material, MaterialBits, 0);
+		}
+
+		// Depth in [0, 1] to DepthBits, values outside are clamped
+		[[nodiscard]] static constexpr std::uint32_t QuantizeDepth(float depth) noexcept
+		{
+			constexpr float Max{ static_cast<float>((1u << DepthBits) - 1) };
+			return depth <= 0.0f ? 0u : depth >= 1.0f ? (1u << DepthBits) - 1 : static_cast<std::uint32_t>(depth * Max);
+		}
+
+		[[nodiscard]] static constexpr std::uint32_t InvertDepth(std::uint32_t depth) noexcept { return ((1u << DepthBits) - 1) - depth; }
+
+		// Layer and pass of a key, commands of different ones are never merged
+		[[nodiscard]] static constexpr std::uint32_t LayerPass(std::uint64_t key) noexcept { return static_cast<std::uint32_t>(key >> 54); }
+
+	private:
+		[[nodiscard]] static constexpr std::uint64_t Field(std::uint32_t value, std::uint32_t bits, std::uint32_t shift) noexcept
+		{
+			return (static_cast<std::uint64_t>(value) & ((std::uint64_t{ 1 } << bits) - 1)) << shift;
+		}
+	};
+
+	// Plain data, so recording is a copy and buckets are never traversed by pointers
+	struct RenderCommand
+	{
+		enum class Type : std::uint8_t
+		{
+			Draw,
+			DrawIndexed,
+			Dispatch
+		};
+
+		Type type{ Type::Draw };
+		PipelineHandle pipeline;
+		MaterialID material{ 0 };
+		// Draws only
+		BufferHandle vertexBuffer;
+		BufferHandle indexBuffer;
+		// Vertices or indices
+		std::uint32_t count{ 0 };
+		// First vertex or index
+		std::uint32_t first{ 0 };
+		std::int32_t vertexOffset{ 0 };
+		std::uint32_t instanceCount{ 1 };
+		std::uint32_t firstInstance{ 0 };
+		// Dispatch only
+		std::uint32_t groups[3]{ 1, 1, 1 };
+	};
+
+	// Commands recorded in parallel and replayed in the order of their sort keys.
+	// Every job thread records into its own bucket, so recording takes no locks.
+	// Sort merges the buckets with a parallel LSD radix sort, commands with equal keys
+	// keep their recording order within a thread. Submit skips state that is already bound.
+	// Draws recorded with a transform are instanced: the ones with the same pipeline and material
+	// are merged by mesh, and their transforms are packed into a ring buffer of the device.
+	class RenderQueue
+	{
+	public:
+		struct Statistics
+		{
+			std::size_t commands{ 0 };
+			// Draws recorded and draw calls made after merging the instanced ones
+			std::size_t draws{ 0 };
+			std::size_t drawCalls{ 0 };
+			std::size_t instances{ 0 };
+			// Set calls made and skipped because the object was bound already
+			std::size_t stateChanges{ 0 };
+			std::size_t redundantStates{ 0 };
+		};
+
+	private:
+		static constexpr std::uint32_t NoTransform{ 0xFFFFFFFF };
+
+		// Sorted in place of the entries, so the radix passes move 16 bytes per command
+		struct Item
+		{
+			std::uint64_t key;
+			std::uint32_t bucket;
+			std::uint32_t entry;
+		};
+
+		struct Entry
+		{
+			std::uint64_t key;
+			RenderCommand command;
+			std::uint32_t transform; // index in Bucket::transforms or NoTransform
+		};
+
+		struct alignas(64) Bucket
+		{
+			std::vector<Entry> entries;
+			std::vector<Mat4> transforms;
+			// Digit counts of the keys for each of the 8 radix passes
+			std::uint32_t histogram[8][256];
+		};
+
+		// A command to replay, instanced draws have the merged instances
+		struct Batch
+		{
+			std::uint32_t item;
+			std::uint32_t instanceCount;
+			std::uint32_t firstInstance;
+		};
+
+		// Instanced draws of one mesh within a run of the same state
+		struct Group
+		{
+			std::uint32_t batch;
+			std::uint32_t written;
+		};
+
+		std::vector<Bucket> m_Buckets;
+		std::vector<Item> m_Items;
+		std::vector<Item> m_Scratch;
+		// [block][digit], counts and then scatter offsets of a radix pass
+		std::vector<std::uint32_t> m_BlockOffsets;
+		bool m_Sorted{ false };
+		Statistics m_Statistics;
+
+		std::vector<Batch> m_Batches;
+		// Open addressing, group indices by mesh
+		std::vector<std::uint32_t> m_GroupTable;
+		std::vector<Group> m_Groups;
+		std::vector<std::uint32_t> m_GroupOf;
+		// Transforms of the frame, uploaded to the region of the ring buffer no frame in flight reads
+		std::vector<Mat4> m_Instances;
+		std::uint32_t m_Frames;
+		std::uint32_t m_RegionSize;
+		// Instances uploaded by the submits of the frame
+		std::uint32_t m_Used{ 0 };
+		std::uint64_t m_Frame{ 0 };
+
+		[[nodiscard]] const Entry& GetEntry(const Item& item) const noexcept { return m_Buckets[item.bucket].entries[item.entry]; }
+		void RadixSort(JobSystem& jobs);
+		// Fills m_Batches and m_Instances, returns the first instance of the submit in the ring buffer
+		std::uint32_t MergeInstances();
+
+	public:
+		// frames: frames the device may have in flight, each has a region of instancesPerFrame transforms in the ring buffer.
+		// Regions grow to fit the instances of a frame, they follow the frames of the device with EndFrame.
+		explicit RenderQueue(std::size_t threads, std::uint32_t frames = GraphicsDevice::FramesInFlight, std::uint32_t instancesPerFrame = 1 << 14);
+		RenderQueue(RenderQueue&&) = default;
+		RenderQueue& operator=(RenderQueue&&) = default;
+		RenderQueue(const RenderQueue&) = delete;
+		RenderQueue& operator=(const RenderQueue&) = delete;
+
+		// Job system threads only, not during Sort and Submit
+		void Record(std::uint64_t key, const RenderCommand& command)
+		{
+			m_Buckets[JobSystem::ThreadIndex()].entries.push_back({ key, command, NoTransform });
+		}
+		// Instanced draw, transform is read at instance rate. The command keeps the mesh (buffers, count, first and vertex offset),
+		// instanceCount and firstInstance are set when merging. Draws of the same layer, pass, pipeline and material
+		// that are adjacent after sorting are merged, each mesh is drawn at the position of its first instance. Blended geometry
+		// that needs its depth order should be recorded without a transform.
+		void Record(std::uint64_t key, const RenderCommand& command, const Mat4& transform)
+		{
+			assert(command.type != RenderCommand::Type::Dispatch);
+			Bucket& bucket = m_Buckets[JobSystem::ThreadIndex()];
+			bucket.entries.push_back({ key, command, static_cast<std::uint32_t>(bucket.transforms.size()) });
+			bucket.transforms.push_back(transform);
+		}
+
+		// Merges the buckets of all threads, main thread only
+		void Sort(JobSystem& jobs);
+		// Replays the sorted commands and removes them, main thread only
+		void Submit(GraphicsDevice& device);
+		// Called with GraphicsDevice::EndFrame, the next submits write the region of the next frame
+		void EndFrame() noexcept;
+
+		[[nodiscard]] std::size_t Size() const noexcept;
+		// Of the last Submit
+		[[nodiscard]] const Statistics& GetStatistics() const noexcept { return m_Statistics; }
+	};
+}
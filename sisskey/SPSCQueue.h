@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <type_traits>
+#include <cstddef>
+
+namespace sisskey
+{
+	// Bounded lock-free queue for one producer and one consumer thread.
+	// Each side caches the other side's index, so the shared cache lines
+	// are only touched when the cached value says the queue is full or empty.
+	template<typename T, std::size_t Capacity>
+	class SPSCQueue
+	{
+		static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+		static_assert(std::is_trivially_copyable_v<T>, "SPSCQueue items must be trivially copyable");
+	private:
+		static constexpr std::size_t Mask{ Capacity - 1 };
+
+		// Consumer
+		alignas(64) std::atomic<std::size_t> m_Head{ 0 };
+		std::size_t m_CachedTail{ 0 };
+		// Producer
+		alignas(64) std::atomic<std::size_t> m_Tail{ 0 };
+		std::size_t m_CachedHead{ 0 };
+
+		alignas(64) std::array<T, Capacity> m_Items;
+
+	public:
+		SPSCQueue() = default;
+		SPSCQueue(const SPSCQueue&) = delete;
+		SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+		// Producer only, returns false if the queue is full
+		[[nodiscard]] bool Push(const T& item) noexcept
+		{
+			const std::size_t tail{ m_Tail.load(std::memory_order_relaxed) };
+			if (tail - m_CachedHead == Capacity)
+			{
+				m_CachedHead = m_Head.load(std::memory_order_acquire);
+				if (tail - m_CachedHead == Capacity)
+					return false;
+			}
+			m_Items[tail & Mask] = item;
+			m_Tail.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer only, returns false if the queue is empty
+		[[nodiscard]] bool Pop(T& item) noexcept
+		{
+			const std::size_t head{ m_Head.load(std::memory_order_relaxed) };
+			if (head == m_CachedTail)
+			{
+				m_CachedTail = m_Tail.load(std::memory_order_acquire);
+				if (head == m_CachedTail)
+					return false;
+			}
+			item = m_Items[head & Mask];
+			m_Head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer only, calls function(const T&) for every item available at the time of the call
+		template<typename F>
+		std::size_t Drain(F&& function)
+		{
+			const std::size_t head{ m_Head.load(std::memory_order_relaxed) };
+			m_CachedTail = m_Tail.load(std::memory_order_acquire);
+			for (std::size_t i{ head }; i != m_CachedTail; ++i)
+				function(m_Items[i & Mask]);
+			m_Head.store(m_CachedTail, std::memory_order_release);
+			return m_CachedTail - head;
+		}
+
+		// Approximate when called concurrently with the other side
+		[[nodiscard]] bool Empty() const noexcept
+		{
+			return m_Head.load(std::memory_order_acquire) == m_Tail.load(std::memory_order_acquire);
+		}
+	};
+}
@@ -0,0 +1,141 @@
+#include "Settings.h"
+#include "Hash.h"
+
+#include <type_traits>
+#include <stdexcept>
+#include <cmath>
+
+namespace sisskey
+{
+	void Settings::AddBinding(std::string key, Target target)
+	{
+		const std::uint64_t hash{ HashName(key) };
+		if (auto it = m_Index.find(hash); it != m_Index.end())
+		{
+			if (m_Bindings[it->second].key != key)
+				throw std::runtime_error{ u8"Settings key hash collision" };
+			m_Bindings[it->second].target = std::move(target);
+			return;
+		}
+
+		m_Index.emplace(hash, m_Bindings.size());
+		m_Bindings.push_back({ std::move(key), std::move(target) });
+	}
+
+	void Settings::Apply(const Binding& binding, JsonValue value)
+	{
+		std::visit([this, &binding, value](auto& target)
+		{
+			using T = std::decay_t<decltype(target)>;
+			if constexpr (std::is_same_v<T, Handler>)
+			{
+				target(binding.key, value);
+				return;
+			}
+			else if constexpr (std::is_same_v<T, bool*>)
+			{
+				if (value.IsBool())
+				{
+					*target = value.AsBool();
+					return;
+				}
+			}
+			else if constexpr (std::is_same_v<T, std::string*>)
+			{
+				if (value.IsString())
+				{
+					target->assign(value.AsString());
+					return;
+				}
+			}
+			else if constexpr (std::is_same_v<T, int*>)
+			{
+				if (value.IsNumber())
+				{
+					*target = static_cast<int>(std::lround(value.AsNumber()));
+					return;
+				}
+			}
+			else
+			{
+				if (value.IsNumber())
+				{
+					*target = static_cast<std::remove_pointer_t<T>>(value.AsNumber());
+					return;
+				}
+			}
+
+			m_LastError = u8"Wrong type of " + binding.key;
+		}, binding.target);
+	}
+
+	void Settings::Apply(JsonValue object)
+	{
+		const std::size_t length{ m_Key.size() };
+		for (JsonValue member : object)
+		{
+			if (length)
+				m_Key += '.';
+			m_Key += member.Key();
+
+			const auto it = m_Index.find(HashName(m_Key));
+			const bool bound{ it != m_Index.end() && m_Bindings[it->second].key == m_Key };
+			if (bound)
+				Apply(m_Bindings[it->second], member);
+
+			// Nested keys can be bound as well as the object itself
+			if (member.IsObject())
+				Apply(member);
+			else if (!bound && m_Unbound)
+				m_Unbound(m_Key, member);
+
+			m_Key.resize(length);
+		}
+	}
+
+	bool Settings::Load(const std::filesystem::path& path, bool watch)
+	{
+		m_Path = path;
+		m_Watcher.reset();
+		if (watch)
+			m_Watcher = std::make_unique<FileWatcher>(path);
+
+		return Reload();
+	}
+
+	bool Settings::Reload()
+	{
+		if (!std::filesystem::exists(m_Path))
+			return false;
+
+		// Parse into a new document, so a malformed file leaves the current one intact
+		MappedFile file{ m_Path };
+		JsonDocument document;
+		document.Parse(file.Data(), file.Size());
+		if (!document.Root().IsObject())
+			throw std::runtime_error{ u8"Settings root must be an object" };
+
+		m_File = std::move(file);
+		m_Document = std::move(document);
+		m_LastError.clear();
+		m_Key.clear();
+		Apply(m_Document.Root());
+		return true;
+	}
+
+	bool Settings::Poll()
+	{
+		if (!m_Watcher || !m_Watcher->Changed())
+			return false;
+
+		try
+		{
+			return Reload();
+		}
+		catch (const std::exception& e)
+		{
+			m_LastError = e.what();
+			return false;
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "Json.h"
+#include "FileWatcher.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <variant>
+#include <functional>
+#include <filesystem>
+#include <memory>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Settings file bound to typed variables.
+	// Keys are dot separated paths of nested objects, e.g. "engine.frameCap" for {"engine":{"frameCap":60}}.
+	// The file is memory mapped and parsed in place, values are applied in one pass over the document,
+	// so the cost doesn't depend on the number of bindings.
+	class Settings
+	{
+	public:
+		// Receives values of keys without a typed binding, views are valid until the next reload
+		using Handler = std::function<void(std::string_view key, JsonValue value)>;
+
+	private:
+		using Target = std::variant<bool*, int*, float*, double*, std::string*, Handler>;
+
+		struct Binding
+		{
+			std::string key;
+			Target target;
+		};
+
+		std::vector<Binding> m_Bindings;
+		std::unordered_map<std::uint64_t, std::size_t> m_Index;
+		Handler m_Unbound;
+
+		std::filesystem::path m_Path;
+		MappedFile m_File;
+		JsonDocument m_Document;
+		std::unique_ptr<FileWatcher> m_Watcher;
+		std::string m_Key;
+		std::string m_LastError;
+
+		void AddBinding(std::string key, Target target);
+		bool Reload();
+		void Apply(JsonValue object);
+		void Apply(const Binding& binding, JsonValue value);
+
+	public:
+		Settings() = default;
+		Settings(Settings&&) = default;
+		Settings& operator=(Settings&&) = default;
+		Settings(const Settings&) = delete;
+		Settings& operator=(const Settings&) = delete;
+
+		// Bound variables must outlive the settings, values of a different type are ignored
+		void Bind(std::string key, bool* value) { AddBinding(std::move(key), Target{ value }); }
+		void Bind(std::string key, int* value) { AddBinding(std::move(key), Target{ value }); }
+		void Bind(std::string key, float* value) { AddBinding(std::move(key), Target{ value }); }
+		void Bind(std::string key, double* value) { AddBinding(std::move(key), Target{ value }); }
+		void Bind(std::string key, std::string* value) { AddBinding(std::move(key), Target{ value }); }
+		// Also works for objects and arrays
+		void Bind(std::string key, Handler handler) { AddBinding(std::move(key), Target{ std::move(handler) }); }
+		void SetUnboundHandler(Handler handler) { m_Unbound = std::move(handler); }
+
+		// Returns false if the file doesn't exist, throws std::runtime_error if it's malformed.
+		// When watching, changes are picked up by Poll even if the file is created later.
+		bool Load(const std::filesystem::path& path, bool watch = true);
+		// Re-applies the file if it has changed since the last call, call it between frames.
+		// A malformed file is ignored, keeping the current values, see LastError.
+		bool Poll();
+
+		// Valid until the next reload
+		[[nodiscard]] JsonValue Root() const noexcept { return m_Document.Root(); }
+		[[nodiscard]] const std::string& LastError() const noexcept { return m_LastError; }
+	};
+}
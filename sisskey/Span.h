@@ -0,0 +1,75 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cassert>
+
+namespace sisskey
+{
+	// View of contiguous elements, a subset of C++20 std::span
+	template<typename T>
+	class Span
+	{
+	private:
+		T* m_Data{ nullptr };
+		std::size_t m_Size{ 0 };
+
+	public:
+		constexpr Span() noexcept = default;
+		constexpr Span(T* data, std::size_t size) noexcept : m_Data{ data }, m_Size{ size } {}
+		template<std::size_t N>
+		constexpr Span(T(&array)[N]) noexcept : m_Data{ array }, m_Size{ N } {}
+		// Containers with data() and size(), e.g. std::vector
+		template<typename C, typename = std::enable_if_t<std::is_convertible_v<decltype(std::declval<C&>().data()), T*>>>
+		constexpr Span(C& container) noexcept : m_Data{ container.data() }, m_Size{ container.size() } {}
+		// Span<T> to Span<const T>
+		template<typename U, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+		constexpr Span(const Span<U>& other) noexcept : m_Data{ other.Data() }, m_Size{ other.Size() } {}
+
+		[[nodiscard]] constexpr T* Data() const noexcept { return m_Data; }
+		[[nodiscard]] constexpr std::size_t Size() const noexcept { return m_Size; }
+		[[nodiscard]] constexpr std::size_t SizeBytes() const noexcept { return m_Size * sizeof(T); }
+		[[nodiscard]] constexpr bool Empty() const noexcept { return m_Size == 0; }
+
+		[[nodiscard]] constexpr T& operator[](std::size_t index) const noexcept
+		{
+			assert(index < m_Size);
+			return m_Data[index];
+		}
+
+		[[nodiscard]] constexpr T* begin() const noexcept { return m_Data; }
+		[[nodiscard]] constexpr T* end() const noexcept { return m_Data + m_Size; }
+
+		[[nodiscard]] constexpr Span First(std::size_t count) const noexcept
+		{
+			assert(count <= m_Size);
+			return { m_Data, count };
+		}
+
+		[[nodiscard]] constexpr Span Subspan(std::size_t offset, std::size_t count) const noexcept
+		{
+			assert(offset <= m_Size && count <= m_Size - offset);
+			return { m_Data + offset, count };
+		}
+
+		[[nodiscard]] constexpr Span Subspan(std::size_t offset) const noexcept
+		{
+			assert(offset <= m_Size);
+			return { m_Data + offset, m_Size - offset };
+		}
+	};
+
+	template<typename T>
+	[[nodiscard]] Span<const std::byte> AsBytes(Span<T> span) noexcept
+	{
+		return { reinterpret_cast<const std::byte*>(span.Data()), span.SizeBytes() };
+	}
+
+	template<typename T>
+	[[nodiscard]] Span<std::byte> AsWritableBytes(Span<T> span) noexcept
+	{
+		static_assert(!std::is_const_v<T>, "Elements must be writable");
+		return { reinterpret_cast<std::byte*>(span.Data()), span.SizeBytes() };
+	}
+}
@@ -0,0 +1,189 @@
+#include "TaskGraph.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace sisskey
+{
+	TaskGraph::Node& TaskGraph::Node::Reads(std::string_view resource)
+	{
+		m_Reads.emplace_back(resource);
+		return *this;
+	}
+
+	TaskGraph::Node& TaskGraph::Node::Writes(std::string_view resource)
+	{
+		m_Writes.emplace_back(resource);
+		return *this;
+	}
+
+	TaskGraph::Node& TaskGraph::AddSystem(std::string name, std::function<void()> function)
+	{
+		m_Compiled = false;
+		return m_Nodes.emplace_back(std::move(name), std::move(function));
+	}
+
+	void TaskGraph::Clear() noexcept
+	{
+		m_Nodes.clear();
+		m_Roots.clear();
+		m_CriticalPath.clear();
+		m_CriticalPathTime = 0.0;
+		m_Compiled = false;
+	}
+
+	void TaskGraph::Compile()
+	{
+		constexpr std::size_t None{ static_cast<std::size_t>(-1) };
+		struct ResourceState
+		{
+			std::size_t writer{ None };
+			std::vector<std::size_t> readers;
+		};
+		std::unordered_map<std::string_view, ResourceState> resources;
+
+		for (auto& node : m_Nodes)
+		{
+			node.m_Dependencies.clear();
+			node.m_Dependents.clear();
+		}
+
+		for (std::size_t i{}; i < m_Nodes.size(); ++i)
+		{
+			Node& node = m_Nodes[i];
+
+			// Read after write
+			for (const auto& name : node.m_Reads)
+			{
+				ResourceState& state = resources[name];
+				if (state.writer != None)
+					node.m_Dependencies.push_back(state.writer);
+				state.readers.push_back(i);
+			}
+
+			// Write after read and write after write
+			for (const auto& name : node.m_Writes)
+			{
+				ResourceState& state = resources[name];
+				for (std::size_t reader : state.readers)
+					if (reader != i)
+						node.m_Dependencies.push_back(reader);
+				if (state.writer != None && state.writer != i)
+					node.m_Dependencies.push_back(state.writer);
+				state.writer = i;
+				state.readers.clear();
+			}
+
+			std::sort(node.m_Dependencies.begin(), node.m_Dependencies.end());
+			node.m_Dependencies.erase(std::unique(node.m_Dependencies.begin(), node.m_Dependencies.end()), node.m_Dependencies.end());
+			for (std::size_t dependency : node.m_Dependencies)
+				m_Nodes[dependency].m_Dependents.push_back(i);
+		}
+
+		// Dependencies always point backwards, so declaration order is a topological order
+		m_Roots.clear();
+		for (std::size_t i{}; i < m_Nodes.size(); ++i)
+			if (m_Nodes[i].m_Dependencies.empty())
+				m_Roots.push_back(i);
+
+		m_Pending = std::make_unique<std::atomic<std::int32_t>[]>(m_Nodes.size());
+		m_Timings.assign(m_Nodes.size(), Timing{});
+		m_PathTime.assign(m_Nodes.size(), 0.0);
+		m_PathPrev.assign(m_Nodes.size(), 0);
+		m_CriticalPath.clear();
+		m_CriticalPath.reserve(m_Nodes.size());
+		m_Compiled = true;
+	}
+
+	void TaskGraph::RunNode(JobSystem& jobs, JobSystem::Job* root, std::size_t index) noexcept
+	{
+		Node& node = m_Nodes[index];
+		Timing& timing = m_Timings[index];
+
+		const auto start = clock::now();
+		if (node.m_Function)
+		{
+			SISSKEY_ZONE(node.m_Name.c_str());
+			node.m_Function();
+		}
+		const auto end = clock::now();
+
+		timing.start = std::chrono::duration<double>(start - m_ExecuteStart).count();
+		timing.duration = std::chrono::duration<double>(end - start).count();
+		timing.thread = JobSystem::ThreadIndex();
+
+		for (std::size_t dependent : node.m_Dependents)
+		{
+			if (m_Pending[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				jobs.Run(jobs.CreateChildJob(root, [this, &jobs, root, dependent]()
+				{
+					RunNode(jobs, root, dependent);
+				}));
+			}
+		}
+	}
+
+	void TaskGraph::Execute(JobSystem& jobs)
+	{
+		if (!m_Compiled)
+			Compile();
+
+		for (std::size_t i{}; i < m_Nodes.size(); ++i)
+			m_Pending[i].store(static_cast<std::int32_t>(m_Nodes[i].m_Dependencies.size()), std::memory_order_relaxed);
+
+		m_ExecuteStart = clock::now();
+
+		JobSystem::Job* root = jobs.CreateJob([]() {});
+		for (std::size_t index : m_Roots)
+		{
+			jobs.Run(jobs.CreateChildJob(root, [this, &jobs, root, index]()
+			{
+				RunNode(jobs, root, index);
+			}));
+		}
+		jobs.Run(root);
+		jobs.Wait(root);
+
+		m_ExecuteTime = std::chrono::duration<double>(clock::now() - m_ExecuteStart).count();
+		UpdateCriticalPath();
+	}
+
+	void TaskGraph::UpdateCriticalPath() noexcept
+	{
+		m_CriticalPath.clear();
+		m_CriticalPathTime = 0.0;
+		if (m_Nodes.empty())
+			return;
+
+		// Longest path in a DAG visiting nodes in topological order
+		std::size_t last{ 0 };
+		for (std::size_t i{}; i < m_Nodes.size(); ++i)
+		{
+			double longest{ 0.0 };
+			m_PathPrev[i] = i;
+			for (std::size_t dependency : m_Nodes[i].m_Dependencies)
+			{
+				if (m_PathTime[dependency] > longest)
+				{
+					longest = m_PathTime[dependency];
+					m_PathPrev[i] = dependency;
+				}
+			}
+			m_PathTime[i] = longest + m_Timings[i].duration;
+
+			if (m_PathTime[i] > m_PathTime[last])
+				last = i;
+		}
+
+		m_CriticalPathTime = m_PathTime[last];
+		for (std::size_t i{ last };; i = m_PathPrev[i])
+		{
+			m_CriticalPath.push_back(i);
+			if (m_PathPrev[i] == i)
+				break;
+		}
+		std::reverse(m_CriticalPath.begin(), m_CriticalPath.end());
+	}
+}
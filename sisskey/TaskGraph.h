@@ -0,0 +1,103 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Graph of per-frame systems ordered by the resources they read and write.
+	// Dependencies follow declaration order: a system runs after the last
+	// preceding writer of everything it reads, and after all preceding readers
+	// and the last writer of everything it writes.
+	// The graph is built once, executing it every frame doesn't allocate.
+	class TaskGraph
+	{
+	public:
+		class Node
+		{
+			friend TaskGraph;
+		private:
+			std::string m_Name;
+			std::function<void()> m_Function;
+			std::vector<std::string> m_Reads;
+			std::vector<std::string> m_Writes;
+
+			std::vector<std::size_t> m_Dependencies;
+			std::vector<std::size_t> m_Dependents;
+
+		public:
+			Node(std::string name, std::function<void()> function) : m_Name{ std::move(name) }, m_Function{ std::move(function) } {}
+
+			Node& Reads(std::string_view resource);
+			Node& Writes(std::string_view resource);
+
+			[[nodiscard]] const std::string& GetName() const noexcept { return m_Name; }
+			[[nodiscard]] const std::vector<std::size_t>& GetDependencies() const noexcept { return m_Dependencies; }
+		};
+
+		// Seconds since the beginning of the last Execute
+		struct Timing
+		{
+			double start{ 0.0 };
+			double duration{ 0.0 };
+			std::size_t thread{ 0 };
+		};
+
+	private:
+		using clock = std::chrono::steady_clock;
+
+		std::deque<Node> m_Nodes;
+		std::vector<std::size_t> m_Roots;
+		std::unique_ptr<std::atomic<std::int32_t>[]> m_Pending;
+		bool m_Compiled{ false };
+
+		clock::time_point m_ExecuteStart;
+		double m_ExecuteTime{ 0.0 };
+		std::vector<Timing> m_Timings;
+		std::vector<double> m_PathTime;
+		std::vector<std::size_t> m_PathPrev;
+		std::vector<std::size_t> m_CriticalPath;
+		double m_CriticalPathTime{ 0.0 };
+
+		void RunNode(JobSystem& jobs, JobSystem::Job* root, std::size_t index) noexcept;
+		void UpdateCriticalPath() noexcept;
+
+	public:
+		TaskGraph() = default;
+		TaskGraph(TaskGraph&&) = default;
+		TaskGraph& operator=(TaskGraph&&) = default;
+		TaskGraph(const TaskGraph&) = delete;
+		TaskGraph& operator=(const TaskGraph&) = delete;
+
+		// The reference is valid until the graph is destroyed or cleared
+		Node& AddSystem(std::string name, std::function<void()> function);
+		void Clear() noexcept;
+
+		// Builds dependencies, called by Execute if the graph has changed
+		void Compile();
+		void Execute(JobSystem& jobs);
+
+		[[nodiscard]] bool Empty() const noexcept { return m_Nodes.empty(); }
+		[[nodiscard]] std::size_t NodeCount() const noexcept { return m_Nodes.size(); }
+		[[nodiscard]] const Node& GetNode(std::size_t index) const noexcept { return m_Nodes[index]; }
+		[[nodiscard]] const Timing& GetTiming(std::size_t index) const noexcept { return m_Timings[index]; }
+
+		// Wall time of the last Execute
+		[[nodiscard]] double ExecuteTime() const noexcept { return m_ExecuteTime; }
+		// Sum of node durations along the longest dependency chain of the last Execute,
+		// the lower bound of ExecuteTime no matter how many threads are available
+		[[nodiscard]] double CriticalPathTime() const noexcept { return m_CriticalPathTime; }
+		// Node indices of the longest chain, from the first to the last one
+		[[nodiscard]] const std::vector<std::size_t>& CriticalPath() const noexcept { return m_CriticalPath; }
+	};
+}
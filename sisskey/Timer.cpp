@@ -1,28 +1,77 @@
 #include "Timer.h"
 
+#include <thread>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifndef _MSC_VER
+#include <cpuid.h>
+#endif
+#endif
+
 namespace sisskey
 {
+	bool Clock::EnableTSC(std::chrono::milliseconds calibration)
+	{
+#if defined(_M_X64) || defined(__x86_64__)
+		// CPUID.80000007H:EDX[8] - invariant TSC, constant rate in all ACPI P-, C- and T-states
+		unsigned int regs[4]{};
+#ifdef _MSC_VER
+		__cpuid(reinterpret_cast<int*>(regs), 0x80000000);
+		if (regs[0] < 0x80000007)
+			return false;
+		__cpuid(reinterpret_cast<int*>(regs), 0x80000007);
+#else
+		if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+			return false;
+		__get_cpuid(0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+		if (!(regs[3] & (1u << 8)))
+			return false;
+
+		const std::int64_t time0{ SteadyNow() };
+		const std::int64_t ticks0{ static_cast<std::int64_t>(__rdtsc()) };
+		std::this_thread::sleep_for(calibration);
+		const std::int64_t ticks1{ static_cast<std::int64_t>(__rdtsc()) };
+		const std::int64_t time1{ SteadyNow() };
+		if (ticks1 <= ticks0 || time1 <= time0)
+			return false;
+
+		// Continue from the current time, so timestamps taken before stay comparable
+		s_TSC.nanosecondsPerTick = static_cast<double>(time1 - time0) / static_cast<double>(ticks1 - ticks0);
+		s_TSC.baseTicks = ticks1;
+		s_TSC.baseTime = time1;
+		s_TSC.enabled = true;
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void Clock::DisableTSC() noexcept
+	{
+		s_TSC.enabled = false;
+	}
+
 	float Timer::Tick(void)
 	{
 		if (m_Stopped)
+		{
+			m_DeltaTime = 0;
 			return 0.0f;
+		}
 
-		m_CurrTime = std::chrono::high_resolution_clock::now();
-
-		float DeltaTime = std::chrono::duration<float>(m_CurrTime - m_PrevTime).count();
-
+		m_CurrTime = Clock::Now();
+		m_DeltaTime = m_CurrTime - m_PrevTime;
 		m_PrevTime = m_CurrTime;
 
-		// Force clamp the value??
-		// return std::clamp(DeltaTime, 0.0f, 0.0003f);
-		return DeltaTime;
+		return static_cast<float>(Clock::ToSeconds(m_DeltaTime));
 	}
 
 	void Timer::Stop()
 	{
 		if (!m_Stopped)
 		{
-			m_StopTime = std::chrono::high_resolution_clock::now();
+			m_StopTime = Clock::Now();
 			m_Stopped = true;
 		}
 	}
@@ -31,9 +80,9 @@ namespace sisskey
 	{
 		if (m_Stopped)
 		{
-			m_CurrTime = m_PrevTime = std::chrono::high_resolution_clock::now();
+			m_CurrTime = m_PrevTime = Clock::Now();
 
-			m_PausedTime += std::chrono::duration<float>(m_CurrTime - m_StopTime).count();
+			m_PausedTime += m_CurrTime - m_StopTime;
 
 			m_Stopped = false;
 		}
@@ -41,16 +90,17 @@ namespace sisskey
 
 	void Timer::Reset()
 	{
-		m_BaseTime = m_CurrTime = m_PrevTime = std::chrono::high_resolution_clock::now();
-		m_PausedTime = 0.0f;
+		m_BaseTime = m_CurrTime = m_PrevTime = Clock::Now();
+		m_PausedTime = 0;
+		m_DeltaTime = 0;
 		m_Stopped = false;
 	}
 
-	float Timer::TotalTime()
+	std::int64_t Timer::TotalTicks() const noexcept
 	{
 		if (m_Stopped)
-			return std::chrono::duration<float>(m_StopTime - m_BaseTime).count() - m_PausedTime;
+			return m_StopTime - m_BaseTime - m_PausedTime;
 		else
-			return std::chrono::duration<float>(m_CurrTime - m_BaseTime).count() - m_PausedTime;
+			return m_CurrTime - m_BaseTime - m_PausedTime;
 	}
-}
\ No newline at end of file
+}
@@ -1,19 +1,70 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
 
 namespace sisskey
 {
+	// Monotonic clock in 64-bit integer nanoseconds, precise for centuries of uptime.
+	// Reads the steady clock, or the time stamp counter once EnableTSC succeeds.
+	class Clock
+	{
+	private:
+		struct TSC
+		{
+			bool enabled;
+			std::int64_t baseTicks;
+			std::int64_t baseTime;
+			double nanosecondsPerTick;
+		};
+		inline static TSC s_TSC{};
+
+		[[nodiscard]] static std::int64_t SteadyNow() noexcept
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+	public:
+		static constexpr std::int64_t Frequency{ 1'000'000'000 };
+
+		[[nodiscard]] static std::int64_t Now() noexcept
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			if (s_TSC.enabled)
+				return s_TSC.baseTime + static_cast<std::int64_t>(static_cast<double>(static_cast<std::int64_t>(__rdtsc()) - s_TSC.baseTicks) * s_TSC.nanosecondsPerTick);
+#endif
+			return SteadyNow();
+		}
+
+		// Switches to the time stamp counter if the CPU has an invariant one,
+		// measuring its frequency against the steady clock for the given duration.
+		// Not thread safe, call once at startup before other threads read the clock.
+		static bool EnableTSC(std::chrono::milliseconds calibration = std::chrono::milliseconds(20));
+		static void DisableTSC() noexcept;
+		[[nodiscard]] static bool TSCEnabled() noexcept { return s_TSC.enabled; }
+
+		[[nodiscard]] static constexpr double ToSeconds(std::int64_t ticks) noexcept { return static_cast<double>(ticks) / Frequency; }
+		[[nodiscard]] static constexpr std::int64_t FromSeconds(double seconds) noexcept { return static_cast<std::int64_t>(seconds * Frequency); }
+	};
+
 	class Timer
 	{
 	private:
-		using tp = std::chrono::time_point<std::chrono::high_resolution_clock>;
-		tp m_BaseTime;
-		tp m_CurrTime;
-		tp m_PrevTime;
-		tp m_StopTime;
+		std::int64_t m_BaseTime;
+		std::int64_t m_CurrTime;
+		std::int64_t m_PrevTime;
+		std::int64_t m_StopTime;
+		std::int64_t m_PausedTime{ 0 };
+		std::int64_t m_DeltaTime{ 0 };
 
-		float m_PausedTime{ 0.0f };
 		bool m_Stopped{ false };
 
 	public:
@@ -23,8 +74,13 @@ namespace sisskey
 		void Stop();
 		void Start();
 		void Reset();
+		// Seconds since the previous Tick, 0 while stopped
 		float Tick();
 
-		float TotalTime();
+		// Clock ticks
+		[[nodiscard]] std::int64_t DeltaTicks() const noexcept { return m_DeltaTime; }
+		[[nodiscard]] std::int64_t TotalTicks() const noexcept;
+
+		[[nodiscard]] double TotalTime() const noexcept { return Clock::ToSeconds(TotalTicks()); }
 	};
-}
\ No newline at end of file
+}
@@ -1,4 +1,6 @@
 #include "Window.h"
+#include "WindowHeadless.h"
+#include "CVar.h"
 
 #ifdef _WIN64
 #include "WindowWinAPI.h"
@@ -6,13 +8,56 @@
 #include "WindowXCB.h"
 #endif
 
-#include <tuple>
+#include <algorithm>
 #include <cassert>
 
 namespace sisskey
 {
+	namespace
+	{
+		CVar<bool> cv_Headless{ SISSKEY_CVAR(u8"window.headless"), false, u8"Run without a display, applied when the window is created" };
+	}
+
+	Window::Window()
+	{
+		m_InputEvents.reserve(256);
+		m_RawMouseMotion.reserve(RawMouseHistory);
+	}
+
+	void Window::ClearInput() noexcept
+	{
+		m_InputEvents.clear();
+		m_RawMouseDelta = {};
+		m_RawMouseMotion.clear();
+		m_RawMouseOldest = 0;
+	}
+
+	void Window::AddRawMouseMotion(const RawMouseMotion& motion) noexcept
+	{
+		m_RawMouseDelta.time = motion.time;
+		m_RawMouseDelta.x += motion.x;
+		m_RawMouseDelta.y += motion.y;
+
+		// Overwrite the oldest one when full, FinishInput restores the order
+		if (m_RawMouseMotion.size() < RawMouseHistory)
+			m_RawMouseMotion.push_back(motion);
+		else
+		{
+			m_RawMouseMotion[m_RawMouseOldest] = motion;
+			m_RawMouseOldest = (m_RawMouseOldest + 1) % RawMouseHistory;
+		}
+	}
+
+	void Window::FinishInput() noexcept
+	{
+		std::rotate(m_RawMouseMotion.begin(), m_RawMouseMotion.begin() + static_cast<std::ptrdiff_t>(m_RawMouseOldest), m_RawMouseMotion.end());
+		m_RawMouseOldest = 0;
+	}
+
 	[[nodiscard]] std::unique_ptr<Window> Window::Create(std::string_view title, std::pair<int, int> size, std::pair<int, int> position, bool fullscreen, bool cursor)
 	{
+		if (cv_Headless.Get())
+			return std::make_unique<WindowHeadless>(title);
 #ifdef _WIN64
 		return std::make_unique<WindowWinAPI>(title, size, position, fullscreen, cursor);
 #elif defined(__linux__)
@@ -20,15 +65,19 @@ namespace sisskey
 #endif
 	}
 
-	[[nodiscard]] std::shared_ptr<void> Window::GetNativeHandle(Window* window)
+	[[nodiscard]] Window::NativeHandle Window::GetNativeHandle(Window* window) noexcept
 	{
 		assert(window);
 #ifdef _WIN64
-		WindowWinAPI* w = static_cast<WindowWinAPI*>(window);
-		return std::make_shared<std::tuple<HWND, HINSTANCE>>(w->m_hWnd, w->m_hInstance);
+		WindowWinAPI* w = dynamic_cast<WindowWinAPI*>(window);
+		if (!w)
+			return { nullptr, 0 };
+		return { w->m_hInstance, reinterpret_cast<std::uintptr_t>(w->m_hWnd) };
 #elif defined(__linux__)
-		WindowXCB* w = static_cast<WindowXCB*>(window);
-		return std::make_shared<std::tuple<xcb_connection_t*, xcb_window_t>>(w->m_pConnection, w->m_Window);
+		WindowXCB* w = dynamic_cast<WindowXCB*>(window);
+		if (!w)
+			return { nullptr, 0 };
+		return { w->m_pConnection, w->m_Window };
 #endif
 	}
 }
\ No newline at end of file
@@ -1,16 +1,35 @@
 #pragma once
 
+#include "Input.h"
+
 #include <utility>
 #include <string>
 #include <string_view>
+#include <vector>
 #include <memory>
+#include <cstdint>
 
 namespace sisskey
 {
 	class Window
 	{
+	public:
+		// Raw mouse motion events kept per frame, older ones are dropped
+		static constexpr std::size_t RawMouseHistory{ 1024 };
+
 	protected:
-		Window() = default;
+		Window();
+
+		std::vector<InputEvent> m_InputEvents;
+		RawMouseMotion m_RawMouseDelta{};
+		std::vector<RawMouseMotion> m_RawMouseMotion;
+		std::size_t m_RawMouseOldest{ 0 };
+
+		// Called by ProcessMessages of the implementations, never allocate
+		void ClearInput() noexcept;
+		void AddRawMouseMotion(const RawMouseMotion& motion) noexcept;
+		void FinishInput() noexcept;
+
 	public:
 		enum class PMResult
 		{
@@ -20,6 +39,24 @@ namespace sisskey
 			Resume
 		};
 
+		// Pixels of a CPU rendered frame, 0xXXRRGGBB
+		struct Framebuffer
+		{
+			std::uint32_t* pixels;
+			int width;
+			int height;
+			// Pixels per row, a multiple of 8
+			int stride;
+		};
+
+		// For graphics API surfaces: HINSTANCE and HWND on Windows, xcb_connection_t* and xcb_window_t on Linux.
+		// Null for headless windows.
+		struct NativeHandle
+		{
+			void* display;
+			std::uintptr_t window;
+		};
+
 		virtual ~Window() = default;
 		Window(const Window&) = delete;
 		Window& operator=(const Window&) = delete;
@@ -27,16 +64,35 @@ namespace sisskey
 		// TODO: constness??
 
 		[[nodiscard]] virtual PMResult ProcessMessages() noexcept = 0;
+		// Blocks until messages are available, Wake is called or the timeout in Clock ticks expires, negative - no timeout.
+		// Returns false on timeout. Messages are left for ProcessMessages.
+		virtual bool WaitMessages(std::int64_t timeout = -1) noexcept = 0;
+		// Ends WaitMessages early, can be called from any thread
+		virtual void Wake() noexcept = 0;
+		// Keyboard and mouse events received before the latest ProcessMessages call, oldest first
+		[[nodiscard]] const std::vector<InputEvent>& GetInputEvents() const noexcept { return m_InputEvents; }
+		// Sum of the raw mouse motion received before the latest ProcessMessages call, time of the latest event.
+		// Only reported while the window has focus.
+		[[nodiscard]] RawMouseMotion GetRawMouseDelta() const noexcept { return m_RawMouseDelta; }
+		// Individual raw mouse motion events summed in GetRawMouseDelta, oldest first, at most RawMouseHistory of the latest
+		[[nodiscard]] const std::vector<RawMouseMotion>& GetRawMouseMotion() const noexcept { return m_RawMouseMotion; }
+		// Events lost because they were received faster than ProcessMessages consumed them
+		[[nodiscard]] virtual std::uint64_t DroppedInputEvents() const noexcept { return 0; }
 		virtual void SetTitle(std::string_view title) = 0;
 		[[nodiscard]] virtual std::string GetTitle() const = 0;
 		virtual void UseSystemCursor(bool use) noexcept = 0;
 		virtual void ChangeResolution(std::pair<int, int> size, bool fullscreen) = 0;
+		// Returns the buffer to render the next frame into, blocks while the system still reads it.
+		// Contents are undefined, the pixels stay valid until the next call.
+		[[nodiscard]] virtual Framebuffer AcquireFramebuffer(std::pair<int, int> size) = 0;
+		// Shows the acquired framebuffer in the window
+		virtual void PresentFramebuffer() = 0;
 
 		[[nodiscard]] static std::unique_ptr<Window> Create(std::string_view title = u8"sisskey",
 															std::pair<int, int> size = { 1280, 720 },
 															std::pair<int, int> position = { -1,-1 },
 															bool fullscreen = false,
 															bool cursor = true);
-		[[nodiscard]] static std::shared_ptr<void> GetNativeHandle(Window* window);
+		[[nodiscard]] static NativeHandle GetNativeHandle(Window* window) noexcept;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "WindowHeadless.h"
+#include "Timer.h"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace sisskey
+{
+	WindowHeadless::WindowHeadless(std::string_view title)
+	{
+		m_Title = title;
+	}
+
+	Window::PMResult WindowHeadless::ProcessMessages() noexcept
+	{
+		ClearInput();
+		FinishInput();
+		return PMResult::Nothing;
+	}
+
+	bool WindowHeadless::WaitMessages(std::int64_t timeout) noexcept
+	{
+		std::unique_lock<std::mutex> lock{ m_WakeMutex };
+		if (timeout < 0)
+			m_WakeCondition.wait(lock, [this] { return m_Woken; });
+		else m_WakeCondition.wait_for(lock, std::chrono::nanoseconds{ timeout * (1'000'000'000 / Clock::Frequency) }, [this] { return m_Woken; });
+
+		const bool woken{ m_Woken };
+		m_Woken = false;
+		return woken;
+	}
+
+	void WindowHeadless::Wake() noexcept
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_WakeMutex };
+			m_Woken = true;
+		}
+		m_WakeCondition.notify_one();
+	}
+
+	void WindowHeadless::SetTitle(std::string_view title)
+	{
+		m_Title = title;
+	}
+
+	std::string WindowHeadless::GetTitle() const
+	{
+		return m_Title;
+	}
+
+	void WindowHeadless::UseSystemCursor(bool /*use*/) noexcept
+	{
+	}
+
+	void WindowHeadless::ChangeResolution(std::pair<int, int> /*size*/, bool /*fullscreen*/)
+	{
+	}
+
+	Window::Framebuffer WindowHeadless::AcquireFramebuffer(std::pair<int, int> size)
+	{
+		auto [width, height] = size;
+		if (width <= 0 || height <= 0)
+			throw std::runtime_error{ u8"Invalid framebuffer size" };
+
+		if (width != m_Framebuffer.width || height != m_Framebuffer.height)
+		{
+			const int stride{ (width + 7) & ~7 };
+			m_FramebufferPixels.assign(static_cast<std::size_t>(stride) * height, 0);
+			m_Framebuffer = { m_FramebufferPixels.data(), width, height, stride };
+		}
+
+		return m_Framebuffer;
+	}
+
+	void WindowHeadless::PresentFramebuffer()
+	{
+	}
+}
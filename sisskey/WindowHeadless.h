@@ -0,0 +1,39 @@
+#pragma once
+#include "Window.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace sisskey
+{
+	// Window without a display for servers and benchmark runs, see the window.headless console variable.
+	// It never receives input or state changes, framebuffers are kept in memory.
+	class WindowHeadless final : public Window
+	{
+	private:
+		std::string m_Title;
+
+		std::mutex m_WakeMutex;
+		std::condition_variable m_WakeCondition;
+		bool m_Woken{ false };
+
+		std::vector<std::uint32_t> m_FramebufferPixels;
+		Framebuffer m_Framebuffer{};
+
+	public:
+		WindowHeadless(std::string_view title);
+
+		[[nodiscard]] PMResult ProcessMessages() noexcept override;
+		bool WaitMessages(std::int64_t timeout = -1) noexcept override;
+		void Wake() noexcept override;
+		void SetTitle(std::string_view title) override;
+		[[nodiscard]] std::string GetTitle() const override;
+		void UseSystemCursor(bool use) noexcept override;
+		void ChangeResolution(std::pair<int, int> size, bool fullscreen) override;
+		[[nodiscard]] Framebuffer AcquireFramebuffer(std::pair<int, int> size) override;
+		void PresentFramebuffer() override;
+	};
+}
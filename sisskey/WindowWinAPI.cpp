@@ -1,10 +1,19 @@
 #include "WindowWinAPI.h"
+#include "Timer.h"
+#include "CVar.h"
 
 #include <stdexcept>
 #include <array>
 
+#include <windowsx.h>
+
 namespace sisskey
 {
+	namespace
+	{
+		CVar<bool> cv_RawMouse{ SISSKEY_CVAR(u8"input.rawMouse"), true, u8"Receive unaccelerated mouse motion through Raw Input, applied when the window is created" };
+	}
+
 	LRESULT WindowWinAPI::m_StaticWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) noexcept
 	{
 		if (message == WM_CREATE)
@@ -32,27 +41,79 @@ namespace sisskey
 		case WM_CLOSE: PostQuitMessage(0); return 0;
 
 		case WM_ACTIVATEAPP: (LOWORD(wParam) == WA_INACTIVE) ? m_PMR = Window::PMResult::Pause : m_PMR = Window::PMResult::Resume; return 0;
+		// Restoring activates the window again
+		case WM_SIZE: if (wParam == SIZE_MINIMIZED) m_PMR = Window::PMResult::Pause; break;
+
+		case WM_KEYDOWN: case WM_SYSKEYDOWN: AddInputEvent(InputEventType::KeyDown, static_cast<std::uint32_t>(wParam), 0, 0); break;
+		case WM_KEYUP: case WM_SYSKEYUP: AddInputEvent(InputEventType::KeyUp, static_cast<std::uint32_t>(wParam), 0, 0); break;
+
+		case WM_MOUSEMOVE: AddInputEvent(InputEventType::MouseMove, 0, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return 0;
+		case WM_LBUTTONDOWN: AddInputEvent(InputEventType::ButtonDown, MouseButtonLeft, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return 0;
+		case WM_LBUTTONUP: AddInputEvent(InputEventType::ButtonUp, MouseButtonLeft, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return 0;
+		case WM_MBUTTONDOWN: AddInputEvent(InputEventType::ButtonDown, MouseButtonMiddle, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return 0;
+		case WM_MBUTTONUP: AddInputEvent(InputEventType::ButtonUp, MouseButtonMiddle, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return 0;
+		case WM_RBUTTONDOWN: AddInputEvent(InputEventType::ButtonDown, MouseButtonRight, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return 0;
+		case WM_RBUTTONUP: AddInputEvent(InputEventType::ButtonUp, MouseButtonRight, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return 0;
+		case WM_XBUTTONDOWN: AddInputEvent(InputEventType::ButtonDown, GET_XBUTTON_WPARAM(wParam) == XBUTTON1 ? MouseButtonX1 : MouseButtonX2, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return TRUE;
+		case WM_XBUTTONUP: AddInputEvent(InputEventType::ButtonUp, GET_XBUTTON_WPARAM(wParam) == XBUTTON1 ? MouseButtonX1 : MouseButtonX2, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)); return TRUE;
+		case WM_MOUSEWHEEL: AddInputEvent(InputEventType::MouseWheel, 0, 0, GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA); return 0;
+		case WM_MOUSEHWHEEL: AddInputEvent(InputEventType::MouseWheel, 0, GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA, 0); return 0;
+		case WM_INPUT:
+		{
+			// Only delivered while the window is in the foreground
+			RAWINPUT raw;
+			UINT size{ sizeof(raw) };
+			if (GetRawInputData(reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &raw, &size, sizeof(RAWINPUTHEADER)) != static_cast<UINT>(-1) &&
+				raw.header.dwType == RIM_TYPEMOUSE && !(raw.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE))
+				AddRawMouseMotion({ Clock::Now(), static_cast<float>(raw.data.mouse.lLastX), static_cast<float>(raw.data.mouse.lLastY) });
+		} break;
 
 		default: return DefWindowProcW(hWnd, message, wParam, lParam);
 		}
+
+		// Let the system handle shortcuts like Alt+F4
+		return DefWindowProcW(hWnd, message, wParam, lParam);
+	}
+
+	void WindowWinAPI::AddInputEvent(InputEventType type, std::uint32_t code, std::int32_t x, std::int32_t y) noexcept
+	{
+		// Messages are only dispatched from ProcessMessages, so events are timestamped once per frame
+		m_InputEvents.push_back({ Clock::Now(), type, code, x, y });
 	}
 
 	Window::PMResult WindowWinAPI::ProcessMessages() noexcept
 	{
 		m_PMR = Window::PMResult::Nothing;
+		ClearInput();
 		MSG msg{};
 		while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE))
 		{
 			if (msg.message == WM_QUIT)
+			{
+				FinishInput();
 				return Window::PMResult::Quit;
+			}
 
 			TranslateMessage(&msg);
 			DispatchMessageW(&msg);
 		}
 
+		FinishInput();
 		return m_PMR;
 	}
 
+	bool WindowWinAPI::WaitMessages(std::int64_t timeout) noexcept
+	{
+		// MWMO_INPUTAVAILABLE also returns for messages that were already seen by PeekMessage but not removed
+		const DWORD milliseconds{ timeout < 0 ? INFINITE : static_cast<DWORD>((timeout * 1000 + Clock::Frequency - 1) / Clock::Frequency) };
+		return MsgWaitForMultipleObjectsEx(1, &m_WakeEvent, milliseconds, QS_ALLINPUT, MWMO_INPUTAVAILABLE) != WAIT_TIMEOUT;
+	}
+
+	void WindowWinAPI::Wake() noexcept
+	{
+		SetEvent(m_WakeEvent);
+	}
+
 	WindowWinAPI::WindowWinAPI(std::string_view title, std::pair<int, int> size, std::pair<int, int> position, bool fullscreen, bool cursor)
 	{
 		// Unpack parameters
@@ -79,6 +140,10 @@ namespace sisskey
 		if (!RegisterClassExW(&wc))
 			throw std::runtime_error{ u8"Failed to register window class" };
 
+		m_WakeEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+		if (!m_WakeEvent)
+			throw std::runtime_error{ u8"Failed to create event" };
+
 		if (fullscreen)
 		{
 			DEVMODEW dmScreenSettings;
@@ -110,6 +175,13 @@ namespace sisskey
 		if (!m_hWnd)
 			throw std::runtime_error{ u8"Failed to create window" };
 
+		if (cv_RawMouse.Get())
+		{
+			// https://docs.microsoft.com/en-us/windows/win32/dxtecharticles/taking-advantage-of-high-dpi-mouse-movement
+			RAWINPUTDEVICE device{ 0x01 /* generic desktop */, 0x02 /* mouse */, 0, m_hWnd };
+			RegisterRawInputDevices(&device, 1, sizeof(device));
+		}
+
 		ShowWindow(m_hWnd, SW_SHOW);
 		SetForegroundWindow(m_hWnd);
 		SetFocus(m_hWnd);
@@ -123,6 +195,7 @@ namespace sisskey
 		ChangeDisplaySettingsW(nullptr, 0); // Restore display mode if changed
 		DestroyWindow(m_hWnd);
 		UnregisterClassW(m_WndClassName.c_str(), m_hInstance);
+		CloseHandle(m_WakeEvent);
 	}
 
 	void WindowWinAPI::SetTitle(std::string_view title)
@@ -210,4 +283,40 @@ namespace sisskey
 			SendMessageW(m_hWnd, WM_SETICON, ICON_SMALL, (LPARAM)IDI_APPLICATION);
 		}
 	}
-}
\ No newline at end of file
+
+	Window::Framebuffer WindowWinAPI::AcquireFramebuffer(std::pair<int, int> size)
+	{
+		auto [width, height] = size;
+		if (width <= 0 || height <= 0)
+			throw std::runtime_error{ u8"Invalid framebuffer size" };
+
+		if (width != m_Framebuffer.width || height != m_Framebuffer.height)
+		{
+			const int stride{ (width + 7) & ~7 };
+			m_FramebufferPixels.assign(static_cast<std::size_t>(stride) * height, 0);
+			m_Framebuffer = { m_FramebufferPixels.data(), width, height, stride };
+		}
+
+		m_Acquired = true;
+		return m_Framebuffer;
+	}
+
+	void WindowWinAPI::PresentFramebuffer()
+	{
+		if (!m_Acquired)
+			return;
+		m_Acquired = false;
+
+		BITMAPINFO info{};
+		info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+		info.bmiHeader.biWidth = m_Framebuffer.stride;
+		info.bmiHeader.biHeight = -m_Framebuffer.height; // top-down
+		info.bmiHeader.biPlanes = 1;
+		info.bmiHeader.biBitCount = 32;
+		info.bmiHeader.biCompression = BI_RGB;
+
+		HDC dc = GetDC(m_hWnd);
+		SetDIBitsToDevice(dc, 0, 0, m_Framebuffer.width, m_Framebuffer.height, 0, 0, 0, m_Framebuffer.height, m_Framebuffer.pixels, &info, DIB_RGB_COLORS);
+		ReleaseDC(m_hWnd, dc);
+	}
+}
@@ -15,9 +15,16 @@ namespace sisskey
 		HWND m_hWnd{ nullptr };
 		HINSTANCE m_hInstance{ nullptr };
 		PMResult m_PMR{ PMResult::Nothing };
+		// Signaled by Wake
+		HANDLE m_WakeEvent{ nullptr };
+		// Copied to the window by SetDIBitsToDevice, one buffer is enough
+		std::vector<std::uint32_t> m_FramebufferPixels;
+		Framebuffer m_Framebuffer{};
+		bool m_Acquired{ false };
 
 		static LRESULT CALLBACK m_StaticWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) noexcept;
 		LRESULT WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) noexcept;
+		void AddInputEvent(InputEventType type, std::uint32_t code, std::int32_t x, std::int32_t y) noexcept;
 
 	public:
 		WindowWinAPI(std::string_view title, std::pair<int, int> size, std::pair<int, int> position, bool fullscreen, bool cursor);
@@ -26,9 +33,13 @@ namespace sisskey
 		// TODO: constness??
 
 		[[nodiscard]] PMResult ProcessMessages() noexcept override;
+		bool WaitMessages(std::int64_t timeout = -1) noexcept override;
+		void Wake() noexcept override;
 		void SetTitle(std::string_view title) override;
 		[[nodiscard]] std::string GetTitle() const override;
 		void UseSystemCursor(bool use) noexcept override;
 		void ChangeResolution(std::pair<int, int> size, bool fullscreen) override;
+		[[nodiscard]] Framebuffer AcquireFramebuffer(std::pair<int, int> size) override;
+		void PresentFramebuffer() override;
 	};
 }
@@ -1,75 +1,294 @@
 #include "WindowXCB.h"
+#include "Timer.h"
+#include "Profiler.h"
+#include "CVar.h"
 
 #include <stdexcept>
+#include <algorithm>
+#include <chrono>
 #include <array>
 #include <cstdint>
 #include <cstring>
+#include <utility>
 #include <xcb/xcb_image.h>
+#include <xcb/xinput.h>
+#include <xcb/shm.h>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <unistd.h>
 
 namespace sisskey
 {
-	Window::PMResult WindowXCB::ProcessMessages() noexcept
+	namespace
 	{
-		Window::PMResult res{ Window::PMResult::Nothing };
-		xcb_generic_event_t* event;
+		CVar<bool> cv_InputThread{ SISSKEY_CVAR(u8"input.thread"), false, u8"Receive window events on a dedicated thread, applied when the window is created" };
+		CVar<bool> cv_RawMouse{ SISSKEY_CVAR(u8"input.rawMouse"), true, u8"Receive unaccelerated mouse motion through XInput2, applied when the window is created" };
+		CVar<bool> cv_SharedMemory{ SISSKEY_CVAR(u8"window.sharedMemory"), true, u8"Present framebuffers through MIT-SHM if the X server supports it, applied when the window is created" };
 
-		while (event = xcb_poll_for_event(m_pConnection))
+		// Quit is never overridden, otherwise the latest state change wins
+		[[nodiscard]] Window::PMResult Merge(Window::PMResult current, Window::PMResult next) noexcept
 		{
-			// https://xcb.freedesktop.org/manual/xproto_8h_source.html
-			switch (event->response_type & ~0x80)
+			return current == Window::PMResult::Quit || next == Window::PMResult::Nothing ? current : next;
+		}
+	}
+
+	WindowXCB::EventKind WindowXCB::Decode(const xcb_generic_event_t* event, std::int64_t time, InputEvent& input, RawMouseMotion& motion, PMResult& result) noexcept
+	{
+		if (CompletePresent(event))
+			return EventKind::Other;
+
+		// https://xcb.freedesktop.org/manual/xproto_8h_source.html
+		switch (event->response_type & ~0x80)
+		{
+		case XCB_EXPOSE:
+		{
+			result = Merge(result, m_Focused && m_Mapped ? Window::PMResult::Resume : Window::PMResult::Pause);
+		} break;
+		case XCB_MOTION_NOTIFY:
+		{
+			const xcb_motion_notify_event_t* motion = reinterpret_cast<const xcb_motion_notify_event_t*>(event);
+			input = { time, InputEventType::MouseMove, 0, motion->event_x, motion->event_y };
+			return EventKind::Input;
+		}
+		case XCB_BUTTON_PRESS:
+		case XCB_BUTTON_RELEASE:
+		{
+			const xcb_button_press_event_t* button = reinterpret_cast<const xcb_button_press_event_t*>(event);
+			const bool press{ (event->response_type & ~0x80) == XCB_BUTTON_PRESS };
+			input = { time, press ? InputEventType::ButtonDown : InputEventType::ButtonUp, 0, button->event_x, button->event_y };
+			switch (button->detail)
 			{
-			case XCB_EXPOSE:
+			case 1: input.code = MouseButtonLeft; break;
+			case 2: input.code = MouseButtonMiddle; break;
+			case 3: input.code = MouseButtonRight; break;
+			case 8: input.code = MouseButtonX1; break;
+			case 9: input.code = MouseButtonX2; break;
+			// Wheel steps are reported as a press followed by a release
+			case 4: case 5: case 6: case 7:
+				if (!press)
+					return EventKind::Other;
+				input.type = InputEventType::MouseWheel;
+				input.x = button->detail == 6 ? -1 : button->detail == 7 ? 1 : 0;
+				input.y = button->detail == 4 ? 1 : button->detail == 5 ? -1 : 0;
+				break;
+			default: return EventKind::Other;
+			}
+			return EventKind::Input;
+		}
+		case XCB_KEY_PRESS:
+		case XCB_KEY_RELEASE:
+		{
+			const xcb_key_press_event_t* key = reinterpret_cast<const xcb_key_press_event_t*>(event);
+			const bool press{ (event->response_type & ~0x80) == XCB_KEY_PRESS };
+			input = { time, press ? InputEventType::KeyDown : InputEventType::KeyUp, key->detail, key->event_x, key->event_y };
+			return EventKind::Input;
+		}
+		// Paused while unfocused or minimized
+		case XCB_FOCUS_IN:
+		case XCB_FOCUS_OUT:
+		case XCB_MAP_NOTIFY:
+		case XCB_UNMAP_NOTIFY:
+		{
+			switch (event->response_type & ~0x80)
 			{
-				//xcb_expose_event_t* expose = reinterpret_cast<xcb_expose_event_t*>(event);
-				res = Window::PMResult::Resume;
-			} break;
-			case XCB_MOTION_NOTIFY:
+			case XCB_FOCUS_IN: m_Focused = true; break;
+			case XCB_FOCUS_OUT: m_Focused = false; break;
+			case XCB_MAP_NOTIFY: m_Mapped = true; break;
+			case XCB_UNMAP_NOTIFY: m_Mapped = false; break;
+			}
+			result = Merge(result, m_Focused && m_Mapped ? Window::PMResult::Resume : Window::PMResult::Pause);
+		} break;
+		case XCB_CLIENT_MESSAGE:
+		{
+			const xcb_client_message_event_t* message = reinterpret_cast<const xcb_client_message_event_t*>(event);
+			if (message->data.data32[0] == m_CloseMessage)
+				result = Merge(result, Window::PMResult::Quit);
+		} break;
+		case XCB_GE_GENERIC:
+		{
+			// Raw events are selected on the root window and arrive regardless of focus
+			const xcb_ge_generic_event_t* generic = reinterpret_cast<const xcb_ge_generic_event_t*>(event);
+			if (!m_XInputOpcode || generic->extension != m_XInputOpcode || generic->event_type != XCB_INPUT_RAW_MOTION || !m_Focused)
+				break;
+
+			// Values are packed for the axes present in the mask, the first two are x and y of relative devices
+			const xcb_input_raw_motion_event_t* raw = reinterpret_cast<const xcb_input_raw_motion_event_t*>(event);
+			const std::uint32_t* mask = xcb_input_raw_button_press_valuator_mask(raw);
+			const xcb_input_fp3232_t* value = xcb_input_raw_button_press_axisvalues_raw(raw);
+			motion = { time, 0.0f, 0.0f };
+			for (std::uint32_t axis{}; axis < 2 && axis < raw->valuators_len * 32u; ++axis)
 			{
-				//xcb_motion_notify_event_t* motion = reinterpret_cast<xcb_motion_notify_event_t*>(event);
+				if (!(mask[axis / 32] & (1u << (axis % 32))))
+					continue;
+				const float v{ static_cast<float>(value->integral + static_cast<double>(value->frac) / 4294967296.0) };
+				(axis == 0 ? motion.x : motion.y) = v;
+				++value;
+			}
+			return EventKind::RawMotion;
+		}
+		}
 
-			} break;
-			case XCB_BUTTON_PRESS:
-			{
-				//xcb_button_press_event_t* press = reinterpret_cast<xcb_button_press_event_t*>(event);
+		return EventKind::Other;
+	}
 
-			} break;
-			case XCB_BUTTON_RELEASE:
-			{
-				//xcb_button_release_event_t* release = reinterpret_cast<xcb_button_press_event_t*>(event);
+	void WindowXCB::SelectRawMotion(xcb_window_t root) noexcept
+	{
+		// https://www.x.org/releases/current/doc/inputproto/XI2proto.txt
+		const xcb_query_extension_reply_t* extension = xcb_get_extension_data(m_pConnection, &xcb_input_id);
+		if (!extension || !extension->present)
+			return;
+
+		xcb_input_xi_query_version_cookie_t cookie = xcb_input_xi_query_version(m_pConnection, 2, 0);
+		xcb_input_xi_query_version_reply_t* reply = xcb_input_xi_query_version_reply(m_pConnection, cookie, nullptr);
+		if (!reply)
+			return;
+		const bool supported{ reply->major_version >= 2 };
+		free(reply);
+		if (!supported)
+			return;
+
+		struct
+		{
+			xcb_input_event_mask_t head;
+			std::uint32_t mask;
+		} mask{};
+		mask.head.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+		mask.head.mask_len = 1;
+		mask.mask = XCB_INPUT_XI_EVENT_MASK_RAW_MOTION;
+		xcb_input_xi_select_events(m_pConnection, root, 1, &mask.head);
+		m_XInputOpcode = extension->major_opcode;
+	}
+
+	Window::PMResult WindowXCB::ProcessMessages() noexcept
+	{
+		ClearInput();
+
+		if (m_pInputQueues)
+		{
+			m_pInputQueues->events.Drain([this](const InputEvent& input) { m_InputEvents.push_back(input); });
+			m_pInputQueues->motion.Drain([this](const RawMouseMotion& motion) { AddRawMouseMotion(motion); });
+			FinishInput();
+			return m_InputThreadResult.exchange(Window::PMResult::Nothing, std::memory_order_acq_rel);
+		}
 
-			} break;
-			case XCB_KEY_PRESS:
+		// Without the input thread events are only timestamped here, once per frame
+		Window::PMResult res{ Window::PMResult::Nothing };
+		const std::int64_t time{ Clock::Now() };
+		InputEvent input;
+		RawMouseMotion motion;
+
+		// xcb allocates every event, the decoded ones are stored without allocations
+		auto decode = [&](xcb_generic_event_t* event)
+		{
+			switch (Decode(event, time, input, motion, res))
 			{
-				//xcb_key_press_event_t* press = reinterpret_cast<xcb_key_press_event_t*>(event);
+			case EventKind::Input: m_InputEvents.push_back(input); break;
+			case EventKind::RawMotion: AddRawMouseMotion(motion); break;
+			case EventKind::Other: break;
+			}
+			free(event);
+		};
+		for (xcb_generic_event_t* event : m_PendingEvents)
+			decode(event);
+		m_PendingEvents.clear();
+		while (xcb_generic_event_t* event = xcb_poll_for_event(m_pConnection))
+			decode(event);
+
+		FinishInput();
+		return res;
+	}
 
-			} break;
-			case XCB_KEY_RELEASE:
+	bool WindowXCB::WaitMessages(std::int64_t timeout) noexcept
+	{
+		pollfd fds[2]{ { m_WakeFd, POLLIN, 0 }, { xcb_get_file_descriptor(m_pConnection), POLLIN, 0 } };
+		nfds_t count{ 2 };
+
+		if (m_pInputQueues)
+		{
+			// Only the input thread reads the connection
+			m_Waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!m_pInputQueues->events.Empty() || !m_pInputQueues->motion.Empty() ||
+				m_InputThreadResult.load(std::memory_order_relaxed) != Window::PMResult::Nothing)
 			{
-				//xcb_key_release_event_t* release = reinterpret_cast<xcb_key_release_event_t*>(event);
+				m_Waiting.store(false, std::memory_order_relaxed);
+				return true;
+			}
+			count = 1;
+		}
+		else
+		{
+			// Events already read from the socket don't make it readable
+			if (m_PendingEvents.empty())
+				if (xcb_generic_event_t* event = xcb_poll_for_queued_event(m_pConnection))
+					m_PendingEvents.push_back(event);
+			if (!m_PendingEvents.empty())
+				return true;
+			xcb_flush(m_pConnection);
+		}
+
+		timespec time{ static_cast<time_t>(timeout / Clock::Frequency), static_cast<long>(timeout % Clock::Frequency * (1'000'000'000 / Clock::Frequency)) };
+		const int ready{ ppoll(fds, count, timeout < 0 ? nullptr : &time, nullptr) };
+		m_Waiting.store(false, std::memory_order_relaxed);
+
+		if (fds[0].revents & POLLIN)
+		{
+			eventfd_t value;
+			eventfd_read(m_WakeFd, &value);
+		}
 
-			} break;
-			case XCB_FOCUS_IN:
+		return ready > 0;
+	}
+
+	void WindowXCB::Wake() noexcept
+	{
+		eventfd_write(m_WakeFd, 1);
+	}
+
+	void WindowXCB::InputThreadMain() noexcept
+	{
+		SISSKEY_PROFILE_THREAD(u8"Input");
+
+		InputEvent input;
+		RawMouseMotion motion;
+		while (xcb_generic_event_t* event = xcb_wait_for_event(m_pConnection))
+		{
+			const std::int64_t time{ Clock::Now() };
+			Window::PMResult result{ Window::PMResult::Nothing };
+
+			const EventKind kind{ Decode(event, time, input, motion, result) };
+			if (kind == EventKind::Input)
 			{
-				//xcb_focus_in_event_t* focus_in = reinterpret_cast<xcb_focus_in_event_t*>(event);
-				res = Window::PMResult::Resume;
-			} break;
-			case XCB_FOCUS_OUT:
+				if (!m_pInputQueues->events.Push(input))
+					m_DroppedInputEvents.fetch_add(1, std::memory_order_relaxed);
+			}
+			else if (kind == EventKind::RawMotion)
 			{
-				//xcb_focus_out_event_t* focus_out = reinterpret_cast<xcb_focus_out_event_t*>(event);
-				res = Window::PMResult::Pause;
-			} break;
-			case XCB_CLIENT_MESSAGE:
+				if (!m_pInputQueues->motion.Push(motion))
+					m_DroppedInputEvents.fetch_add(1, std::memory_order_relaxed);
+			}
+			else if (result != Window::PMResult::Nothing)
 			{
-				xcb_client_message_event_t* message = reinterpret_cast<xcb_client_message_event_t*>(event);
-				if (message->data.data32[0] == m_CloseMessage)
-					res = Window::PMResult::Quit;
-			} break;
+				Window::PMResult current{ m_InputThreadResult.load(std::memory_order_relaxed) };
+				while (!m_InputThreadResult.compare_exchange_weak(current, Merge(current, result), std::memory_order_acq_rel, std::memory_order_relaxed));
 			}
-
 			free(event);
+
+			// Pairs with the fence in WaitMessages, either it sees the event or the thread sees the flag
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_Waiting.load(std::memory_order_relaxed))
+				Wake();
+
+			// The destructor wakes the thread with a client message after clearing the flag
+			if (!m_InputThreadRunning.load(std::memory_order_acquire))
+				return;
 		}
 
-		return res;
+		// The connection is broken
+		m_InputThreadResult.store(Window::PMResult::Quit, std::memory_order_release);
 	}
 
 	WindowXCB::WindowXCB(std::string_view title, std::pair<int, int> size, std::pair<int, int> position, bool fullscreen, bool cursor)
@@ -86,6 +305,10 @@ namespace sisskey
 		if (xcb_connection_has_error(m_pConnection))
 			throw std::runtime_error{ u8"Failed to connect to X Server" };
 
+		m_WakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (m_WakeFd == -1)
+			throw std::runtime_error{ u8"Failed to create eventfd" };
+
 		xcb_screen_t* pScreen = xcb_setup_roots_iterator(xcb_get_setup(m_pConnection)).data;
 
 		// https://github.com/Medium/phantomjs-1/blob/master/src/qt/qtbase/src/plugins/platforms/xcb/qxcbcursor.cpp
@@ -135,7 +358,8 @@ namespace sisskey
 								XCB_EVENT_MASK_ENTER_WINDOW | XCB_EVENT_MASK_LEAVE_WINDOW |// ??
 								XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE | // mouse
 								XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE |// keyboard
-								XCB_EVENT_MASK_FOCUS_CHANGE,
+								XCB_EVENT_MASK_FOCUS_CHANGE |
+								XCB_EVENT_MASK_STRUCTURE_NOTIFY, // map, unmap
 								cursor ? XCB_CURSOR_NONE : m_NullCursor
 		};
 
@@ -242,13 +466,76 @@ namespace sisskey
 		xcb_change_property(m_pConnection, XCB_PROP_MODE_REPLACE, m_Window, reply1->atom, 4, 32, 1, &reply2->atom);
 		m_CloseMessage = reply2->atom;
 
+		if (cv_RawMouse.Get())
+			SelectRawMotion(pScreen->root);
+
+		// Framebuffers are presented in the native format, 32 bit little endian pixels of the root depth
+		const xcb_setup_t* setup = xcb_get_setup(m_pConnection);
+		for (xcb_format_iterator_t format = xcb_setup_pixmap_formats_iterator(setup); format.rem; xcb_format_next(&format))
+		{
+			if (format.data->depth != pScreen->root_depth || format.data->bits_per_pixel != 32 || setup->image_byte_order != XCB_IMAGE_ORDER_LSB_FIRST)
+				continue;
+			m_PresentDepth = pScreen->root_depth;
+			m_PresentContext = xcb_generate_id(m_pConnection);
+			xcb_create_gc(m_pConnection, m_PresentContext, m_Window, 0, nullptr);
+			break;
+		}
+
+		if (cv_SharedMemory.Get())
+		{
+			// https://www.x.org/releases/current/doc/xextproto/shm.html
+			const xcb_query_extension_reply_t* extension = xcb_get_extension_data(m_pConnection, &xcb_shm_id);
+			if (extension && extension->present)
+				m_ShmCompletion = static_cast<std::uint8_t>(extension->first_event + XCB_SHM_COMPLETION);
+		}
+
 		xcb_map_window(m_pConnection, m_Window);
 
 		xcb_flush(m_pConnection);
+
+		if (cv_InputThread.Get())
+		{
+			// Sent to the window to unblock xcb_wait_for_event on shutdown
+			xcb_intern_atom_cookie_t cookie = xcb_intern_atom(m_pConnection, 0, static_cast<uint16_t>(strlen("SISSKEY_WAKE")), "SISSKEY_WAKE");
+			if (xcb_intern_atom_reply_t* reply = xcb_intern_atom_reply(m_pConnection, cookie, nullptr))
+			{
+				m_WakeMessage = reply->atom;
+				free(reply);
+			}
+
+			m_pInputQueues = std::make_unique<InputQueues>();
+			m_InputEvents.reserve(4096);
+			m_InputThreadRunning.store(true, std::memory_order_relaxed);
+			m_InputThread = std::thread{ &WindowXCB::InputThreadMain, this };
+		}
 	}
 
 	WindowXCB::~WindowXCB()
 	{
+		// Completion events may be received by the input thread
+		DestroyPresentBuffers();
+		if (m_PresentContext)
+			xcb_free_gc(m_pConnection, m_PresentContext);
+
+		if (m_InputThread.joinable())
+		{
+			m_InputThreadRunning.store(false, std::memory_order_release);
+
+			// Without an event mask the event is delivered to the creator of the window
+			xcb_client_message_event_t wake{};
+			wake.response_type = XCB_CLIENT_MESSAGE;
+			wake.format = 32;
+			wake.window = m_Window;
+			wake.type = m_WakeMessage;
+			xcb_send_event(m_pConnection, 0, m_Window, XCB_EVENT_MASK_NO_EVENT, reinterpret_cast<const char*>(&wake));
+			xcb_flush(m_pConnection);
+			m_InputThread.join();
+		}
+
+		for (xcb_generic_event_t* event : m_PendingEvents)
+			free(event);
+		close(m_WakeFd);
+
 		UseSystemCursor(true);
 		if (m_NullCursor)
 			xcb_free_cursor(m_pConnection, m_NullCursor);
@@ -297,4 +584,183 @@ namespace sisskey
 		{
 		}
 	}
-}
\ No newline at end of file
+
+	bool WindowXCB::CompletePresent(const xcb_generic_event_t* event) noexcept
+	{
+		if (!m_ShmCompletion || (event->response_type & ~0x80) != m_ShmCompletion)
+			return false;
+
+		const xcb_shm_completion_event_t* completion = reinterpret_cast<const xcb_shm_completion_event_t*>(event);
+		{
+			std::lock_guard<std::mutex> lock{ m_PresentMutex };
+			for (PresentBuffer& buffer : m_PresentBuffers)
+				if (buffer.segment == completion->shmseg)
+					buffer.busy = false;
+		}
+		m_PresentDone.notify_all();
+		return true;
+	}
+
+	void WindowXCB::WaitPresent(PresentBuffer& buffer) noexcept
+	{
+		if (m_pInputQueues)
+		{
+			// A lost completion event must not hang the frame
+			std::unique_lock<std::mutex> lock{ m_PresentMutex };
+			if (!m_PresentDone.wait_for(lock, std::chrono::seconds{ 1 }, [&buffer] { return !buffer.busy; }))
+				buffer.busy = false;
+			return;
+		}
+
+		// Other events are kept for ProcessMessages
+		while (buffer.busy)
+		{
+			xcb_generic_event_t* event = xcb_wait_for_event(m_pConnection);
+			if (!event)
+			{
+				buffer.busy = false;
+				break;
+			}
+
+			if (CompletePresent(event))
+				free(event);
+			else m_PendingEvents.push_back(event);
+		}
+	}
+
+	void WindowXCB::CreatePresentBuffers(int width, int height)
+	{
+		DestroyPresentBuffers();
+
+		const int stride{ (width + 7) & ~7 };
+		const std::size_t bytes{ static_cast<std::size_t>(stride) * height * sizeof(std::uint32_t) };
+
+		m_UseShm = m_ShmCompletion != 0;
+		for (PresentBuffer& buffer : m_PresentBuffers)
+		{
+			const int id{ m_UseShm ? shmget(IPC_PRIVATE, bytes, IPC_CREAT | 0600) : -1 };
+			if (id == -1)
+			{
+				m_UseShm = false;
+				break;
+			}
+
+			void* pixels = shmat(id, nullptr, 0);
+			xcb_generic_error_t* error{ nullptr };
+			const std::uint32_t segment{ xcb_generate_id(m_pConnection) };
+			if (pixels != reinterpret_cast<void*>(-1))
+				error = xcb_request_check(m_pConnection, xcb_shm_attach_checked(m_pConnection, segment, static_cast<std::uint32_t>(id), 0));
+			// Freed when both sides detach, the server can't attach remote clients' memory
+			shmctl(id, IPC_RMID, nullptr);
+
+			if (pixels == reinterpret_cast<void*>(-1) || error)
+			{
+				if (pixels != reinterpret_cast<void*>(-1))
+					shmdt(pixels);
+				free(error);
+				m_UseShm = false;
+				break;
+			}
+
+			std::lock_guard<std::mutex> lock{ m_PresentMutex };
+			buffer.pixels = static_cast<std::uint32_t*>(pixels);
+			buffer.segment = segment;
+		}
+
+		if (!m_UseShm)
+		{
+			DestroyPresentBuffers();
+			m_PutImageBuffer.assign(static_cast<std::size_t>(stride) * height, 0);
+		}
+
+		// Padding pixels of the rows are not drawn
+		const xcb_rectangle_t clip{ 0, 0, static_cast<std::uint16_t>(width), static_cast<std::uint16_t>(height) };
+		xcb_set_clip_rectangles(m_pConnection, XCB_CLIP_ORDERING_UNSORTED, m_PresentContext, 0, 0, 1, &clip);
+
+		m_Framebuffer = { nullptr, width, height, stride };
+		m_PresentIndex = 0;
+	}
+
+	void WindowXCB::DestroyPresentBuffers() noexcept
+	{
+		for (PresentBuffer& buffer : m_PresentBuffers)
+		{
+			if (!buffer.pixels)
+				continue;
+
+			WaitPresent(buffer);
+			xcb_shm_detach(m_pConnection, buffer.segment);
+			shmdt(buffer.pixels);
+
+			std::lock_guard<std::mutex> lock{ m_PresentMutex };
+			buffer = {};
+		}
+
+		m_PutImageBuffer = {};
+		m_Framebuffer = {};
+		m_Acquired = false;
+	}
+
+	Window::Framebuffer WindowXCB::AcquireFramebuffer(std::pair<int, int> size)
+	{
+		auto [width, height] = size;
+		if (width <= 0 || height <= 0 || width > UINT16_MAX || height > UINT16_MAX)
+			throw std::runtime_error{ u8"Invalid framebuffer size" };
+		if (!m_PresentContext)
+			throw std::runtime_error{ u8"X server pixel format is not supported for framebuffers" };
+
+		if (width != m_Framebuffer.width || height != m_Framebuffer.height)
+			CreatePresentBuffers(width, height);
+
+		if (m_UseShm)
+		{
+			// Double buffered, the buffer was presented two frames ago
+			PresentBuffer& buffer = m_PresentBuffers[m_PresentIndex];
+			WaitPresent(buffer);
+			m_Framebuffer.pixels = buffer.pixels;
+		}
+		else m_Framebuffer.pixels = m_PutImageBuffer.data();
+
+		m_Acquired = true;
+		return m_Framebuffer;
+	}
+
+	void WindowXCB::PresentFramebuffer()
+	{
+		if (!m_Acquired)
+			return;
+		m_Acquired = false;
+
+		auto [pixels, width, height, stride] = m_Framebuffer;
+		if (m_UseShm)
+		{
+			PresentBuffer& buffer = m_PresentBuffers[m_PresentIndex];
+			{
+				std::lock_guard<std::mutex> lock{ m_PresentMutex };
+				buffer.busy = true;
+			}
+
+			// The server reads the segment directly and sends a completion event when it's done
+			xcb_shm_put_image(m_pConnection, m_Window, m_PresentContext,
+							  static_cast<std::uint16_t>(stride), static_cast<std::uint16_t>(height), 0, 0,
+							  static_cast<std::uint16_t>(width), static_cast<std::uint16_t>(height), 0, 0,
+							  m_PresentDepth, XCB_IMAGE_FORMAT_Z_PIXMAP, 1, buffer.segment, 0);
+			m_PresentIndex = (m_PresentIndex + 1) % m_PresentBuffers.size();
+		}
+		else
+		{
+			// Pixels are copied into the request, requests are limited in size
+			const std::uint32_t maxBytes{ xcb_get_maximum_request_length(m_pConnection) * 4 - static_cast<std::uint32_t>(sizeof(xcb_put_image_request_t)) };
+			const int rows{ std::max(1, static_cast<int>(maxBytes / (static_cast<std::uint32_t>(stride) * 4))) };
+			for (int y{}; y < height; y += rows)
+			{
+				const int count{ std::min(rows, height - y) };
+				xcb_put_image(m_pConnection, XCB_IMAGE_FORMAT_Z_PIXMAP, m_Window, m_PresentContext,
+							  static_cast<std::uint16_t>(stride), static_cast<std::uint16_t>(count), 0, static_cast<std::int16_t>(y), 0, m_PresentDepth,
+							  static_cast<std::uint32_t>(count * stride * 4), reinterpret_cast<const std::uint8_t*>(pixels + static_cast<std::size_t>(y) * stride));
+			}
+		}
+
+		xcb_flush(m_pConnection);
+	}
+}
@@ -1,5 +1,15 @@
 #pragma once
 #include "Window.h"
+#include "SPSCQueue.h"
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <array>
+#include <vector>
+#include <memory>
+#include <cstdint>
 
 #include <xcb/xcb.h>
 #include <xcb/xcb_atom.h>
@@ -16,6 +26,70 @@ namespace sisskey
 		xcb_connection_t* m_pConnection{ nullptr };
 		xcb_window_t m_Window{};
 
+		// XInput2 raw mouse motion, see the input.rawMouse console variable
+		std::uint8_t m_XInputOpcode{ 0 };
+
+		// Accessed by the thread that decodes events
+		bool m_Focused{ true };
+		bool m_Mapped{ true };
+
+		// Optional input thread, see the input.thread console variable
+		struct InputQueues
+		{
+			SPSCQueue<InputEvent, 4096> events;
+			// Enough for 8000 Hz mice at 1 FPS
+			SPSCQueue<RawMouseMotion, 8192> motion;
+		};
+		std::unique_ptr<InputQueues> m_pInputQueues;
+		std::thread m_InputThread;
+		std::atomic<PMResult> m_InputThreadResult{ PMResult::Nothing };
+		std::atomic<bool> m_InputThreadRunning{ false };
+		std::atomic<std::uint64_t> m_DroppedInputEvents{ 0 };
+		xcb_atom_t m_WakeMessage{ XCB_NONE };
+
+		// eventfd signaled by Wake and by the input thread while WaitMessages is blocked
+		int m_WakeFd{ -1 };
+		std::atomic<bool> m_Waiting{ false };
+		// Taken from the xcb queue by WaitMessages and AcquireFramebuffer, oldest first
+		std::vector<xcb_generic_event_t*> m_PendingEvents;
+
+		// Framebuffer presentation through MIT-SHM, xcb_put_image if the server doesn't support it
+		struct PresentBuffer
+		{
+			std::uint32_t* pixels{ nullptr };
+			std::uint32_t segment{ XCB_NONE };
+			// Until the completion event, guarded by m_PresentMutex
+			bool busy{ false };
+		};
+		std::array<PresentBuffer, 2> m_PresentBuffers;
+		std::vector<std::uint32_t> m_PutImageBuffer;
+		// Event code of ShmCompletion, 0 - no MIT-SHM
+		std::uint8_t m_ShmCompletion{ 0 };
+		bool m_UseShm{ false };
+		xcb_gcontext_t m_PresentContext{ XCB_NONE };
+		std::uint8_t m_PresentDepth{ 0 };
+		Framebuffer m_Framebuffer{};
+		std::size_t m_PresentIndex{ 0 };
+		bool m_Acquired{ false };
+		std::mutex m_PresentMutex;
+		std::condition_variable m_PresentDone;
+
+		enum class EventKind
+		{
+			Other,
+			Input,
+			RawMotion
+		};
+
+		// Window state changes are merged into result
+		[[nodiscard]] EventKind Decode(const xcb_generic_event_t* event, std::int64_t time, InputEvent& input, RawMouseMotion& motion, PMResult& result) noexcept;
+		void SelectRawMotion(xcb_window_t root) noexcept;
+		// Returns true if the event completed a shared memory put
+		bool CompletePresent(const xcb_generic_event_t* event) noexcept;
+		void WaitPresent(PresentBuffer& buffer) noexcept;
+		void CreatePresentBuffers(int width, int height);
+		void DestroyPresentBuffers() noexcept;
+		void InputThreadMain() noexcept;
 
 	public:
 		WindowXCB(std::string_view title, std::pair<int, int> size, std::pair<int, int> position, bool fullscreen, bool cursor);
@@ -24,9 +98,15 @@ namespace sisskey
 		// TODO: constness??
 
 		[[nodiscard]] PMResult ProcessMessages() noexcept override;
+		bool WaitMessages(std::int64_t timeout = -1) noexcept override;
+		void Wake() noexcept override;
 		void SetTitle(std::string_view title) override;
 		[[nodiscard]] std::string GetTitle() const override;
 		void UseSystemCursor(bool use) noexcept override;
 		void ChangeResolution(std::pair<int, int> size, bool fullscreen) override;
+		[[nodiscard]] Framebuffer AcquireFramebuffer(std::pair<int, int> size) override;
+		void PresentFramebuffer() override;
+
+		[[nodiscard]] std::uint64_t DroppedInputEvents() const noexcept override { return m_DroppedInputEvents.load(std::memory_order_relaxed); }
 	};
 }
@@ -0,0 +1,261 @@
+#include "World.h"
+
+#include <mutex>
+#include <new>
+#include <cstring>
+#include <stdexcept>
+
+namespace sisskey
+{
+	namespace
+	{
+		std::array<ComponentRegistry::Info, MaxComponentTypes> g_ComponentInfos;
+		std::uint32_t g_ComponentCount{ 0 };
+		std::mutex g_ComponentMutex;
+	}
+
+	ComponentID ComponentRegistry::Register(std::size_t size, std::size_t alignment)
+	{
+		std::lock_guard<std::mutex> lock{ g_ComponentMutex };
+		if (g_ComponentCount == MaxComponentTypes)
+			throw std::length_error{ u8"Too many component types" };
+
+		g_ComponentInfos[g_ComponentCount] = { size, alignment };
+		return g_ComponentCount++;
+	}
+
+	const ComponentRegistry::Info& ComponentRegistry::Get(ComponentID id) noexcept
+	{
+		assert(id < g_ComponentCount);
+		return g_ComponentInfos[id];
+	}
+
+	Archetype::Archetype(ComponentMask mask) : m_Mask{ mask }
+	{
+		std::size_t bytesPerEntity{ sizeof(Entity) };
+		for (ComponentID id{}; id < MaxComponentTypes; ++id)
+		{
+			if (mask & (ComponentMask{ 1 } << id))
+			{
+				m_Components.push_back(id);
+				bytesPerEntity += ComponentRegistry::Get(id).size;
+			}
+		}
+
+		// Find the largest capacity that fits into a chunk with alignment padding
+		m_Offsets.fill(NoColumn);
+		for (std::size_t capacity{ ChunkSize / bytesPerEntity }; capacity > 0; --capacity)
+		{
+			std::size_t offset{ sizeof(Entity) * capacity };
+			for (ComponentID id : m_Components)
+			{
+				const auto& info = ComponentRegistry::Get(id);
+				offset = (offset + info.alignment - 1) & ~(info.alignment - 1);
+				m_Offsets[id] = static_cast<std::uint32_t>(offset);
+				offset += info.size * capacity;
+			}
+
+			if (offset <= ChunkSize)
+			{
+				m_Capacity = static_cast<std::uint32_t>(capacity);
+				break;
+			}
+		}
+
+		if (m_Capacity == 0)
+			throw std::length_error{ u8"Components don't fit into an archetype chunk" };
+	}
+
+	Archetype::~Archetype()
+	{
+		for (auto& chunk : m_Chunks)
+			::operator delete(chunk.memory, std::align_val_t{ 64 });
+	}
+
+	std::pair<std::uint32_t, std::uint32_t> Archetype::AllocateRow(Entity entity)
+	{
+		if (m_Chunks.empty() || m_Chunks.back().count == m_Capacity)
+			m_Chunks.push_back({ static_cast<std::byte*>(::operator new(ChunkSize, std::align_val_t{ 64 })), 0 });
+
+		Chunk& chunk = m_Chunks.back();
+		const std::uint32_t row{ chunk.count++ };
+		Entities(chunk)[row] = entity;
+		++m_EntityCount;
+		return { static_cast<std::uint32_t>(m_Chunks.size() - 1), row };
+	}
+
+	Entity Archetype::RemoveRow(std::uint32_t chunkIndex, std::uint32_t row) noexcept
+	{
+		Chunk& chunk = m_Chunks[chunkIndex];
+		Chunk& last = m_Chunks.back();
+		const std::uint32_t lastRow{ last.count - 1 };
+
+		Entity moved{};
+		if (&chunk != &last || row != lastRow)
+		{
+			moved = Entities(last)[lastRow];
+			Entities(chunk)[row] = moved;
+			for (ComponentID id : m_Components)
+			{
+				const std::size_t size{ ComponentRegistry::Get(id).size };
+				std::memcpy(chunk.memory + m_Offsets[id] + row * size, last.memory + m_Offsets[id] + lastRow * size, size);
+			}
+		}
+
+		--m_EntityCount;
+		if (--last.count == 0)
+		{
+			::operator delete(last.memory, std::align_val_t{ 64 });
+			m_Chunks.pop_back();
+		}
+		return moved;
+	}
+
+	World::World()
+	{
+		// Entities without components
+		(void)GetArchetype(0);
+	}
+
+	Archetype* World::GetArchetype(ComponentMask mask)
+	{
+		if (auto it = m_ArchetypeMap.find(mask); it != m_ArchetypeMap.end())
+			return it->second;
+
+		Archetype* archetype = m_Archetypes.emplace_back(std::make_unique<Archetype>(mask)).get();
+		m_ArchetypeMap.emplace(mask, archetype);
+		return archetype;
+	}
+
+	Entity World::AllocateEntity()
+	{
+		if (!m_FreeIndices.empty())
+		{
+			const std::uint32_t index{ m_FreeIndices.back() };
+			m_FreeIndices.pop_back();
+			return { index, m_Records[index].generation };
+		}
+
+		m_Records.emplace_back();
+		return { static_cast<std::uint32_t>(m_Records.size() - 1), 0 };
+	}
+
+	void World::Place(Entity entity, Archetype* archetype)
+	{
+		auto [chunk, row] = archetype->AllocateRow(entity);
+		Record& record = m_Records[entity.index];
+		record.archetype = archetype;
+		record.chunk = chunk;
+		record.row = row;
+	}
+
+	void World::Unplace(const Record& record) noexcept
+	{
+		const Entity moved{ record.archetype->RemoveRow(record.chunk, record.row) };
+		if (moved.index != Entity::InvalidIndex)
+		{
+			m_Records[moved.index].chunk = record.chunk;
+			m_Records[moved.index].row = record.row;
+		}
+	}
+
+	void World::Move(Entity entity, Archetype* target)
+	{
+		const Record old{ m_Records[entity.index] };
+		Place(entity, target);
+		const Record& record = m_Records[entity.index];
+
+		const Archetype::Chunk& from = old.archetype->GetChunk(old.chunk);
+		const Archetype::Chunk& to = target->GetChunk(record.chunk);
+		for (ComponentID id : old.archetype->m_Components)
+		{
+			if (void* dst = target->Column(to, id))
+			{
+				const std::size_t size{ ComponentRegistry::Get(id).size };
+				std::memcpy(static_cast<std::byte*>(dst) + record.row * size,
+							static_cast<std::byte*>(old.archetype->Column(from, id)) + old.row * size, size);
+			}
+		}
+
+		Unplace(old);
+	}
+
+	Entity World::Create()
+	{
+		return CreateRaw(0, nullptr, nullptr);
+	}
+
+	Entity World::CreateRaw(std::size_t count, const ComponentID* ids, const void* const* data)
+	{
+		ComponentMask mask{ 0 };
+		for (std::size_t i{}; i < count; ++i)
+			mask |= ComponentMask{ 1 } << ids[i];
+
+		const Entity entity{ AllocateEntity() };
+		Place(entity, GetArchetype(mask));
+		++m_EntityCount;
+
+		for (std::size_t i{}; i < count; ++i)
+			std::memcpy(GetRaw(entity, ids[i]), data[i], ComponentRegistry::Get(ids[i]).size);
+		return entity;
+	}
+
+	void World::Destroy(Entity entity)
+	{
+		if (!IsAlive(entity))
+			return;
+
+		Record& record = m_Records[entity.index];
+		Unplace(record);
+		record.archetype = nullptr;
+		++record.generation;
+		m_FreeIndices.push_back(entity.index);
+		--m_EntityCount;
+	}
+
+	void World::AddRaw(Entity entity, ComponentID id, const void* data)
+	{
+		assert(IsAlive(entity));
+
+		Archetype* source = m_Records[entity.index].archetype;
+		if (!(source->GetMask() & (ComponentMask{ 1 } << id)))
+		{
+			Archetype*& target = source->m_AddEdges[id];
+			if (!target)
+			{
+				target = GetArchetype(source->GetMask() | (ComponentMask{ 1 } << id));
+				target->m_RemoveEdges[id] = source;
+			}
+			Move(entity, target);
+		}
+
+		std::memcpy(GetRaw(entity, id), data, ComponentRegistry::Get(id).size);
+	}
+
+	void World::RemoveRaw(Entity entity, ComponentID id)
+	{
+		assert(IsAlive(entity));
+
+		Archetype* source = m_Records[entity.index].archetype;
+		if (!(source->GetMask() & (ComponentMask{ 1 } << id)))
+			return;
+
+		Archetype*& target = source->m_RemoveEdges[id];
+		if (!target)
+		{
+			target = GetArchetype(source->GetMask() & ~(ComponentMask{ 1 } << id));
+			target->m_AddEdges[id] = source;
+		}
+		Move(entity, target);
+	}
+
+	void* World::GetRaw(Entity entity, ComponentID id) const noexcept
+	{
+		if (!IsAlive(entity))
+			return nullptr;
+
+		const Record& record = m_Records[entity.index];
+		void* column = record.archetype->Column(record.archetype->GetChunk(record.chunk), id);
+		return column ? static_cast<std::byte*>(column) + record.row * ComponentRegistry::Get(id).size : nullptr;
+	}
+}
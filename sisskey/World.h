@@ -0,0 +1,299 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+namespace sisskey
+{
+	// Generational entity identifier, stale handles of destroyed entities are detected
+	struct Entity
+	{
+		static constexpr std::uint32_t InvalidIndex{ 0xFFFFFFFF };
+
+		std::uint32_t index{ InvalidIndex };
+		std::uint32_t generation{ 0 };
+
+		[[nodiscard]] bool operator==(const Entity& other) const noexcept { return index == other.index && generation == other.generation; }
+		[[nodiscard]] bool operator!=(const Entity& other) const noexcept { return !(*this == other); }
+	};
+
+	using ComponentID = std::uint32_t;
+	using ComponentMask = std::uint64_t;
+	constexpr std::size_t MaxComponentTypes{ 64 };
+
+	// Components are plain data: they are moved between chunks with memcpy and never destroyed
+	class ComponentRegistry
+	{
+	private:
+		template<typename T>
+		[[nodiscard]] static ComponentID TypeID()
+		{
+			static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>, "Components must be trivially copyable and destructible");
+			static const ComponentID id{ Register(sizeof(T), alignof(T)) };
+			return id;
+		}
+
+	public:
+		struct Info
+		{
+			std::size_t size;
+			std::size_t alignment;
+		};
+
+		[[nodiscard]] static ComponentID Register(std::size_t size, std::size_t alignment);
+		[[nodiscard]] static const Info& Get(ComponentID id) noexcept;
+
+		template<typename T>
+		[[nodiscard]] static ComponentID ID() { return TypeID<std::remove_cv_t<T>>(); }
+
+		template<typename T>
+		[[nodiscard]] static ComponentMask Bit() { return ComponentMask{ 1 } << ID<T>(); }
+	};
+
+	// All entities with the same set of components, stored in fixed size chunks.
+	// Each chunk is laid out as structure of arrays: entity ids followed by one array per component.
+	// Chunks are kept dense, only the last one can be partially filled.
+	class Archetype
+	{
+		friend class World;
+	public:
+		static constexpr std::size_t ChunkSize{ 16 * 1024 };
+		static constexpr std::uint32_t NoColumn{ 0xFFFFFFFF };
+
+		struct Chunk
+		{
+			std::byte* memory{ nullptr };
+			std::uint32_t count{ 0 };
+		};
+
+	private:
+		ComponentMask m_Mask;
+		std::vector<ComponentID> m_Components;
+		std::array<std::uint32_t, MaxComponentTypes> m_Offsets;
+		std::uint32_t m_Capacity{ 0 };
+		std::vector<Chunk> m_Chunks;
+		std::size_t m_EntityCount{ 0 };
+
+		// Archetype graph cache for adding/removing a single component
+		std::array<Archetype*, MaxComponentTypes> m_AddEdges{};
+		std::array<Archetype*, MaxComponentTypes> m_RemoveEdges{};
+
+		// Returns chunk and row of the new entity
+		std::pair<std::uint32_t, std::uint32_t> AllocateRow(Entity entity);
+		// Fills the hole with the last entity and returns it, or an invalid entity if the last row was removed
+		Entity RemoveRow(std::uint32_t chunk, std::uint32_t row) noexcept;
+
+	public:
+		explicit Archetype(ComponentMask mask);
+		~Archetype();
+		Archetype(const Archetype&) = delete;
+		Archetype& operator=(const Archetype&) = delete;
+
+		[[nodiscard]] ComponentMask GetMask() const noexcept { return m_Mask; }
+		[[nodiscard]] std::uint32_t ChunkCapacity() const noexcept { return m_Capacity; }
+		[[nodiscard]] std::size_t ChunkCount() const noexcept { return m_Chunks.size(); }
+		[[nodiscard]] std::size_t EntityCount() const noexcept { return m_EntityCount; }
+		[[nodiscard]] const Chunk& GetChunk(std::size_t index) const noexcept { return m_Chunks[index]; }
+
+		[[nodiscard]] Entity* Entities(const Chunk& chunk) const noexcept { return reinterpret_cast<Entity*>(chunk.memory); }
+		[[nodiscard]] void* Column(const Chunk& chunk, ComponentID id) const noexcept
+		{
+			return m_Offsets[id] == NoColumn ? nullptr : chunk.memory + m_Offsets[id];
+		}
+
+		template<typename T>
+		[[nodiscard]] T* Column(const Chunk& chunk) const
+		{
+			return static_cast<T*>(Column(chunk, ComponentRegistry::ID<T>()));
+		}
+	};
+
+	class World
+	{
+		template<typename...>
+		friend class Query;
+	private:
+		struct Record
+		{
+			Archetype* archetype{ nullptr };
+			std::uint32_t chunk{ 0 };
+			std::uint32_t row{ 0 };
+			std::uint32_t generation{ 0 };
+		};
+
+		std::vector<Record> m_Records;
+		std::vector<std::uint32_t> m_FreeIndices;
+		std::vector<std::unique_ptr<Archetype>> m_Archetypes;
+		std::unordered_map<ComponentMask, Archetype*> m_ArchetypeMap;
+		std::size_t m_EntityCount{ 0 };
+
+		[[nodiscard]] Archetype* GetArchetype(ComponentMask mask);
+		[[nodiscard]] Entity AllocateEntity();
+		void Place(Entity entity, Archetype* archetype);
+		void Unplace(const Record& record) noexcept;
+		void Move(Entity entity, Archetype* target);
+
+	public:
+		World();
+		World(World&&) = default;
+		World& operator=(World&&) = default;
+		World(const World&) = delete;
+		World& operator=(const World&) = delete;
+
+		[[nodiscard]] Entity Create();
+
+		template<typename... Ts>
+		Entity Create(const Ts&... components)
+		{
+			const std::array<ComponentID, sizeof...(Ts)> ids{ ComponentRegistry::ID<Ts>()... };
+			const std::array<const void*, sizeof...(Ts)> data{ &components... };
+			return CreateRaw(ids.size(), ids.data(), data.data());
+		}
+
+		// Type-erased versions, used by CommandBuffer
+		Entity CreateRaw(std::size_t count, const ComponentID* ids, const void* const* data);
+		void AddRaw(Entity entity, ComponentID id, const void* data);
+		void RemoveRaw(Entity entity, ComponentID id);
+		[[nodiscard]] void* GetRaw(Entity entity, ComponentID id) const noexcept;
+
+		void Destroy(Entity entity);
+		[[nodiscard]] bool IsAlive(Entity entity) const noexcept
+		{
+			return entity.index < m_Records.size() && m_Records[entity.index].generation == entity.generation && m_Records[entity.index].archetype;
+		}
+
+		// Replaces the value if the component already exists
+		template<typename T>
+		void Add(Entity entity, const T& component = {}) { AddRaw(entity, ComponentRegistry::ID<T>(), &component); }
+
+		template<typename T>
+		void Remove(Entity entity) { RemoveRaw(entity, ComponentRegistry::ID<T>()); }
+
+		// Pointer is invalidated by structural changes (creating, destroying, adding or removing components)
+		template<typename T>
+		[[nodiscard]] T* Get(Entity entity) const { return static_cast<T*>(GetRaw(entity, ComponentRegistry::ID<T>())); }
+
+		template<typename T>
+		[[nodiscard]] bool Has(Entity entity) const { return IsAlive(entity) && (m_Records[entity.index].archetype->GetMask() & ComponentRegistry::Bit<T>()); }
+
+		[[nodiscard]] std::size_t EntityCount() const noexcept { return m_EntityCount; }
+		[[nodiscard]] std::size_t ArchetypeCount() const noexcept { return m_Archetypes.size(); }
+	};
+
+	// Cached query over all archetypes containing the Ts components.
+	// Const qualified components document read-only access.
+	// Newly created archetypes are matched incrementally before iterating.
+	// Structural changes are not allowed during iteration, record them into a CommandBuffer.
+	template<typename... Ts>
+	class Query
+	{
+	private:
+		struct ChunkRef
+		{
+			Archetype* archetype;
+			std::size_t chunk;
+		};
+
+		World* m_World;
+		ComponentMask m_Required;
+		ComponentMask m_Excluded{ 0 };
+		std::vector<Archetype*> m_Archetypes;
+		std::size_t m_Matched{ 0 };
+		std::vector<ChunkRef> m_Chunks;
+
+		template<typename F>
+		static void CallChunk(Archetype& archetype, const Archetype::Chunk& chunk, F& function)
+		{
+			function(static_cast<std::size_t>(chunk.count), archetype.Entities(chunk), archetype.template Column<Ts>(chunk)...);
+		}
+
+	public:
+		explicit Query(World& world) : m_World{ &world }, m_Required{ (ComponentRegistry::Bit<Ts>() | ... | ComponentMask{ 0 }) } {}
+
+		template<typename... Us>
+		Query& Exclude()
+		{
+			m_Excluded |= (ComponentRegistry::Bit<Us>() | ... | ComponentMask{ 0 });
+			m_Archetypes.clear();
+			m_Matched = 0;
+			return *this;
+		}
+
+		void Update()
+		{
+			const auto& archetypes = m_World->m_Archetypes;
+			for (; m_Matched < archetypes.size(); ++m_Matched)
+			{
+				const ComponentMask mask{ archetypes[m_Matched]->GetMask() };
+				if ((mask & m_Required) == m_Required && !(mask & m_Excluded))
+					m_Archetypes.push_back(archetypes[m_Matched].get());
+			}
+		}
+
+		[[nodiscard]] std::size_t Count()
+		{
+			Update();
+			std::size_t count{ 0 };
+			for (Archetype* archetype : m_Archetypes)
+				count += archetype->EntityCount();
+			return count;
+		}
+
+		// function(std::size_t count, Entity* entities, Ts*... components)
+		template<typename F>
+		void ForEachChunk(F&& function)
+		{
+			Update();
+			for (Archetype* archetype : m_Archetypes)
+				for (std::size_t i{}; i < archetype->ChunkCount(); ++i)
+					CallChunk(*archetype, archetype->GetChunk(i), function);
+		}
+
+		// function(Entity entity, Ts&... components)
+		template<typename F>
+		void ForEach(F&& function)
+		{
+			ForEachChunk([&function](std::size_t count, Entity* entities, Ts*... components)
+			{
+				for (std::size_t i{}; i < count; ++i)
+					function(entities[i], components[i]...);
+			});
+		}
+
+		// Chunks are distributed between job system threads, function must be thread safe
+		template<typename F>
+		void ParallelForEachChunk(JobSystem& jobs, F&& function)
+		{
+			Update();
+			m_Chunks.clear();
+			for (Archetype* archetype : m_Archetypes)
+				for (std::size_t i{}; i < archetype->ChunkCount(); ++i)
+					m_Chunks.push_back({ archetype, i });
+
+			jobs.ParallelFor(0, m_Chunks.size(), [this, &function](std::size_t first, std::size_t last)
+			{
+				for (std::size_t i{ first }; i < last; ++i)
+					CallChunk(*m_Chunks[i].archetype, m_Chunks[i].archetype->GetChunk(m_Chunks[i].chunk), function);
+			});
+		}
+
+		template<typename F>
+		void ParallelForEach(JobSystem& jobs, F&& function)
+		{
+			ParallelForEachChunk(jobs, [&function](std::size_t count, Entity* entities, Ts*... components)
+			{
+				for (std::size_t i{}; i < count; ++i)
+					function(entities[i], components[i]...);
+			});
+		}
+	};
+}